@@ -28,6 +28,12 @@
 #include "ShaderToy_BDF.h"
 
 #include "dear_imgui/imgui.h"
+#include "cpu/blob_grid.h"
+#include "cpu/brick_map.h"
+#include "cpu/csg_scene.h"
+
+#include <algorithm>
+#include <fstream>
 
 #if FALCOR_D3D12_AVAILABLE
 FALCOR_EXPORT_D3D12_AGILITY_SDK
@@ -44,13 +50,19 @@ namespace {
     Gui::RadioButtonGroup kColorStepFunRBs = { {0,"Old",true},{1,"HSV",true},{2,"2",true},{3,"3",true},{4,"4",true} };
 
     Gui::RadioButtonGroup kSceneRBs = { {0,"Blobs", true}, {1,"Primitives", true},
-        {2,"Sphere", true}, {3,"Box", true}, {4,"Cylinder", true}, {5,"Torus", true}, {6,"Test", true} };
-    enum class Scenes : uint32_t {BLOBS = 0, PRIMITIVES = 1, SPHERE = 2, BOX = 3, CYLINDER = 4, TORUS = 5,TEST = 6};
-
-    Gui::RadioButtonGroup kTraceRBs = { {0,"sdf_trace", true}, {1,"bdf_trace", true},{2,"segment_trace",true},{3,"their_sphere_trace",true} };
-    enum class Tracers : uint32_t {SDF_TRACE = 0, BDF_TRACE = 1, SEGMENT_TRACE = 2, THEIR_SPHERE_TRACE = 3};
-    Gui::RadioButtonGroup kShadowRBs = { {0,"sdf_trace", true}, {1,"bdf_trace", true}, {2,"no_shadow",true}};
-    enum class Shadows : uint32_t { SDF_TRACE = 0, BDF_TRACE = 1, NO_SHADOW = 2 };
+        {2,"Sphere", true}, {3,"Box", true}, {4,"Cylinder", true}, {5,"Torus", true}, {6,"Test", true}, {7,"CSG", true} };
+    enum class Scenes : uint32_t {BLOBS = 0, PRIMITIVES = 1, SPHERE = 2, BOX = 3, CYLINDER = 4, TORUS = 5,TEST = 6, CSG = 7};
+
+    Gui::RadioButtonGroup kTraceRBs = { {0,"sdf_trace", true}, {1,"bdf_trace", true},{2,"segment_trace",true},{3,"their_sphere_trace",true},{4,"bdf_trace_relaxed",true},{5,"bdf_trace_refined",true} };
+    enum class Tracers : uint32_t {SDF_TRACE = 0, BDF_TRACE = 1, SEGMENT_TRACE = 2, THEIR_SPHERE_TRACE = 3, BDF_TRACE_RELAXED = 4, BDF_TRACE_REFINED = 5};
+    Gui::RadioButtonGroup kShadowRBs = { {0,"sdf_trace", true}, {1,"bdf_trace", true}, {2,"no_shadow",true}, {3,"bdf_packet",true}, {4,"bdf_soft",true}};
+    enum class Shadows : uint32_t { SDF_TRACE = 0, BDF_TRACE = 1, NO_SHADOW = 2, BDF_PACKET = 3, BDF_SOFT = 4 };
+    Gui::RadioButtonGroup kNormalRBs = { {0,"normal_central", true}, {1,"normal_tetrahedral", true}, {2,"normal_analytic",true}};
+    enum class Normals : uint32_t { CENTRAL = 0, TETRAHEDRAL = 1, ANALYTIC = 2 };
+    Gui::RadioButtonGroup kConeRBs = { {0,"Off", true}, {1,"8x8", true}, {2,"16x16", true} };
+    const uint32_t kConeTiles[] = { 0, 8, 16 };
+    const size_t kMaxPermutations = 32;         // kept compiled and remembered across sessions
+    const size_t kPrecompiledPermutations = 4;  // compiled at startup
 }
 
 void ShaderToy_BDF::onGuiRender(Gui* pGui)
@@ -82,11 +94,11 @@ void ShaderToy_BDF::onGuiRender(Gui* pGui)
         ImGui::PopID();
         changed |= changedColoring;
 
-        static uint32_t vColoringStepFunID = 4;
-        static float3 vColorA = float3( 93,  127, 232 ) / 255.f;
-        static float3 vColorB = float3( 92,  236, 220 ) / 255.f;
-        static float3 vColorC = float3( 241, 222, 100 ) / 255.f;
-        static float3 vColorD = float3( 220, 94,  75  ) / 255.f;
+        uint32_t& vColoringStepFunID = mParams.vColoringStepFunID;
+        float3& vColorA = mParams.vColorA;
+        float3& vColorB = mParams.vColorB;
+        float3& vColorC = mParams.vColorC;
+        float3& vColorD = mParams.vColorD;
         if (colorID == Coloring::STEPSIZE || colorID == Coloring::SHADOWSTEP)
         {
             settingsGroup.text("Step coloring:");
@@ -107,24 +119,29 @@ void ShaderToy_BDF::onGuiRender(Gui* pGui)
         }
 
         static Scenes sceneID = Scenes::PRIMITIVES, prevSceneID = sceneID;
-        static float sThreshold = .5f;
-        static float sBlobRadius = 4.f;
-        static float3 pPrimitiveData = float3(1);
-        static float3 pTestPos = float3(0);
-        static int3 pRepeatNum = int3(1000, 0, 1000);
-        static float3 pRepeatDist = float3(4);
-        static bool pShowPlane = true;
+        float& sThreshold = mParams.sThreshold;
+        float& sBlobRadius = mParams.sBlobRadius;
+        float3& pPrimitiveData = mParams.pPrimitiveData;
+        float3& pTestPos = mParams.pTestPos;
+        int3& pRepeatNum = mParams.pRepeatNum;
+        float3& pRepeatDist = mParams.pRepeatDist;
+        bool& pShowPlane = mParams.pShowPlane;
         static Tracers traceID = Tracers::SDF_TRACE;
-        static int primaryMaxIter = 512;
-        static float primaryMaxDist = 500.0f;
-        static float sMarchEpsilon = 0.1f;
-        static float sKappaFactor = 2.f;
+        int& primaryMaxIter = mParams.primaryMaxIter;
+        float& primaryMaxDist = mParams.primaryMaxDist;
+        float& sMarchEpsilon = mParams.sMarchEpsilon;
+        float& sKappaFactor = mParams.sKappaFactor;
+        float& bdfOmega = mParams.bdfOmega;
+        float& bdfHitScale = mParams.bdfHitScale;
+        float& shadowSoftness = mParams.shadowSoftness;
         static Shadows shadowID = Shadows::SDF_TRACE;
-        static int secondaryMaxIter = 256;
-        static float secondaryMaxDist = 100.0f;
-        static float secondaryEpsilon = 0.001f;
-        static float secondaryMinDist = 0.01f;
-        static float secondaryNOffset = 0.01f;
+        static Normals normalID = Normals::ANALYTIC;
+        static uint32_t coneID = 0;
+        int& secondaryMaxIter = mParams.secondaryMaxIter;
+        float& secondaryMaxDist = mParams.secondaryMaxDist;
+        float& secondaryEpsilon = mParams.secondaryEpsilon;
+        float& secondaryMinDist = mParams.secondaryMinDist;
+        float& secondaryNOffset = mParams.secondaryNOffset;
 
         if (colorID != Coloring::SEGMENT_TRACING)
         {
@@ -140,13 +157,24 @@ void ShaderToy_BDF::onGuiRender(Gui* pGui)
             case Scenes::BLOBS:
                 changed |= ImGui::SliderFloat("S_THRESHOLD", &sThreshold, 0.f, 1.f);
                 changed |= ImGui::SliderFloat("S_BLOB_RADIUS", &sBlobRadius, 0.f, 8.f);
-                if (changedScene)
+                changed |= ImGui::SliderInt("Blob count (0: original)", &mBlobCount, 0, 100000);
+                if ((mBlobCount > 0 && updateBlobGrid()) || changedScene)
                 {
                     primaryMaxIter = 150;
                     primaryMaxDist = 60.f;
                     shadowID = Shadows::NO_SHADOW;
                     mpCamera->setPosition(float3(0, 3.5, 7));
                     mpCamera->setTarget(float3(0,2.2,0));
+                    if (mBlobCount > 0 && mpBlobGrid)
+                    {   // look at the whole field from above its front edge
+                        bdf::float3 origin = mpBlobGrid->origin();
+                        bdf::int3 dims = mpBlobGrid->dims();
+                        float3 size = mpBlobGrid->cellSize() * float3(dims.x, dims.y, dims.z);
+                        float3 target = float3(origin.x, origin.y, origin.z) + .5f * size;
+                        mpCamera->setPosition(target + float3(0.f, .3f * size.x + 4.f, .6f * size.z + 8.f));
+                        mpCamera->setTarget(target);
+                        primaryMaxDist = 2.f * length(size) + 60.f;
+                    }
                 }
                 break;
             case Scenes::PRIMITIVES:
@@ -196,6 +224,28 @@ void ShaderToy_BDF::onGuiRender(Gui* pGui)
                     mpCamera->setTarget(float3(0, 0, 0));
                 }
                 break;
+            case Scenes::CSG:
+                if ((changedScene && mCsgHash == 0) || settingsGroup.button("Load scene file"))
+                {
+                    std::string filename;
+                    if (openFileDialog({ { "csg", "CSG scene" } }, filename)) changed |= loadCsgScene(filename);
+                }
+                if (mCsgHash == 0)
+                {
+                    sceneID = prevSceneID; // nothing to show
+                    break;
+                }
+                settingsGroup.text(mCsgFile);
+                if (changedScene)
+                {
+                    mpCamera->setPosition(float3(6, 3, 4));
+                    mpCamera->setTarget(float3(0, 0, 0.5));
+                    if (traceID == Tracers::THEIR_SPHERE_TRACE)
+                        traceID = Tracers::SDF_TRACE;
+                    if (traceID == Tracers::SEGMENT_TRACE)
+                        traceID = Tracers::BDF_TRACE;
+                }
+                break;
             case Scenes::TEST:
                 changed |= ImGui::SliderFloat3("Size", &pPrimitiveData.x, 0.f, 4.f);
                 changed |= ImGui::SliderFloat3("TestPos", &pTestPos.x, 0.f, 4.f);
@@ -209,7 +259,7 @@ void ShaderToy_BDF::onGuiRender(Gui* pGui)
             default:
                 break;
             }
-            if (static_cast<uint32_t>(Scenes::SPHERE) <= static_cast<uint32_t>(sceneID))
+            if (static_cast<uint32_t>(Scenes::SPHERE) <= static_cast<uint32_t>(sceneID) && sceneID != Scenes::CSG)
             {
                 changed |= ImGui::SliderInt3("Repetition", &pRepeatNum.x, 0, 100);
                 changed |= ImGui::SliderFloat3("Distance", &pRepeatDist.x, 0.f, 25.f);
@@ -233,7 +283,7 @@ void ShaderToy_BDF::onGuiRender(Gui* pGui)
             }
             else
             {
-                auto tracemethods = Gui::RadioButtonGroup(kTraceRBs.begin(), kTraceRBs.begin() + 2);
+                auto tracemethods = Gui::RadioButtonGroup{ kTraceRBs[0], kTraceRBs[1], kTraceRBs[4], kTraceRBs[5] };
                 traceChanged |= settingsGroup.radioButtons(tracemethods, reinterpret_cast<uint32_t&>(traceID));
             }
             ImGui::PopID();
@@ -249,6 +299,40 @@ void ShaderToy_BDF::onGuiRender(Gui* pGui)
             {
                 changed |= ImGui::SliderFloat("S_KAPPA_FACTOR", &sKappaFactor, 1e-15f, 5.f);
             }
+            if (traceID == Tracers::BDF_TRACE_RELAXED || traceID == Tracers::BDF_TRACE_REFINED)
+            {
+                changed |= ImGui::SliderFloat("BDF_OMEGA", &bdfOmega, 1.f, 2.f);
+            }
+            if (traceID == Tracers::BDF_TRACE_REFINED)
+            {
+                changed |= ImGui::SliderFloat("BDF_HIT_SCALE", &bdfHitScale, 1.f, 64.f);
+            }
+            settingsGroup.text("Cone pre-pass (start rays at a per tile distance):");
+            ImGui::PushID("Cone:");
+            changed |= settingsGroup.radioButtons(kConeRBs, coneID);
+            ImGui::PopID();
+            changed |= ImGui::Checkbox("Depth reprojection (start rays at last frame's hit)", &mReprojection);
+            if (mReprojection)
+            {
+                changed |= ImGui::SliderFloat("Reprojection margin", &mReprojMargin, 0.f, .5f);
+            }
+            if (settingsGroup.button("Load brick map"))
+            {   // baked by bdf_render --bake, used while the scene and its parameters are those of the bake
+                std::string filename;
+                if (openFileDialog({ { "bdfb", "Brick map" } }, filename)) changed |= loadBrickMap(filename);
+            }
+            if (mpBrickMap)
+            {
+                settingsGroup.text(mBrickMapFile + " (" + mpBrickMap->header().scene + ")" +
+                    (mBrickMapOn && !mUseBrickMap ? ", not used: baked from another scene or other parameters" : ""));
+                changed |= ImGui::Checkbox("Brick map (BDF bounds away from the surface)", &mBrickMapOn);
+            }
+
+            // NORMAL
+            settingsGroup.text("Normal:");
+            ImGui::PushID("Normal:");
+            changed |= settingsGroup.radioButtons(kNormalRBs, reinterpret_cast<uint32_t&>(normalID));
+            ImGui::PopID();
 
             // SHADOW
             if (changedColoring && colorID == Coloring::SHADOWSTEP)
@@ -278,43 +362,60 @@ void ShaderToy_BDF::onGuiRender(Gui* pGui)
                 changed |= ImGui::SliderFloat("SECONDARY_EPSILON", &secondaryEpsilon, 1e-15f, 1.f, "%.4f", 4.f);
                 changed |= ImGui::SliderFloat("SECONDARY_NOFFSET", &secondaryNOffset, 1e-15f, 1.f, "%.4f", 4.f);
             }
+            if (shadowID == Shadows::BDF_SOFT)
+            {
+                changed |= ImGui::SliderFloat("SHADOW_SOFTNESS", &shadowSoftness, 1.f, 64.f);
+            }
+            changed |= ImGui::SliderInt("LIGHT_COUNT", &mParams.lightCount, 1, bdf::kMaxLightCount);
+            changed |= ImGui::Checkbox("Trace statistics", &mTraceStats);
             // UPDATE SHADER
         }
         if (changed) {
-            mpMainPass->addDefine("V_COLORING", std::to_string(static_cast<uint32_t>(colorID)));
-            mpMainPass->addDefine("V_COLORING_FUNC", std::string("itershade") + kColorStepFunRBs[vColoringStepFunID].label);
-            mpMainPass->addDefine("V_COLOR_A", std::string("vec3(")+std::to_string(vColorA.x)+','+std::to_string(vColorA.y)+','+std::to_string(vColorA.z)+')');
-            mpMainPass->addDefine("V_COLOR_B", std::string("vec3(")+std::to_string(vColorB.x)+','+std::to_string(vColorB.y)+','+std::to_string(vColorB.z)+')');
-            mpMainPass->addDefine("V_COLOR_C", std::string("vec3(")+std::to_string(vColorC.x)+','+std::to_string(vColorC.y)+','+std::to_string(vColorC.z)+')');
-            mpMainPass->addDefine("V_COLOR_D", std::string("vec3(")+std::to_string(vColorD.x)+','+std::to_string(vColorD.y)+','+std::to_string(vColorD.z)+')');
-
-            mpMainPass->addDefine("SCENE_SDF", std::string("sd") + kSceneRBs[reinterpret_cast<uint32_t&>(sceneID)].label);
-            mpMainPass->addDefine("SCENE_BDF", std::string("bd") + kSceneRBs[reinterpret_cast<uint32_t&>(sceneID)].label);
-            
-            mpMainPass->addDefine(kTraceStr, kTraceRBs[reinterpret_cast<uint32_t&>(traceID)].label);
-            mpMainPass->addDefine(kShadowStr, kShadowRBs[reinterpret_cast<uint32_t&>(shadowID)].label);
-
-            mpMainPass->addDefine("PRIMARY_MAXITER", std::to_string(primaryMaxIter));
-            mpMainPass->addDefine("PRIMARY_MAXDIST", std::to_string(primaryMaxDist));
-
-            mpMainPass->addDefine("SECONDARY_MAXITER", std::to_string(secondaryMaxIter));
-            mpMainPass->addDefine("SECONDARY_MAXDIST", std::to_string(secondaryMaxDist));
-            mpMainPass->addDefine("SECONDARY_MINDIST", std::to_string(secondaryMinDist));
-            mpMainPass->addDefine("SECONDARY_EPSILON", std::to_string(secondaryEpsilon));
-            mpMainPass->addDefine("SECONDARY_NOFFSET", std::to_string(secondaryNOffset));
-
-            mpMainPass->addDefine("S_THRESHOLD", std::to_string(sThreshold));
-            mpMainPass->addDefine("S_BLOB_RADIUS", std::to_string(sBlobRadius));
-            mpMainPass->addDefine("S_MARCH_EPSILON", std::to_string(sMarchEpsilon));
-            mpMainPass->addDefine("S_KAPPA_FACTOR", std::to_string(sKappaFactor));
-
-            mpMainPass->addDefine("P_REPEAT_X_NUM", std::to_string(pRepeatNum.x));
-            mpMainPass->addDefine("P_REPEAT_Y_NUM", std::to_string(pRepeatNum.y));
-            mpMainPass->addDefine("P_REPEAT_Z_NUM", std::to_string(pRepeatNum.z));
-            mpMainPass->addDefine("P_REPEAT_DIST", std::string("vec3(")+std::to_string(pRepeatDist.x)+','+std::to_string(pRepeatDist.y)+','+std::to_string(pRepeatDist.z)+')');
-            mpMainPass->addDefine("P_PRIMITIVE_DATA", std::string("vec3(") + std::to_string(pPrimitiveData.x) + ',' + std::to_string(pPrimitiveData.y) + ',' + std::to_string(pPrimitiveData.z) + ')');
-            mpMainPass->addDefine("P_TEST_POS", std::string("vec3(") + std::to_string(pTestPos.x) + ',' + std::to_string(pTestPos.y) + ',' + std::to_string(pTestPos.z) + ')');
-            mpMainPass->addDefine("P_PLANE_ON", std::to_string(static_cast<int>(pShowPlane)));
+            // Only the structural choices select a shader permutation, everything else is in ParamsCB
+            Program::DefineList defines;
+            defines.add("V_COLORING", std::to_string(static_cast<uint32_t>(colorID)));
+            defines.add("SCENE_SDF", std::string("sd") + kSceneRBs[reinterpret_cast<uint32_t&>(sceneID)].label);
+            const std::string sceneLabel = kSceneRBs[reinterpret_cast<uint32_t&>(sceneID)].label;
+            // re-validated on every change: a slider of the scene makes the map stale
+            mUseBrickMap = mBrickMapOn && mpBrickMap && sceneLabel == mpBrickMap->header().scene &&
+                mpBrickMap->header().sceneHash == brickMapSceneHash(reinterpret_cast<uint32_t&>(sceneID));
+            if (mUseBrickMap)
+            {   // the exact BDF is left to the map near the surface
+                defines.add("BRICK_MAP");
+                defines.add("BRICK_MAP_BDF", "bd" + sceneLabel);
+                defines.add("SCENE_BDF", "bdBrickMap");
+            }
+            else defines.add("SCENE_BDF", "bd" + sceneLabel);
+            defines.add("SCENE_SDG", std::string("sdg") + kSceneRBs[reinterpret_cast<uint32_t&>(sceneID)].label);
+            defines.add("NORMAL", kNormalRBs[reinterpret_cast<uint32_t&>(normalID)].label);
+            defines.add(kTraceStr, kTraceRBs[reinterpret_cast<uint32_t&>(traceID)].label);
+            // bdf_packet and bdf_soft take all the lights of a hit at once, the others one ray at a time
+            const bool lightsShadow = shadowID == Shadows::BDF_PACKET || shadowID == Shadows::BDF_SOFT;
+            defines.add(kShadowStr, lightsShadow ? "no_shadow" : kShadowRBs[reinterpret_cast<uint32_t&>(shadowID)].label);
+            defines.add("SHADOW_LIGHTS", lightsShadow ? kShadowRBs[reinterpret_cast<uint32_t&>(shadowID)].label : "shadow_lights");
+            if (sceneID == Scenes::CSG) defines.add("CSG_SCENE", std::to_string(mCsgHash)); // new scene, new permutation
+            mUseBlobGrid = sceneID == Scenes::BLOBS && mBlobCount > 0 && mpBlobGrid;
+            if (mUseBlobGrid) defines.add("BLOB_GRID");
+            mUseTraceStats = mTraceStats && colorID != Coloring::SEGMENT_TRACING;
+            if (mUseTraceStats)
+            {   // counted by the main pass and the cone pre-pass
+                defines.add("TRACE_STATS");
+                defines.add("TRACE_EVALS_PER_STEP", std::to_string(bdf::evalsPerStep(static_cast<bdf::Tracers>(traceID))));
+                defines.add("NORMAL_EVALS", std::to_string(bdf::normalEvals(static_cast<bdf::Normals>(normalID))));
+                if (shadowID != Shadows::NO_SHADOW) defines.add("SHADOW_STATS");
+            }
+            mConeTile = colorID != Coloring::SEGMENT_TRACING ? kConeTiles[coneID] : 0;
+            if (mConeTile > 0)
+            {   // the pre-pass is the same permutation with a tile distance output
+                defines.add("CONE_TILE", std::to_string(mConeTile));
+                Program::DefineList prepassDefines = defines;
+                prepassDefines.add("CONE_PREPASS");
+                mpConePass = getMainPass(prepassDefines);
+            }
+            mUseReprojection = mReprojection && colorID != Coloring::SEGMENT_TRACING;
+            if (mUseReprojection) defines.add("DEPTH_REPROJECTION");
+            mpMainPass = getMainPass(defines);
+            mDepthHistoryValid = false; // the previous depths belong to another scene or tracer
 
             mTestDataString = std::string("sc") +
                 kColoringRBs[reinterpret_cast<uint32_t&>(colorID)].label + '_' +
@@ -329,11 +430,54 @@ void ShaderToy_BDF::onGuiRender(Gui* pGui)
         changed = false;
 
         ImGui::Text(mTestDataString.c_str());
+        if (mUseTraceStats) renderTraceStatsUI(settingsGroup);
 
         settingsGroup.release();
     }
 }
 
+void ShaderToy_BDF::renderTraceStatsUI(Gui::Group& group)
+{
+    group.text(bdf::formatStats(mFrameStats, mParams.primaryMaxIter, mParams.secondaryMaxIter));
+    auto plot = [](const char* label, const bdf::RayStats& rays)
+    {
+        float bins[bdf::kStepBins];
+        for (uint32_t b = 0; b < bdf::kStepBins; ++b) bins[b] = float(rays.histogram[b]);
+        ImGui::PlotHistogram(label, bins, int(bdf::kStepBins), 0, nullptr, 0.f, FLT_MAX, ImVec2(0, 60));
+    };
+    plot("Primary steps", mFrameStats.primary);
+    if (mFrameStats.shadow.rays > 0) plot("Shadow steps", mFrameStats.shadow);
+
+    bool log = mpStatsCsv != nullptr;
+    if (ImGui::Checkbox("Log to trace_stats.csv", &log))
+    {
+        if (log)
+        {
+            mpStatsCsv = fopen("trace_stats.csv", "w");
+            if (mpStatsCsv) bdf::writeStatsCsvHeader(mpStatsCsv);
+            else logError("Failed to open 'trace_stats.csv'");
+            mStatsFrame = 0;
+        }
+        else
+        {
+            fclose(mpStatsCsv);
+            mpStatsCsv = nullptr;
+        }
+    }
+}
+
+void ShaderToy_BDF::readTraceStats(RenderContext* pRenderContext)
+{
+    // waits for the frame: the statistics are a measurement mode, the timer excludes the wait
+    pRenderContext->copyResource(mpStatsReadback.get(), mpStatsCounters.get());
+    pRenderContext->flush(true);
+    const uint32_t* words = static_cast<const uint32_t*>(mpStatsReadback->map(Buffer::MapType::Read));
+    mFrameStats = bdf::TraceStats::fromCounters(words, mpStatsTimer->getElapsedTime());
+    mpStatsReadback->unmap();
+    if (mpStatsCsv)
+        bdf::writeStatsCsvRow(mpStatsCsv, mTestDataString, mStatsFrame++, mParams.primaryMaxIter, mParams.secondaryMaxIter, mFrameStats);
+}
+
 void ShaderToy_BDF::onLoad(RenderContext* pRenderContext)
 {
     // create camera
@@ -345,8 +489,198 @@ void ShaderToy_BDF::onLoad(RenderContext* pRenderContext)
     mpCameraController->update();
     mpCamera->beginFrame();
 
-    // Load shaders
-    mpMainPass = FullScreenPass::create("Samples/ShaderToy_BDF/BDF.ps.slang");
+    // Load shaders: the permutations of earlier sessions, most recently used first. The first kPrecompiledPermutations
+    // are compiled up front so that switching back to them is instant, the others when they are used again.
+    std::ifstream permutations(mPermutationFile);
+    for (std::string line; std::getline(permutations, line) && mRecentPermutations.size() < kMaxPermutations;)
+        if (!line.empty() && line.find("LIGHT_COUNT=") == std::string::npos &&    // a define before it was a uniform
+            std::find(mRecentPermutations.begin(), mRecentPermutations.end(), line) == mRecentPermutations.end())
+            mRecentPermutations.push_back(line);
+    permutations.close();
+    const std::vector<std::string> recent = mRecentPermutations;
+    for (size_t i = std::min(recent.size(), kPrecompiledPermutations); i-- > 0;)
+    {   // oldest first, so that they keep their order
+        Program::DefineList defines;
+        size_t begin = 0;
+        for (size_t end; (end = recent[i].find(';', begin)) != std::string::npos; begin = end + 1)
+        {
+            size_t eq = recent[i].find('=', begin);
+            if (eq == std::string::npos || eq > end) break;
+            defines.add(recent[i].substr(begin, eq - begin), recent[i].substr(eq + 1, end - eq - 1));
+        }
+        if (!defines.empty()) getMainPass(defines)->getProgram()->getActiveVersion();
+    }
+
+    Program::DefineList defaults;
+    defaults.add("V_COLORING", "0");
+    defaults.add("SCENE_SDF", "sdPrimitives");
+    defaults.add("SCENE_BDF", "bdPrimitives");
+    defaults.add("SCENE_SDG", "sdgPrimitives");
+    defaults.add("NORMAL", "normal_analytic");
+    defaults.add(kTraceStr, "sdf_trace");
+    defaults.add(kShadowStr, "no_shadow");
+    defaults.add("SHADOW_LIGHTS", "shadow_lights");
+    mpMainPass = getMainPass(defaults);
+}
+
+FullScreenPass::SharedPtr ShaderToy_BDF::getMainPass(const Program::DefineList& defines)
+{
+    std::string key;
+    for (const auto& define : defines) key += define.first + '=' + define.second + ';';
+
+    auto it = mPassCache.find(key);
+    FullScreenPass::SharedPtr pPass = it != mPassCache.end() ? it->second : FullScreenPass::create("Samples/ShaderToy_BDF/BDF.ps.slang", defines);
+    mPassCache[key] = pPass;
+
+    // most recently used first; the ones pushed out of the list are released (the current passes hold their own)
+    auto recent = std::find(mRecentPermutations.begin(), mRecentPermutations.end(), key);
+    if (recent != mRecentPermutations.end() && recent == mRecentPermutations.begin()) return pPass;
+    if (recent != mRecentPermutations.end()) mRecentPermutations.erase(recent);
+    mRecentPermutations.insert(mRecentPermutations.begin(), key);
+    for (size_t i = kMaxPermutations; i < mRecentPermutations.size(); ++i) mPassCache.erase(mRecentPermutations[i]);
+    mRecentPermutations.resize(std::min(mRecentPermutations.size(), kMaxPermutations));
+
+    // remembered for the next session, except generated scenes, which change between sessions
+    std::ofstream file(mPermutationFile, std::ios::trunc);
+    for (const std::string& line : mRecentPermutations)
+        if (line.find("CSG_SCENE=") == std::string::npos) file << line << '\n';
+    return pPass;
+}
+
+bool ShaderToy_BDF::loadCsgScene(const std::string& filename)
+{
+    bdf::CsgProgram program;
+    std::string error;
+    if (!bdf::loadCsgScene(filename, program, error))
+    {
+        msgBox(error);
+        return false;
+    }
+
+    // the generated functions are included by BDF.ps.slang, so they are written next to it
+    std::string shaderPath;
+    if (!findFileInShaderDirectories("Samples/ShaderToy_BDF/BDF.ps.slang", shaderPath))
+    {
+        msgBox("Can't find BDF.ps.slang in the shader directories");
+        return false;
+    }
+    std::string source = bdf::generateCsgSlang(program);
+    std::ofstream(getDirectoryFromFile(shaderPath) + "/csg_scene.generated.slang") << source;
+
+    mCsgFile = filename;
+    mCsgHash = std::max<size_t>(std::hash<std::string>()(source), 1);
+    mpCsgProgram = std::make_shared<bdf::CsgProgram>(std::move(program));
+    return true;
+}
+
+bool ShaderToy_BDF::loadBrickMap(const std::string& filename)
+{
+    auto map = std::make_shared<bdf::BrickMap>();
+    std::string error;
+    if (!map->load(filename, error))
+    {
+        msgBox(error);
+        return false;
+    }
+    // uploaded straight from the mapping
+    mpBrickCells = Buffer::createStructured(sizeof(bdf::BrickMap::Cell), uint32_t(map->cellCount()), ResourceBindFlags::ShaderResource, Buffer::CpuAccess::None, map->cells(), false);
+    mpBrickVoxels = Buffer::createStructured(sizeof(float), uint32_t(std::max<size_t>(map->voxelCount(), 1)), ResourceBindFlags::ShaderResource, Buffer::CpuAccess::None, map->voxelCount() ? map->voxels() : nullptr, false);
+    mpBrickMap = map;
+    mBrickMapFile = filename;
+    mBrickMapOn = true;
+    return true;
+}
+
+uint64_t ShaderToy_BDF::brickMapSceneHash(uint32_t sceneID) const
+{   // the SceneParams of SceneParams::fromSettings
+    bdf::SceneParams params;
+    params.blobs.T = mParams.sThreshold;
+    params.blobs.radius = mParams.sBlobRadius;
+    params.blobs.kappa = mParams.sKappaFactor;
+    params.blobs.grid = mBlobCount > 0 ? mpBlobGrid.get() : nullptr;
+    params.primitiveData = bdf::float3(mParams.pPrimitiveData.x, mParams.pPrimitiveData.y, mParams.pPrimitiveData.z);
+    params.testPos = bdf::float3(mParams.pTestPos.x, mParams.pTestPos.y, mParams.pTestPos.z);
+    params.repeatNum = { mParams.pRepeatNum.x, mParams.pRepeatNum.y, mParams.pRepeatNum.z };
+    params.repeatDist = bdf::float3(mParams.pRepeatDist.x, mParams.pRepeatDist.y, mParams.pRepeatDist.z);
+    params.planeOn = mParams.pShowPlane;
+    params.csg = mpCsgProgram.get();
+    return bdf::brickMapSceneHash(static_cast<bdf::Scenes>(sceneID), params);
+}
+
+bool ShaderToy_BDF::updateBlobGrid()
+{
+    if (mpBlobGrid && mpBlobGrid->vertices().size() == size_t(mBlobCount) && mBlobGridRadius == mParams.sBlobRadius)
+        return false;
+    if (mParams.sBlobRadius <= 0.f) return false;
+
+    mpBlobGrid = std::make_shared<bdf::BlobGrid>(bdf::BlobGrid::randomField(uint32_t(mBlobCount), mParams.sBlobRadius));
+    mBlobGridRadius = mParams.sBlobRadius;
+    const auto& vertices = mpBlobGrid->vertices();
+    const auto& cells = mpBlobGrid->cells();
+    const auto& indices = mpBlobGrid->indices();
+    mpBlobVertices = Buffer::createStructured(sizeof(bdf::BlobVertex), uint32_t(vertices.size()), ResourceBindFlags::ShaderResource, Buffer::CpuAccess::None, vertices.data(), false);
+    mpBlobCells = Buffer::createStructured(sizeof(bdf::BlobCell), uint32_t(cells.size()), ResourceBindFlags::ShaderResource, Buffer::CpuAccess::None, cells.data(), false);
+    mpBlobIndices = Buffer::createStructured(sizeof(uint32_t), uint32_t(std::max<size_t>(indices.size(), 1)), ResourceBindFlags::ShaderResource, Buffer::CpuAccess::None, indices.empty() ? nullptr : indices.data(), false);
+    return true;
+}
+
+void ShaderToy_BDF::setShaderParams(const FullScreenPass::SharedPtr& pPass)
+{
+    auto cb = pPass["ParamsCB"];
+    cb["primaryMaxIter"] = mParams.primaryMaxIter;
+    cb["primaryMaxDist"] = mParams.primaryMaxDist;
+    cb["secondaryMaxIter"] = mParams.secondaryMaxIter;
+    cb["secondaryMaxDist"] = mParams.secondaryMaxDist;
+    cb["secondaryMinDist"] = mParams.secondaryMinDist;
+    cb["secondaryEpsilon"] = mParams.secondaryEpsilon;
+    cb["secondaryNOffset"] = mParams.secondaryNOffset;
+    cb["bdfOmega"] = mParams.bdfOmega;
+    cb["bdfHitScale"] = mParams.bdfHitScale;
+    cb["shadowSoftness"] = mParams.shadowSoftness;
+    cb["lightCount"] = mParams.lightCount;
+
+    cb["sThreshold"] = mParams.sThreshold;
+    cb["sBlobRadius"] = mParams.sBlobRadius;
+    cb["sMarchEpsilon"] = mParams.sMarchEpsilon;
+    cb["sKappaFactor"] = mParams.sKappaFactor;
+
+    cb["pPrimitiveData"] = mParams.pPrimitiveData;
+    cb["pTestPos"] = mParams.pTestPos;
+    cb["pRepeatNum"] = mParams.pRepeatNum;
+    cb["pRepeatDist"] = mParams.pRepeatDist;
+    cb["pPlaneOn"] = static_cast<int>(mParams.pShowPlane);
+
+    cb["vColoringFunc"] = static_cast<int>(mParams.vColoringStepFunID);
+    cb["vColorA"] = mParams.vColorA;
+    cb["vColorB"] = mParams.vColorB;
+    cb["vColorC"] = mParams.vColorC;
+    cb["vColorD"] = mParams.vColorD;
+
+    if (mUseBlobGrid)
+    {
+        pPass["gBlobVertices"] = mpBlobVertices;
+        pPass["gBlobCells"] = mpBlobCells;
+        pPass["gBlobIndices"] = mpBlobIndices;
+        auto grid = pPass["BlobGridCB"];
+        bdf::float3 origin = mpBlobGrid->origin();
+        bdf::int3 dims = mpBlobGrid->dims();
+        grid["gridOrigin"] = float3(origin.x, origin.y, origin.z);
+        grid["gridCellSize"] = mpBlobGrid->cellSize();
+        grid["gridDims"] = int3(dims.x, dims.y, dims.z);
+        grid["gridKGlobal"] = mpBlobGrid->KGlobal();
+        grid["gridMaxRadius"] = mpBlobGrid->maxRadius();
+    }
+    if (mUseBrickMap)
+    {
+        pPass["gBrickCells"] = mpBrickCells;
+        pPass["gBrickVoxels"] = mpBrickVoxels;
+        auto map = pPass["BrickMapCB"];
+        const bdf::BrickMap::Header& h = mpBrickMap->header();
+        map["brickOrigin"] = float3(h.origin[0], h.origin[1], h.origin[2]);
+        map["brickVoxelSize"] = h.voxelSize;
+        map["brickDims"] = int3(h.dims[0], h.dims[1], h.dims[2]);
+        map["brickSize"] = int(h.brickSize);
+    }
 }
 
 void ShaderToy_BDF::onFrameRender(RenderContext* pRenderContext, const Fbo::SharedPtr& pTargetFbo)
@@ -360,23 +694,96 @@ void ShaderToy_BDF::onFrameRender(RenderContext* pRenderContext, const Fbo::Shar
 
     // iResolution
     float2 resolution = float2((float)pTargetFbo->getWidth(), (float)pTargetFbo->getHeight());
-    mpMainPass["ToyCB"]["iResolution"] = resolution;
-    mpMainPass["ToyCB"]["iTime"] = (float)gpFramework->getGlobalClock().getTime();
-
     static bool wasMouseButtonDownLastFrame = mpShadertoyMouse.z > 0;
     mpShadertoyMouse.w = abs(mpShadertoyMouse.w) * (!wasMouseButtonDownLastFrame && mpShadertoyMouse.z > 0 ? 1.f : -1.f );
-    mpMainPass["ToyCB"]["iMouse"] = mpShadertoyMouse * float4(resolution, resolution);
     wasMouseButtonDownLastFrame = mpShadertoyMouse.z > 0;
 
-    mpMainPass["Camera"]["camEye"] = mpCamera->getPosition();
-    mpMainPass["Camera"]["camInvViewProj"] = mpCamera->getInvViewProjMatrix();
+    // the pass may have just been switched, so the parameters are uploaded every frame
+    auto bindFrame = [&](const FullScreenPass::SharedPtr& pPass)
+    {
+        pPass["ToyCB"]["iResolution"] = resolution;
+        pPass["ToyCB"]["iTime"] = (float)gpFramework->getGlobalClock().getTime();
+        pPass["ToyCB"]["iMouse"] = mpShadertoyMouse * float4(resolution, resolution);
+        pPass["Camera"]["camEye"] = mpCamera->getPosition();
+        pPass["Camera"]["camInvViewProj"] = mpCamera->getInvViewProjMatrix();
+        setShaderParams(pPass);
+    };
+    bindFrame(mpMainPass);
+
+    // trace statistics: the passes add to the counters, read back after the frame
+    if (mUseTraceStats)
+    {
+        if (!mpStatsCounters)
+        {
+            const uint32_t words = bdf::TraceStats::kCounterWords;
+            mpStatsCounters = Buffer::createStructured(sizeof(uint32_t), words,
+                Resource::BindFlags::ShaderResource | Resource::BindFlags::UnorderedAccess, Buffer::CpuAccess::None, nullptr, false);
+            mpStatsReadback = Buffer::create(words * sizeof(uint32_t), Resource::BindFlags::None, Buffer::CpuAccess::Read, nullptr);
+            mpStatsTimer = GpuTimer::create();
+        }
+        pRenderContext->clearUAV(mpStatsCounters->getUAV().get(), uint4(0));
+        mpMainPass["gTraceStats"] = mpStatsCounters;
+        if (mConeTile > 0) mpConePass["gTraceStats"] = mpStatsCounters;
+        mpStatsTimer->begin();
+    }
+
+    // cone pre-pass: one pixel per tile, read by the main pass as the ray start distance
+    if (mConeTile > 0)
+    {
+        uint32_t tilesX = (pTargetFbo->getWidth() + mConeTile - 1) / mConeTile, tilesY = (pTargetFbo->getHeight() + mConeTile - 1) / mConeTile;
+        if (!mpConeFbo || mpConeFbo->getWidth() != tilesX || mpConeFbo->getHeight() != tilesY)
+        {
+            Fbo::Desc desc;
+            desc.setColorTarget(0, ResourceFormat::R32Float);
+            mpConeFbo = Fbo::create2D(tilesX, tilesY, desc);
+        }
+        bindFrame(mpConePass);
+        mpConePass->execute(pRenderContext, mpConeFbo);
+        mpMainPass["gConeTmin"] = mpConeFbo->getColorTexture(0);
+    }
+
+    // depth reprojection: reads the previous frame's hit distances and writes this frame's into the other texture
+    if (mUseReprojection)
+    {
+        uint32_t width = pTargetFbo->getWidth(), height = pTargetFbo->getHeight();
+        if (!mpDepth[0] || mpDepth[0]->getWidth() != width || mpDepth[0]->getHeight() != height)
+        {
+            for (Texture::SharedPtr& pDepth : mpDepth)
+                pDepth = Texture::create2D(width, height, ResourceFormat::R32Float, 1, 1, nullptr,
+                    Resource::BindFlags::ShaderResource | Resource::BindFlags::UnorderedAccess);
+            mDepthHistoryValid = false;
+        }
+        auto reproj = mpMainPass["ReprojCB"];
+        reproj["prevEye"] = mPrevEye;
+        reproj["prevViewProj"] = mPrevViewProj;
+        reproj["prevInvViewProj"] = mPrevInvViewProj;
+        reproj["reprojMargin"] = mReprojMargin;
+        reproj["reprojValid"] = int(mDepthHistoryValid);
+        mpMainPass["gDepthPrev"] = mpDepth[0];
+        mpMainPass["gDepthOut"] = mpDepth[1];
+    }
 
     // run final pass
     mpMainPass->execute(pRenderContext, pTargetFbo);
+    if (mUseTraceStats)
+    {
+        mpStatsTimer->end();
+        readTraceStats(pRenderContext);
+    }
+
+    if (mUseReprojection)
+    {
+        std::swap(mpDepth[0], mpDepth[1]);
+        mPrevEye = mpCamera->getPosition();
+        mPrevViewProj = mpCamera->getViewProjMatrix();
+        mPrevInvViewProj = mpCamera->getInvViewProjMatrix();
+        mDepthHistoryValid = true;
+    }
 }
 
 void ShaderToy_BDF::onShutdown()
 {
+    if (mpStatsCsv) fclose(mpStatsCsv);
 }
 
 bool ShaderToy_BDF::onKeyEvent(const KeyboardEvent& keyEvent)
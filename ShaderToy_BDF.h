@@ -27,9 +27,12 @@
  **************************************************************************/
 #pragma once
 #include "Falcor.h"
+#include "cpu/trace_stats.h"
 
 using namespace Falcor;
 
+namespace bdf { class BlobGrid; class BrickMap; struct CsgProgram; }
+
 class ShaderToy_BDF : public IRenderer
 {
 public:
@@ -43,8 +46,96 @@ public:
     void onGuiRender(Gui* pGui) override;
 
 private:
+    // Continuous shader parameters, uploaded to ParamsCB every frame (see defines.slang)
+    struct ShaderParams
+    {
+        int primaryMaxIter = 512;
+        float primaryMaxDist = 500.0f;
+        int secondaryMaxIter = 256;
+        float secondaryMaxDist = 100.0f;
+        float secondaryMinDist = 0.01f;
+        float secondaryEpsilon = 0.001f;
+        float secondaryNOffset = 0.01f;
+        float bdfOmega = 1.6f;
+        float bdfHitScale = 4.f;
+        float shadowSoftness = 8.f;
+        int lightCount = 3;     // 1..MAX_LIGHT_COUNT
+
+        float sThreshold = .5f;
+        float sBlobRadius = 4.f;
+        float sMarchEpsilon = 0.1f;
+        float sKappaFactor = 2.f;
+
+        float3 pPrimitiveData = float3(1);
+        float3 pTestPos = float3(0);
+        int3 pRepeatNum = int3(1000, 0, 1000);
+        float3 pRepeatDist = float3(4);
+        bool pShowPlane = true;
+
+        uint32_t vColoringStepFunID = 4;
+        float3 vColorA = float3(93, 127, 232) / 255.f;
+        float3 vColorB = float3(92, 236, 220) / 255.f;
+        float3 vColorC = float3(241, 222, 100) / 255.f;
+        float3 vColorD = float3(220, 94, 75) / 255.f;
+    };
+
+    // Returns the pass compiled for the given structural defines, creating it on first use, and moves the permutation
+    // to the front of the recently used ones.
+    FullScreenPass::SharedPtr getMainPass(const Program::DefineList& defines);
+    void setShaderParams(const FullScreenPass::SharedPtr& pPass);
+    // Parses a CSG scene file (cpu/csg_scene.h) and writes its generated sdCSG/bdCSG for the CSG scene.
+    bool loadCsgScene(const std::string& filename);
+    // Maps a brick map file (cpu/brick_map.h) and uploads it for BrickMap.slang.
+    bool loadBrickMap(const std::string& filename);
+    // brickMapSceneHash (cpu/brick_map.h) of the scene with the current parameters, compared to the map's bake.
+    uint64_t brickMapSceneHash(uint32_t sceneID) const;
+    // Rebuilds the blob grid and its buffers (BlobGrid.slang) if the count or radius changed; true if it did.
+    bool updateBlobGrid();
+    // Reads back the counters of the frame just rendered (TraceStats.slang) and logs them if enabled.
+    void readTraceStats(RenderContext* pRenderContext);
+    void renderTraceStatsUI(Gui::Group& group);
+
     float                           mAspectRatio = 0;
+    ShaderParams                    mParams;
     FullScreenPass::SharedPtr       mpMainPass;
+    std::unordered_map<std::string, FullScreenPass::SharedPtr> mPassCache; // keyed by the define set, the recent ones
+    std::vector<std::string>        mRecentPermutations;    // define sets, most recently used first, at most kMaxPermutations
+    uint32_t                        mConeTile = 0;  // CONE_TILE, 0: no cone pre-pass
+    FullScreenPass::SharedPtr       mpConePass;
+    Fbo::SharedPtr                  mpConeFbo;      // R32Float, one texel per tile
+    bool                            mReprojection = false;
+    bool                            mUseReprojection = false;   // DEPTH_REPROJECTION
+    float                           mReprojMargin = .05f;
+    bool                            mDepthHistoryValid = false;
+    Texture::SharedPtr              mpDepth[2];     // R32Float primary hit distances: previous, current frame
+    bool                            mTraceStats = false;
+    bool                            mUseTraceStats = false;     // TRACE_STATS
+    Buffer::SharedPtr               mpStatsCounters;    // gTraceStats, cleared every frame
+    Buffer::SharedPtr               mpStatsReadback;
+    GpuTimer::SharedPtr             mpStatsTimer;       // main and cone pass
+    bdf::TraceStats                 mFrameStats;
+    uint64_t                        mStatsFrame = 0;
+    FILE*                           mpStatsCsv = nullptr;   // trace_stats.csv while logging
+    float3                          mPrevEye;
+    float4x4                        mPrevViewProj;
+    float4x4                        mPrevInvViewProj;
+    std::string                     mPermutationFile = "ShaderToy_BDF_permutations.txt";
+    std::string                     mCsgFile;
+    size_t                          mCsgHash = 0;   // of the generated source, 0: no scene file loaded
+    std::shared_ptr<bdf::CsgProgram> mpCsgProgram;
+    int                             mBlobCount = 0; // 0: the three original blobs
+    bool                            mUseBlobGrid = false;
+    float                           mBlobGridRadius = 0.f;
+    std::shared_ptr<bdf::BlobGrid>  mpBlobGrid;
+    Buffer::SharedPtr               mpBlobVertices;
+    Buffer::SharedPtr               mpBlobCells;
+    Buffer::SharedPtr               mpBlobIndices;
+    std::string                     mBrickMapFile;
+    bool                            mBrickMapOn = false;
+    bool                            mUseBrickMap = false;   // BRICK_MAP, when the map was baked from the scene shown as it is
+    std::shared_ptr<bdf::BrickMap>  mpBrickMap;
+    Buffer::SharedPtr               mpBrickCells;
+    Buffer::SharedPtr               mpBrickVoxels;
     Camera::SharedPtr               mpCamera;
     CameraController::SharedPtr     mpCameraController;
     float4                          mpShadertoyMouse;
@@ -0,0 +1,160 @@
+#pragma once
+
+// Host mirror of bdf_primitives.slang. The primitives in use are templates over the point type (see number_types.h),
+// with branches written as selects; the bdBox variants kept for comparison are float only.
+
+#include "common.h"
+#include "number_types.h"
+
+namespace bdf
+{
+    // SDF primitives mostly copied from Inigo Quilez's SDF primitives https://iquilezles.org/articles/distfunctions/
+
+    template <class V>
+    scalar_t<V> bdSphere(const V& p, float s)
+    {
+        using F = scalar_t<V>;
+        F d2 = dot2(p);
+        return branch(d2 > s * s, [&] { return sqrt(d2 - s * s); }, [&] { return sqrt(d2) - s; });
+    }
+
+    inline float bdBoxOlder(float3 p, float3 b)
+    {
+        float3 q = abs(p) - b;
+        float d = min3( //distances to the three corners
+            dot2(q + float3(2.f * b.x, 0, 0)),
+            dot2(q + float3(0, 2.f * b.y, 0)),
+            dot2(q + float3(0, 0, 2.f * b.z))
+        );
+
+        float3 m = max(q, 0.f); // conditional distances to three edges:
+        d = q.z >= 0.f ? d : std::min(d,
+                dot2(float3(m.x, m.y, q.z))
+            );
+        d = q.y >= 0.f ? d : std::min(d,
+                dot2(float3(m.x, m.z, q.y))
+            );
+        d = q.x >= 0.f ? d : std::min(d,
+                dot2(float3(m.y, m.z, q.x))
+            );
+        float s = max3(q.x, q.y, q.z);
+        return s < 0.f ? s : std::sqrt(d);
+    }
+
+    inline float bdBoxOldish(float3 p, float3 b)
+    {
+        float3 q = abs(p) - b;
+        float d = min3( // minimum distance to face-diagonal vertices
+            dot2(q + float3(2.f * b.x, 0, 0)),
+            dot2(q + float3(0, 2.f * b.y, 0)),
+            dot2(q + float3(0, 0, 2.f * b.z))
+        );
+        float3 q2 = q * q; // conditional distances to three edges/faces
+        float3 m2 = float3(q.x >= 0.f ? q2.x : 0.f, q.y >= 0.f ? q2.y : 0.f, q.z >= 0.f ? q2.z : 0.f);
+        d = q.z >= 0.f ? d : std::min(d,
+                m2.x + m2.y + q2.z
+            );
+        d = q.y >= 0.f ? d : std::min(d,
+                m2.x + q2.y + m2.z
+            );
+        d = q.x >= 0.f ? d : std::min(d,
+                q2.x + m2.y + m2.z
+            );
+        float s = max3(q.x, q.y, q.z);
+        return s < 0.f ? s : std::sqrt(d);
+    }
+
+    inline float bdBox1(float3 p, float3 b)
+    { // optimized
+        float3 q = abs(p) - b;
+        float3 q2 = max(q, 0.f) * q;
+        float  d = q2.y + q2.z + dot2(q.x + (q.x < 0.f ? 0.f : 2.f * b.x));
+        d = std::min(d, q2.z + q2.x + dot2(q.y + (q.y < 0.f ? 0.f : 2.f * b.y)));
+        d = std::min(d, q2.x + q2.y + dot2(q.z + (q.z < 0.f ? 0.f : 2.f * b.z)));
+        float s = max3(q.x, q.y, q.z);
+        return s < 0.f ? s : std::sqrt(d);
+    }
+    inline float bdBox2(float3 p, float3 b)
+    { // optimized
+        float3 q = abs(p) - b;
+        float3 tmp = 2.f * float3(q.x >= 0.f, q.y >= 0.f, q.z >= 0.f) * b;
+        float3 q2 = max(q, 0.f) * q;
+        float  d = q2.y + q2.z + dot2(q.x + tmp.x);
+        d = std::min(d, q2.z + q2.x + dot2(q.y + tmp.y));
+        d = std::min(d, q2.x + q2.y + dot2(q.z + tmp.z));
+        float s = max3(q.x, q.y, q.z);
+        return s < 0.f ? s : std::sqrt(d);
+    }
+
+    template <class V>
+    scalar_t<V> bdBox3(const V& p, float3 b)
+    { // optimized
+        using F = scalar_t<V>;
+        F qx = abs(p.x) - b.x, qy = abs(p.y) - b.y, qz = abs(p.z) - b.z;
+        F b2qx = select(qx > 0.f, F(2.f * b.x), F(0.f)) + qx;
+        F b2qy = select(qy > 0.f, F(2.f * b.y), F(0.f)) + qy;
+        F b2qz = select(qz > 0.f, F(2.f * b.z), F(0.f)) + qz;
+        F q2x = max(qx, F(0.f)) * qx, q2y = max(qy, F(0.f)) * qy, q2z = max(qz, F(0.f)) * qz;
+        F s = max(qx, max(qy, qz));
+        F d = min(q2y + q2z + sqr(b2qx), min(q2z + q2x + sqr(b2qy), q2x + q2y + sqr(b2qz)));
+        return branch(s < 0.f, [&] { return s; }, [&] { return sqrt(d); });
+    }
+
+    template <class V>
+    scalar_t<V> bdBox(const V& p, float3 b)
+    {
+        return bdBox3(p, b);
+    }
+
+    template <class V>
+    scalar_t<V> bdCylinder(const V& p, float r) // Infinite
+    {
+        using F = scalar_t<V>;
+        F d2 = sqr(p.x) + sqr(p.z);
+        return branch(d2 > r * r, [&] { return sqrt(d2 - r * r); }, [&] { return sqrt(d2) - r; });
+    }
+
+    template <class V>
+    scalar_t<V> bdCylinder(const V& p, float _r, float _h)
+    {
+        using F = scalar_t<V>;
+        F r = lengthXZ(p);
+        F qx = r - _r, qy = abs(p.y) - _h;
+        F d = sqr(max(qx, F(0.f))) + sqr(qy + 2.f * _h);
+        d = branch((qx >= 0.f) & (qy >= 0.f), [&] { return d; }, [&] { return min(d,
+              .95f * (sqr(qx) + sqr(qy))
+          ); });
+        d = branch(qx <= 0.f, [&] { return d; }, [&] { return min(d,
+              1.0f * (sqr(r) + sqr(max(qy, F(0.f))) - _r * _r)
+          ); });
+        F s = max(qx, qy);
+        return branch(s < 0.f, [&] { return s; }, [&] { return sqrt(d); });
+    }
+
+    template <class V>
+    scalar_t<V> bdTorus(const V& p, float2 t) //t = vec2(R,r)
+    {
+        using F = scalar_t<V>;
+        F d2 = sqr(lengthXZ(p) - t.x) + sqr(p.y);
+        return branch(d2 <= t.y * t.y, [&] { return sqrt(d2) - t.y; }, [&] { return sqrt(d2 - t.y * t.y); });
+    }
+
+    template <class V>
+    scalar_t<V> bdCone(const V& p, float t) // Infinite
+    {
+        using F = scalar_t<V>;
+        F r = abs(p.y) * t;
+        F d2 = sqr(p.x) + sqr(p.z);
+        return branch(d2 > sqr(r), [&] { return sqrt(d2 - sqr(r)); }, [&] { return (sqrt(d2) - r) / std::sqrt(1.f + t * t); });
+    }
+
+    template <class V>
+    scalar_t<V> bdPlane(const V& p, float3 n)
+    {
+        scalar_t<V> d = p.x * n.x + p.y * n.y + p.z * n.z; // = sdPlane(p, n);
+        return select(d < 0.f, d, 2.f * d + 2.f);
+        // Technically the BDF would be infinite, but since we have to sphere trace
+        // back from the inside to the ray-surface intersection, we take an arbitrary
+        // value for the BDF. This is the only place where we do that.
+    }
+}
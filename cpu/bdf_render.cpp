@@ -0,0 +1,699 @@
+// Headless renderer for the BDF sample: renders single frames or every scene/tracer combination on the CPU.
+
+#include "blob_grid.h"
+#include "brick_map.h"
+#include "csg_bvh.h"
+#include "distributed.h"
+#include "parallel.h"
+#include "renderer.h"
+#include "stream_render.h"
+#include "sweep.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+using namespace bdf;
+
+namespace
+{
+    void printUsage()
+    {
+        printf(
+            "Usage: bdf_render [options]\n"
+            "  --scene <label>        Blobs, Primitives, Sphere, Box, Cylinder, Torus, Test, CSG (default Primitives)\n"
+            "  --csg <file>           scene file for the CSG scene (implies --scene CSG), see csg_scene.h\n"
+            "  --emit-slang <file>    write the sdCSG/bdCSG/sdgCSG Slang generated from the --csg scene\n"
+            "  --no-bvh               evaluate the --csg scene linearly instead of through a BVH\n"
+            "  --blobs <n>            Blobs scene of n random blobs in a uniform grid instead of the original three\n"
+            "  --trace <label>        sdf_trace, bdf_trace, segment_trace, their_sphere_trace, bdf_trace_relaxed,\n"
+            "                         bdf_trace_refined, interval_segment_trace (default sdf_trace)\n"
+            "  --omega <f>            step factor of bdf_trace_relaxed/refined (default 1.6)\n"
+            "  --hit-scale <f>        bdf_trace_refined hit epsilon before refinement, in epsilons (default 4)\n"
+            "  --shadow <label>       sdf_trace, bdf_trace, no_shadow, bdf_packet, bdf_soft (default: matches the tracer)\n"
+            "  --lights <n>           LIGHT_COUNT, lights on the ring (default 3, at most 64)\n"
+            "  --softness <f>         SHADOW_SOFTNESS, penumbra factor of bdf_soft (default 8)\n"
+            "  --normal <label>       normal_central, normal_tetrahedral, normal_analytic (default normal_analytic)\n"
+            "  --coloring <n>         0 default, 1 step count, 2 shadow step count, 3 original segment tracing\n"
+            "  --size <w>x<h>         image size (default 1280x720)\n"
+            "  --maxiter <n>          PRIMARY_MAXITER\n"
+            "  --maxdist <d>          PRIMARY_MAXDIST\n"
+            "  --eye <x,y,z>          camera position (default: the GUI's per scene pose)\n"
+            "  --target <x,y,z>       camera target\n"
+            "  --threads <n>          worker threads (default: all hardware threads)\n"
+            "  --tile <n>             tile size in pixels (default 16)\n"
+            "  --packet <n>           1, 8 or 16: ray packet width for bdf_trace primary rays (default 1)\n"
+            "  --cone <n>             start primary rays at the distance found by one cone per n x n tile (8 or 16);\n"
+            "                         also renders without it and reports the step reduction\n"
+            "  --reproject <n>        render n frames of first-person camera motion, starting the primary rays from the\n"
+            "                         reprojected depth of the previous frame, and compare them with full traces\n"
+            "  --margin <f>           reprojection start margin, relative to the hit distance (default 0.05)\n"
+            "  --bake <file>          bake the scene's BDF into a brick map file (see brick_map.h) and render with it\n"
+            "  --bake-lo <x,y,z>      lower corner of the baked box (default: camera target - 16)\n"
+            "  --bake-hi <x,y,z>      upper corner of the baked box (default: camera target + 16)\n"
+            "  --bake-voxel <f>       voxel size of the bake (default 0.0625)\n"
+            "  --brick-map <file>     render with a brick map baked from the scene with the same parameters (--blobs,\n"
+            "                         --csg); also renders without it and reports the difference\n"
+            "  --stats <file.csv>     print the tracing statistics of each frame and write them as CSV (trace_stats.h)\n"
+            "  --out <file>           output image, .png or .exr (default <configuration name>.png)\n"
+            "  --stream <n>           render the frame n rows at a time and write each band while the next one traces,\n"
+            "                         for images too large to hold in memory (e.g. --size 32768x16384)\n"
+            "  --depth                with --stream and an .exr --out, also write the primary hit distance (Z) and step\n"
+            "                         count (steps) channels\n"
+            "  --all <dir>            render every scene/tracer combination into dir\n"
+            "  --sweep <file>         render every combination of a sweep file (see sweep.h) into --sweep-dir, with a\n"
+            "                         table of the timings and steps in sweep.csv\n"
+            "  --sweep-dir <dir>      output directory of --sweep (default .)\n"
+            "  --jobs <n>             configurations of --sweep rendered at once (default: all hardware threads), each on\n"
+            "                         --threads threads (default 1 with --sweep)\n"
+            "  --workers <n>          render the frame or the --sweep with n worker processes of this host, in bands of\n"
+            "                         rows handed out by this process (see distributed.h); each on --threads threads\n"
+            "                         (default 1)\n"
+            "  --band <n>             rows of a --workers tile (default 32)\n"
+            "  --slow-worker <ms>     testing: the first worker sleeps this long before each tile, so that its tiles\n"
+            "                         are re-issued to the others\n");
+    }
+
+    bool parseFloat3(const char* s, float3& v)
+    {
+        return sscanf(s, "%f,%f,%f", &v.x, &v.y, &v.z) == 3;
+    }
+
+    template <class E>
+    bool parseEnum(const char* const* labels, uint32_t count, const char* s, E& e)
+    {
+        uint32_t index;
+        if (!parseLabel(labels, count, s, index)) return false;
+        e = static_cast<E>(index);
+        return true;
+    }
+
+    // Camera of frame i of a first-person walk: forward and sideways, turning slightly.
+    CameraDesc walkCamera(const CameraDesc& camera, uint32_t i)
+    {
+        float3 forward = camera.target - camera.position;
+        const float dist = length(forward);
+        forward = forward / dist;
+        const float3 right = normalize(cross(forward, camera.up));
+        CameraDesc c = camera;
+        c.position = camera.position + float(i) * dist * (.004f * forward + .003f * right);
+        c.target = camera.target + float(i) * dist * (.004f * forward + .006f * right);
+        return c;
+    }
+
+    // --stats: prints the statistics of a frame and appends them to the CSV
+    void logStats(FILE* csv, const RenderSettings& settings, uint64_t frame, const TraceStats& stats)
+    {
+        if (!csv) return;
+        printf("%s", formatStats(stats, settings.primaryMaxIter, settings.secondaryMaxIter).c_str());
+        writeStatsCsvRow(csv, testDataString(settings), frame, settings.primaryMaxIter, settings.secondaryMaxIter, stats);
+    }
+
+    // writePng, or an EXR file for a path ending in .exr
+    bool writeImage(const std::string& path, const Image& image)
+    {
+        std::string error;
+        if (ImageStreamWriter::isExr(path))
+        {
+            ImageStreamWriter writer;
+            if (writer.open(path, image.width, image.height, false, error) && writer.writeRows(image, nullptr, error) &&
+                writer.close(error))
+                return true;
+        }
+        else if (writePng(path, image))
+            return true;
+        fprintf(stderr, "Failed to write '%s'\n", path.c_str());
+        return false;
+    }
+
+    // Renders the frames of walkCamera with and without reprojection and reports steps and differences.
+    bool renderReprojected(const Renderer& renderer, const RenderSettings& settings, const CameraDesc& camera,
+        uint32_t width, uint32_t height, uint32_t frames, const std::string& path, FILE* statsCsv)
+    {
+        RenderSettings full = settings;
+        full.reprojection = false;
+        DepthHistory history;
+        Image image, reference;
+        uint64_t steps[2] = {}, reprojected = 0, rejected = 0, changed = 0;
+        double ms[2] = {};
+        for (uint32_t i = 0; i < frames; ++i)
+        {
+            CameraDesc c = walkCamera(camera, i);
+            Renderer::FrameStats stats[2];
+            auto start = std::chrono::steady_clock::now();
+            renderer.render(full, c, width, height, reference, &stats[0]);
+            auto mid = std::chrono::steady_clock::now();
+            renderer.render(settings, c, width, height, image, &stats[1], &history);
+            auto end = std::chrono::steady_clock::now();
+            ms[0] += std::chrono::duration<double, std::milli>(mid - start).count();
+            ms[1] += std::chrono::duration<double, std::milli>(end - mid).count();
+            for (int k = 0; k < 2; ++k) steps[k] += stats[k].trace.primary.steps + stats[k].trace.prepassEvals;
+            logStats(statsCsv, settings, i, stats[1].trace);
+            reprojected += stats[1].reprojectedRays;
+            rejected += stats[1].rejectedRays;
+            for (size_t p = 0; p < image.pixels.size(); ++p)
+            {
+                const float4 &a = image.pixels[p], &b = reference.pixels[p];
+                changed += std::max(std::abs(a.x - b.x), std::max(std::abs(a.y - b.y), std::abs(a.z - b.z))) > 1.f / 255.f;
+            }
+        }
+        const double rays = double(width) * height * frames;
+        printf("%-70s %u frames, steps/px %.2f -> %.2f (%+.1f%%), %.2f -> %.2f ms/frame\n", testDataString(settings).c_str(),
+            frames, double(steps[0]) / rays, double(steps[1]) / rays, 100. * (double(steps[1]) - double(steps[0])) / double(steps[0]),
+            ms[0] / frames, ms[1] / frames);
+        printf("  reprojected %.1f%% of the rays, %.2f%% rejected inside a surface, %.3f%% of the pixels changed\n",
+            100. * double(reprojected) / rays, 100. * double(rejected) / rays, 100. * double(changed) / rays);
+        return writeImage(path, image);
+    }
+
+    bool renderToFile(const Renderer& renderer, const RenderSettings& settings, const CameraDesc& camera,
+        uint32_t width, uint32_t height, const std::string& path, FILE* statsCsv)
+    {
+        Image image;
+        Renderer::FrameStats stats;
+        auto start = std::chrono::steady_clock::now();
+        renderer.render(settings, camera, width, height, image, &stats);
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        const double pixels = double(width) * height;
+        printf("%-70s %9.2f ms %8.2f Mrays/s %8.2f steps/px\n", testDataString(settings).c_str(), ms, pixels / (ms * 1e3),
+            double(stats.trace.primary.steps + stats.trace.prepassEvals) / pixels);
+        logStats(statsCsv, settings, 0, stats.trace);
+        if (settings.coneTile > 0 && stats.prepassTiles > 0)
+        {   // same frame without the pre-pass
+            RenderSettings reference = settings;
+            reference.coneTile = 0;
+            Image refImage;
+            Renderer::FrameStats refStats;
+            start = std::chrono::steady_clock::now();
+            renderer.render(reference, camera, width, height, refImage, &refStats);
+            double refMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            uint32_t changed = 0;   // by more than one 8 bit step
+            for (size_t i = 0; i < image.pixels.size(); ++i)
+            {
+                const float4 &a = image.pixels[i], &b = refImage.pixels[i];
+                changed += std::max(std::abs(a.x - b.x), std::max(std::abs(a.y - b.y), std::abs(a.z - b.z))) > 1.f / 255.f;
+            }
+            double before = double(refStats.trace.primary.steps) / pixels;
+            double after = double(stats.trace.primary.steps + stats.trace.prepassEvals) / pixels;
+            printf("  cone pre-pass %ux%u: %.2f -> %.2f steps/px (%.2f primary + %.2f pre-pass over %u tiles), %+.1f%% steps, "
+                "%.2f -> %.2f ms, %u pixels changed\n", settings.coneTile, settings.coneTile, before, after,
+                double(stats.trace.primary.steps) / pixels, double(stats.trace.prepassEvals) / pixels, stats.prepassTiles,
+                100. * (after - before) / before, refMs, ms, changed);
+        }
+        if (settings.brickMap)
+        {   // same frame with the exact BDF everywhere
+            RenderSettings reference = settings;
+            reference.brickMap = nullptr;
+            Image refImage;
+            Renderer::FrameStats refStats;
+            renderer.render(reference, camera, width, height, refImage, &refStats);
+            uint32_t changed = 0;
+            for (size_t i = 0; i < image.pixels.size(); ++i)
+            {
+                const float4 &a = image.pixels[i], &b = refImage.pixels[i];
+                changed += std::max(std::abs(a.x - b.x), std::max(std::abs(a.y - b.y), std::abs(a.z - b.z))) > 1.f / 255.f;
+            }
+            printf("  brick map: %.2f -> %.2f ms (%+.1f%%), %.2f -> %.2f steps/px, %u pixels changed\n", refStats.trace.ms,
+                stats.trace.ms, 100. * (stats.trace.ms - refStats.trace.ms) / refStats.trace.ms,
+                double(refStats.trace.primary.steps + refStats.trace.shadow.steps) / pixels,
+                double(stats.trace.primary.steps + stats.trace.shadow.steps) / pixels, changed);
+        }
+        return writeImage(path, image);
+    }
+
+    // --stream: renders the frame in bands straight into path
+    bool renderStreamedToFile(const Renderer& renderer, const RenderSettings& settings, const CameraDesc& camera,
+        uint32_t width, uint32_t height, const std::string& path, const StreamRenderDesc& desc, FILE* statsCsv)
+    {
+        StreamRenderStats stats;
+        std::string error;
+        if (!renderStreamed(renderer, settings, camera, width, height, path, desc, stats, error))
+        {
+            fprintf(stderr, "%s\n", error.c_str());
+            return false;
+        }
+        const double pixels = double(width) * height;
+        printf("%-70s %9.2f ms %8.2f Mrays/s %8.2f steps/px\n", testDataString(settings).c_str(), stats.ms,
+            pixels / (stats.ms * 1e3), double(stats.frame.trace.primary.steps + stats.frame.trace.prepassEvals) / pixels);
+        printf("  streamed %u bands into '%s': %.1f ms tracing, %.1f ms encoding alongside, %.1f ms waiting for the encoder, "
+            "%.1f MB of bands (%.1f MB as one image)\n", stats.bands, path.c_str(), stats.frame.trace.ms, stats.encodeMs,
+            stats.stallMs, double(stats.bandBytes) / (1 << 20), pixels * sizeof(float4) / (1 << 20));
+        logStats(statsCsv, settings, 0, stats.frame.trace);
+        return true;
+    }
+
+    void printDistributedStats(const DistributedStats& stats, uint32_t workerCount)
+    {
+        printf("  %u workers: %u tiles, %u re-issued, %u duplicate results, %u workers failed; tiles per worker:",
+            workerCount, stats.tiles, stats.reissued, stats.duplicates, stats.failedWorkers);
+        for (uint32_t n : stats.workerTiles) printf(" %u", n);
+        printf("\n");
+    }
+
+    // --workers: renders the frame with worker processes
+    bool renderDistributedToFile(const RenderSettings& settings, const CameraDesc& camera, uint32_t width, uint32_t height,
+        const DistributedDesc& desc, const std::string& path, FILE* statsCsv)
+    {
+        DistributedStats stats;
+        std::string error;
+        const bool ok = renderDistributed({ { settings, camera, width, height } }, desc,
+            [&](uint32_t, const Image& image, const Renderer::FrameStats& frameStats)
+            {
+                logStats(statsCsv, settings, 0, frameStats.trace);
+                return writeImage(path, image);
+            }, stats, error);
+        if (!ok)
+        {
+            fprintf(stderr, "%s\n", error.c_str());
+            return false;
+        }
+        const double pixels = double(width) * height;
+        printf("%-70s %9.2f ms %8.2f Mrays/s\n", testDataString(settings).c_str(), stats.ms, pixels / (stats.ms * 1e3));
+        printDistributedStats(stats, desc.workerCount);
+        return true;
+    }
+
+    // Bakes the brick map of the configured scene into path.
+    bool bakeToFile(const RenderSettings& settings, const BrickMapDesc& desc, const std::string& path)
+    {
+        auto start = std::chrono::steady_clock::now();
+        const SceneParams params = SceneParams::fromSettings(settings);
+        BrickMapBake bake = dispatchScene(settings.scene, params, [&](const auto& scene)
+        {
+            return bakeBrickMap(scene, kSceneLabels[uint32_t(settings.scene)], brickMapSceneHash(settings.scene, params), desc);
+        });
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        const BrickMap::Header& h = bake.header;
+        printf("Brick map: %dx%dx%d bricks of %u^3 voxels of %g, %u with voxels (%.1f%%), %.1f MB, baked in %.1f ms\n",
+            h.dims[0], h.dims[1], h.dims[2], h.brickSize, h.voxelSize, h.brickCount, 100. * h.brickCount / double(bake.cells.size()),
+            double(h.fileSize) / (1 << 20), ms);
+        std::string error;
+        if (!writeBrickMap(path, bake, error))
+        {
+            fprintf(stderr, "%s\n", error.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    // Renders the jobs of a sweep, jobs at a time, each on options.threadCount threads, or with the workers of
+    // distributed, and writes their images and sweep.csv into dir. configure applies the scene defaults and the
+    // command line as for a single render.
+    template <class Configure>
+    bool renderSweep(const SweepSpec& spec, const RenderSettings& base, const CameraDesc& camera, Configure&& configure,
+        Renderer::Options options, uint32_t width, uint32_t height, uint32_t jobs, const DistributedDesc* distributed,
+        const std::string& dir, FILE* statsCsv)
+    {
+        struct Job
+        {
+            SweepPoint point;
+            RenderSettings settings;
+            CameraDesc camera;
+            std::string name;
+            Renderer::FrameStats stats;
+            bool ok = false;
+        };
+        std::vector<Job> queue;
+        std::set<std::string> names;
+        uint32_t duplicates = 0;
+        for (const SweepPoint& p : spec.expand(base.scene, base.trace, width, height))
+        {
+            Job job;
+            job.point = p;
+            job.settings = base;
+            job.camera = camera;
+            configure(p.scene, p.trace, job.settings, job.camera);
+            if (p.shadow >= 0 && p.scene != Scenes::BLOBS) job.settings.shadow = static_cast<Shadows>(p.shadow);  // as configure
+            if (p.maxIter > 0) job.settings.primaryMaxIter = p.maxIter;
+            if (!spec.cameras.empty() && !spec.cameras[p.camera].sceneDefault)
+            {
+                job.camera.position = spec.cameras[p.camera].eye;
+                job.camera.target = spec.cameras[p.camera].target;
+            }
+            job.name = sweepJobName(job.settings, p);
+            if (!names.insert(job.name).second)
+            {   // same image, same file
+                ++duplicates;
+                continue;
+            }
+            queue.push_back(std::move(job));
+        }
+        if (duplicates > 0) printf("Sweep: skipped %u configurations that repeat another\n", duplicates);
+
+        if (options.threadCount == 0) options.threadCount = 1;
+        const Renderer renderer(options);
+        std::mutex printMutex;
+        uint32_t done = 0;
+        auto finish = [&](Job& job, const Image& image)
+        {
+            const std::string path = dir + "/" + job.name + ".png";
+            job.ok = writePng(path, image);
+            std::lock_guard<std::mutex> lock(printMutex);
+            ++done;
+            if (!job.ok) fprintf(stderr, "Failed to write '%s'\n", path.c_str());
+            printf("[%3u/%zu] %-90s %9.2f ms\n", done, queue.size(), job.name.c_str(), job.stats.trace.ms);
+        };
+        auto start = std::chrono::steady_clock::now();
+        if (distributed)
+        {   // ms of a job: from its first tile handed out to its last result, jobs overlapping as with --jobs
+            printf("Sweep: %zu configurations on %u workers of %u threads each\n", queue.size(), distributed->workerCount,
+                options.threadCount);
+            std::vector<DistributedFrame> frames;
+            for (const Job& job : queue) frames.push_back({ job.settings, job.camera, job.point.width, job.point.height });
+            DistributedDesc desc = *distributed;
+            desc.options = options;
+            DistributedStats stats;
+            std::string error;
+            if (!renderDistributed(frames, desc, [&](uint32_t i, const Image& image, const Renderer::FrameStats& stats)
+                {
+                    queue[i].stats = stats;
+                    finish(queue[i], image);
+                    return true;
+                }, stats, error))
+            {
+                fprintf(stderr, "%s\n", error.c_str());
+                return false;
+            }
+            printDistributedStats(stats, desc.workerCount);
+        }
+        else
+        {
+            printf("Sweep: %zu configurations, %u at a time on %u threads each\n", queue.size(),
+                std::min(jobs ? jobs : defaultThreadCount(), uint32_t(queue.size())), options.threadCount);
+            parallelFor(uint32_t(queue.size()), jobs, [&](uint32_t i, uint32_t)
+            {
+                Job& job = queue[i];
+                Image image;
+                renderer.render(job.settings, job.camera, job.point.width, job.point.height, image, &job.stats);
+                finish(job, image);
+            });
+        }
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        printf("Sweep done in %.1f s\n", ms * 1e-3);
+
+        const std::string tablePath = dir + "/sweep.csv";
+        FILE* table = fopen(tablePath.c_str(), "w");
+        if (!table)
+        {
+            fprintf(stderr, "Failed to open '%s'\n", tablePath.c_str());
+            return false;
+        }
+        fprintf(table, "name,scene,trace,shadow,maxiter,width,height,camera,threads,ms,primary_mrays_per_s,primary_steps_per_px,"
+            "shadow_steps_per_px,evals_per_px,exhausted_fraction\n");
+        bool ok = true;
+        for (const Job& job : queue)
+        {
+            const TraceStats& t = job.stats.trace;
+            const double pixels = double(job.point.width) * job.point.height;
+            fprintf(table, "%s,%s,%s,%s,%d,%u,%u,%u,%u,%.3f,%.3f,%.3f,%.3f,%.3f,%.5f\n", job.name.c_str(),
+                kSceneLabels[uint32_t(job.settings.scene)], kTraceLabels[uint32_t(job.settings.trace)],
+                kShadowLabels[uint32_t(job.settings.shadow)], job.settings.primaryMaxIter, job.point.width, job.point.height,
+                job.point.camera, options.threadCount, t.ms, pixels / (t.ms * 1e3), double(t.primary.steps) / pixels,
+                double(t.shadow.steps) / pixels, double(t.evals()) / pixels, double(t.primary.exhausted) / pixels);
+            if (statsCsv)
+                writeStatsCsvRow(statsCsv, job.name, 0, job.settings.primaryMaxIter, job.settings.secondaryMaxIter, t);
+            ok &= job.ok;
+        }
+        fclose(table);
+        return ok;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    if (argc == 3 && !strcmp(argv[1], "--worker"))
+    {   // started by a coordinator, see distributed.h
+        std::string error;
+        if (runWorker(atoi(argv[2]), error)) return 0;
+        fprintf(stderr, "Worker: %s\n", error.c_str());
+        return 1;
+    }
+
+    RenderSettings settings;
+    CameraDesc camera;
+    Renderer::Options options;
+    uint32_t width = 1280, height = 720;
+    std::string outPath, allDir, csgPath, slangPath, statsPath, sweepPath, sweepDir = ".", bakePath, brickMapPath;
+    BrickMapDesc bakeDesc;
+    StreamRenderDesc streamDesc;
+    bool stream = false;
+    DistributedDesc distributedDesc;
+    distributedDesc.workerCount = 0;
+    bool hasBakeLo = false, hasBakeHi = false;
+    bool hasShadow = false, hasEye = false, hasTarget = false, useBvh = true;
+    int maxIter = -1, blobCount = 0, reprojectFrames = 0;
+    uint32_t jobs = 0;
+    float maxDist = -1.f;
+    float3 eye, target;
+    Shadows shadowArg = Shadows::NO_SHADOW;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const char* arg = argv[i];
+        const char* val = i + 1 < argc ? argv[i + 1] : nullptr;
+        bool ok = val != nullptr;
+        if (!strcmp(arg, "--help") || !strcmp(arg, "-h")) { printUsage(); return 0; }
+        else if (!strcmp(arg, "--scene")) ok = ok && parseEnum(kSceneLabels, 8, val, settings.scene);
+        else if (!strcmp(arg, "--csg")) ok = ok && (csgPath = val, settings.scene = Scenes::CSG, true);
+        else if (!strcmp(arg, "--emit-slang")) ok = ok && (slangPath = val, true);
+        else if (!strcmp(arg, "--no-bvh")) { useBvh = false; continue; }
+        else if (!strcmp(arg, "--blobs")) ok = ok && (blobCount = atoi(val)) > 0 && (settings.scene = Scenes::BLOBS, true);
+        else if (!strcmp(arg, "--trace")) ok = ok && parseEnum(kTraceLabels, 7, val, settings.trace);
+        else if (!strcmp(arg, "--omega")) ok = ok && (settings.bdfOmega = float(atof(val))) >= 1.f;
+        else if (!strcmp(arg, "--hit-scale")) ok = ok && (settings.bdfHitScale = float(atof(val))) >= 1.f;
+        else if (!strcmp(arg, "--shadow")) ok = ok && parseEnum(kShadowLabels, 5, val, shadowArg), hasShadow = true;
+        else if (!strcmp(arg, "--lights")) ok = ok && (settings.lightCount = atoi(val)) > 0 && settings.lightCount <= kMaxLightCount;
+        else if (!strcmp(arg, "--softness")) ok = ok && (settings.shadowSoftness = float(atof(val))) > 0.f;
+        else if (!strcmp(arg, "--normal")) ok = ok && parseEnum(kNormalLabels, 3, val, settings.normal);
+        else if (!strcmp(arg, "--coloring")) ok = ok && uint32_t(atoi(val)) <= 3, settings.coloring = static_cast<Coloring>(ok ? atoi(val) : 0);
+        else if (!strcmp(arg, "--size")) ok = ok && sscanf(val, "%ux%u", &width, &height) == 2;
+        else if (!strcmp(arg, "--maxiter")) ok = ok && (maxIter = atoi(val)) > 0;
+        else if (!strcmp(arg, "--maxdist")) ok = ok && (maxDist = float(atof(val))) > 0.f;
+        else if (!strcmp(arg, "--eye")) ok = ok && parseFloat3(val, eye), hasEye = true;
+        else if (!strcmp(arg, "--target")) ok = ok && parseFloat3(val, target), hasTarget = true;
+        else if (!strcmp(arg, "--threads")) ok = ok && (options.threadCount = uint32_t(atoi(val)), true);
+        else if (!strcmp(arg, "--tile")) ok = ok && (options.tileSize = uint32_t(atoi(val))) > 0;
+        else if (!strcmp(arg, "--packet")) ok = ok && (options.packetWidth = uint32_t(atoi(val))) > 0;
+        else if (!strcmp(arg, "--cone")) ok = ok && (settings.coneTile = uint32_t(atoi(val))) > 0;
+        else if (!strcmp(arg, "--reproject")) ok = ok && (reprojectFrames = atoi(val)) > 0 && (settings.reprojection = true);
+        else if (!strcmp(arg, "--margin")) ok = ok && (settings.reprojectionMargin = float(atof(val))) > 0.f;
+        else if (!strcmp(arg, "--bake")) ok = ok && (bakePath = brickMapPath = val, true);
+        else if (!strcmp(arg, "--bake-lo")) ok = ok && parseFloat3(val, bakeDesc.lo) && (hasBakeLo = true);
+        else if (!strcmp(arg, "--bake-hi")) ok = ok && parseFloat3(val, bakeDesc.hi) && (hasBakeHi = true);
+        else if (!strcmp(arg, "--bake-voxel")) ok = ok && (bakeDesc.voxelSize = float(atof(val))) > 0.f;
+        else if (!strcmp(arg, "--brick-map")) ok = ok && (brickMapPath = val, true);
+        else if (!strcmp(arg, "--stats")) ok = ok && (statsPath = val, true);
+        else if (!strcmp(arg, "--out")) ok = ok && (outPath = val, true);
+        else if (!strcmp(arg, "--stream")) ok = ok && (streamDesc.bandRows = uint32_t(atoi(val))) > 0 && (stream = true);
+        else if (!strcmp(arg, "--depth")) { streamDesc.depthSteps = true; continue; }
+        else if (!strcmp(arg, "--all")) ok = ok && (allDir = val, true);
+        else if (!strcmp(arg, "--sweep")) ok = ok && (sweepPath = val, true);
+        else if (!strcmp(arg, "--sweep-dir")) ok = ok && (sweepDir = val, true);
+        else if (!strcmp(arg, "--jobs")) ok = ok && (jobs = uint32_t(atoi(val))) > 0;
+        else if (!strcmp(arg, "--workers")) ok = ok && (distributedDesc.workerCount = uint32_t(atoi(val))) > 0;
+        else if (!strcmp(arg, "--band")) ok = ok && (distributedDesc.bandRows = uint32_t(atoi(val))) > 0;
+        else if (!strcmp(arg, "--slow-worker")) ok = ok && (distributedDesc.slowWorkerMs = uint32_t(atoi(val)), true);
+        else ok = false;
+        if (!ok)
+        {
+            fprintf(stderr, "Invalid argument '%s'\n", arg);
+            printUsage();
+            return 1;
+        }
+        ++i;
+    }
+
+    if (!csgPath.empty())
+    {
+        auto program = std::make_shared<CsgProgram>();
+        std::string error;
+        if (!loadCsgScene(csgPath, *program, error))
+        {
+            fprintf(stderr, "%s\n", error.c_str());
+            return 1;
+        }
+        settings.csg = program;
+        if (useBvh)
+        {
+            auto start = std::chrono::steady_clock::now();
+            auto bvh = std::make_shared<CsgBvh>(*program);
+            double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            const CsgBvh::Stats& stats = bvh->getStats();
+            printf("BVH: %u primitives (+%u unbounded), %u nodes, depth %u, built in %.2f ms\n",
+                stats.boundedCount, stats.unboundedCount, stats.nodeCount, stats.depth, ms);
+            settings.csgBvh = bvh;
+        }
+        if (!slangPath.empty() && !(std::ofstream(slangPath) << generateCsgSlang(*program)))
+        {
+            fprintf(stderr, "Failed to write '%s'\n", slangPath.c_str());
+            return 1;
+        }
+    }
+    else if (settings.scene == Scenes::CSG || !slangPath.empty())
+    {
+        fprintf(stderr, "The CSG scene needs a scene file (--csg)\n");
+        return 1;
+    }
+
+    if (blobCount > 0)
+    {
+        auto start = std::chrono::steady_clock::now();
+        auto grid = std::make_shared<BlobGrid>(BlobGrid::randomField(uint32_t(blobCount), settings.sBlobRadius));
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        printf("Blob grid: %d blobs, %dx%dx%d cells, %zu entries, built in %.2f ms\n", blobCount,
+            grid->dims().x, grid->dims().y, grid->dims().z, grid->indices().size(), ms);
+        settings.blobGrid = grid;
+    }
+
+    if (!brickMapPath.empty() && (!sweepPath.empty() || !allDir.empty()))
+    {
+        fprintf(stderr, "A brick map belongs to one scene, --bake and --brick-map can't go with --all or --sweep\n");
+        return 1;
+    }
+
+    if (stream && (!sweepPath.empty() || !allDir.empty() || reprojectFrames > 0))
+    {
+        fprintf(stderr, "--stream renders one frame, it can't go with --all, --sweep or --reproject\n");
+        return 1;
+    }
+    const bool distributed = distributedDesc.workerCount > 0;
+    if (distributed && (stream || !allDir.empty() || reprojectFrames > 0))
+    {
+        fprintf(stderr, "--workers renders one frame or a --sweep, it can't go with --all, --stream or --reproject\n");
+        return 1;
+    }
+    if (streamDesc.depthSteps && !(stream && ImageStreamWriter::isExr(outPath)))
+    {
+        fprintf(stderr, "--depth needs --stream and an .exr --out\n");
+        return 1;
+    }
+
+    FILE* statsCsv = nullptr;
+    if (!statsPath.empty())
+    {
+        statsCsv = fopen(statsPath.c_str(), "w");
+        if (!statsCsv)
+        {
+            fprintf(stderr, "Failed to open '%s'\n", statsPath.c_str());
+            return 1;
+        }
+        writeStatsCsvHeader(statsCsv);
+    }
+
+    Renderer renderer(options);
+    auto configure = [&](Scenes scene, Tracers trace, RenderSettings& s, CameraDesc& c)
+    {
+        s.trace = trace;
+        applySceneDefaults(scene, s, c);
+        if (scene == Scenes::BLOBS && s.blobGrid)
+        {   // look at the whole field from above its front edge
+            float3 lo = s.blobGrid->origin(), size = s.blobGrid->cellSize() * float3(float(s.blobGrid->dims().x), float(s.blobGrid->dims().y), float(s.blobGrid->dims().z));
+            c.target = lo + .5f * size;
+            c.position = c.target + float3(0.f, .3f * size.x + 4.f, .6f * size.z + 8.f);
+            s.primaryMaxDist = 2.f * length(size) + 60.f;
+        }
+        if (hasShadow && scene != Scenes::BLOBS) s.shadow = shadowArg;
+        if (maxIter > 0) s.primaryMaxIter = maxIter;
+        if (maxDist > 0.f) s.primaryMaxDist = maxDist;
+        if (hasEye) c.position = eye;
+        if (hasTarget) c.target = target;
+    };
+
+    if (!sweepPath.empty())
+    {
+        SweepSpec spec;
+        std::string error;
+        if (!loadSweepSpec(sweepPath, spec, error))
+        {
+            fprintf(stderr, "%s\n", error.c_str());
+            return 1;
+        }
+        if (!settings.csg && std::find(spec.scenes.begin(), spec.scenes.end(), Scenes::CSG) != spec.scenes.end())
+        {
+            fprintf(stderr, "The CSG scene needs a scene file (--csg)\n");
+            return 1;
+        }
+        bool ok = renderSweep(spec, settings, camera, configure, options, width, height, jobs,
+            distributed ? &distributedDesc : nullptr, sweepDir, statsCsv);
+        if (statsCsv) fclose(statsCsv);
+        return ok ? 0 : 1;
+    }
+
+    if (!allDir.empty())
+    {
+        bool ok = true;
+        for (uint32_t sc = 0; sc < (settings.csg ? 8u : 7u); ++sc)
+            for (uint32_t tr = 0; tr < 7; ++tr)
+            {
+                Scenes scene = static_cast<Scenes>(sc);
+                Tracers trace = static_cast<Tracers>(tr);
+                if (!isTracerAvailable(scene, trace)) continue;
+                RenderSettings s = settings;
+                CameraDesc c = camera;
+                configure(scene, trace, s, c);
+                ok &= renderToFile(renderer, s, c, width, height, allDir + "/" + testDataString(s) + ".png", statsCsv);
+            }
+        if (statsCsv) fclose(statsCsv);
+        return ok ? 0 : 1;
+    }
+
+    Scenes scene = settings.scene;
+    if (!isTracerAvailable(scene, settings.trace))
+    {
+        fprintf(stderr, "Tracer '%s' is only available for the Blobs scene\n", kTraceLabels[static_cast<uint32_t>(settings.trace)]);
+        return 1;
+    }
+    configure(scene, settings.trace, settings, camera);
+    if (outPath.empty()) outPath = testDataString(settings) + ".png";
+    if (!bakePath.empty())
+    {
+        if (!hasBakeLo) bakeDesc.lo = camera.target - 16.f;
+        if (!hasBakeHi) bakeDesc.hi = camera.target + 16.f;
+        bakeDesc.threadCount = options.threadCount;
+        if (!bakeToFile(settings, bakeDesc, bakePath)) return 1;
+    }
+    if (!brickMapPath.empty())
+    {
+        auto start = std::chrono::steady_clock::now();
+        auto map = std::make_shared<BrickMap>();
+        std::string error;
+        if (!map->load(brickMapPath, error))
+        {
+            fprintf(stderr, "%s\n", error.c_str());
+            return 1;
+        }
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        if (strcmp(map->header().scene, kSceneLabels[uint32_t(scene)]))
+        {
+            fprintf(stderr, "'%s' was baked from the %s scene\n", brickMapPath.c_str(), map->header().scene);
+            return 1;
+        }
+        if (map->header().sceneHash != brickMapSceneHash(scene, SceneParams::fromSettings(settings)))
+        {
+            fprintf(stderr, "'%s' was baked from other parameters of the %s scene\n", brickMapPath.c_str(), map->header().scene);
+            return 1;
+        }
+        printf("Brick map '%s': %zu cells, %zu voxels, mapped in %.3f ms\n", brickMapPath.c_str(), map->cellCount(), map->voxelCount(), ms);
+        settings.brickMap = map;
+    }
+    if (distributed)
+    {
+        distributedDesc.options = options;
+        if (distributedDesc.options.threadCount == 0) distributedDesc.options.threadCount = 1;
+    }
+    bool ok = distributed ? renderDistributedToFile(settings, camera, width, height, distributedDesc, outPath, statsCsv)
+        : stream ? renderStreamedToFile(renderer, settings, camera, width, height, outPath, streamDesc, statsCsv)
+        : reprojectFrames > 0
+        ? renderReprojected(renderer, settings, camera, width, height, uint32_t(reprojectFrames), outPath, statsCsv)
+        : renderToFile(renderer, settings, camera, width, height, outPath, statsCsv);
+    if (statsCsv) fclose(statsCsv);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,129 @@
+// Benchmark of the gridded blob field (BlobGrid) on random fields of 100 to 100k blobs at constant density. For each
+// count it reports the grid build time and shape, ns per field, KSegment (one radius long) and bdf query on the
+// points bdf_trace visits, and the mean steps per ray of segment_trace and bdf_trace. With the grid the cost of a
+// query should not depend on the number of blobs.
+
+#include "bench_common.h"
+#include "scenes.h"
+#include "tracers.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace bdf;
+
+namespace
+{
+    // Rays from above the front edge of the field towards random points of it.
+    std::vector<Ray> fieldRays(const BlobGrid& grid, uint32_t count, uint32_t seed)
+    {
+        std::mt19937 rng(seed);
+        std::uniform_real_distribution<float> u(0.f, 1.f);
+        float3 size = grid.cellSize() * float3(float(grid.dims().x), float(grid.dims().y), float(grid.dims().z));
+        float3 center = grid.origin() + .5f * size;
+        float3 eye = center + float3(0.f, .3f * size.x + 4.f, .6f * size.z + 8.f);
+        std::vector<Ray> rays(count);
+        for (Ray& r : rays)
+        {
+            float3 target = grid.origin() + float3(u(rng) * size.x, u(rng) * size.y, u(rng) * size.z);
+            r = { eye, 0.f, normalize(target - eye), 0.f };
+        }
+        return rays;
+    }
+
+    // Forwards to the scene and records the points a tracer evaluates.
+    struct RecordingScene
+    {
+        const Scene<Scenes::BLOBS>& scene;
+        std::vector<float3>& pts;
+
+        float bdf(float3 p) const
+        {
+            pts.push_back(p);
+            return scene.bdf(p);
+        }
+    };
+
+    void printUsage()
+    {
+        printf(
+            "Usage: bdf_bench_blobs [options]\n"
+            "  --sizes <n,n,...>  blob counts (default 100,1000,10000,100000)\n"
+            "  --min-time <ms>    measuring time per configuration (default 200)\n"
+            "  --csv <file>       also write the results as CSV\n");
+    }
+}
+
+int main(int argc, char** argv)
+{
+    std::vector<uint32_t> sizes = { 100, 1000, 10000, 100000 };
+    std::string csvPath;
+    double minMs = 200.;
+    for (int i = 1; i < argc; ++i)
+    {
+        const char* val = i + 1 < argc ? argv[i + 1] : nullptr;
+        if (!strcmp(argv[i], "--sizes") && val)
+        {
+            sizes = parseList<uint32_t>(val);
+            ++i;
+        }
+        else if (!strcmp(argv[i], "--min-time") && val) minMs = atof(val), ++i;
+        else if (!strcmp(argv[i], "--csv") && val) csvPath = val, ++i;
+        else
+        {
+            printUsage();
+            return strcmp(argv[i], "--help") ? 1 : 0;
+        }
+    }
+
+    FILE* csv = nullptr;
+    if (!openBenchCsv(csvPath, "blobs,build_ms,cells,entries,field_ns,ksegment_ns,bdblobs_ns,segment_steps,bdf_steps", csv)) return 1;
+
+    printf("%8s %9s %9s %9s | %9s %11s %10s | %13s %10s\n", "blobs", "build ms", "cells", "entries",
+        "field ns", "KSegment ns", "bdBlobs ns", "segment steps", "bdf steps");
+    const float radius = 4.f, T = .5f, eps = 1e-3f;
+    for (uint32_t count : sizes)
+    {
+        if (count == 0) continue;
+        auto start = Clock::now();
+        BlobGrid grid(BlobGrid::randomField(count, radius));
+        double buildMs = elapsedMs(start);
+        SceneParams params;
+        params.blobs.radius = radius;
+        params.blobs.T = T;
+        params.blobs.grid = &grid;
+        const Scene<Scenes::BLOBS> scene{ params };
+        const float tMax = 2.f * grid.cellSize() * length(float3(float(grid.dims().x), float(grid.dims().y), float(grid.dims().z))) + 60.f;
+
+        // trace the rays, keeping the points bdf_trace evaluates
+        std::vector<Ray> rays = fieldRays(grid, 1024, 3);
+        std::vector<float3> pts, segEnd;
+        RecordingScene recorder = { scene, pts };
+        uint64_t segmentSteps = 0, bdfSteps = 0;
+        for (Ray r : rays)
+        {
+            r.Tmax = tMax;
+            segmentSteps += uint64_t(segment_trace(scene, r, { eps, 512 }, eps).steps);
+            bdfSteps += uint64_t(bdf_trace(recorder, r, { eps, 512 }).steps);
+        }
+        for (size_t i = 0; i < pts.size(); ++i)
+            segEnd.push_back(pts[i] + float3(0.f, 0.f, radius));
+
+        double fieldNs = measureCycling(pts.size(), minMs, [&](size_t i) { return grid.Field(pts[i]); });
+        double kNs = measureCycling(pts.size(), minMs, [&](size_t i) { return grid.KSegment(pts[i], segEnd[i]); });
+        double bdNs = measureCycling(pts.size(), minMs, [&](size_t i) { return scene.bdf(pts[i]); });
+        double segmentMean = double(segmentSteps) / double(rays.size()), bdfMean = double(bdfSteps) / double(rays.size());
+        printf("%8u %9.2f %9zu %9zu | %9.1f %11.1f %10.1f | %13.1f %10.1f\n", count, buildMs, grid.cells().size(),
+            grid.indices().size(), fieldNs, kNs, bdNs, segmentMean, bdfMean);
+        if (csv)
+            fprintf(csv, "%u,%.3f,%zu,%zu,%.2f,%.2f,%.2f,%.2f,%.2f\n", count, buildMs, grid.cells().size(),
+                grid.indices().size(), fieldNs, kNs, bdNs, segmentMean, bdfMean);
+    }
+    if (csv) fclose(csv);
+    return 0;
+}
@@ -0,0 +1,199 @@
+// Benchmark of the CSG BVH against the linear evaluation of CsgProgram on random scenes of 1k, 10k and 100k
+// primitives. For each size it reports the build time and tree shape, ns per bdf query on random points and on
+// the points a bdf_trace visits, the speedup, and the largest difference to the linear result (expected 0).
+// With --check it instead compares the BVH's bdf and sdf with the linear ones on random points near and far from
+// scenes of each primitive type, and fails on any difference.
+
+#include "bench_common.h"
+#include "csg_bvh.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace bdf;
+
+namespace
+{
+    const char* kPrimitiveTypes[5] = { "sphere", "box", "cylinder", "torus", "cone" };
+
+    // Randomly placed and rotated primitives at constant density, on a ground plane. type is an index into
+    // kPrimitiveTypes, -1 cycles through the bounded ones.
+    std::string randomScene(uint32_t count, float halfSize, uint32_t seed, int type = -1)
+    {
+        std::mt19937 rng(seed);
+        std::uniform_real_distribution<float> pos(-halfSize, halfSize), size(.1f, .4f), unit(-1.f, 1.f), angle(0.f, 180.f);
+        std::string text = "plane 0 1 0\n";
+        char buf[256];
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            snprintf(buf, sizeof(buf), "translate %g %g %g { rotate %g %g %g %g { ", pos(rng), std::abs(pos(rng)) + .5f, pos(rng),
+                unit(rng), unit(rng), unit(rng) + 1.5f, angle(rng));
+            text += buf;
+            switch (type < 0 ? int(i % 4) : type)
+            {
+            case 0: snprintf(buf, sizeof(buf), "sphere %g", size(rng)); break;
+            case 1: snprintf(buf, sizeof(buf), "box %g %g %g", size(rng), size(rng), size(rng)); break;
+            case 2: snprintf(buf, sizeof(buf), "cylinder %g %g", size(rng), size(rng)); break;
+            case 3: snprintf(buf, sizeof(buf), "torus %g %g", size(rng), .3f * size(rng)); break;
+            default: snprintf(buf, sizeof(buf), "cone %g", size(rng)); break;
+            }
+            text += buf;
+            text += " } }\n";
+        }
+        return text;
+    }
+
+    // Points visited by bdf_trace for rays from outside the scene towards its center.
+    std::vector<float3> marchPoints(const CsgBvh& bvh, float halfSize, uint32_t maxPoints, uint32_t seed)
+    {
+        std::vector<float3> pts;
+        std::mt19937 rng(seed);
+        std::uniform_real_distribution<float> u(-1.f, 1.f);
+        const float3 eye = float3(1.5f * halfSize, halfSize, 1.5f * halfSize);
+        while (pts.size() < maxPoints)
+        {
+            float3 target = float3(.7f * halfSize * u(rng), .2f * halfSize * (u(rng) + 1.f), .7f * halfSize * u(rng));
+            float3 v = normalize(target - eye);
+            float T = 0.f;
+            for (int i = 0; i < 256 && pts.size() < maxPoints; ++i)
+            {
+                float3 p = eye + T * v;
+                pts.push_back(p);
+                float d = bvh.bdf(p);
+                T += d;
+                if (std::abs(d) <= 1e-3f * T || T > 10.f * halfSize) break;
+            }
+        }
+        return pts;
+    }
+
+    // Largest |bvh - linear| of bdf and sdf for each primitive type, on random points of a box four times the size
+    // of the scene, where most boxes are far away and culled. Returns the number of types that differ.
+    int check(uint32_t count)
+    {
+        int failed = 0;
+        for (int type = 0; type < 5; ++type)
+        {
+            const float halfSize = 2.f * std::cbrt(float(count));
+            CsgProgram program;
+            std::string error;
+            if (!parseCsgScene(randomScene(count, halfSize, 42 + type, type), program, error))
+            {
+                fprintf(stderr, "%s\n", error.c_str());
+                return 1;
+            }
+            CsgBvh bvh(program);
+            std::mt19937 rng(13);
+            std::uniform_real_distribution<float> u(-4.f * halfSize, 4.f * halfSize);
+            float maxBdf = 0.f, maxSdf = 0.f;
+            for (uint32_t i = 0; i < 20000; ++i)
+            {
+                float3 p = float3(u(rng), std::abs(u(rng)), u(rng));
+                maxBdf = std::max(maxBdf, std::abs(bvh.bdf(p) - program.bdf(p)));
+                maxSdf = std::max(maxSdf, std::abs(bvh.sdf(p) - program.sdf(p)));
+            }
+            printf("%-8s %8u | bdf max diff %-10g sdf max diff %g\n", kPrimitiveTypes[type], count, maxBdf, maxSdf);
+            failed += maxBdf != 0.f || maxSdf != 0.f;
+        }
+        return failed;
+    }
+
+    void printUsage()
+    {
+        printf(
+            "Usage: bdf_bench_bvh [options]\n"
+            "  --sizes <n,n,...>  primitive counts (default 1000,10000,100000, with --check 1000,10000)\n"
+            "  --min-time <ms>    measuring time per configuration (default 200)\n"
+            "  --csv <file>       also write the results as CSV\n"
+            "  --check            compare with the linear evaluation per primitive type instead of measuring\n");
+    }
+}
+
+int main(int argc, char** argv)
+{
+    std::vector<uint32_t> sizes = { 1000, 10000, 100000 };
+    std::string csvPath;
+    double minMs = 200.;
+    bool checkOnly = false, sizesGiven = false;
+    for (int i = 1; i < argc; ++i)
+    {
+        const char* val = i + 1 < argc ? argv[i + 1] : nullptr;
+        if (!strcmp(argv[i], "--sizes") && val)
+        {
+            sizes = parseList<uint32_t>(val);
+            sizesGiven = true;
+            ++i;
+        }
+        else if (!strcmp(argv[i], "--min-time") && val) minMs = atof(val), ++i;
+        else if (!strcmp(argv[i], "--csv") && val) csvPath = val, ++i;
+        else if (!strcmp(argv[i], "--check")) checkOnly = true;
+        else
+        {
+            printUsage();
+            return strcmp(argv[i], "--help") ? 1 : 0;
+        }
+    }
+
+    if (checkOnly)
+    {
+        if (!sizesGiven) sizes = { 1000, 10000 };
+        int failed = 0;
+        for (uint32_t count : sizes)
+            if (count) failed += check(count);
+        return failed ? 1 : 0;
+    }
+
+    FILE* csv = nullptr;
+    if (!openBenchCsv(csvPath, "primitives,build_ms,nodes,depth,distribution,linear_ns,bvh_ns,speedup,max_diff", csv)) return 1;
+
+    printf("%10s %10s %8s %6s | %-12s %14s %14s %9s %10s\n", "primitives", "build ms", "nodes", "depth",
+        "points", "linear ns/q", "bvh ns/q", "speedup", "max diff");
+    for (uint32_t count : sizes)
+    {
+        if (count == 0) continue;
+        const float halfSize = 2.f * std::cbrt(float(count));
+        CsgProgram program;
+        std::string error;
+        if (!parseCsgScene(randomScene(count, halfSize, 42), program, error))
+        {
+            fprintf(stderr, "%s\n", error.c_str());
+            return 1;
+        }
+
+        auto start = Clock::now();
+        CsgBvh bvh(program);
+        double buildMs = elapsedMs(start);
+        const CsgBvh::Stats& stats = bvh.getStats();
+
+        std::vector<float3> pts[2];
+        std::mt19937 rng(7);
+        std::uniform_real_distribution<float> u(-halfSize, halfSize);
+        for (uint32_t i = 0; i < 4096; ++i) pts[0].push_back(float3(u(rng), std::abs(u(rng)), u(rng)));
+        pts[1] = marchPoints(bvh, halfSize, 4096, 11);
+        const char* labels[2] = { "random", "bdf_trace" };
+
+        for (int set = 0; set < 2; ++set)
+        {
+            float maxDiff = 0.f;
+            for (uint32_t i = 0; i < 256; ++i)
+            {
+                float3 p = pts[set][i * pts[set].size() / 256];
+                maxDiff = std::max(maxDiff, std::abs(bvh.bdf(p) - program.bdf(p)));
+            }
+            double linearNs = measureCycling(pts[set].size(), minMs, [&](size_t i) { return program.bdf(pts[set][i]); });
+            double bvhNs = measureCycling(pts[set].size(), minMs, [&](size_t i) { return bvh.bdf(pts[set][i]); });
+            printf("%10u %10.2f %8u %6u | %-12s %14.1f %14.1f %8.1fx %10g\n", count, buildMs, stats.nodeCount, stats.depth,
+                labels[set], linearNs, bvhNs, linearNs / bvhNs, maxDiff);
+            if (csv)
+                fprintf(csv, "%u,%.3f,%u,%u,%s,%.2f,%.2f,%.2f,%g\n", count, buildMs, stats.nodeCount, stats.depth,
+                    labels[set], linearNs, bvhNs, linearNs / bvhNs, maxDiff);
+        }
+    }
+    if (csv) fclose(csv);
+    return 0;
+}
@@ -0,0 +1,144 @@
+#pragma once
+
+// Shared parts of the bdf_bench_* programs: timing loops, option lists, the --csg scene and --csv file, and the
+// primary rays of the GUI's camera pose of a scene.
+
+#include "camera.h"
+#include "csg_bvh.h"
+#include "csg_scene.h"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace bdf
+{
+    using Clock = std::chrono::steady_clock;
+
+    inline double elapsedMs(Clock::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    }
+
+    inline volatile float gSink;
+
+    inline float sinkValue(float v) { return v; }
+    inline float sinkValue(float3 v) { return v.x + v.y + v.z; }
+
+    // Calls pass, which handles perPass items and returns a value, until minMs has passed and returns ns per item.
+    // One pass warms up first. The values are summed into gSink, so that the work is not optimized away.
+    template <class Pass>
+    double measurePasses(size_t perPass, double minMs, Pass pass)
+    {
+        float acc = pass();
+        uint64_t items = 0;
+        auto start = Clock::now();
+        double ms = 0.;
+        do
+        {
+            acc += pass();
+            items += perPass;
+            ms = elapsedMs(start);
+        } while (ms < minMs);
+        gSink = acc;
+        return ms * 1e6 / double(items);
+    }
+
+    // measurePasses over the points, calling fn on each
+    template <class Fn>
+    double measure(const std::vector<float3>& pts, double minMs, Fn fn)
+    {
+        return measurePasses(pts.size(), minMs, [&]
+        {
+            float acc = 0.f;
+            for (float3 p : pts) acc += sinkValue(fn(p));
+            return acc;
+        });
+    }
+
+    // Calls fn on the indices 0..n-1, cycling and reading the clock every 16 calls, until minMs has passed and returns
+    // ns per call. For calls too slow to make whole passes over the items.
+    template <class Fn>
+    double measureCycling(size_t n, double minMs, Fn fn)
+    {
+        uint64_t evals = 0;
+        float acc = 0.f;
+        auto start = Clock::now();
+        double ms = 0.;
+        do
+        {
+            for (uint32_t i = 0; i < 16; ++i, ++evals)
+                acc += fn(size_t(evals % n));
+            ms = elapsedMs(start);
+        } while (ms < minMs);
+        gSink = acc;
+        return ms * 1e6 / double(evals);
+    }
+
+    // "a,b,c" as numbers
+    template <class T>
+    std::vector<T> parseList(const char* s)
+    {
+        std::vector<T> v;
+        for (const char* c = s; *c; ++c)
+            if (c == s || c[-1] == ',') v.push_back(T(atof(c)));
+        return v;
+    }
+
+    // Loads the CSG scene file into settings.csg and builds its BVH into settings.csgBvh; prints the error and returns
+    // false on failure.
+    inline bool loadBenchCsg(const std::string& path, RenderSettings& settings)
+    {
+        auto program = std::make_shared<CsgProgram>();
+        std::string error;
+        if (!loadCsgScene(path, *program, error))
+        {
+            fprintf(stderr, "%s\n", error.c_str());
+            return false;
+        }
+        settings.csg = program;
+        settings.csgBvh = std::make_shared<CsgBvh>(*program);
+        return true;
+    }
+
+    // Opens the --csv file and writes its header line; csv stays null for an empty path. Prints the error and returns
+    // false on failure.
+    inline bool openBenchCsv(const std::string& path, const char* header, FILE*& csv)
+    {
+        csv = nullptr;
+        if (path.empty()) return true;
+        csv = fopen(path.c_str(), "w");
+        if (!csv)
+        {
+            fprintf(stderr, "Failed to open '%s'\n", path.c_str());
+            return false;
+        }
+        fprintf(csv, "%s\n", header);
+        return true;
+    }
+
+    // Pixel cone of a width x height image, the primary epsilon of the shader
+    inline float pixelTan(uint32_t width, uint32_t height)
+    {
+        return 1.f / length(float2(float(width), float(height)));
+    }
+
+    // Applies the defaults of the scene to settings and returns its primary rays at width x height in scanline order.
+    inline std::vector<Ray> primaryRays(Scenes scene, RenderSettings& settings, uint32_t width, uint32_t height)
+    {
+        CameraDesc camera;
+        applySceneDefaults(scene, settings, camera);
+        const float2 iResolution = float2(float(width), float(height));
+        const CameraData cam = CameraData::create(camera, iResolution.x / iResolution.y);
+        std::vector<Ray> rays;
+        rays.reserve(size_t(width) * height);
+        for (uint32_t y = 0; y < height; ++y)
+            for (uint32_t x = 0; x < width; ++x)
+                rays.push_back(getCameraRay(cam, float2(float(x) + .5f, float(y) + .5f), iResolution, settings.primaryMaxDist));
+        return rays;
+    }
+}
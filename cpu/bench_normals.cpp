@@ -0,0 +1,122 @@
+// Cost and accuracy of the shading normals: central differences (6 sdf calls), tetrahedral differences (4 calls)
+// and the analytic gradient of the scene's sdg (1 call). The points are the primary hits of sdf_trace from the GUI's
+// camera pose of each scene. The error is the angle to central differences with a step of 1e-3 instead of the
+// shader's 1e-2, so near creases and edges all three disagree with it.
+
+#include "bench_common.h"
+#include "scenes.h"
+#include "tracers.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <type_traits>
+
+using namespace bdf;
+
+namespace
+{
+    template <class SceneT>
+    float3 fineNormal(const SceneT& scene, float3 p)
+    {
+        const float h = 1e-3f;
+        return normalize(float3(scene.sdf(p + float3(h, 0, 0)) - scene.sdf(p - float3(h, 0, 0)),
+                                scene.sdf(p + float3(0, h, 0)) - scene.sdf(p - float3(0, h, 0)),
+                                scene.sdf(p + float3(0, 0, h)) - scene.sdf(p - float3(0, 0, h))));
+    }
+
+    void printUsage()
+    {
+        printf(
+            "Usage: bdf_bench_normals [options]\n"
+            "  --size <w>x<h>      rays per scene (default 640x360)\n"
+            "  --min-time <ms>     measuring time per normal method (default 200)\n"
+            "  --csg <file>        also measure a CSG scene file\n"
+            "  --csv <file>        also write the results as CSV\n");
+    }
+}
+
+int main(int argc, char** argv)
+{
+    uint32_t width = 640, height = 360;
+    double minMs = 200.;
+    std::string csvPath, csgPath;
+    for (int i = 1; i < argc; ++i)
+    {
+        const char* val = i + 1 < argc ? argv[i + 1] : nullptr;
+        bool ok = val != nullptr;
+        if (!strcmp(argv[i], "--size")) ok = ok && sscanf(val, "%ux%u", &width, &height) == 2;
+        else if (!strcmp(argv[i], "--min-time")) ok = ok && (minMs = atof(val)) > 0.;
+        else if (!strcmp(argv[i], "--csg")) ok = ok && (csgPath = val, true);
+        else if (!strcmp(argv[i], "--csv")) ok = ok && (csvPath = val, true);
+        else ok = false;
+        if (!ok)
+        {
+            printUsage();
+            return strcmp(argv[i], "--help") ? 1 : 0;
+        }
+        ++i;
+    }
+
+    std::vector<Scenes> scenes = { Scenes::PRIMITIVES, Scenes::SPHERE, Scenes::BOX, Scenes::CYLINDER, Scenes::TORUS, Scenes::BLOBS };
+    RenderSettings base;
+    if (!csgPath.empty())
+    {
+        if (!loadBenchCsg(csgPath, base)) return 1;
+        scenes.push_back(Scenes::CSG);
+    }
+
+    FILE* csv;
+    if (!openBenchCsv(csvPath, "scene,normal,points,ns,mean_deg,p99_deg,max_deg", csv)) return 1;
+
+    printf("%-10s %-18s %7s | %8s %7s | %9s %9s %9s\n", "scene", "normal", "points", "ns", "speedup", "mean deg", "p99 deg", "max deg");
+    const float tanPix = pixelTan(width, height);
+    for (Scenes sceneID : scenes)
+    {
+        RenderSettings settings = base;
+        const std::vector<Ray> rays = primaryRays(sceneID, settings, width, height);
+        const SphereTraceDesc desc = { tanPix, settings.primaryMaxIter };
+
+        dispatchScene(sceneID, SceneParams::fromSettings(settings), [&](const auto& scene)
+        {
+            std::vector<float3> pts;
+            for (const Ray& ray : rays)
+            {
+                TraceResult r = sdf_trace(scene, ray, desc);
+                if ((r.flags & 3) == 2) pts.push_back(ray.P + r.T * ray.V);
+            }
+            if (pts.empty()) return 0;
+
+            // called through pointers, so that each method is compiled (and its sdf calls inlined) on its own
+            using SceneT = std::decay_t<decltype(scene)>;
+            float3 (*const volatile methods[3])(const SceneT&, float3) = { &normal_central<SceneT>, &normal_tetrahedral<SceneT>,
+                &normal_analytic<SceneT> };
+            double centralNs = 0.;
+            for (uint32_t n = 0; n < 3; ++n)
+            {
+                const Normals id = Normals(n);
+                double ns = measure(pts, minMs, [&](float3 p) { return methods[n](scene, p); });
+                if (id == Normals::CENTRAL) centralNs = ns;
+                std::vector<float> errors(pts.size());
+                double sum = 0.;
+                for (size_t i = 0; i < pts.size(); ++i)
+                {
+                    float c = clamp(dot(normal(id, scene, pts[i]), fineNormal(scene, pts[i])), -1.f, 1.f);
+                    sum += errors[i] = std::acos(c) * 180.f / 3.14159265f;
+                }
+                float maxError = *std::max_element(errors.begin(), errors.end());
+                std::nth_element(errors.begin(), errors.begin() + errors.size() * 99 / 100, errors.end());
+                float p99 = errors[errors.size() * 99 / 100];
+                double mean = sum / double(pts.size());
+                printf("%-10s %-18s %7zu | %8.1f %6.2fx | %9.4f %9.4f %9.3f\n", kSceneLabels[uint32_t(sceneID)], kNormalLabels[n],
+                    pts.size(), ns, centralNs / ns, mean, p99, maxError);
+                if (csv)
+                    fprintf(csv, "%s,%s,%zu,%.2f,%.5f,%.5f,%.4f\n", kSceneLabels[uint32_t(sceneID)], kNormalLabels[n], pts.size(),
+                        ns, mean, p99, maxError);
+            }
+            return 0;
+        });
+    }
+    if (csv) fclose(csv);
+    return 0;
+}
@@ -0,0 +1,215 @@
+// The templated primitives in each number type of number_types.h. For every primitive it reports ns per evaluation
+// in float, Interval (a box of side 0.1) and Dual; for intervals the mean width and the sampled points of the box
+// whose value fell outside it (expected 0), for duals the largest distance of the gradient to the analytic sdg
+// (sd primitives and Vertex). Then interval_segment_trace is compared with bdf_trace on the primary rays of the
+// GUI's camera pose of each scene: steps per ray, time, rays whose hit/miss changed and the hit distance error
+// in epsilons, as in bdf_bench_tracers.
+
+#include "bench_common.h"
+#include "scenes.h"
+#include "tracers.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <random>
+
+using namespace bdf;
+
+namespace
+{
+    const float kHalfBox = .05f;
+
+    struct Primitive
+    {
+        std::string name;
+        std::function<double(const std::vector<float3>&, double)> floatNs, intervalNs, dualNs;
+        std::function<float(float3)> value;
+        std::function<Interval(float3)> bound;      // over the box of half side kHalfBox around the point
+        std::function<float3(float3)> dualGradient;
+        std::function<float3(float3)> reference;    // analytic gradient, or null
+    };
+
+    // The primitive is passed as a generic lambda and instantiated for each number type.
+    template <class Fn>
+    Primitive makePrimitive(const char* name, Fn fn, std::function<float3(float3)> reference = nullptr)
+    {
+        Primitive prim;
+        prim.name = name;
+        prim.floatNs = [fn](const std::vector<float3>& pts, double minMs) { return measure(pts, minMs, [fn](float3 p) { return fn(p); }); };
+        prim.intervalNs = [fn](const std::vector<float3>& pts, double minMs)
+        {
+            return measure(pts, minMs, [fn](float3 p) { return fn(intervalBox(p - float3(kHalfBox), p + float3(kHalfBox))).lo; });
+        };
+        prim.dualNs = [fn](const std::vector<float3>& pts, double minMs) { return measure(pts, minMs, [fn](float3 p) { return fn(dualPoint(p)).d.x; }); };
+        prim.value = [fn](float3 p) { return fn(p); };
+        prim.bound = [fn](float3 p) { return fn(intervalBox(p - float3(kHalfBox), p + float3(kHalfBox))); };
+        prim.dualGradient = [fn](float3 p) { return fn(dualPoint(p)).d; };
+        prim.reference = reference;
+        return prim;
+    }
+
+    std::vector<Primitive> primitives()
+    {
+        const float3 kBox = float3(1.f, .5f, .75f), kPlane = float3(0, 1, 0);
+        const float kSphere = 1.4f, kCone = .3f, kCylR = 1.5f, kCylH = 1.f;
+        const float2 kTorus = float2(1.f, .5f);
+        const float3 kCenter = float3(.5f, -.25f, 0.f);
+        const float kRadius = 2.f;
+        return {
+            makePrimitive("sdSphere", [=](const auto& p) { return sdSphere(p, kSphere); }, [=](float3 p) { return sdgSphere(p, kSphere).xyz(); }),
+            makePrimitive("bdSphere", [=](const auto& p) { return bdSphere(p, kSphere); }),
+            makePrimitive("sdBox", [=](const auto& p) { return sdBox(p, kBox); }, [=](float3 p) { return sdgBox(p, kBox).xyz(); }),
+            makePrimitive("bdBox", [=](const auto& p) { return bdBox(p, kBox); }),
+            makePrimitive("sdCylinder", [=](const auto& p) { return sdCylinder(p, kCylR, kCylH); },
+                [=](float3 p) { return sdgCylinder(p, kCylR, kCylH).xyz(); }),
+            makePrimitive("bdCylinder", [=](const auto& p) { return bdCylinder(p, kCylR, kCylH); }),
+            makePrimitive("sdTorus", [=](const auto& p) { return sdTorus(p, kTorus); }, [=](float3 p) { return sdgTorus(p, kTorus).xyz(); }),
+            makePrimitive("bdTorus", [=](const auto& p) { return bdTorus(p, kTorus); }),
+            makePrimitive("sdCone", [=](const auto& p) { return sdCone(p, kCone); }, [=](float3 p) { return sdgCone(p, kCone).xyz(); }),
+            makePrimitive("bdCone", [=](const auto& p) { return bdCone(p, kCone); }),
+            makePrimitive("sdPlane", [=](const auto& p) { return sdPlane(p, kPlane); }, [=](float3 p) { return sdgPlane(p, kPlane).xyz(); }),
+            makePrimitive("bdPlane", [=](const auto& p) { return bdPlane(p, kPlane); }),
+            makePrimitive("Vertex", [=](const auto& p) { return Vertex(p, kCenter, kRadius, 1.f); },
+                [=](float3 p) { return VertexGradient(p, kCenter, kRadius, 1.f).xyz(); }),
+        };
+    }
+
+    void printUsage()
+    {
+        printf(
+            "Usage: bdf_bench_number_types [options]\n"
+            "  --size <w>x<h>      rays per scene (default 320x180)\n"
+            "  --kappa <f>         segment growth factor of interval_segment_trace (default 2)\n"
+            "  --min-time <ms>     measuring time per primitive and number type (default 100)\n"
+            "  --csg <file>        also trace a CSG scene file\n"
+            "  --csv <file>        also write the primitive results as CSV\n");
+    }
+}
+
+int main(int argc, char** argv)
+{
+    uint32_t width = 320, height = 180;
+    float kappa = 2.f;
+    double minMs = 100.;
+    std::string csvPath, csgPath;
+    for (int i = 1; i < argc; ++i)
+    {
+        const char* val = i + 1 < argc ? argv[i + 1] : nullptr;
+        bool ok = val != nullptr;
+        if (!strcmp(argv[i], "--size")) ok = ok && sscanf(val, "%ux%u", &width, &height) == 2;
+        else if (!strcmp(argv[i], "--kappa")) ok = ok && (kappa = float(atof(val))) > 1.f;
+        else if (!strcmp(argv[i], "--min-time")) ok = ok && (minMs = atof(val)) > 0.;
+        else if (!strcmp(argv[i], "--csg")) ok = ok && (csgPath = val, true);
+        else if (!strcmp(argv[i], "--csv")) ok = ok && (csvPath = val, true);
+        else ok = false;
+        if (!ok)
+        {
+            printUsage();
+            return strcmp(argv[i], "--help") ? 1 : 0;
+        }
+        ++i;
+    }
+
+    FILE* csv;
+    if (!openBenchCsv(csvPath, "primitive,float_ns,interval_ns,dual_ns,interval_width,outside,gradient_error", csv)) return 1;
+
+    // primitives on random points in [-3,3]^3
+    std::mt19937 rng(1234);
+    std::uniform_real_distribution<float> u(-3.f, 3.f), v(-kHalfBox, kHalfBox);
+    std::vector<float3> pts(4096);
+    for (float3& p : pts) p = float3(u(rng), u(rng), u(rng));
+
+    printf("%-10s | %8s %11s %8s | %14s %7s | %13s\n", "primitive", "float ns", "interval ns", "dual ns", "interval width",
+        "outside", "max grad err");
+    for (const Primitive& prim : primitives())
+    {
+        double floatNs = prim.floatNs(pts, minMs), intervalNs = prim.intervalNs(pts, minMs), dualNs = prim.dualNs(pts, minMs);
+        double width = 0.;
+        uint64_t outside = 0;
+        float gradientError = 0.f;
+        for (float3 p : pts)
+        {
+            Interval b = prim.bound(p);
+            width += double(b.hi - b.lo);
+            for (int s = 0; s < 16; ++s)
+            {
+                float d = prim.value(p + float3(v(rng), v(rng), v(rng)));
+                const float tolerance = 1e-5f * (1.f + std::abs(d));
+                outside += d < b.lo - tolerance || d > b.hi + tolerance;
+            }
+            if (prim.reference) gradientError = std::max(gradientError, length(prim.dualGradient(p) - prim.reference(p)));
+        }
+        width /= double(pts.size());
+        if (prim.reference)
+            printf("%-10s | %8.2f %11.2f %8.2f | %14.4f %7llu | %13.2e\n", prim.name.c_str(), floatNs, intervalNs, dualNs, width,
+                (unsigned long long)outside, gradientError);
+        else
+            printf("%-10s | %8.2f %11.2f %8.2f | %14.4f %7llu | %13s\n", prim.name.c_str(), floatNs, intervalNs, dualNs, width,
+                (unsigned long long)outside, "-");
+        if (csv)
+            fprintf(csv, "%s,%.3f,%.3f,%.3f,%.5f,%llu,%.3e\n", prim.name.c_str(), floatNs, intervalNs, dualNs, width,
+                (unsigned long long)outside, prim.reference ? gradientError : 0.f);
+    }
+    if (csv) fclose(csv);
+
+    // interval_segment_trace against bdf_trace
+    std::vector<Scenes> scenes = { Scenes::PRIMITIVES, Scenes::SPHERE, Scenes::BOX, Scenes::CYLINDER, Scenes::TORUS, Scenes::BLOBS };
+    RenderSettings base;
+    if (!csgPath.empty())
+    {
+        if (!loadBenchCsg(csgPath, base)) return 1;
+        scenes.push_back(Scenes::CSG);
+    }
+
+    printf("\n%-10s %-22s | %9s %8s | %8s %8s %8s\n", "scene", "tracer", "steps/ray", "ms", "hit chg", "mean err", "p99 err");
+    const float tanPix = pixelTan(width, height);
+    for (Scenes sceneID : scenes)
+    {
+        RenderSettings settings = base;
+        const std::vector<Ray> rays = primaryRays(sceneID, settings, width, height);
+        const SphereTraceDesc desc = { tanPix, settings.primaryMaxIter };
+
+        dispatchScene(sceneID, SceneParams::fromSettings(settings), [&](const auto& scene)
+        {
+            using Tracer = std::function<TraceResult(const Ray&)>;
+            const std::pair<const char*, Tracer> tracers[] = {
+                { "bdf_trace", [&](const Ray& r) { return bdf_trace(scene, r, desc); } },
+                { "interval_segment_trace", [&](const Ray& r) { return interval_segment_trace(scene, r, desc, kappa); } },
+            };
+            std::vector<TraceResult> reference;
+            for (const auto& tracer : tracers)
+            {
+                std::vector<TraceResult> results(rays.size());
+                uint64_t steps = 0, changed = 0;
+                auto start = Clock::now();
+                for (size_t i = 0; i < rays.size(); ++i)
+                    steps += uint64_t((results[i] = tracer.second(rays[i])).steps);
+                double ms = elapsedMs(start);
+                if (reference.empty()) reference = results;
+
+                std::vector<float> errors;
+                for (size_t i = 0; i < rays.size(); ++i)
+                {
+                    const TraceResult &a = results[i], &b = reference[i];
+                    bool hitA = (a.flags & 3) == 2, hitB = (b.flags & 3) == 2;  // shaded as a hit
+                    if (hitA != hitB) ++changed;
+                    else if (hitA) errors.push_back(std::abs(a.T - b.T) / (tanPix * b.T));
+                }
+                double mean = 0., p99 = 0.;
+                if (!errors.empty())
+                {
+                    for (float e : errors) mean += e;
+                    mean /= double(errors.size());
+                    std::nth_element(errors.begin(), errors.begin() + errors.size() * 99 / 100, errors.end());
+                    p99 = errors[errors.size() * 99 / 100];
+                }
+                printf("%-10s %-22s | %9.2f %8.1f | %7.3f%% %8.3f %8.3f\n", kSceneLabels[uint32_t(sceneID)], tracer.first,
+                    double(steps) / double(rays.size()), ms, 100. * double(changed) / double(rays.size()), mean, p99);
+            }
+            return 0;
+        });
+    }
+    return 0;
+}
@@ -0,0 +1,298 @@
+// Microbenchmark of the sd* and bd* primitives (including every bdBox variant and the ray packet instantiations).
+// For each primitive and point distribution it reports ns/eval and Mevals/s; the divergence column is the
+// cost on random points relative to coherent ones, i.e. how much the primitive suffers from unpredictable
+// branches (scalar) or mixed lanes (packets).
+// With --check it instead traces random rays against each primitive with bdf_trace_packet and the scalar bdf_trace
+// and fails if any lane's flags differ, its steps by more than one or its T by more than the hit tolerance. The
+// scalar and the vector code contract different operations into FMAs, which near grazing hits (cancellation in
+// d2 - s * s) moves T by a few 1e-4 and can end a march one step apart.
+
+#include "bdf_primitives.h"
+#include "bench_common.h"
+#include "sdf_primitives.h"
+#include "tracers_simd.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace bdf;
+
+namespace
+{
+    const uint32_t kPointCount = 1 << 16;
+
+    enum class Distribution : uint32_t { RANDOM = 0, COHERENT = 1, NEAR_SURFACE = 2 };
+    const char* kDistributionLabels[3] = { "random", "coherent", "near-surface" };
+
+    struct Points
+    {
+        std::vector<float> x, y, z;
+
+        void push(float3 p) { x.push_back(p.x); y.push_back(p.y); z.push_back(p.z); }
+        float3 at(size_t i) const { return float3(x[i], y[i], z[i]); }
+        size_t size() const { return x.size(); }
+    };
+
+    using Bench = double (*)(const Points& pts, double minMs); // returns ns per evaluation
+    using Check = int (*)(const std::vector<Ray>& rays, int width); // returns the number of mismatching rays
+
+    struct Primitive
+    {
+        std::string name;
+        std::function<float(float3)> sdf;   // exact distance, defines the near-surface set
+        Bench scalar;
+        Bench packet8;
+        Bench packet16;
+        Check check;
+    };
+
+    // The primitive is a template argument so that it is inlined into the loop, as it would be in a tracer.
+    template <class Fn>
+    double measureScalar(const Points& pts, double minMs, Fn fn)
+    {
+        return measurePasses(pts.size(), minMs, [&pts, fn]
+        {
+            float acc = 0.f;
+            for (size_t i = 0; i < pts.size(); ++i) acc += fn(pts.at(i));
+            return acc;
+        });
+    }
+
+    template <class F, F (*Kernel)(const tvec3<F>&)>
+    double measurePacket(const Points& pts, double minMs)
+    {
+        return measurePasses(pts.size(), minMs, [&pts]
+        {
+            F acc = 0.f;
+            for (size_t i = 0; i + F::width <= pts.size(); i += F::width)
+                acc = acc + Kernel({ F::load(&pts.x[i]), F::load(&pts.y[i]), F::load(&pts.z[i]) });
+            return acc[0];
+        });
+    }
+
+    // A primitive as a scene: bdf_trace calls bdf, bdf_trace_packet finds the bdfT overload below.
+    template <float (*Kernel)(const float3&)>
+    struct ScalarScene
+    {
+        float bdf(float3 p) const { return Kernel(p); }
+    };
+
+    template <class F, F (*Kernel)(const tvec3<F>&)>
+    struct PacketScene {};
+
+    template <class F, F (*Kernel)(const tvec3<F>&)>
+    F bdfT(const PacketScene<F, Kernel>&, const tvec3<F>& p)
+    {
+        return Kernel(p);
+    }
+
+    const SphereTraceDesc kCheckDesc = { 1e-3f, 512 };
+
+    template <class F, F (*Kernel)(const tvec3<F>&), float (*ScalarKernel)(const float3&)>
+    int checkPackets(const std::vector<Ray>& rays)
+    {
+        int mismatches = 0;
+        for (size_t i = 0; i + F::width <= rays.size(); i += F::width)
+        {
+            TraceResultPacket<F> packet = bdf_trace_packet(PacketScene<F, Kernel>(), packRays<F>(&rays[i]), kCheckDesc);
+            for (int l = 0; l < F::width; ++l)
+            {
+                TraceResult a = packet.lane(l), b = bdf_trace(ScalarScene<ScalarKernel>(), rays[i + l], kCheckDesc);
+                if (std::abs(a.steps - b.steps) > 1 || a.flags != b.flags
+                    || std::abs(a.T - b.T) > kCheckDesc.epsilon * std::max(1.f, std::abs(b.T)))
+                {
+                    if (mismatches++ < 4)
+                        printf("  ray %zu: packet T %.6f steps %d flags %d, scalar T %.6f steps %d flags %d\n",
+                            i + l, a.T, a.steps, a.flags, b.T, b.steps, b.flags);
+                }
+            }
+        }
+        return mismatches;
+    }
+
+    template <class F, F (*Kernel)(const tvec3<F>&), float (*ScalarKernel)(const float3&),
+              class G, G (*Kernel16)(const tvec3<G>&)>
+    int checkWidth(const std::vector<Ray>& rays, int width)
+    {
+        return width == 8 ? checkPackets<F, Kernel, ScalarKernel>(rays) : checkPackets<G, Kernel16, ScalarKernel>(rays);
+    }
+
+#define SCALAR(expr) [](const Points& pts, double minMs) { return measureScalar(pts, minMs, [](float3 p) { return expr; }); }
+#define PACKETS(kernel) &measurePacket<f32x8, kernel<tvec3<f32x8>>>, &measurePacket<f32x16, kernel<tvec3<f32x16>>>, \
+    &checkWidth<f32x8, kernel<tvec3<f32x8>>, kernel<float3>, f32x16, kernel<tvec3<f32x16>>>
+#define NO_PACKETS nullptr, nullptr, nullptr
+
+    // Parameters of the Primitives scene
+    const float3 kBox = float3(1.f, .5f, .75f);
+    const float kSphere = 1.4f, kCone = .3f, kCylR = 1.5f, kCylH = 1.f;
+    const float2 kTorus = float2(1.f, .5f);
+    const float3 kPlane = float3(0, 1, 0);
+
+    template <class V> scalar_t<V> bdSphereP(const V& p) { return bdSphere(p, kSphere); }
+    template <class V> scalar_t<V> bdBoxP(const V& p) { return bdBox3(p, kBox); }
+    template <class V> scalar_t<V> bdCylinderP(const V& p) { return bdCylinder(p, kCylR, kCylH); }
+    template <class V> scalar_t<V> bdTorusP(const V& p) { return bdTorus(p, kTorus); }
+    template <class V> scalar_t<V> bdConeP(const V& p) { return bdCone(p, kCone); }
+    template <class V> scalar_t<V> bdPlaneP(const V& p) { return bdPlane(p, kPlane); }
+
+    std::vector<Primitive> primitives()
+    {
+        auto sdSphereE = [](float3 p) { return sdSphere(p, kSphere); };
+        auto sdBoxE = [](float3 p) { return sdBox(p, kBox); };
+        auto sdCylinderE = [](float3 p) { return sdCylinder(p, kCylR, kCylH); };
+        auto sdTorusE = [](float3 p) { return sdTorus(p, kTorus); };
+        auto sdConeE = [](float3 p) { return sdCone(p, kCone); };
+        auto sdPlaneE = [](float3 p) { return sdPlane(p, kPlane); };
+        return {
+            { "sdSphere", sdSphereE, SCALAR(sdSphere(p, kSphere)), NO_PACKETS },
+            { "bdSphere", sdSphereE, SCALAR(bdSphere(p, kSphere)), PACKETS(bdSphereP) },
+            { "sdBox", sdBoxE, SCALAR(sdBox(p, kBox)), NO_PACKETS },
+            { "bdBoxOlder", sdBoxE, SCALAR(bdBoxOlder(p, kBox)), NO_PACKETS },
+            { "bdBoxOldish", sdBoxE, SCALAR(bdBoxOldish(p, kBox)), NO_PACKETS },
+            { "bdBox1", sdBoxE, SCALAR(bdBox1(p, kBox)), NO_PACKETS },
+            { "bdBox2", sdBoxE, SCALAR(bdBox2(p, kBox)), NO_PACKETS },
+            { "bdBox3", sdBoxE, SCALAR(bdBox3(p, kBox)), PACKETS(bdBoxP) },
+            { "sdCylinder", sdCylinderE, SCALAR(sdCylinder(p, kCylR, kCylH)), NO_PACKETS },
+            { "bdCylinder", sdCylinderE, SCALAR(bdCylinder(p, kCylR, kCylH)), PACKETS(bdCylinderP) },
+            { "sdTorus", sdTorusE, SCALAR(sdTorus(p, kTorus)), NO_PACKETS },
+            { "bdTorus", sdTorusE, SCALAR(bdTorus(p, kTorus)), PACKETS(bdTorusP) },
+            { "sdCone", sdConeE, SCALAR(sdCone(p, kCone)), NO_PACKETS },
+            { "bdCone", sdConeE, SCALAR(bdCone(p, kCone)), PACKETS(bdConeP) },
+            { "sdPlane", sdPlaneE, SCALAR(sdPlane(p, kPlane)), NO_PACKETS },
+            { "bdPlane", sdPlaneE, SCALAR(bdPlane(p, kPlane)), PACKETS(bdPlaneP) },
+        };
+    }
+
+    // Points in [-3,3]^3. Coherent points walk a grid in scanline order, so consecutive evaluations mostly take
+    // the same branch; near-surface points are random points within 0.05 of the primitive's surface.
+    Points makePoints(Distribution dist, const std::function<float(float3)>& sdf, uint32_t seed)
+    {
+        Points pts;
+        std::mt19937 rng(seed);
+        std::uniform_real_distribution<float> u(-3.f, 3.f);
+        switch (dist)
+        {
+        case Distribution::RANDOM:
+            while (pts.size() < kPointCount) pts.push(float3(u(rng), u(rng), u(rng)));
+            break;
+        case Distribution::COHERENT:
+        {
+            const uint32_t n = 41; // 41^3 > kPointCount
+            for (uint32_t i = 0; pts.size() < kPointCount; ++i)
+            {
+                uint32_t x = i % n, y = (i / n) % n, z = i / (n * n);
+                pts.push(float3(-3.f + 6.f * x / (n - 1), -3.f + 6.f * y / (n - 1), -3.f + 6.f * z / (n - 1)));
+            }
+            break;
+        }
+        case Distribution::NEAR_SURFACE:
+            while (pts.size() < kPointCount)
+            {
+                float3 p = float3(u(rng), u(rng), u(rng));
+                if (std::abs(sdf(p)) < 0.05f) pts.push(p);
+            }
+            break;
+        }
+        return pts;
+    }
+
+    // Rays from a sphere of radius 8 around the primitive towards random points of [-2,2]^3; most hit, some graze
+    // the surface or miss.
+    std::vector<Ray> makeRays(uint32_t count, uint32_t seed)
+    {
+        std::vector<Ray> rays;
+        std::mt19937 rng(seed);
+        std::uniform_real_distribution<float> u(-1.f, 1.f);
+        while (rays.size() < count)
+        {
+            float3 dir = float3(u(rng), u(rng), u(rng));
+            if (dot(dir, dir) > 1.f || dot(dir, dir) < 1e-4f) continue;
+            float3 P = 8.f * normalize(dir);
+            float3 target = 2.f * float3(u(rng), u(rng), u(rng));
+            rays.push_back({ P, 0.f, normalize(target - P), 20.f });
+        }
+        return rays;
+    }
+
+    void printUsage()
+    {
+        printf(
+            "Usage: bdf_bench_primitives [options]\n"
+            "  --filter <text>    only primitives whose name contains text\n"
+            "  --min-time <ms>    measuring time per primitive and distribution (default 100)\n"
+            "  --csv <file>       also write the results as CSV\n"
+            "  --check            compare the packet tracers with the scalar bdf_trace instead of measuring\n");
+    }
+}
+
+int main(int argc, char** argv)
+{
+    std::string filter, csvPath;
+    double minMs = 100.;
+    bool check = false;
+    for (int i = 1; i < argc; ++i)
+    {
+        const char* val = i + 1 < argc ? argv[i + 1] : nullptr;
+        if (!strcmp(argv[i], "--filter") && val) filter = val, ++i;
+        else if (!strcmp(argv[i], "--min-time") && val) minMs = atof(val), ++i;
+        else if (!strcmp(argv[i], "--csv") && val) csvPath = val, ++i;
+        else if (!strcmp(argv[i], "--check")) check = true;
+        else
+        {
+            printUsage();
+            return strcmp(argv[i], "--help") ? 1 : 0;
+        }
+    }
+
+    if (check)
+    {
+        const std::vector<Ray> rays = makeRays(kPointCount, 4321);
+        int failed = 0;
+        for (const Primitive& prim : primitives())
+        {
+            if (!prim.check || (!filter.empty() && prim.name.find(filter) == std::string::npos)) continue;
+            for (int width : { 8, 16 })
+            {
+                int mismatches = prim.check(rays, width);
+                printf("%-14s %5d | %zu rays, %d mismatches\n", prim.name.c_str(), width, rays.size(), mismatches);
+                failed += mismatches != 0;
+            }
+        }
+        return failed ? 1 : 0;
+    }
+
+    FILE* csv = nullptr;
+    if (!openBenchCsv(csvPath, "primitive,width,distribution,ns_per_eval,mevals_per_s", csv)) return 1;
+
+    printf("%-14s %5s | %-27s | %-27s | %-27s | %s\n", "primitive", "width",
+        "random ns/eval  Mevals/s", "coherent ns/eval  Mevals/s", "near-surf ns/eval  Mevals/s", "divergence");
+    for (const Primitive& prim : primitives())
+    {
+        if (!filter.empty() && prim.name.find(filter) == std::string::npos) continue;
+
+        Points pts[3];
+        for (uint32_t d = 0; d < 3; ++d) pts[d] = makePoints(static_cast<Distribution>(d), prim.sdf, 1234 + d);
+
+        for (int width : { 1, 8, 16 })
+        {
+            if ((width == 8 && !prim.packet8) || (width == 16 && !prim.packet16)) continue;
+            double ns[3];
+            for (uint32_t d = 0; d < 3; ++d)
+            {
+                Bench bench = width == 1 ? prim.scalar : width == 8 ? prim.packet8 : prim.packet16;
+                ns[d] = bench(pts[d], minMs);
+                if (csv)
+                    fprintf(csv, "%s,%d,%s,%.4f,%.2f\n", prim.name.c_str(), width, kDistributionLabels[d], ns[d], 1e3 / ns[d]);
+            }
+            printf("%-14s %5d | %12.3f %12.1f  | %12.3f %12.1f  | %12.3f %12.1f  | %8.2fx\n", prim.name.c_str(), width,
+                ns[0], 1e3 / ns[0], ns[1], 1e3 / ns[1], ns[2], 1e3 / ns[2], ns[0] / ns[1]);
+        }
+    }
+    if (csv) fclose(csv);
+    return 0;
+}
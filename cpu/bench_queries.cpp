@@ -0,0 +1,207 @@
+// Benchmark of SceneQuery (scene_query.h) on a million random points per scene. For each scene it reports ns per
+// point for the SDF and BDF values of a scalar loop over Scene::sdf/bdf and of SceneQuery::points on one thread and
+// on all threads, ns per point with the gradient as well (one thread), the largest difference to the scalar values
+// and sdg (expected at rounding level), and for SceneQuery::boxes ns per box and the sampled points of a box whose
+// SDF or BDF fell outside its bounds. These are expected 0, except for the BDF of a blob grid: its scalar bdf takes
+// a per cell sphere bound that the other number types replace by the spheres of every vertex.
+
+#include "bench_common.h"
+#include "blob_grid.h"
+#include "scene_query.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace bdf;
+
+namespace
+{
+    struct Points
+    {
+        std::vector<float> x, y, z;
+    };
+
+    struct Values
+    {
+        std::vector<float> sdf, bdf, gx, gy, gz;
+
+        explicit Values(size_t n) : sdf(n), bdf(n), gx(n), gy(n), gz(n) {}
+        PointResults values() { return { sdf.data(), bdf.data() }; }
+        PointResults all() { return { sdf.data(), bdf.data(), gx.data(), gy.data(), gz.data() }; }
+    };
+
+    float maxDiff(const Values& a, const Values& b)
+    {
+        float d = 0.f;
+        for (size_t i = 0; i < a.sdf.size(); ++i)
+        {
+            d = std::max(d, std::abs(a.sdf[i] - b.sdf[i]));
+            d = std::max(d, std::abs(a.bdf[i] - b.bdf[i]));
+            d = std::max(d, std::abs(a.gx[i] - b.gx[i]) + std::abs(a.gy[i] - b.gy[i]) + std::abs(a.gz[i] - b.gz[i]));
+        }
+        return d;
+    }
+
+    void printUsage()
+    {
+        printf(
+            "Usage: bdf_bench_queries [options]\n"
+            "  --points <n>     points per scene (default 1000000)\n"
+            "  --boxes <n>      boxes per scene (default 100000)\n"
+            "  --box-size <f>   side of the boxes (default 0.25)\n"
+            "  --threads <n>    threads of the parallel run (default: all hardware threads)\n"
+            "  --csg <file>     also query this CSG scene (see csg_scene.h)\n"
+            "  --csv <file>     also write the results as CSV\n");
+    }
+}
+
+int main(int argc, char** argv)
+{
+    size_t pointCount = 1000000, boxCount = 100000;
+    float boxSize = .25f;
+    uint32_t threadCount = 0;
+    std::string csgPath, csvPath;
+    for (int i = 1; i < argc; ++i)
+    {
+        const char* val = i + 1 < argc ? argv[i + 1] : nullptr;
+        if (!strcmp(argv[i], "--points") && val) pointCount = size_t(atoll(val)), ++i;
+        else if (!strcmp(argv[i], "--boxes") && val) boxCount = size_t(atoll(val)), ++i;
+        else if (!strcmp(argv[i], "--box-size") && val) boxSize = float(atof(val)), ++i;
+        else if (!strcmp(argv[i], "--threads") && val) threadCount = uint32_t(atoi(val)), ++i;
+        else if (!strcmp(argv[i], "--csg") && val) csgPath = val, ++i;
+        else if (!strcmp(argv[i], "--csv") && val) csvPath = val, ++i;
+        else
+        {
+            printUsage();
+            return strcmp(argv[i], "--help") ? 1 : 0;
+        }
+    }
+
+    RenderSettings base;
+    if (!csgPath.empty() && !loadBenchCsg(csgPath, base)) return 1;
+
+    FILE* csv = nullptr;
+    if (!openBenchCsv(csvPath, "scene,scalar_ns,query_ns,parallel_ns,gradient_ns,max_diff,box_ns,sdf_misses,bdf_misses", csv)) return 1;
+
+    struct Case
+    {
+        const char* name;
+        Scenes scene;
+        int blobs;
+    };
+    std::vector<Case> cases = { { "Primitives", Scenes::PRIMITIVES, 0 }, { "Sphere", Scenes::SPHERE, 0 },
+        { "Torus", Scenes::TORUS, 0 }, { "Blobs", Scenes::BLOBS, 0 }, { "Blobs (grid of 256)", Scenes::BLOBS, 256 } };
+    if (base.csg) cases.push_back({ "CSG", Scenes::CSG, 0 });
+
+    printf("Lanes: %d, %zu points, %zu boxes of %g\n", QueryLanes::width, pointCount, boxCount, boxSize);
+    printf("%-20s %12s %12s %12s %12s %10s | %10s %10s %10s\n", "scene", "scalar ns/p", "query ns/p", "parallel",
+        "+gradient", "max diff", "ns/box", "sdf miss", "bdf miss");
+    for (const Case& c : cases)
+    {
+        RenderSettings settings = base;
+        CameraDesc camera;
+        settings.scene = c.scene;
+        applySceneDefaults(c.scene, settings, camera);
+        std::shared_ptr<BlobGrid> grid;
+        if (c.blobs > 0)
+        {
+            grid = std::make_shared<BlobGrid>(BlobGrid::randomField(uint32_t(c.blobs), settings.sBlobRadius));
+            settings.blobGrid = grid;
+        }
+
+        // points in a box around the camera target, as far as the camera is from it
+        const float half = length(camera.position - camera.target);
+        std::mt19937 rng(42);
+        std::uniform_real_distribution<float> u(-half, half);
+        Points pts;
+        for (size_t i = 0; i < pointCount; ++i)
+        {
+            pts.x.push_back(camera.target.x + u(rng));
+            pts.y.push_back(camera.target.y + u(rng));
+            pts.z.push_back(camera.target.z + u(rng));
+        }
+        const PointQueries queries = { pts.x.data(), pts.y.data(), pts.z.data(), pointCount };
+
+        Values scalar(pointCount), query(pointCount), parallel(pointCount), gradient(pointCount);
+        const SceneParams params = SceneParams::fromSettings(settings);
+        auto start = Clock::now();
+        dispatchScene(c.scene, params, [&](const auto& scene)
+        {
+            for (size_t i = 0; i < pointCount; ++i)
+            {
+                const float3 p(pts.x[i], pts.y[i], pts.z[i]);
+                scalar.sdf[i] = scene.sdf(p);
+                scalar.bdf[i] = scene.bdf(p);
+            }
+        });
+        const double scalarNs = elapsedMs(start) * 1e6 / double(pointCount);
+
+        SceneQuery sceneQuery(settings);
+        QueryOptions options;
+        options.threadCount = 1;
+        start = Clock::now();
+        sceneQuery.points(queries, query.values(), options);
+        const double queryNs = elapsedMs(start) * 1e6 / double(pointCount);
+        start = Clock::now();
+        sceneQuery.points(queries, gradient.all(), options);
+        const double gradientNs = elapsedMs(start) * 1e6 / double(pointCount);
+        options.threadCount = threadCount;
+        start = Clock::now();
+        sceneQuery.points(queries, parallel.values(), options);
+        const double parallelNs = elapsedMs(start) * 1e6 / double(pointCount);
+
+        dispatchScene(c.scene, params, [&](const auto& scene)
+        {   // the reference gradients; the SDF of the gradient run comes from sdg, so it is checked against that
+            for (size_t i = 0; i < pointCount; ++i)
+            {
+                const float4 g = scene.sdg(float3(pts.x[i], pts.y[i], pts.z[i]));
+                scalar.gx[i] = query.gx[i] = parallel.gx[i] = g.x;
+                scalar.gy[i] = query.gy[i] = parallel.gy[i] = g.y;
+                scalar.gz[i] = query.gz[i] = parallel.gz[i] = g.z;
+                gradient.sdf[i] += scalar.sdf[i] - g.w;
+            }
+        });
+        const float diff = std::max(std::max(maxDiff(scalar, query), maxDiff(scalar, parallel)), maxDiff(scalar, gradient));
+
+        // boxes at the first points, checked at 8 random points each
+        const size_t boxes = std::min(boxCount, pointCount);
+        std::vector<float> hiX(boxes), hiY(boxes), hiZ(boxes), sdfLo(boxes), sdfHi(boxes), bdfLo(boxes), bdfHi(boxes);
+        for (size_t i = 0; i < boxes; ++i)
+        {
+            hiX[i] = pts.x[i] + boxSize;
+            hiY[i] = pts.y[i] + boxSize;
+            hiZ[i] = pts.z[i] + boxSize;
+        }
+        const BoxQueries boxQueries = { pts.x.data(), pts.y.data(), pts.z.data(), hiX.data(), hiY.data(), hiZ.data(), boxes };
+        start = Clock::now();
+        sceneQuery.boxes(boxQueries, { sdfLo.data(), sdfHi.data(), bdfLo.data(), bdfHi.data() }, options);
+        const double boxNs = boxes ? elapsedMs(start) * 1e6 / double(boxes) : 0.;
+        uint32_t sdfMisses = 0, bdfMisses = 0;
+        std::uniform_real_distribution<float> v(0.f, boxSize);
+        dispatchScene(c.scene, params, [&](const auto& scene)
+        {
+            for (size_t i = 0; i < boxes; ++i)
+                for (int k = 0; k < 8; ++k)
+                {
+                    const float3 p(pts.x[i] + v(rng), pts.y[i] + v(rng), pts.z[i] + v(rng));
+                    const float s = scene.sdf(p), b = scene.bdf(p), tol = 1e-4f * (1.f + std::abs(s) + std::abs(b));
+                    sdfMisses += s < sdfLo[i] - tol || s > sdfHi[i] + tol;
+                    bdfMisses += b < bdfLo[i] - tol || b > bdfHi[i] + tol;
+                }
+        });
+
+        printf("%-20s %12.1f %12.1f %12.1f %12.1f %10g | %10.1f %10u %10u\n", c.name, scalarNs, queryNs, parallelNs,
+            gradientNs, diff, boxNs, sdfMisses, bdfMisses);
+        if (csv)
+            fprintf(csv, "%s,%.2f,%.2f,%.2f,%.2f,%g,%.2f,%u,%u\n", c.name, scalarNs, queryNs, parallelNs, gradientNs, diff,
+                boxNs, sdfMisses, bdfMisses);
+    }
+    if (csv) fclose(csv);
+    return 0;
+}
@@ -0,0 +1,155 @@
+// Benchmark of SceneQuery::rays (scene_query.h) on two batches of arbitrary rays: a scanner, rays in random
+// directions from one point in random order, and a visibility batch, rays from random points towards one light
+// direction. For each batch it reports rays per second traced as they come and sorted, one ray at a time and (for
+// bdf_trace) in packets, the mean and largest step count, and the rays whose result differs from the unsorted
+// one-at-a-time run: sorting must not change any result, packets may change T within the hit epsilon and on rays
+// that ran out of iterations (origins inside an object, where the steps oscillate).
+
+#include "bench_common.h"
+#include "scene_query.h"
+#include "tracers.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iterator>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace bdf;
+
+namespace
+{
+    float3 randomDirection(std::mt19937& rng)
+    {
+        std::uniform_real_distribution<float> u(-1.f, 1.f);
+        for (;;)
+        {
+            float3 v(u(rng), u(rng), u(rng));
+            float l = length(v);
+            if (l > 1e-3f && l <= 1.f) return v / l;
+        }
+    }
+
+    // Rays whose flags differ or whose T differs by more than epsilon T; with ignoreExhausted the T of rays that
+    // ran out of iterations in both is not compared
+    uint32_t differences(const std::vector<TraceResult>& a, const std::vector<TraceResult>& b, float epsilon, bool ignoreExhausted)
+    {
+        uint32_t n = 0;
+        for (size_t i = 0; i < a.size(); ++i)
+            n += a[i].flags != b[i].flags ||
+                 (!(ignoreExhausted && (a[i].flags & 4)) && std::abs(a[i].T - b[i].T) > epsilon * std::max(a[i].T, 1.f));
+        return n;
+    }
+
+    void printUsage()
+    {
+        printf(
+            "Usage: bdf_bench_rays [options]\n"
+            "  --scene <label>    Primitives, Sphere, Box, Cylinder, Torus, Test, Blobs (default Primitives)\n"
+            "  --csg <file>       query this CSG scene instead (see csg_scene.h)\n"
+            "  --trace <label>    sdf_trace, bdf_trace, segment_trace, ... (default bdf_trace)\n"
+            "  --rays <n>         rays per batch (default 200000)\n"
+            "  --threads <n>      (default: all hardware threads)\n"
+            "  --csv <file>       also write the results as CSV\n");
+    }
+}
+
+int main(int argc, char** argv)
+{
+    RenderSettings settings;
+    RayQueryDesc desc;
+    size_t rayCount = 200000;
+    QueryOptions options;
+    std::string csgPath, csvPath;
+    bool ok = true;
+    for (int i = 1; i < argc; ++i)
+    {
+        const char* val = i + 1 < argc ? argv[i + 1] : nullptr;
+        uint32_t index = 0;
+        if (!strcmp(argv[i], "--scene") && val) ok = parseLabel(kSceneLabels, uint32_t(std::size(kSceneLabels)), val, index), settings.scene = Scenes(index), ++i;
+        else if (!strcmp(argv[i], "--csg") && val) csgPath = val, settings.scene = Scenes::CSG, ++i;
+        else if (!strcmp(argv[i], "--trace") && val) ok = parseLabel(kTraceLabels, uint32_t(std::size(kTraceLabels)), val, index), desc.tracer = Tracers(index), ++i;
+        else if (!strcmp(argv[i], "--rays") && val) rayCount = size_t(atoll(val)), ++i;
+        else if (!strcmp(argv[i], "--threads") && val) options.threadCount = uint32_t(atoi(val)), ++i;
+        else if (!strcmp(argv[i], "--csv") && val) csvPath = val, ++i;
+        else ok = false;
+        if (!ok)
+        {
+            printUsage();
+            return strcmp(argv[i], "--help") ? 1 : 0;
+        }
+    }
+
+    if (!csgPath.empty())
+    {
+        if (!loadBenchCsg(csgPath, settings)) return 1;
+    }
+    else if (settings.scene == Scenes::CSG)
+    {
+        fprintf(stderr, "The CSG scene needs a scene file (--csg)\n");
+        return 1;
+    }
+    CameraDesc camera;
+    const Tracers tracer = desc.tracer;
+    applySceneDefaults(settings.scene, settings, camera);
+    SceneQuery query(settings);
+
+    FILE* csv = nullptr;
+    if (!openBenchCsv(csvPath, "batch,sorted,packets,mrays_per_s,mean_steps,max_steps,differences", csv)) return 1;
+
+    // the scanner at the camera, the visibility rays from the ground and the objects on it towards a light
+    const float extent = length(camera.position - camera.target);
+    std::mt19937 rng(42);
+    std::uniform_real_distribution<float> u(-extent, extent), h(0.f, .5f * extent);
+    std::vector<Ray> batches[2];
+    for (size_t i = 0; i < rayCount; ++i)
+    {
+        batches[0].push_back({ camera.position, 0.f, randomDirection(rng), settings.primaryMaxDist });
+        const float3 p = camera.target + float3(u(rng), h(rng) - 1.f, u(rng));
+        batches[1].push_back({ p, settings.secondaryMinDist, normalize(lightDirection(0, 3)), settings.secondaryMaxDist });
+    }
+    const char* names[2] = { "scanner", "visibility" };
+
+    printf("%s, %s, %zu rays per batch, %d lanes\n", kSceneLabels[uint32_t(settings.scene)], kTraceLabels[uint32_t(tracer)],
+        rayCount, QueryLanes::width);
+    printf("%-12s %7s %8s %12s %10s %10s %12s\n", "batch", "sorted", "packets", "Mrays/s", "steps", "max", "differences");
+    for (int b = 0; b < 2; ++b)
+    {
+        std::vector<TraceResult> reference;
+        for (int packets = 0; packets < (tracer == Tracers::BDF_TRACE ? 2 : 1); ++packets)
+            for (int sorted = 0; sorted < 2; ++sorted)
+            {
+                desc.sort = sorted != 0;
+                desc.packets = packets != 0;
+                std::vector<TraceResult> results(rayCount);
+                std::string error;
+                auto start = Clock::now();
+                if (!query.rays(batches[b].data(), rayCount, results.data(), desc, error, options))
+                {
+                    fprintf(stderr, "%s\n", error.c_str());
+                    return 1;
+                }
+                const double ms = elapsedMs(start);
+                uint64_t steps = 0;
+                int maxSteps = 0;
+                for (const TraceResult& r : results)
+                {
+                    steps += uint64_t(r.steps);
+                    maxSteps = std::max(maxSteps, r.steps);
+                }
+                if (reference.empty()) reference = results;
+                const uint32_t diff = differences(reference, results, packets ? desc.trace.epsilon : 0.f, packets != 0);
+                const double mrays = double(rayCount) / (ms * 1e3);
+                printf("%-12s %7s %8s %12.3f %10.1f %10d %12u\n", names[b], sorted ? "yes" : "no", packets ? "yes" : "no",
+                    mrays, double(steps) / double(rayCount), maxSteps, diff);
+                if (csv)
+                    fprintf(csv, "%s,%d,%d,%.4f,%.2f,%d,%u\n", names[b], sorted, packets, mrays, double(steps) / double(rayCount),
+                        maxSteps, diff);
+            }
+    }
+    if (csv) fclose(csv);
+    return 0;
+}
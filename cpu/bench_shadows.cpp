@@ -0,0 +1,141 @@
+// Shadow cost per shaded pixel against the number of lights. The primary rays of the GUI's camera pose of each
+// SDF/BDF scene are traced once with bdf_trace; the shadow rays of every hit toward LIGHT_COUNT lights are then
+// traced by each shadow mode (shadowLights, tracers_simd.h) on one thread. Reported per hit: time, steps, and the
+// mean difference of the light visibilities to bdf_trace (near 0 for the modes that only change how the rays are
+// traced: the cones of bdf_packet skip space the SDF shows free, where bdf_trace may stop on a grazing ray). The
+// steps of bdf_packet include its shared cone steps and grow sublinearly once the lights are dense.
+
+#include "bench_common.h"
+#include "tracers_simd.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+using namespace bdf;
+
+namespace
+{
+    struct Hit
+    {
+        float3 p, n;
+        float T;
+    };
+
+    void printUsage()
+    {
+        printf(
+            "Usage: bdf_bench_shadows [options]\n"
+            "  --size <w>x<h>         primary rays per scene (default 320x180)\n"
+            "  --lights <n,n,...>     light counts (default 1,2,4,8,16,32,64, at most 64)\n"
+            "  --softness <f>         penumbra factor of bdf_soft (default 8)\n"
+            "  --csg <file>           also measure a CSG scene file\n"
+            "  --csv <file>           also write the results as CSV\n");
+    }
+}
+
+int main(int argc, char** argv)
+{
+    uint32_t width = 320, height = 180;
+    std::vector<int> lightCounts = { 1, 2, 4, 8, 16, 32, 64 };
+    float softness = 8.f;
+    std::string csvPath, csgPath;
+    for (int i = 1; i < argc; ++i)
+    {
+        const char* val = i + 1 < argc ? argv[i + 1] : nullptr;
+        bool ok = val != nullptr;
+        if (!strcmp(argv[i], "--size")) ok = ok && sscanf(val, "%ux%u", &width, &height) == 2;
+        else if (!strcmp(argv[i], "--lights")) ok = ok && !(lightCounts = parseList<int>(val)).empty();
+        else if (!strcmp(argv[i], "--softness")) ok = ok && (softness = float(atof(val))) > 0.f;
+        else if (!strcmp(argv[i], "--csg")) ok = ok && (csgPath = val, true);
+        else if (!strcmp(argv[i], "--csv")) ok = ok && (csvPath = val, true);
+        else ok = false;
+        for (int n : lightCounts) ok = ok && n > 0 && n <= kMaxLightCount;
+        if (!ok)
+        {
+            printUsage();
+            return strcmp(argv[i], "--help") ? 1 : 0;
+        }
+        ++i;
+    }
+
+    std::vector<Scenes> scenes = { Scenes::PRIMITIVES, Scenes::SPHERE, Scenes::BOX, Scenes::CYLINDER, Scenes::TORUS };
+    RenderSettings base;
+    if (!csgPath.empty())
+    {
+        if (!loadBenchCsg(csgPath, base)) return 1;
+        scenes.push_back(Scenes::CSG);
+    }
+
+    FILE* csv = nullptr;
+    if (!openBenchCsv(csvPath, "scene,lights,shadow,ns_per_hit,steps_per_hit,visibility_error", csv)) return 1;
+
+    const Shadows modes[] = { Shadows::BDF_TRACE, Shadows::SDF_TRACE, Shadows::BDF_PACKET, Shadows::BDF_SOFT };
+    const float tanPix = pixelTan(width, height);
+    for (Scenes sceneID : scenes)
+    {
+        RenderSettings settings = base;
+        const std::vector<Ray> rays = primaryRays(sceneID, settings, width, height);
+        const SphereTraceDesc desc = { tanPix, settings.primaryMaxIter };
+        const SphereTraceDesc shadowDesc = { settings.secondaryEpsilon, settings.secondaryMaxIter };
+
+        dispatchScene(sceneID, SceneParams::fromSettings(settings), [&](const auto& scene)
+        {
+            std::vector<Hit> hits;
+            for (const Ray& ray : rays)
+            {
+                TraceResult ret = bdf_trace(scene, ray, desc);
+                if ((ret.flags & 3) != 2) continue;     // shaded as a hit
+                float3 p = ray.P + ray.V * ret.T;
+                hits.push_back({ p, normal(settings.normal, scene, p), ret.T });
+            }
+            printf("\n%s: %zu hits\n", kSceneLabels[uint32_t(sceneID)], hits.size());
+            printf("  %6s", "lights");
+            for (Shadows mode : modes) printf(" | %-10s %7s %8s", kShadowLabels[uint32_t(mode)], "steps", "vis err");
+            printf("\n");
+
+            std::vector<float> reference, visibility;
+            for (int lightCount : lightCounts)
+            {
+                printf("  %6d", lightCount);
+                reference.assign(hits.size() * size_t(lightCount), 0.f);
+                visibility.assign(hits.size() * size_t(lightCount), 0.f);
+                for (Shadows mode : modes)
+                {
+                    std::vector<float>& vis = mode == Shadows::BDF_TRACE ? reference : visibility;
+                    uint64_t steps = 0;
+                    auto start = Clock::now();
+                    for (size_t h = 0; h < hits.size(); ++h)
+                    {   // the shadow rays of mainImageBDF
+                        Ray shadowRays[kMaxLightCount];
+                        for (int i = 0; i < lightCount; ++i)
+                            shadowRays[i] = { hits[h].p + (settings.secondaryNOffset + tanPix * hits[h].T) * hits[h].n,
+                                        settings.secondaryMinDist + tanPix * hits[h].T, lightDirection(i, lightCount), settings.secondaryMaxDist };
+                        steps += uint64_t(shadowLights(mode, scene, shadowRays, lightCount, shadowDesc, softness, &vis[h * size_t(lightCount)]));
+                    }
+                    double ms = elapsedMs(start);
+
+                    double error = 0.;
+                    if (mode != Shadows::BDF_TRACE)
+                    {
+                        for (size_t i = 0; i < vis.size(); ++i) error += std::abs(double(vis[i] - reference[i]));
+                        error /= double(std::max<size_t>(vis.size(), 1));
+                    }
+                    double hitCount = double(std::max<size_t>(hits.size(), 1));
+                    printf(" | %7.0f ns %7.1f %8.4f", ms * 1e6 / hitCount, double(steps) / hitCount, error);
+                    if (csv)
+                        fprintf(csv, "%s,%d,%s,%.1f,%.3f,%.6f\n", kSceneLabels[uint32_t(sceneID)], lightCount, kShadowLabels[uint32_t(mode)],
+                            ms * 1e6 / hitCount, double(steps) / hitCount, error);
+                }
+                printf("\n");
+            }
+            return 0;
+        });
+    }
+    if (csv) fclose(csv);
+    return 0;
+}
@@ -0,0 +1,154 @@
+// Compares the over-relaxed and hit-refined BDF tracers with bdf_trace on the primary rays of the GUI's camera pose
+// of each SDF/BDF scene. For every tracer configuration it reports the mean steps per ray and, against bdf_trace at
+// the shader's epsilon (one pixel cone), the rays whose hit/miss changed and the hit distance error in epsilons
+// (|T - T_bdf_trace| / (epsilon * T)). bdf_trace with the loosened epsilon alone is listed to show what the
+// refinement buys back.
+
+#include "bench_common.h"
+#include "scenes.h"
+#include "tracers.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+using namespace bdf;
+
+namespace
+{
+    struct Config
+    {
+        Tracers trace;
+        float omega;
+        float hitScale;     // bdf_trace: epsilon scale, bdf_trace_refined: hit scale
+    };
+
+    struct Result
+    {
+        double steps = 0.;      // per ray
+        double ms = 0.;
+        double hitChanged = 0.; // fraction of the rays
+        double meanError = 0.;  // in epsilons, over the rays both hit
+        double p99Error = 0.;
+        double over1 = 0.;      // fraction of the common hits more than one epsilon off
+    };
+
+    void printUsage()
+    {
+        printf(
+            "Usage: bdf_bench_tracers [options]\n"
+            "  --size <w>x<h>         rays per scene (default 640x360)\n"
+            "  --omega <f,f,...>      over-relaxation factors (default 1.2,1.6,1.9)\n"
+            "  --hit-scale <f,f,...>  loosened hit epsilons of bdf_trace_refined, in epsilons (default 4,8,16)\n"
+            "  --csg <file>           also measure a CSG scene file\n"
+            "  --csv <file>           also write the results as CSV\n");
+    }
+}
+
+int main(int argc, char** argv)
+{
+    uint32_t width = 640, height = 360;
+    std::vector<float> omegas = { 1.2f, 1.6f, 1.9f }, hitScales = { 4.f, 8.f, 16.f };
+    std::string csvPath, csgPath;
+    for (int i = 1; i < argc; ++i)
+    {
+        const char* val = i + 1 < argc ? argv[i + 1] : nullptr;
+        bool ok = val != nullptr;
+        if (!strcmp(argv[i], "--size")) ok = ok && sscanf(val, "%ux%u", &width, &height) == 2;
+        else if (!strcmp(argv[i], "--omega")) ok = ok && !(omegas = parseList<float>(val)).empty();
+        else if (!strcmp(argv[i], "--hit-scale")) ok = ok && !(hitScales = parseList<float>(val)).empty();
+        else if (!strcmp(argv[i], "--csg")) ok = ok && (csgPath = val, true);
+        else if (!strcmp(argv[i], "--csv")) ok = ok && (csvPath = val, true);
+        else ok = false;
+        if (!ok)
+        {
+            printUsage();
+            return strcmp(argv[i], "--help") ? 1 : 0;
+        }
+        ++i;
+    }
+
+    std::vector<Scenes> scenes = { Scenes::PRIMITIVES, Scenes::SPHERE, Scenes::BOX, Scenes::CYLINDER, Scenes::TORUS, Scenes::BLOBS };
+    RenderSettings base;
+    if (!csgPath.empty())
+    {
+        if (!loadBenchCsg(csgPath, base)) return 1;
+        scenes.push_back(Scenes::CSG);
+    }
+
+    std::vector<Config> configs;
+    for (float h : hitScales) configs.push_back({ Tracers::BDF_TRACE, 1.f, h });
+    for (float w : omegas) configs.push_back({ Tracers::BDF_TRACE_RELAXED, w, 1.f });
+    for (float w : omegas)
+        for (float h : hitScales) configs.push_back({ Tracers::BDF_TRACE_REFINED, w, h });
+
+    FILE* csv;
+    if (!openBenchCsv(csvPath, "scene,tracer,omega,hit_scale,steps,ms,hit_changed,mean_error,p99_error,over_1", csv)) return 1;
+
+    const float tanPix = pixelTan(width, height);
+    for (Scenes sceneID : scenes)
+    {
+        RenderSettings settings = base;
+        const std::vector<Ray> rays = primaryRays(sceneID, settings, width, height);
+        const SphereTraceDesc desc = { tanPix, settings.primaryMaxIter };
+
+        dispatchScene(sceneID, SceneParams::fromSettings(settings), [&](const auto& scene)
+        {
+            std::vector<TraceResult> reference(rays.size());
+            uint64_t refSteps = 0;
+            auto start = Clock::now();
+            for (size_t i = 0; i < rays.size(); ++i)
+                refSteps += uint64_t((reference[i] = bdf_trace(scene, rays[i], desc)).steps);
+            double refMs = elapsedMs(start);
+            printf("\n%s: bdf_trace %.2f steps/ray, %.1f ms\n", kSceneLabels[uint32_t(sceneID)], double(refSteps) / double(rays.size()), refMs);
+            printf("  %-18s %5s %5s | %9s %7s %8s | %8s %8s %8s %8s\n", "tracer", "omega", "hit", "steps/ray", "steps",
+                "ms", "hit chg", "mean err", "p99 err", ">1 eps");
+
+            for (const Config& config : configs)
+            {
+                SphereTraceDesc d = desc;
+                if (config.trace == Tracers::BDF_TRACE) d.epsilon *= config.hitScale;
+                uint64_t steps = 0, changed = 0;
+                std::vector<float> errors;
+                errors.reserve(rays.size());
+                start = Clock::now();
+                std::vector<TraceResult> results(rays.size());
+                for (size_t i = 0; i < rays.size(); ++i)
+                    results[i] = trace(config.trace, scene, rays[i], d, settings.sMarchEpsilon, config.omega, config.hitScale);
+                Result r;
+                r.ms = elapsedMs(start);
+                for (size_t i = 0; i < rays.size(); ++i)
+                {
+                    const TraceResult &a = results[i], &b = reference[i];
+                    steps += uint64_t(a.steps);
+                    bool hitA = (a.flags & 3) == 2, hitB = (b.flags & 3) == 2;  // shaded as a hit
+                    if (hitA != hitB) ++changed;
+                    else if (hitA) errors.push_back(std::abs(a.T - b.T) / (tanPix * b.T));
+                }
+                r.steps = double(steps) / double(rays.size());
+                r.hitChanged = double(changed) / double(rays.size());
+                if (!errors.empty())
+                {
+                    double sum = 0.;
+                    size_t over = 0;
+                    for (float e : errors) sum += e, over += e > 1.f;
+                    r.meanError = sum / double(errors.size());
+                    r.over1 = double(over) / double(errors.size());
+                    std::nth_element(errors.begin(), errors.begin() + errors.size() * 99 / 100, errors.end());
+                    r.p99Error = errors[errors.size() * 99 / 100];
+                }
+
+                const char* label = kTraceLabels[uint32_t(config.trace)];
+                printf("  %-18s %5.2f %5.1f | %9.2f %+6.1f%% %8.1f | %7.3f%% %8.3f %8.3f %7.3f%%\n", label, config.omega,
+                    config.hitScale, r.steps, 100. * (r.steps * double(rays.size()) / double(refSteps) - 1.), r.ms,
+                    100. * r.hitChanged, r.meanError, r.p99Error, 100. * r.over1);
+                if (csv)
+                    fprintf(csv, "%s,%s,%.3f,%.3f,%.3f,%.3f,%.6f,%.4f,%.4f,%.6f\n", kSceneLabels[uint32_t(sceneID)], label,
+                        config.omega, config.hitScale, r.steps, r.ms, r.hitChanged, r.meanError, r.p99Error, r.over1);
+            }
+            return 0;
+        });
+    }
+    if (csv) fclose(csv);
+    return 0;
+}
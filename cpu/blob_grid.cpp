@@ -0,0 +1,222 @@
+#include "blob_grid.h"
+
+#include "bdf_primitives.h"
+#include "segment_tracing.h"
+
+#include <algorithm>
+#include <random>
+
+namespace bdf
+{
+    namespace
+    {
+        const uint32_t kMaxCells = 1u << 22;
+    }
+
+    BlobGrid::BlobGrid(std::vector<BlobVertex> vertices, float cellSize) : mVertices(std::move(vertices))
+    {
+        float3 lo = float3(0.f), hi = float3(0.f);
+        for (size_t i = 0; i < mVertices.size(); ++i)
+        {
+            const BlobVertex& v = mVertices[i];
+            lo = i ? min(lo, v.c - float3(v.R)) : v.c - float3(v.R);
+            hi = i ? max(hi, v.c + float3(v.R)) : v.c + float3(v.R);
+            mMaxRadius = std::max(mMaxRadius, v.R);
+        }
+        mCellSize = cellSize > 0.f ? cellSize : (mMaxRadius > 0.f ? mMaxRadius : 1.f);
+        float3 extent = hi - lo;
+        for (;;)
+        {
+            mDims = { std::max(1, int(std::ceil(extent.x / mCellSize))), std::max(1, int(std::ceil(extent.y / mCellSize))),
+                      std::max(1, int(std::ceil(extent.z / mCellSize))) };
+            double cells = double(mDims.x) * mDims.y * mDims.z;
+            if (cells <= kMaxCells) break;
+            mCellSize *= float(std::cbrt(cells / kMaxCells)) * 1.01f;
+        }
+        mOrigin = lo;
+
+        // counting sort of the (cell, vertex) pairs
+        mCells.assign(size_t(mDims.x) * mDims.y * mDims.z, { 0, 0 });
+        auto forCells = [&](const BlobVertex& v, auto&& f)
+        {
+            int3 a, b;
+            cellRange(v, a, b);
+            for (int z = a.z; z <= b.z; ++z)
+                for (int y = a.y; y <= b.y; ++y)
+                    for (int x = a.x; x <= b.x; ++x)
+                        f(mCells[cellIndex({ x, y, z })]);
+        };
+        for (const BlobVertex& v : mVertices) forCells(v, [](BlobCell& cell) { ++cell.count; });
+        uint32_t first = 0;
+        for (BlobCell& cell : mCells)
+        {
+            cell.first = first;
+            first += cell.count;
+            cell.count = 0;
+        }
+        mIndices.resize(first);
+        for (uint32_t i = 0; i < mVertices.size(); ++i)
+            forCells(mVertices[i], [&](BlobCell& cell) { mIndices[cell.first + cell.count++] = i; });
+
+        for (const BlobCell& cell : mCells)
+        {
+            float K = 0.f;
+            for (uint32_t i = cell.first; i < cell.first + cell.count; ++i)
+                K += FalloffK(mVertices[mIndices[i]].e, mVertices[mIndices[i]].R);
+            mKGlobal = std::max(mKGlobal, K);
+        }
+        if (mKGlobal == 0.f) mKGlobal = 1.f; // empty field
+    }
+
+    std::vector<BlobVertex> BlobGrid::randomField(uint32_t count, float radius, uint32_t seed)
+    {
+        std::mt19937 rng(seed);
+        const float L = .6f * radius * std::sqrt(float(count));
+        std::uniform_real_distribution<float> xz(-L, L), y(0.f, 1.5f * radius);
+        std::vector<BlobVertex> vertices(count);
+        for (BlobVertex& v : vertices)
+        {
+            v.c = float3(xz(rng), y(rng), xz(rng));
+            v.R = radius;
+            v.e = 1.f;
+        }
+        return vertices;
+    }
+
+    int3 BlobGrid::cellOf(float3 p) const
+    {
+        float3 g = clamp((p - mOrigin) / mCellSize, -1e+6f, 1e+6f);
+        return { int(std::floor(g.x)), int(std::floor(g.y)), int(std::floor(g.z)) };
+    }
+
+    void BlobGrid::cellRange(const BlobVertex& v, int3& lo, int3& hi) const
+    {
+        lo = cellOf(v.c - float3(v.R));
+        hi = cellOf(v.c + float3(v.R));
+        lo = { std::max(lo.x, 0), std::max(lo.y, 0), std::max(lo.z, 0) };
+        hi = { std::min(hi.x, mDims.x - 1), std::min(hi.y, mDims.y - 1), std::min(hi.z, mDims.z - 1) };
+    }
+
+    float BlobGrid::Field(float3 p) const
+    {
+        int3 c = cellOf(p);
+        if (!inside(c)) return 0.f;
+        const BlobCell& cell = mCells[cellIndex(c)];
+        float I = 0.f;
+        for (uint32_t i = cell.first; i < cell.first + cell.count; ++i)
+        {
+            const BlobVertex& v = mVertices[mIndices[i]];
+            I += Vertex(p, v.c, v.R, v.e);
+        }
+        return I;
+    }
+
+    float4 BlobGrid::FieldGradient(float3 p) const
+    {
+        int3 c = cellOf(p);
+        if (!inside(c)) return float4(0.f);
+        const BlobCell& cell = mCells[cellIndex(c)];
+        float4 g = float4(0.f);
+        for (uint32_t i = cell.first; i < cell.first + cell.count; ++i)
+        {
+            const BlobVertex& v = mVertices[mIndices[i]];
+            g = g + VertexGradient(p, v.c, v.R, v.e);
+        }
+        return g;
+    }
+
+    float BlobGrid::KSegment(float3 a, float3 b) const
+    {
+        // clip [a, b] to the grid box
+        float3 dir = b - a;
+        float t0 = 0.f, t1 = 1.f;
+        const float3 boxHi = mOrigin + mCellSize * float3(float(mDims.x), float(mDims.y), float(mDims.z));
+        for (int k = 0; k < 3; ++k)
+        {
+            float o = (&a.x)[k], d = (&dir.x)[k], lo = (&mOrigin.x)[k], hi = (&boxHi.x)[k];
+            if (d == 0.f)
+            {
+                if (o < lo || o > hi) return 0.f;
+                continue;
+            }
+            float ta = (lo - o) / d, tb = (hi - o) / d;
+            t0 = std::max(t0, std::min(ta, tb));
+            t1 = std::min(t1, std::max(ta, tb));
+        }
+        if (t0 > t1) return 0.f;
+
+        // walk the cells along the segment; a vertex is counted in the first of its cells the walk enters
+        int3 c = cellOf(a + t0 * dir);
+        c = { std::clamp(c.x, 0, mDims.x - 1), std::clamp(c.y, 0, mDims.y - 1), std::clamp(c.z, 0, mDims.z - 1) };
+        int step[3];
+        float tMax[3], tDelta[3];
+        for (int k = 0; k < 3; ++k)
+        {
+            float d = (&dir.x)[k];
+            step[k] = d > 0.f ? 1 : -1;
+            float boundary = (&mOrigin.x)[k] + mCellSize * float((&c.x)[k] + (d > 0.f ? 1 : 0));
+            tMax[k] = d != 0.f ? (boundary - (&a.x)[k]) / d : 1e+30f;
+            tDelta[k] = d != 0.f ? mCellSize / std::abs(d) : 1e+30f;
+        }
+
+        float K = 0.f;
+        int3 prev = { -1, -1, -1 };
+        bool hasPrev = false;
+        for (;;)
+        {
+            const BlobCell& cell = mCells[cellIndex(c)];
+            for (uint32_t i = cell.first; i < cell.first + cell.count; ++i)
+            {
+                const BlobVertex& v = mVertices[mIndices[i]];
+                if (hasPrev)
+                {
+                    int3 lo, hi;
+                    cellRange(v, lo, hi);
+                    if (prev.x >= lo.x && prev.x <= hi.x && prev.y >= lo.y && prev.y <= hi.y && prev.z >= lo.z && prev.z <= hi.z)
+                        continue;   // counted in the previous cell
+                }
+                K += VertexKSegment(v.c, v.R, v.e, a, b);
+            }
+
+            int k = tMax[0] < tMax[1] ? (tMax[0] < tMax[2] ? 0 : 2) : (tMax[1] < tMax[2] ? 1 : 2);
+            if (tMax[k] > t1) break;
+            prev = c;
+            hasPrev = true;
+            (&c.x)[k] += step[k];
+            if (!inside(c)) break;
+            tMax[k] += tDelta[k];
+        }
+        return K;
+    }
+
+    float BlobGrid::SphereBound(float3 p, float scale) const
+    {
+        int3 c = cellOf(p);
+        float d = 1e+10f;
+        for (int z = c.z - 1; z <= c.z + 1; ++z)
+            for (int y = c.y - 1; y <= c.y + 1; ++y)
+                for (int x = c.x - 1; x <= c.x + 1; ++x)
+                {
+                    if (!inside({ x, y, z })) continue;
+                    const BlobCell& cell = mCells[cellIndex({ x, y, z })];
+                    for (uint32_t i = cell.first; i < cell.first + cell.count; ++i)
+                    {
+                        const BlobVertex& v = mVertices[mIndices[i]];
+                        d = std::min(d, bdSphere(p - v.c, scale * v.R));
+                    }
+                }
+
+        if (c.x <= 1 && c.y <= 1 && c.z <= 1 && c.x >= mDims.x - 2 && c.y >= mDims.y - 2 && c.z >= mDims.z - 2)
+            return d;   // the block covers the whole grid
+
+        // Vertices not listed around c have their support, and so their sphere, outside the 3x3x3 block of cells,
+        // and all of them are inside the grid box: their distance is at least the larger of the two.
+        float3 blockLo = mOrigin + mCellSize * float3(float(c.x - 1), float(c.y - 1), float(c.z - 1));
+        float3 blockHi = blockLo + float3(3.f * mCellSize);
+        float3 toExit = min(p - blockLo, blockHi - p);
+        float blockDist = std::min(toExit.x, std::min(toExit.y, toExit.z));
+        const float3 boxHi = mOrigin + mCellSize * float3(float(mDims.x), float(mDims.y), float(mDims.z));
+        float gridDist = length(max(max(mOrigin - p, p - boxHi), 0.f));
+        return std::min(d, std::max(blockDist, gridDist));
+    }
+}
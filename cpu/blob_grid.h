@@ -0,0 +1,75 @@
+#pragma once
+
+// Uniform grid over the vertices of a blob field (see segment_tracing.h), so that the field, its Lipschitz
+// bounds and the sphere bound of bdBlobs only visit vertices whose support can reach the query.
+// Every vertex is listed in each cell its support box [c - R, c + R] overlaps, so a point query reads a single
+// cell, and a segment query walks the cells along the segment. The layout (vertices, cells as first/count into
+// indices) is uploaded as is to the structured buffers of BlobGrid.slang.
+
+#include "common.h"
+
+#include <vector>
+
+namespace bdf
+{
+    struct BlobVertex
+    {
+        float3 c;   // center
+        float R;    // radius of support
+        float e;    // energy
+    };
+
+    struct BlobCell
+    {
+        uint32_t first;
+        uint32_t count;
+    };
+
+    class BlobGrid
+    {
+    public:
+        // cellSize 0: the largest vertex radius
+        explicit BlobGrid(std::vector<BlobVertex> vertices, float cellSize = 0.f);
+
+        // count blobs of the given radius at random on a slab, with the same density for every count
+        static std::vector<BlobVertex> randomField(uint32_t count, float radius, uint32_t seed = 1);
+
+        // Sum of the vertex fields at p (Object() + T)
+        float Field(float3 p) const;
+
+        // Gradient and value of Field: float4(dField/dp, Field)
+        float4 FieldGradient(float3 p) const;
+
+        // Sum of the local Lipschitz bounds on [a, b] of the vertices whose support reaches the segment
+        float KSegment(float3 a, float3 b) const;
+
+        // Largest sum of the global vertex bounds in one cell: a Lipschitz bound of the whole field
+        float KGlobal() const { return mKGlobal; }
+
+        // min of bdSphere(p - c, scale * R) over the vertices, or a lower bound of it if the nearest is far
+        float SphereBound(float3 p, float scale) const;
+
+        float maxRadius() const { return mMaxRadius; }
+        float3 origin() const { return mOrigin; }
+        float cellSize() const { return mCellSize; }
+        int3 dims() const { return mDims; }
+        const std::vector<BlobVertex>& vertices() const { return mVertices; }
+        const std::vector<BlobCell>& cells() const { return mCells; }
+        const std::vector<uint32_t>& indices() const { return mIndices; }
+
+    private:
+        int3 cellOf(float3 p) const;
+        bool inside(int3 c) const { return c.x >= 0 && c.y >= 0 && c.z >= 0 && c.x < mDims.x && c.y < mDims.y && c.z < mDims.z; }
+        uint32_t cellIndex(int3 c) const { return uint32_t((c.z * mDims.y + c.y) * mDims.x + c.x); }
+        void cellRange(const BlobVertex& v, int3& lo, int3& hi) const;
+
+        std::vector<BlobVertex> mVertices;
+        std::vector<BlobCell> mCells;
+        std::vector<uint32_t> mIndices;
+        float3 mOrigin = float3(0.f);
+        float mCellSize = 1.f;
+        int3 mDims = { 1, 1, 1 };
+        float mKGlobal = 0.f;
+        float mMaxRadius = 0.f;
+    };
+}
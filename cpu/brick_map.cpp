@@ -0,0 +1,226 @@
+#include "brick_map.h"
+#include "blob_grid.h"
+#include "csg_scene.h"
+
+#include <cstdio>
+#include <cstring>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace bdf
+{
+    namespace
+    {
+        const char kMagic[8] = { 'B', 'D', 'F', 'B', 'R', 'I', 'C', 'K' };
+
+        // Read-only view of a whole file, null on failure
+        void* mapFile(const std::string& path, size_t& size)
+        {
+#ifdef _WIN32
+            HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+            if (file == INVALID_HANDLE_VALUE) return nullptr;
+            LARGE_INTEGER fileSize;
+            void* view = nullptr;
+            if (GetFileSizeEx(file, &fileSize) && fileSize.QuadPart > 0)
+            {
+                HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+                if (mapping)
+                {
+                    view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+                    CloseHandle(mapping);   // the view keeps the mapping alive
+                }
+                size = size_t(fileSize.QuadPart);
+            }
+            CloseHandle(file);
+            return view;
+#else
+            int fd = open(path.c_str(), O_RDONLY);
+            if (fd < 0) return nullptr;
+            struct stat st;
+            void* view = nullptr;
+            if (fstat(fd, &st) == 0 && st.st_size > 0)
+            {
+                view = mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+                if (view == MAP_FAILED) view = nullptr;
+                size = size_t(st.st_size);
+            }
+            close(fd);
+            return view;
+#endif
+        }
+
+        void unmapFile(void* view, size_t size)
+        {
+#ifdef _WIN32
+            (void)size;
+            UnmapViewOfFile(view);
+#else
+            munmap(view, size);
+#endif
+        }
+    }
+
+    BrickMap::~BrickMap()
+    {
+        unmap();
+    }
+
+    void BrickMap::unmap()
+    {
+        if (mMapping) unmapFile(mMapping, mMappingSize);
+        mMapping = nullptr;
+        mHeader = nullptr;
+        mCells = nullptr;
+        mVoxels = nullptr;
+    }
+
+    bool BrickMap::load(const std::string& path, std::string& error)
+    {
+        unmap();
+        size_t size = 0;
+        void* view = mapFile(path, size);
+        if (!view)
+        {
+            error = "cannot map '" + path + "'";
+            return false;
+        }
+        const Header& h = *static_cast<const Header*>(view);
+        const size_t cells = size >= sizeof(Header) ? size_t(std::max(h.dims[0], 0)) * std::max(h.dims[1], 0) * std::max(h.dims[2], 0) : 0;
+        const size_t voxels = size >= sizeof(Header) ? size_t(h.brickCount) * h.brickSize * h.brickSize * h.brickSize : 0;
+        const char* problem =
+            size < sizeof(Header) || std::memcmp(h.magic, kMagic, sizeof(kMagic)) ? "not a brick map" :
+            h.version != kVersion ? "unsupported version" :
+            h.fileSize != size ? "truncated" :
+            h.brickSize == 0 || !(h.voxelSize > 0.f) || cells == 0 ? "invalid header" :
+            h.cellOffset < sizeof(Header) || h.cellOffset + cells * sizeof(Cell) > size ||
+            h.voxelOffset < h.cellOffset + cells * sizeof(Cell) || h.voxelOffset + voxels * sizeof(float) > size ? "invalid offsets" :
+            nullptr;
+        if (!problem)
+        {   // bound() indexes the voxels with the cells as they are
+            const Cell* cellTable = reinterpret_cast<const Cell*>(static_cast<const char*>(view) + h.cellOffset);
+            for (size_t i = 0; i < cells && !problem; ++i)
+                if (cellTable[i].brick != kCollapsed && cellTable[i].brick >= h.brickCount) problem = "invalid brick index";
+        }
+        if (problem)
+        {
+            unmapFile(view, size);
+            error = path + ": " + problem;
+            return false;
+        }
+
+        mPath = path;
+        mMapping = view;
+        mMappingSize = size;
+        mHeader = &h;
+        mCells = reinterpret_cast<const Cell*>(static_cast<const char*>(view) + h.cellOffset);
+        mVoxels = reinterpret_cast<const float*>(static_cast<const char*>(view) + h.voxelOffset);
+        mOrigin = float3(h.origin[0], h.origin[1], h.origin[2]);
+        mDims = { h.dims[0], h.dims[1], h.dims[2] };
+        mBrickSize = h.brickSize;
+        mBrickVoxels = size_t(h.brickSize) * h.brickSize * h.brickSize;
+        mVoxelSize = h.voxelSize;
+        mInvBrickExtent = 1.f / (h.voxelSize * float(h.brickSize));
+        return true;
+    }
+
+    uint64_t brickMapSceneHash(Scenes scene, const SceneParams& params)
+    {   // FNV-1a over the values, field by field so that no padding is hashed
+        uint64_t hash = 14695981039346656037ull;
+        auto add = [&hash](const auto& value)
+        {
+            const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&value);
+            for (size_t i = 0; i < sizeof(value); ++i) hash = (hash ^ bytes[i]) * 1099511628211ull;
+        };
+        auto add3 = [&add](const auto& v) { add(v.x); add(v.y); add(v.z); };
+        add(uint32_t(scene));
+        switch (scene)
+        {
+        case Scenes::BLOBS:
+            add(params.blobs.T);
+            if (params.blobs.grid)
+                for (const BlobVertex& v : params.blobs.grid->vertices())
+                {
+                    add3(v.c);
+                    add(v.R);
+                    add(v.e);
+                }
+            else add(params.blobs.radius);
+            break;
+        case Scenes::PRIMITIVES:
+            break;
+        case Scenes::CSG:
+            if (params.csg)
+            {
+                for (const CsgInstruction& in : params.csg->code)
+                {
+                    add(uint32_t(in.op));
+                    add(in.data);
+                }
+                for (float c : params.csg->constants) add(c);
+            }
+            break;
+        default:    // a primitive with repetition and ground plane, the test scene
+            add3(params.primitiveData);
+            if (scene == Scenes::TEST) add3(params.testPos);
+            add3(params.repeatNum);
+            add3(params.repeatDist);
+            add(params.planeOn);
+            break;
+        }
+        return hash;
+    }
+
+    BrickMapBake beginBrickMapBake(const BrickMapDesc& desc, const char* sceneLabel, uint64_t sceneHash)
+    {
+        BrickMapBake bake;
+        BrickMap::Header& h = bake.header;
+        std::memset(&h, 0, sizeof(h));
+        std::memcpy(h.magic, kMagic, sizeof(kMagic));
+        h.version = BrickMap::kVersion;
+        h.brickSize = std::max(desc.brickSize, 1u);
+        h.voxelSize = desc.voxelSize;
+        const float brickExtent = desc.voxelSize * float(h.brickSize);
+        const float3 extent = desc.hi - desc.lo;
+        h.origin[0] = desc.lo.x;
+        h.origin[1] = desc.lo.y;
+        h.origin[2] = desc.lo.z;
+        h.dims[0] = std::max(int(std::ceil(extent.x / brickExtent)), 1);
+        h.dims[1] = std::max(int(std::ceil(extent.y / brickExtent)), 1);
+        h.dims[2] = std::max(int(std::ceil(extent.z / brickExtent)), 1);
+        h.cellOffset = (sizeof(BrickMap::Header) + 63) & ~size_t(63);
+        std::snprintf(h.scene, sizeof(h.scene), "%s", sceneLabel);
+        h.sceneHash = sceneHash;
+        bake.cells.resize(size_t(h.dims[0]) * h.dims[1] * h.dims[2]);
+        return bake;
+    }
+
+    bool writeBrickMap(const std::string& path, const BrickMapBake& bake, std::string& error)
+    {
+        FILE* file = fopen(path.c_str(), "wb");
+        if (!file)
+        {
+            error = "cannot open '" + path + "'";
+            return false;
+        }
+        const BrickMap::Header& h = bake.header;
+        const char zeros[64] = {};
+        const size_t cellBytes = bake.cells.size() * sizeof(BrickMap::Cell);
+        bool ok = fwrite(&h, sizeof(h), 1, file) == 1 &&
+            fwrite(zeros, 1, size_t(h.cellOffset) - sizeof(h), file) == size_t(h.cellOffset) - sizeof(h) &&
+            fwrite(bake.cells.data(), 1, cellBytes, file) == cellBytes &&
+            fwrite(zeros, 1, size_t(h.voxelOffset - h.cellOffset) - cellBytes, file) == size_t(h.voxelOffset - h.cellOffset) - cellBytes &&
+            (bake.voxels.empty() || fwrite(bake.voxels.data(), sizeof(float), bake.voxels.size(), file) == bake.voxels.size());
+        ok = fclose(file) == 0 && ok;
+        if (!ok) error = "failed to write '" + path + "'";
+        return ok;
+    }
+}
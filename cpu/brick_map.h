@@ -0,0 +1,215 @@
+#pragma once
+
+// Baked cache of a static scene's BDF: a sparse two-level brick map over a box, stored in a file that is mapped
+// into memory as is, on the CPU (BrickMap::load) and as the GPU buffers of BrickMap.slang.
+//
+// The box is split into bricks of brickSize^3 voxels. Every brick cell of the top level stores a lower bound of the
+// BDF over the whole brick, from bdfT over the brick's Interval box (scenes.h); a step shorter than the BDF
+// is still a safe step, so the bound can stand in for the BDF anywhere in the brick. Bricks whose bound is larger
+// than a voxel are collapsed to it, and so are the bricks whose upper bound is not: deep inside solid geometry no
+// voxel bound could exceed a voxel, the BDF is evaluated exactly there anyway. The others point to brickSize^3 voxel
+// bounds computed the same way.
+// BrickMapScene answers its bdf from the map where the bound is larger than a voxel, and from the exact SCENE_BDF
+// near the surface and outside the box. The BDF is not Lipschitz (bdSphere grows as sqrt(d^2 - r^2)), so the bound
+// cannot be extrapolated from samples at the centers.
+//
+// The header names the scene and hashes what its BDF was baked from (brickMapSceneHash); a map only stands in for
+// the scene while both match.
+//
+// File layout, little endian, as the GPU buffers: Header, the dims.x * dims.y * dims.z Cells (x fastest) at
+// cellOffset, then brickCount * brickSize^3 voxel floats at voxelOffset (x fastest within a brick).
+
+#include "parallel.h"
+#include "scenes.h"
+
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <vector>
+
+namespace bdf
+{
+    class BrickMap
+    {
+    public:
+        static const uint32_t kVersion = 2;
+        static const uint32_t kCollapsed = 0xffffffffu;     // Cell::brick of a collapsed brick
+
+        struct Header
+        {
+            char magic[8];          // "BDFBRICK"
+            uint32_t version;
+            uint32_t brickSize;     // voxels per brick side
+            float origin[3];        // lower corner of the box
+            float voxelSize;
+            int32_t dims[3];        // bricks per axis
+            uint32_t brickCount;    // bricks with voxels
+            uint64_t cellOffset;
+            uint64_t voxelOffset;
+            uint64_t fileSize;
+            char scene[64];         // kSceneLabels entry the map was baked from
+            uint64_t sceneHash;     // brickMapSceneHash of the scene
+        };
+
+        struct Cell
+        {
+            float s;                // lower bound of the BDF over the brick
+            uint32_t brick;         // index of the voxels, kCollapsed if none
+        };
+
+        BrickMap() = default;
+        ~BrickMap();
+        BrickMap(const BrickMap&) = delete;
+        BrickMap& operator=(const BrickMap&) = delete;
+
+        // Maps the file and checks its header; on failure returns false with a message in error.
+        bool load(const std::string& path, std::string& error);
+
+        const Header& header() const { return *mHeader; }
+        const std::string& path() const { return mPath; }    // of the mapped file
+        const Cell* cells() const { return mCells; }
+        const float* voxels() const { return mVoxels; }
+        size_t cellCount() const { return size_t(mHeader->dims[0]) * mHeader->dims[1] * mHeader->dims[2]; }
+        size_t voxelCount() const { return size_t(mHeader->brickCount) * mBrickVoxels; }
+
+        // Below this bound the exact BDF is evaluated
+        float nearDistance() const { return mVoxelSize; }
+
+        // Lower bound of the BDF at p, -infinity outside the box
+        float bound(float3 p) const
+        {
+            const float3 q = (p - mOrigin) * mInvBrickExtent;
+            if (!(q.x >= 0.f && q.y >= 0.f && q.z >= 0.f && q.x < mDims.x && q.y < mDims.y && q.z < mDims.z))
+                return -std::numeric_limits<float>::infinity();
+            const int3 c = { int(q.x), int(q.y), int(q.z) };
+            const Cell& cell = mCells[(size_t(c.z) * mDims.y + c.y) * mDims.x + c.x];
+            if (cell.brick == kCollapsed) return cell.s;
+            const int n = int(mBrickSize);
+            const float3 v = (q - float3(float(c.x), float(c.y), float(c.z))) * float(n);
+            const int3 i = { std::min(int(v.x), n - 1), std::min(int(v.y), n - 1), std::min(int(v.z), n - 1) };
+            return std::max(cell.s, mVoxels[size_t(cell.brick) * mBrickVoxels + (size_t(i.z) * n + i.y) * n + i.x]);
+        }
+
+    private:
+        void unmap();
+
+        std::string mPath;
+        void* mMapping = nullptr;
+        size_t mMappingSize = 0;
+        const Header* mHeader = nullptr;
+        const Cell* mCells = nullptr;
+        const float* mVoxels = nullptr;
+        float3 mOrigin = float3(0.f);
+        int3 mDims = { 0, 0, 0 };
+        uint32_t mBrickSize = 0;
+        size_t mBrickVoxels = 0;
+        float mVoxelSize = 0.f, mInvBrickExtent = 0.f;
+    };
+
+    struct BrickMapDesc
+    {
+        float3 lo = float3(-16.f), hi = float3(16.f);   // box to bake
+        float voxelSize = 1.f / 16.f;
+        uint32_t brickSize = 8;
+        uint32_t threadCount = 0;                       // 0: one per hardware thread
+    };
+
+    // A baked map before it is written
+    struct BrickMapBake
+    {
+        BrickMap::Header header;
+        std::vector<BrickMap::Cell> cells;
+        std::vector<float> voxels;
+    };
+
+    // Hash of everything the BDF of scene depends on: the SceneParams fields it reads, the CSG program of a scene file
+    // and the vertices of a blob grid.
+    uint64_t brickMapSceneHash(Scenes scene, const SceneParams& params);
+
+    BrickMapBake beginBrickMapBake(const BrickMapDesc& desc, const char* sceneLabel, uint64_t sceneHash);
+    bool writeBrickMap(const std::string& path, const BrickMapBake& bake, std::string& error);
+
+    // Bounds the BDF of scene over the bricks, then over the voxels of the bricks whose bounds straddle a voxel, both
+    // in parallel. Brick indices follow the cell order, so the file does not depend on the threads.
+    template <class SceneT>
+    BrickMapBake bakeBrickMap(const SceneT& scene, const char* sceneLabel, uint64_t sceneHash, const BrickMapDesc& desc)
+    {
+        BrickMapBake bake = beginBrickMapBake(desc, sceneLabel, sceneHash);
+        const BrickMap::Header& h = bake.header;
+        const int n = int(h.brickSize);
+        const float3 origin = float3(h.origin[0], h.origin[1], h.origin[2]);
+        const float brickExtent = h.voxelSize * float(n);
+        const uint32_t cellCount = uint32_t(bake.cells.size());
+        auto cellCoord = [&](uint32_t i) { return int3{ int(i % uint32_t(h.dims[0])), int(i / uint32_t(h.dims[0]) % uint32_t(h.dims[1])), int(i / uint32_t(h.dims[0] * h.dims[1])) }; };
+
+        std::vector<float> upper(cellCount);
+        parallelFor(cellCount, desc.threadCount, [&](uint32_t i, uint32_t)
+        {
+            const int3 c = cellCoord(i);
+            const float3 lo = origin + float3(float(c.x), float(c.y), float(c.z)) * brickExtent;
+            const Interval b = bdfT(scene, intervalBox(lo, lo + brickExtent));
+            bake.cells[i].s = b.lo;
+            upper[i] = b.hi;
+        });
+        uint32_t brickCount = 0;
+        for (uint32_t i = 0; i < cellCount; ++i)
+        {   // a voxel bound is at most the brick's upper bound: at or below a voxel, bound() falls back to the BDF
+            BrickMap::Cell& cell = bake.cells[i];
+            cell.brick = cell.s > h.voxelSize || upper[i] <= h.voxelSize ? BrickMap::kCollapsed : brickCount++;
+        }
+
+        const size_t brickVoxels = size_t(n) * n * n;
+        bake.voxels.resize(size_t(brickCount) * brickVoxels);
+        bake.header.brickCount = brickCount;
+        bake.header.voxelOffset = bake.header.cellOffset + ((bake.cells.size() * sizeof(BrickMap::Cell) + 63) & ~size_t(63));
+        bake.header.fileSize = bake.header.voxelOffset + bake.voxels.size() * sizeof(float);
+        parallelFor(cellCount, desc.threadCount, [&](uint32_t i, uint32_t)
+        {
+            const uint32_t brick = bake.cells[i].brick;
+            if (brick == BrickMap::kCollapsed) return;
+            const int3 c = cellCoord(i);
+            float* voxels = &bake.voxels[size_t(brick) * brickVoxels];
+            for (int z = 0; z < n; ++z)
+                for (int y = 0; y < n; ++y)
+                    for (int x = 0; x < n; ++x)
+                    {
+                        const float3 lo = origin + float3(float(c.x * n + x), float(c.y * n + y), float(c.z * n + z)) * h.voxelSize;
+                        voxels[(z * n + y) * n + x] = bdfT(scene, intervalBox(lo, lo + h.voxelSize)).lo;
+                    }
+        });
+        return bake;
+    }
+
+    // SceneT with its bdf answered from the map away from the surface. sdf and sdg are the scene's.
+    template <class SceneT>
+    struct BrickMapScene
+    {
+        const SceneT& scene;
+        const BrickMap& map;
+        const SceneParams& params;
+
+        BrickMapScene(const SceneT& scene_, const BrickMap& map_) : scene(scene_), map(map_), params(scene_.params) {}
+
+        float sdf(float3 p) const { return scene.sdf(p); }
+        float4 sdg(float3 p) const { return scene.sdg(p); }
+        float bdf(float3 p) const
+        {
+            const float b = map.bound(p);
+            return b > map.nearDistance() ? b : scene.bdf(p);
+        }
+    };
+
+    // Lanes take the map one by one; intervals and duals (interval_segment_trace) bound the scene itself, as the map
+    // only answers points
+    template <class SceneT, class V>
+    scalar_t<V> bdfT(const BrickMapScene<SceneT>& scene, const V& p)
+    {
+        if constexpr (isLaneType<scalar_t<V>>)
+            return bdfLaneByLane(scene, p);
+        else if constexpr (std::is_same_v<V, float3>)
+            return scene.bdf(p);
+        else
+            return bdfT(scene.scene, p);
+    }
+}
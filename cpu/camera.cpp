@@ -0,0 +1,67 @@
+#include "camera.h"
+
+namespace bdf
+{
+    float4x4 inverse(const float4x4& M)
+    {
+        const float* m = &M.m[0][0];
+        float inv[16];
+        inv[0] = m[5] * m[10] * m[15] - m[5] * m[11] * m[14] - m[9] * m[6] * m[15] + m[9] * m[7] * m[14] + m[13] * m[6] * m[11] - m[13] * m[7] * m[10];
+        inv[4] = -m[4] * m[10] * m[15] + m[4] * m[11] * m[14] + m[8] * m[6] * m[15] - m[8] * m[7] * m[14] - m[12] * m[6] * m[11] + m[12] * m[7] * m[10];
+        inv[8] = m[4] * m[9] * m[15] - m[4] * m[11] * m[13] - m[8] * m[5] * m[15] + m[8] * m[7] * m[13] + m[12] * m[5] * m[11] - m[12] * m[7] * m[9];
+        inv[12] = -m[4] * m[9] * m[14] + m[4] * m[10] * m[13] + m[8] * m[5] * m[14] - m[8] * m[6] * m[13] - m[12] * m[5] * m[10] + m[12] * m[6] * m[9];
+        inv[1] = -m[1] * m[10] * m[15] + m[1] * m[11] * m[14] + m[9] * m[2] * m[15] - m[9] * m[3] * m[14] - m[13] * m[2] * m[11] + m[13] * m[3] * m[10];
+        inv[5] = m[0] * m[10] * m[15] - m[0] * m[11] * m[14] - m[8] * m[2] * m[15] + m[8] * m[3] * m[14] + m[12] * m[2] * m[11] - m[12] * m[3] * m[10];
+        inv[9] = -m[0] * m[9] * m[15] + m[0] * m[11] * m[13] + m[8] * m[1] * m[15] - m[8] * m[3] * m[13] - m[12] * m[1] * m[11] + m[12] * m[3] * m[9];
+        inv[13] = m[0] * m[9] * m[14] - m[0] * m[10] * m[13] - m[8] * m[1] * m[14] + m[8] * m[2] * m[13] + m[12] * m[1] * m[10] - m[12] * m[2] * m[9];
+        inv[2] = m[1] * m[6] * m[15] - m[1] * m[7] * m[14] - m[5] * m[2] * m[15] + m[5] * m[3] * m[14] + m[13] * m[2] * m[7] - m[13] * m[3] * m[6];
+        inv[6] = -m[0] * m[6] * m[15] + m[0] * m[7] * m[14] + m[4] * m[2] * m[15] - m[4] * m[3] * m[14] - m[12] * m[2] * m[7] + m[12] * m[3] * m[6];
+        inv[10] = m[0] * m[5] * m[15] - m[0] * m[7] * m[13] - m[4] * m[1] * m[15] + m[4] * m[3] * m[13] + m[12] * m[1] * m[7] - m[12] * m[3] * m[5];
+        inv[14] = -m[0] * m[5] * m[14] + m[0] * m[6] * m[13] + m[4] * m[1] * m[14] - m[4] * m[2] * m[13] - m[12] * m[1] * m[6] + m[12] * m[2] * m[5];
+        inv[3] = -m[1] * m[6] * m[11] + m[1] * m[7] * m[10] + m[5] * m[2] * m[11] - m[5] * m[3] * m[10] - m[9] * m[2] * m[7] + m[9] * m[3] * m[6];
+        inv[7] = m[0] * m[6] * m[11] - m[0] * m[7] * m[10] - m[4] * m[2] * m[11] + m[4] * m[3] * m[10] + m[8] * m[2] * m[7] - m[8] * m[3] * m[6];
+        inv[11] = -m[0] * m[5] * m[11] + m[0] * m[7] * m[9] + m[4] * m[1] * m[11] - m[4] * m[3] * m[9] - m[8] * m[1] * m[7] + m[8] * m[3] * m[5];
+        inv[15] = m[0] * m[5] * m[10] - m[0] * m[6] * m[9] - m[4] * m[1] * m[10] + m[4] * m[2] * m[9] + m[8] * m[1] * m[6] - m[8] * m[2] * m[5];
+
+        float det = m[0] * inv[0] + m[1] * inv[4] + m[2] * inv[8] + m[3] * inv[12];
+        float4x4 r;
+        float* o = &r.m[0][0];
+        for (int i = 0; i < 16; ++i) o[i] = inv[i] / det;
+        return r;
+    }
+
+    CameraData CameraData::create(const CameraDesc& desc, float aspectRatio)
+    {
+        float3 f = normalize(desc.target - desc.position);
+        float3 s = normalize(cross(f, desc.up));
+        float3 u = cross(s, f);
+        float4x4 view = float4x4::identity();
+        view.m[0][0] = s.x; view.m[0][1] = s.y; view.m[0][2] = s.z; view.m[0][3] = -dot(s, desc.position);
+        view.m[1][0] = u.x; view.m[1][1] = u.y; view.m[1][2] = u.z; view.m[1][3] = -dot(u, desc.position);
+        view.m[2][0] = -f.x; view.m[2][1] = -f.y; view.m[2][2] = -f.z; view.m[2][3] = dot(f, desc.position);
+
+        float tanHalfFovY = std::tan(desc.fovY * 0.5f);
+        float4x4 proj;
+        proj.m[0][0] = 1.f / (aspectRatio * tanHalfFovY);
+        proj.m[1][1] = 1.f / tanHalfFovY;
+        proj.m[2][2] = desc.farZ / (desc.nearZ - desc.farZ);
+        proj.m[2][3] = -(desc.farZ * desc.nearZ) / (desc.farZ - desc.nearZ);
+        proj.m[3][2] = -1.f;
+
+        CameraData data;
+        data.camEye = desc.position;
+        data.camViewProj = mul(proj, view);
+        data.camInvViewProj = inverse(data.camViewProj);
+        return data;
+    }
+
+    Ray getCameraRay(const CameraData& camera, float2 fragCoord, float2 iResolution, float maxDist)
+    {
+        float2 px = (2.f * fragCoord - iResolution) / iResolution * float2(1, -1);
+        float4 far = mul(camera.camInvViewProj, float4(px.x, px.y, 1, 1));
+        float4 near = mul(camera.camInvViewProj, float4(px.x, px.y, 0, 1));
+        float3 dir = normalize(far.xyz() / far.w - near.xyz() / near.w);
+        Ray res = { camera.camEye, 0.00f, dir, maxDist };
+        return res;
+    }
+}
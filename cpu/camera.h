@@ -0,0 +1,22 @@
+#pragma once
+
+// The Camera cbuffer of BDF.ps.slang, built the way Falcor's Camera builds its matrices
+// (right handed look-at, perspective projection to [0,1] depth).
+
+#include "common.h"
+#include "settings.h"
+
+namespace bdf
+{
+    struct CameraData
+    {
+        float3 camEye;
+        float4x4 camViewProj;
+        float4x4 camInvViewProj;
+
+        static CameraData create(const CameraDesc& desc, float aspectRatio);
+    };
+
+    // getCameraRay of BDF.ps.slang; fragCoord is in pixels with (0,0) at the top left corner.
+    Ray getCameraRay(const CameraData& camera, float2 fragCoord, float2 iResolution, float maxDist);
+}
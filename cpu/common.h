@@ -0,0 +1,55 @@
+#pragma once
+
+// Host mirror of common.slang
+
+#include "vector_math.h"
+
+namespace bdf
+{
+    struct Ray
+    {
+        float3 P;
+        float Tmin;
+        float3 V;
+        float Tmax;
+    };
+
+    struct SphereTraceDesc
+    {
+        float epsilon; //Stopping distance to surface
+        int maxiters; //Maximum iteration count
+    };
+
+    struct TraceResult
+    {
+        float T; // Distance taken on ray
+        int flags; // flags bit 0:   distance condition:     true if travelled to far t > t_max
+        int steps; // flags bit 1:   surface condition:      true if distance to surface is small < error threshold
+    };             // flags bit 2:   iteration condition:    true if the step budget ran out
+
+    constexpr float pi = 3.1415926535897932384626433832795f;
+
+    inline float3 Uncharted2ToneMapping(float3 color)
+    { //https://www.shadertoy.com/view/lslGzl
+        const float A = 0.15f, B = 0.50f, C = 0.10f, D = 0.20f, E = 0.02f, F = 0.30f, W = 11.2f, exposure = 1.f, gammainv = 1.f / 2.2f;
+        const float white = (W * (A * W + C * B) + D * E) / (W * (A * W + B) + D * F) - E / F;
+        color *= exposure;
+        color = (color * (color * A + C * B) + D * E) / (color * (color * A + B) + D * F) - E / F;
+        return pow(color / white, float3(gammainv));
+    }
+
+    inline float3 hsv2rgb(float3 c)
+    {
+        const float4 K = float4(1.f, 2.f / 3.f, 1.f / 3.f, 3.f);
+        return c.z * mix(float3(K.x), clamp(abs(fract(float3(c.x) + K.xyz()) * 6.f - float3(K.w)) - float3(K.x), 0.f, 1.f), c.y);
+    }
+
+    inline float min3(float a, float b, float c) { return std::min(std::min(a, b), c); }
+    inline float min3(float3 a) { return std::min(a.x, std::min(a.y, a.z)); }
+    inline float max3(float a, float b, float c) { return std::max(std::max(a, b), c); }
+    inline float max3(float3 a) { return std::max(a.x, std::max(a.y, a.z)); }
+
+    inline float dot2(float2 a) { return dot(a, a); }
+    inline float dot2(float3 a) { return dot(a, a); }
+    inline float dot2(float a) { return a * a; }
+}
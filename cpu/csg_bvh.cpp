@@ -0,0 +1,266 @@
+#include "csg_bvh.h"
+
+#include <algorithm>
+
+namespace bdf
+{
+    namespace
+    {
+        struct PrimitiveRef
+        {
+            Aabb box;
+            float3 centroid;
+            float bound2;                   // square of primitiveBound
+            std::vector<uint32_t> chain;    // instruction indices: transforms from the root, then the primitive
+        };
+
+        // Box of a primitive in its own frame; false if it is unbounded.
+        bool primitiveBox(CsgOp op, const float* c, Aabb& box)
+        {
+            float3 e;
+            switch (op)
+            {
+            case CsgOp::SPHERE: e = float3(c[0]); break;
+            case CsgOp::BOX: e = float3(c[0], c[1], c[2]); break;
+            case CsgOp::CYLINDER: e = float3(c[0], c[1], c[0]); break;
+            case CsgOp::TORUS: e = float3(c[0] + c[1], c[1], c[0] + c[1]); break;
+            default: return false;  // cone, plane
+            }
+            box.lo = -1.f * e;
+            box.hi = e;
+            return true;
+        }
+
+        // Smallest ratio of the primitive's sd and bd to the distance to its box. bdCylinder scales the squared
+        // distance to the nearest edge by .95 where the point is beside the cap or level with the side; the other
+        // terms and primitives are at least the box distance. Transforms scale both alike. Slightly below sqrt(.95)
+        // against rounding.
+        float primitiveBound(CsgOp op)
+        {
+            return op == CsgOp::CYLINDER ? .97f : 1.f;
+        }
+
+        // Box of the children of a transform in the transform's parent frame.
+        Aabb transformBox(CsgOp op, const float* c, const Aabb& box)
+        {
+            Aabb out = box;
+            switch (op)
+            {
+            case CsgOp::TRANSLATE:
+                out.lo = box.lo + float3(c[0], c[1], c[2]);
+                out.hi = box.hi + float3(c[0], c[1], c[2]);
+                break;
+            case CsgOp::ROTATE:
+            {   // c maps parent to child, its transpose maps the child box back
+                float3 m = box.center(), e = .5f * (box.hi - box.lo), cm, ce;
+                cm = float3(c[0] * m.x + c[3] * m.y + c[6] * m.z, c[1] * m.x + c[4] * m.y + c[7] * m.z, c[2] * m.x + c[5] * m.y + c[8] * m.z);
+                ce = float3(std::abs(c[0]) * e.x + std::abs(c[3]) * e.y + std::abs(c[6]) * e.z,
+                            std::abs(c[1]) * e.x + std::abs(c[4]) * e.y + std::abs(c[7]) * e.z,
+                            std::abs(c[2]) * e.x + std::abs(c[5]) * e.y + std::abs(c[8]) * e.z);
+                out.lo = cm - ce;
+                out.hi = cm + ce;
+                break;
+            }
+            case CsgOp::SCALE:
+                out.lo = c[0] * box.lo;
+                out.hi = c[0] * box.hi;
+                break;
+            case CsgOp::REPEAT:
+            {   // copies at -count..count times the distance
+                float3 r = float3(c[0] * c[3], c[1] * c[4], c[2] * c[5]);
+                out.lo = box.lo - r;
+                out.hi = box.hi + r;
+                break;
+            }
+            default: break;
+            }
+            return out;
+        }
+
+        class Builder
+        {
+        public:
+            Builder(std::vector<PrimitiveRef>& refs, const CsgBvh::Options& options, uint32_t maxDepth)
+                : mRefs(refs), mOptions(options), mMaxDepth(maxDepth) {}
+
+            struct BuildNode
+            {
+                Aabb box;
+                float bound2;
+                uint32_t first, count;  // refs range for leaves
+                uint32_t right;         // inner node: index of the right child
+            };
+
+            std::vector<BuildNode> nodes;
+            std::vector<uint32_t> order;    // ref indices in leaf order
+            uint32_t depth = 0;
+
+            void build()
+            {
+                order.resize(mRefs.size());
+                for (uint32_t i = 0; i < order.size(); ++i) order[i] = i;
+                if (!order.empty()) buildNode(0, uint32_t(order.size()), 1);
+            }
+
+        private:
+            uint32_t buildNode(uint32_t first, uint32_t count, uint32_t level)
+            {
+                depth = std::max(depth, level);
+                uint32_t index = uint32_t(nodes.size());
+                nodes.push_back({});
+                Aabb box, centroids;
+                float bound2 = 1.f;
+                for (uint32_t i = first; i < first + count; ++i)
+                {
+                    box.extend(mRefs[order[i]].box);
+                    centroids.extend(mRefs[order[i]].centroid);
+                    bound2 = std::min(bound2, mRefs[order[i]].bound2);
+                }
+                nodes[index].box = box;
+                nodes[index].bound2 = bound2;
+
+                uint32_t mid;
+                if (count <= mOptions.maxLeafSize || level + 1 >= mMaxDepth || !split(first, count, box, centroids, mid))
+                {
+                    nodes[index].first = first;
+                    nodes[index].count = count;
+                    return index;
+                }
+                nodes[index].count = 0;
+                buildNode(first, mid - first, level + 1);
+                uint32_t right = buildNode(mid, first + count - mid, level + 1);
+                nodes[index].right = right;
+                return index;
+            }
+
+            // Binned SAH split of order[first, first + count); false if a leaf is cheaper.
+            bool split(uint32_t first, uint32_t count, const Aabb& box, const Aabb& centroids, uint32_t& mid)
+            {
+                const uint32_t binCount = std::max(mOptions.binCount, 2u);
+                float3 extent = centroids.hi - centroids.lo;
+                int axis = extent.x >= extent.y && extent.x >= extent.z ? 0 : extent.y >= extent.z ? 1 : 2;
+                float lo = (&centroids.lo.x)[axis], ext = (&extent.x)[axis];
+                auto* begin = order.data() + first;
+                if (ext <= 0.f)
+                {   // all centroids coincide: only a median split can make progress
+                    mid = first + count / 2;
+                    return count > 2 * mOptions.maxLeafSize;
+                }
+
+                auto binOf = [&](uint32_t ref)
+                {
+                    uint32_t b = uint32_t(float(binCount) * ((&mRefs[ref].centroid.x)[axis] - lo) / ext);
+                    return std::min(b, binCount - 1);
+                };
+                std::vector<Aabb> bins(binCount);
+                std::vector<uint32_t> counts(binCount, 0);
+                for (uint32_t i = 0; i < count; ++i)
+                {
+                    uint32_t b = binOf(begin[i]);
+                    bins[b].extend(mRefs[begin[i]].box);
+                    ++counts[b];
+                }
+
+                // cost of splitting after bin b: areas of both sides times their primitive counts
+                std::vector<float> rightCost(binCount, 0.f);
+                Aabb acc;
+                uint32_t n = 0;
+                for (uint32_t b = binCount - 1; b > 0; --b)
+                {
+                    acc.extend(bins[b]);
+                    n += counts[b];
+                    rightCost[b - 1] = n ? acc.area() * float(n) : 0.f;
+                }
+                float best = 1e+30f;
+                uint32_t bestBin = 0;
+                acc = Aabb();
+                n = 0;
+                for (uint32_t b = 0; b + 1 < binCount; ++b)
+                {
+                    acc.extend(bins[b]);
+                    n += counts[b];
+                    float cost = (n ? acc.area() * float(n) : 0.f) + rightCost[b];
+                    if (n > 0 && n < count && cost < best)
+                    {
+                        best = cost;
+                        bestBin = b;
+                    }
+                }
+                const float kTraversalCost = 1.f;   // relative to one primitive evaluation
+                float leafCost = box.area() * float(count);
+                if (best >= 1e+30f || (count <= 4 * mOptions.maxLeafSize && kTraversalCost * box.area() + best >= leafCost))
+                    return false;
+
+                auto* split = std::partition(begin, begin + count, [&](uint32_t ref) { return binOf(ref) <= bestBin; });
+                mid = first + uint32_t(split - begin);
+                return true;
+            }
+
+            std::vector<PrimitiveRef>& mRefs;
+            const CsgBvh::Options& mOptions;
+            uint32_t mMaxDepth;
+        };
+    }
+
+    CsgBvh::CsgBvh(const CsgProgram& program, const Options& options)
+    {
+        mConstants = program.constants;
+
+        // Walk the program with the stack of enclosing transforms; each primitive gets its chain and world box.
+        std::vector<PrimitiveRef> refs;
+        std::vector<std::vector<uint32_t>> unbounded;
+        std::vector<uint32_t> chain;
+        for (uint32_t i = 0; i < program.code.size(); ++i)
+        {
+            const CsgInstruction& in = program.code[i];
+            if (in.op == CsgOp::POP)
+            {
+                chain.pop_back();
+                continue;
+            }
+            if (in.op >= CsgOp::TRANSLATE)
+            {
+                chain.push_back(i);
+                continue;
+            }
+            std::vector<uint32_t> primChain = chain;
+            primChain.push_back(i);
+            Aabb box;
+            if (!primitiveBox(in.op, mConstants.data() + in.data, box))
+            {
+                unbounded.push_back(std::move(primChain));
+                continue;
+            }
+            for (auto t = chain.rbegin(); t != chain.rend(); ++t)
+                box = transformBox(program.code[*t].op, mConstants.data() + program.code[*t].data, box);
+            // pad against rounding, the culling test compares the box distance with the primitive's own
+            float3 pad = 1e-5f * (box.hi - box.lo) + float3(1e-6f);
+            box.lo = box.lo - pad;
+            box.hi = box.hi + pad;
+            float bound = primitiveBound(in.op);
+            refs.push_back({ box, box.center(), bound * bound, std::move(primChain) });
+        }
+
+        auto emit = [&](const std::vector<uint32_t>& primChain)
+        {
+            Primitive prim = { uint32_t(mCode.size()), uint32_t(primChain.size()) };
+            for (uint32_t index : primChain) mCode.push_back(program.code[index]);
+            return prim;
+        };
+        for (const auto& primChain : unbounded) mUnbounded.push_back(emit(primChain));
+
+        Builder builder(refs, options, kMaxDepth);
+        builder.build();
+        for (uint32_t ref : builder.order) mPrimitives.push_back(emit(refs[ref].chain));
+        mNodes.reserve(builder.nodes.size());
+        for (const Builder::BuildNode& n : builder.nodes)
+        {
+            mNodes.push_back({ n.box, n.count ? n.first : n.right, n.count, n.bound2 });
+            mStats.leafCount += n.count ? 1 : 0;
+        }
+        mStats.nodeCount = uint32_t(mNodes.size());
+        mStats.depth = builder.depth;
+        mStats.boundedCount = uint32_t(mPrimitives.size());
+        mStats.unboundedCount = uint32_t(mUnbounded.size());
+    }
+}
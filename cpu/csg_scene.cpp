@@ -0,0 +1,364 @@
+#include "csg_scene.h"
+
+#include "common.h"
+
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+
+namespace bdf
+{
+    namespace
+    {
+        struct Token
+        {
+            std::string text;
+            uint32_t line;
+        };
+
+        struct OpDesc
+        {
+            const char* keyword;
+            CsgOp op;
+            uint32_t operands;   // numbers read from the file
+        };
+
+        const OpDesc kOps[] = {
+            { "sphere", CsgOp::SPHERE, 1 }, { "box", CsgOp::BOX, 3 }, { "cylinder", CsgOp::CYLINDER, 2 },
+            { "torus", CsgOp::TORUS, 2 }, { "cone", CsgOp::CONE, 1 }, { "plane", CsgOp::PLANE, 3 },
+            { "translate", CsgOp::TRANSLATE, 3 }, { "rotate", CsgOp::ROTATE, 4 }, { "scale", CsgOp::SCALE, 1 },
+            { "repeat", CsgOp::REPEAT, 6 },
+        };
+
+        std::vector<Token> tokenize(const std::string& text)
+        {
+            std::vector<Token> tokens;
+            uint32_t line = 1;
+            for (size_t i = 0; i < text.size();)
+            {
+                char c = text[i];
+                if (c == '\n') { ++line; ++i; }
+                else if (c == '#') { while (i < text.size() && text[i] != '\n') ++i; }
+                else if (std::isspace(static_cast<unsigned char>(c))) ++i;
+                else if (c == '{' || c == '}') { tokens.push_back({ std::string(1, c), line }); ++i; }
+                else
+                {
+                    size_t end = i;
+                    while (end < text.size() && !std::isspace(static_cast<unsigned char>(text[end])) &&
+                           text[end] != '{' && text[end] != '}' && text[end] != '#') ++end;
+                    tokens.push_back({ text.substr(i, end - i), line });
+                    i = end;
+                }
+            }
+            return tokens;
+        }
+
+        class Parser
+        {
+        public:
+            Parser(const std::vector<Token>& tokens, CsgProgram& program) : mTokens(tokens), mProgram(program) {}
+
+            bool parse(std::string& error)
+            {
+                if (!parseNodes(0, false)) { error = mError; return false; }
+                if (mProgram.primitiveCount == 0) { error = "scene has no primitives"; return false; }
+                return true;
+            }
+
+        private:
+            bool fail(uint32_t line, const std::string& message)
+            {
+                mError = "line " + std::to_string(line) + ": " + message;
+                return false;
+            }
+
+            uint32_t line() const { return mPos < mTokens.size() ? mTokens[mPos].line : (mTokens.empty() ? 1 : mTokens.back().line); }
+
+            bool number(float& v)
+            {
+                if (mPos >= mTokens.size()) return fail(line(), "number expected at end of file");
+                const std::string& s = mTokens[mPos].text;
+                char* end;
+                v = std::strtof(s.c_str(), &end);
+                if (s.empty() || *end != '\0' || !std::isfinite(v)) return fail(line(), "number expected, got '" + s + "'");
+                ++mPos;
+                return true;
+            }
+
+            // Nodes until '}' (inside a block) or the end of the file (top level).
+            bool parseNodes(uint32_t depth, bool block)
+            {
+                while (mPos < mTokens.size())
+                {
+                    const Token& t = mTokens[mPos];
+                    if (t.text == "}")
+                    {
+                        if (!block) return fail(t.line, "unmatched '}'");
+                        ++mPos;
+                        return true;
+                    }
+                    if (!parseNode(depth)) return false;
+                }
+                return block ? fail(line(), "missing '}'") : true;
+            }
+
+            bool parseNode(uint32_t depth)
+            {
+                const Token& t = mTokens[mPos++];
+                if (t.text == "union") return block(t, depth);
+
+                const OpDesc* desc = nullptr;
+                for (const OpDesc& d : kOps)
+                    if (t.text == d.keyword) desc = &d;
+                if (!desc) return fail(t.line, "unknown node '" + t.text + "'");
+
+                float v[6];
+                for (uint32_t i = 0; i < desc->operands; ++i)
+                    if (!number(v[i])) return false;
+
+                CsgInstruction in = { desc->op, uint32_t(mProgram.constants.size()) };
+                std::vector<float>& c = mProgram.constants;
+                switch (desc->op)
+                {
+                case CsgOp::PLANE:
+                {
+                    float3 n = float3(v[0], v[1], v[2]);
+                    if (dot(n, n) == 0.f) return fail(t.line, "plane normal is zero");
+                    n = normalize(n);
+                    c.insert(c.end(), { n.x, n.y, n.z });
+                    break;
+                }
+                case CsgOp::ROTATE:
+                {
+                    float3 a = float3(v[0], v[1], v[2]);
+                    if (dot(a, a) == 0.f) return fail(t.line, "rotation axis is zero");
+                    a = normalize(a);
+                    float angle = v[3] * pi / 180.f, cs = std::cos(angle), sn = std::sin(angle), k = 1.f - cs;
+                    // transpose of the axis-angle rotation, i.e. the world to object rotation
+                    c.insert(c.end(), {
+                        cs + a.x * a.x * k,       a.x * a.y * k + a.z * sn, a.x * a.z * k - a.y * sn,
+                        a.y * a.x * k - a.z * sn, cs + a.y * a.y * k,       a.y * a.z * k + a.x * sn,
+                        a.z * a.x * k + a.y * sn, a.z * a.y * k - a.x * sn, cs + a.z * a.z * k });
+                    break;
+                }
+                case CsgOp::SCALE:
+                    if (!(v[0] > 0.f)) return fail(t.line, "scale must be positive");
+                    c.push_back(v[0]);
+                    break;
+                case CsgOp::REPEAT:
+                    for (int i = 0; i < 3; ++i)
+                    {
+                        if (v[i] < 0.f || v[i] != std::floor(v[i])) return fail(t.line, "repeat counts must be non-negative integers");
+                        if (v[i] != 0.f && !(v[i + 3] > 0.f)) return fail(t.line, "repeat distance must be positive");
+                    }
+                    c.insert(c.end(), v, v + 6);
+                    break;
+                default:
+                    c.insert(c.end(), v, v + desc->operands);
+                    break;
+                }
+
+                if (desc->op < CsgOp::TRANSLATE)
+                {
+                    mProgram.code.push_back(in);
+                    ++mProgram.primitiveCount;
+                    return true;
+                }
+                if (depth >= CsgProgram::kMaxDepth) return fail(t.line, "transforms nested too deep");
+                mProgram.code.push_back(in);
+                if (!block(t, depth + 1)) return false;
+                mProgram.code.push_back({ CsgOp::POP, 0 });
+                return true;
+            }
+
+            bool block(const Token& owner, uint32_t depth)
+            {
+                if (mPos >= mTokens.size() || mTokens[mPos].text != "{") return fail(owner.line, "'{' expected after '" + owner.text + "'");
+                ++mPos;
+                return parseNodes(depth, true);
+            }
+
+            const std::vector<Token>& mTokens;
+            CsgProgram& mProgram;
+            size_t mPos = 0;
+            std::string mError;
+        };
+
+        // Float literal that reads back to the same value.
+        std::string literal(float v)
+        {
+            char buf[32];
+            snprintf(buf, sizeof(buf), "%.9g", v);
+            std::string s = buf;
+            if (s.find_first_of(".en") == std::string::npos) s += '.';
+            return s;
+        }
+
+        std::string vec3Literal(const float* c)
+        {
+            return "vec3(" + literal(c[0]) + ", " + literal(c[1]) + ", " + literal(c[2]) + ")";
+        }
+
+        // One scene function (pre: sd, bd or sdg); every transform opens a block with its own p<depth>/s<depth>,
+        // and for sdg m<depth>, the linear part of the map from world coordinates to the block's (see applyCsgTransform).
+        void generateFunction(std::ostringstream& out, const CsgProgram& program, const std::string& pre)
+        {
+            const bool gradient = pre == "sdg";
+            if (gradient)
+                out << "vec4 sdgCSG(vec3 p0)\n{\n    vec4 d = vec4(0., 0., 0., 1e+10);\n    float s0 = 1.;\n"
+                    << "    float3x3 m0 = float3x3(1., 0., 0., 0., 1., 0., 0., 0., 1.);\n";
+            else
+                out << "float " << pre << "CSG(vec3 p0)\n{\n    float d = 1e+10;\n    float s0 = 1.;\n";
+            uint32_t depth = 0;
+            auto indent = [&]() { return std::string(4 * (depth + 1), ' '); };
+            for (const CsgInstruction& in : program.code)
+            {
+                const float* c = program.constants.data() + in.data;
+                std::string p = "p" + std::to_string(depth), s = "s" + std::to_string(depth);
+                std::string call;
+                switch (in.op)
+                {
+                case CsgOp::SPHERE: call = pre + "Sphere(" + p + ", " + literal(c[0]) + ")"; break;
+                case CsgOp::BOX: call = pre + "Box(" + p + ", " + vec3Literal(c) + ")"; break;
+                case CsgOp::CYLINDER: call = pre + "Cylinder(" + p + ", " + literal(c[0]) + ", " + literal(c[1]) + ")"; break;
+                case CsgOp::TORUS: call = pre + "Torus(" + p + ", vec2(" + literal(c[0]) + ", " + literal(c[1]) + "))"; break;
+                case CsgOp::CONE: call = pre + "Cone(" + p + ", " + literal(c[0]) + ")"; break;
+                case CsgOp::PLANE: call = pre + "Plane(" + p + ", " + vec3Literal(c) + ")"; break;
+                case CsgOp::POP:
+                    --depth;
+                    out << indent() << "}\n";
+                    continue;
+                default:
+                {
+                    out << indent() << "{\n";
+                    ++depth;
+                    std::string q = "p" + std::to_string(depth), t = "s" + std::to_string(depth);
+                    switch (in.op)
+                    {
+                    case CsgOp::TRANSLATE:
+                        out << indent() << "vec3 " << q << " = " << p << " - " << vec3Literal(c) << ";\n";
+                        out << indent() << "float " << t << " = " << s << ";\n";
+                        break;
+                    case CsgOp::ROTATE:
+                        out << indent() << "vec3 " << q << " = vec3(dot(" << vec3Literal(c) << ", " << p << "), dot("
+                            << vec3Literal(c + 3) << ", " << p << "), dot(" << vec3Literal(c + 6) << ", " << p << "));\n";
+                        out << indent() << "float " << t << " = " << s << ";\n";
+                        break;
+                    case CsgOp::SCALE:
+                        out << indent() << "vec3 " << q << " = " << p << " / " << literal(c[0]) << ";\n";
+                        out << indent() << "float " << t << " = " << s << " * " << literal(c[0]) << ";\n";
+                        break;
+                    case CsgOp::REPEAT:
+                        out << indent() << "vec3 " << q << " = " << p << ";\n";
+                        for (int i = 0; i < 3; ++i)
+                        {
+                            if (c[i] == 0.f) continue;
+                            std::string axis = q + "." + "xyz"[i];
+                            out << indent() << axis << " = REPLIM(" << axis << ", " << literal(c[i + 3]) << ", " << literal(c[i]) << ");\n";
+                        }
+                        out << indent() << "float " << t << " = " << s << ";\n";
+                        break;
+                    default: break;
+                    }
+                    if (!gradient) continue;
+                    std::string n = "m" + std::to_string(depth - 1), m = "m" + std::to_string(depth);
+                    out << indent() << "float3x3 " << m << " = ";
+                    if (in.op == CsgOp::ROTATE)
+                    {
+                        out << "mul(float3x3(";
+                        for (int i = 0; i < 9; ++i) out << (i ? ", " : "") << literal(c[i]);
+                        out << "), " << n << ");\n";
+                    }
+                    else if (in.op == CsgOp::SCALE) out << n << " / " << literal(c[0]) << ";\n";
+                    else out << n << ";\n";
+                    continue;
+                }
+                }
+                if (gradient)
+                    out << indent() << "{ vec4 g = " << call << "; d = sdgMin(d, vec4(" << s << " * mul(g.xyz, m" << depth
+                        << "), " << s << " * g.w)); }\n";
+                else
+                    out << indent() << "d = min(d, " << s << " * " << call << ");\n";
+            }
+            out << "    return d;\n}\n";
+        }
+    }
+
+    float4 CsgProgram::sdg(float3 p) const
+    {
+        float3 ps[kMaxDepth + 1], ms[kMaxDepth + 1][3];
+        float ss[kMaxDepth + 1];
+        float3 m[3] = { float3(1, 0, 0), float3(0, 1, 0), float3(0, 0, 1) };
+        uint32_t top = 0;
+        float s = 1.f;
+        float4 d = float4(0, 0, 0, 1e+10f);
+        for (const CsgInstruction& in : code)
+        {
+            const float* c = constants.data() + in.data;
+            if (in.op < CsgOp::TRANSLATE)
+                d = sdgMin(d, csgWorldGradient(sdgCsgPrimitive(in.op, c, p), m, s));
+            else if (in.op == CsgOp::POP)
+            {
+                --top;
+                p = ps[top];
+                s = ss[top];
+                for (int i = 0; i < 3; ++i) m[i] = ms[top][i];
+            }
+            else
+            {
+                ps[top] = p;
+                ss[top] = s;
+                for (int i = 0; i < 3; ++i) ms[top][i] = m[i];
+                ++top;
+                applyCsgTransform(in.op, c, p, s, m);
+            }
+        }
+        return d;
+    }
+
+    bool parseCsgScene(const std::string& text, CsgProgram& program, std::string& error)
+    {
+        CsgProgram parsed;
+        parsed.name = program.name;
+        std::vector<Token> tokens = tokenize(text);
+        if (!Parser(tokens, parsed).parse(error)) return false;
+        program = std::move(parsed);
+        return true;
+    }
+
+    bool loadCsgScene(const std::string& path, CsgProgram& program, std::string& error)
+    {
+        std::ifstream file(path, std::ios::binary);
+        if (!file)
+        {
+            error = "cannot open '" + path + "'";
+            return false;
+        }
+        std::ostringstream text;
+        text << file.rdbuf();
+        program.name = path;
+        if (!parseCsgScene(text.str(), program, error))
+        {
+            error = path + ": " + error;
+            return false;
+        }
+        return true;
+    }
+
+    std::string generateCsgSlang(const CsgProgram& program)
+    {
+        std::ostringstream out;
+        out << "// Generated from " << (program.name.empty() ? "a CSG scene" : program.name)
+            << " by generateCsgSlang (cpu/csg_scene.cpp), do not edit.\n"
+            << "// " << program.primitiveCount << " primitives\n\n";
+        generateFunction(out, program, "sd");
+        out << '\n';
+        generateFunction(out, program, "bd");
+        out << '\n';
+        generateFunction(out, program, "sdg");
+        return out.str();
+    }
+}
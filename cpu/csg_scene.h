@@ -0,0 +1,164 @@
+#pragma once
+
+// Data-driven CSG scenes. A scene file is parsed once into a flat instruction buffer (CsgProgram), which is
+// both interpreted on the CPU (sdf/bdf, no virtual dispatch) and translated into a matched pair of Slang
+// functions for BDF.ps.slang (generateCsgSlang). Both evaluators come from the same instructions, so the
+// SDF and the BDF of a scene always describe the same geometry.
+//
+// Format: whitespace separated tokens, '#' starts a comment. The scene is the union of its nodes:
+//   sphere <r>                      box <x> <y> <z>             cylinder <r> <h>
+//   torus <R> <r>                   cone <c>                    plane <nx> <ny> <nz>
+//   translate <x> <y> <z> { ... }   rotate <ax> <ay> <az> <degrees> { ... }
+//   scale <s> { ... }               repeat <nx> <ny> <nz> <dx> <dy> <dz> { ... }    (REPLIM, n = 0: no repetition)
+//   union { ... }
+// Transforms apply to the nodes inside their braces, the same way p is transformed before the primitive
+// call in sdPrimitives (translate t evaluates the children at p - t).
+
+#include "bdf_primitives.h"
+#include "sdf_primitives.h"
+
+#include <string>
+#include <vector>
+
+namespace bdf
+{
+    enum class CsgOp : uint32_t
+    {
+        // primitives: d = min(d, scale * prim(p, constants...))
+        SPHERE, BOX, CYLINDER, TORUS, CONE, PLANE,
+        // transforms push a new (p, scale) frame, POP restores the previous one
+        TRANSLATE, ROTATE, SCALE, REPEAT, POP
+    };
+
+    struct CsgInstruction
+    {
+        CsgOp op;
+        uint32_t data;  // offset of the operands in CsgProgram::constants
+    };
+
+    struct CsgProgram
+    {
+        static const uint32_t kMaxDepth = 32;   // transform nesting limit
+
+        std::string name;                       // file name the program was loaded from
+        std::vector<CsgInstruction> code;
+        std::vector<float> constants;
+        uint32_t primitiveCount = 0;
+
+        float sdf(float3 p) const { return eval<false>(p); }
+        float bdf(float3 p) const { return eval<true>(p); }
+        float4 sdg(float3 p) const;    // float4(gradient of sdf, sdf)
+
+        // p: float3 or a tvec3 of a number type of number_types.h
+        template <bool Bound, class V>
+        scalar_t<V> eval(V p) const;
+    };
+
+    // Parses scene text; on failure returns false with a "line N: ..." message in error.
+    bool parseCsgScene(const std::string& text, CsgProgram& program, std::string& error);
+    bool loadCsgScene(const std::string& path, CsgProgram& program, std::string& error);
+
+    // Slang source defining float sdCSG(vec3), float bdCSG(vec3) and vec4 sdgCSG(vec3) for SCENE_SDF/SCENE_BDF/SCENE_SDG.
+    std::string generateCsgSlang(const CsgProgram& program);
+
+    // d = prim(p) of a primitive instruction
+    template <bool Bound, class V>
+    inline scalar_t<V> evalCsgPrimitive(CsgOp op, const float* c, const V& p)
+    {
+        switch (op)
+        {
+        case CsgOp::SPHERE: return Bound ? bdSphere(p, c[0]) : sdSphere(p, c[0]);
+        case CsgOp::BOX: return Bound ? bdBox(p, float3(c[0], c[1], c[2])) : sdBox(p, float3(c[0], c[1], c[2]));
+        case CsgOp::CYLINDER: return Bound ? bdCylinder(p, c[0], c[1]) : sdCylinder(p, c[0], c[1]);
+        case CsgOp::TORUS: return Bound ? bdTorus(p, float2(c[0], c[1])) : sdTorus(p, float2(c[0], c[1]));
+        case CsgOp::CONE: return Bound ? bdCone(p, c[0]) : sdCone(p, c[0]);
+        case CsgOp::PLANE: default: return Bound ? bdPlane(p, float3(c[0], c[1], c[2])) : sdPlane(p, float3(c[0], c[1], c[2]));
+        }
+    }
+
+    // float4(gradient, d) of a primitive instruction
+    inline float4 sdgCsgPrimitive(CsgOp op, const float* c, float3 p)
+    {
+        switch (op)
+        {
+        case CsgOp::SPHERE: return sdgSphere(p, c[0]);
+        case CsgOp::BOX: return sdgBox(p, float3(c[0], c[1], c[2]));
+        case CsgOp::CYLINDER: return sdgCylinder(p, c[0], c[1]);
+        case CsgOp::TORUS: return sdgTorus(p, float2(c[0], c[1]));
+        case CsgOp::CONE: return sdgCone(p, c[0]);
+        case CsgOp::PLANE: default: return sdgPlane(p, float3(c[0], c[1], c[2]));
+        }
+    }
+
+    // Moves p (and the distance scale s) into the frame of a transform instruction's children
+    template <class V>
+    inline void applyCsgTransform(CsgOp op, const float* c, V& p, float& s)
+    {
+        switch (op)
+        {
+        case CsgOp::TRANSLATE: p = p - float3(c[0], c[1], c[2]); break;
+        case CsgOp::ROTATE:     // c: inverse rotation, row-major 3x3
+            p = V{ c[0] * p.x + c[1] * p.y + c[2] * p.z,
+                   c[3] * p.x + c[4] * p.y + c[5] * p.z,
+                   c[6] * p.x + c[7] * p.y + c[8] * p.z };
+            break;
+        case CsgOp::SCALE: p = V{ p.x / c[0], p.y / c[0], p.z / c[0] }; s *= c[0]; break;
+        case CsgOp::REPEAT:     // c: counts, distances
+            if (c[0] != 0.f) p.x = REPLIM(p.x, c[3], c[0]);
+            if (c[1] != 0.f) p.y = REPLIM(p.y, c[4], c[1]);
+            if (c[2] != 0.f) p.z = REPLIM(p.z, c[5], c[2]);
+            break;
+        default: break;
+        }
+    }
+
+    // Same, also moving m, the rows of the linear part of the map from world to frame coordinates, so that a
+    // gradient g of the frame is s * (g.x * m[0] + g.y * m[1] + g.z * m[2]) in world coordinates (csgWorldGradient)
+    inline void applyCsgTransform(CsgOp op, const float* c, float3& p, float& s, float3 m[3])
+    {
+        applyCsgTransform(op, c, p, s);
+        if (op == CsgOp::ROTATE)
+        {
+            float3 r[3] = { m[0], m[1], m[2] };
+            for (int i = 0; i < 3; ++i)
+                m[i] = c[3 * i] * r[0] + c[3 * i + 1] * r[1] + c[3 * i + 2] * r[2];
+        }
+        else if (op == CsgOp::SCALE)
+            for (int i = 0; i < 3; ++i) m[i] = m[i] / c[0];
+    }
+
+    inline float4 csgWorldGradient(float4 g, const float3 m[3], float s)
+    {
+        return float4(s * (g.x * m[0] + g.y * m[1] + g.z * m[2]), s * g.w);
+    }
+
+    template <bool Bound, class V>
+    scalar_t<V> CsgProgram::eval(V p) const
+    {
+        V ps[kMaxDepth + 1];
+        float ss[kMaxDepth + 1];
+        uint32_t top = 0;
+        float s = 1.f;
+        scalar_t<V> d = 1e+10f;
+        for (const CsgInstruction& in : code)
+        {
+            const float* c = constants.data() + in.data;
+            if (in.op < CsgOp::TRANSLATE)
+                d = min(d, s * evalCsgPrimitive<Bound>(in.op, c, p));
+            else if (in.op == CsgOp::POP)
+            {
+                --top;
+                p = ps[top];
+                s = ss[top];
+            }
+            else
+            {
+                ps[top] = p;
+                ss[top] = s;
+                ++top;
+                applyCsgTransform(in.op, c, p, s);
+            }
+        }
+        return d;
+    }
+}
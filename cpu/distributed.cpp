@@ -0,0 +1,637 @@
+#include "distributed.h"
+
+#include "blob_grid.h"
+#include "brick_map.h"
+#include "csg_bvh.h"
+#include "csg_scene.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <type_traits>
+
+#if !defined(_WIN32)
+#include <cerrno>
+#include <csignal>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+namespace bdf
+{
+#if defined(_WIN32)
+    bool renderDistributed(const std::vector<DistributedFrame>&, const DistributedDesc&, const FrameDone&, DistributedStats&,
+        std::string& error)
+    {
+        error = "Distributed rendering needs a POSIX host";
+        return false;
+    }
+
+    bool runWorker(int, std::string& error)
+    {
+        error = "Distributed rendering needs a POSIX host";
+        return false;
+    }
+#else
+    namespace
+    {
+        using Clock = std::chrono::steady_clock;
+
+        double elapsedMs(Clock::time_point start)
+        {
+            return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+        }
+
+        enum class MessageType : uint32_t { SETUP, TILE, RESULT, FAILURE };
+
+        // A message as sent: a header of type and size, then the values in memory layout; coordinator and workers
+        // are the same executable.
+        struct Message
+        {
+            MessageType type = MessageType::FAILURE;
+            std::vector<uint8_t> data;
+            size_t pos = 0;     // read position
+
+            template <class T>
+            void put(const T& v)
+            {
+                static_assert(std::is_trivially_copyable_v<T>, "sent as bytes");
+                putBytes(&v, sizeof(T));
+            }
+            void putBytes(const void* p, size_t size)
+            {
+                data.insert(data.end(), static_cast<const uint8_t*>(p), static_cast<const uint8_t*>(p) + size);
+            }
+            void putString(const std::string& s)
+            {
+                put(uint64_t(s.size()));
+                putBytes(s.data(), s.size());
+            }
+            template <class T>
+            void putVector(const std::vector<T>& v)
+            {
+                static_assert(std::is_trivially_copyable_v<T>, "sent as bytes");
+                put(uint64_t(v.size()));
+                putBytes(v.data(), v.size() * sizeof(T));
+            }
+
+            template <class T>
+            bool get(T& v)
+            {
+                static_assert(std::is_trivially_copyable_v<T>, "sent as bytes");
+                return getBytes(&v, sizeof(T));
+            }
+            bool getBytes(void* p, size_t size)
+            {
+                if (size > data.size() - pos) return false;
+                memcpy(p, data.data() + pos, size);
+                pos += size;
+                return true;
+            }
+            bool getString(std::string& s)
+            {
+                uint64_t size;
+                if (!get(size) || size > data.size() - pos) return false;
+                s.assign(reinterpret_cast<const char*>(data.data() + pos), size_t(size));
+                pos += size_t(size);
+                return true;
+            }
+            template <class T>
+            bool getVector(std::vector<T>& v)
+            {
+                uint64_t size;
+                if (!get(size) || size > (data.size() - pos) / sizeof(T)) return false;
+                v.resize(size_t(size));
+                return getBytes(v.data(), size_t(size) * sizeof(T));
+            }
+        };
+
+        struct MessageHeader
+        {
+            MessageType type;
+            uint32_t reserved;
+            uint64_t size;
+        };
+
+        bool sendAll(int fd, const void* p, size_t size)
+        {
+            const char* bytes = static_cast<const char*>(p);
+            while (size > 0)
+            {
+                const ssize_t n = ::send(fd, bytes, size, MSG_NOSIGNAL);
+                if (n < 0 && errno == EINTR) continue;
+                if (n <= 0) return false;
+                bytes += n;
+                size -= size_t(n);
+            }
+            return true;
+        }
+
+        bool receiveAll(int fd, void* p, size_t size)
+        {
+            char* bytes = static_cast<char*>(p);
+            while (size > 0)
+            {
+                const ssize_t n = ::recv(fd, bytes, size, 0);
+                if (n < 0 && errno == EINTR) continue;
+                if (n <= 0) return false;
+                bytes += n;
+                size -= size_t(n);
+            }
+            return true;
+        }
+
+        bool sendMessage(int fd, const Message& m)
+        {
+            const MessageHeader header = { m.type, 0, m.data.size() };
+            return sendAll(fd, &header, sizeof(header)) && sendAll(fd, m.data.data(), m.data.size());
+        }
+
+        bool receiveMessage(int fd, Message& m)
+        {
+            MessageHeader header;
+            if (!receiveAll(fd, &header, sizeof(header)) || header.size > (uint64_t(1) << 40)) return false;
+            m.type = header.type;
+            m.data.resize(size_t(header.size));
+            m.pos = 0;
+            return receiveAll(fd, m.data.data(), m.data.size());
+        }
+
+        // The fields of RenderSettings and CameraDesc sent to the workers, for both directions: all but the shared
+        // scene data (sent separately) and reprojection, which needs the frames in order
+        template <class S, class F>
+        bool visitSettings(S& s, F&& f)
+        {
+            return f(s.coloring) && f(s.coloringStepFunc) && f(s.colorA) && f(s.colorB) && f(s.colorC) && f(s.colorD) &&
+                   f(s.scene) && f(s.trace) && f(s.shadow) && f(s.normal) && f(s.primaryMaxIter) && f(s.primaryMaxDist) &&
+                   f(s.coneTile) && f(s.bdfOmega) && f(s.bdfHitScale) && f(s.secondaryMaxIter) && f(s.secondaryMaxDist) &&
+                   f(s.secondaryMinDist) && f(s.secondaryEpsilon) && f(s.secondaryNOffset) && f(s.lightCount) &&
+                   f(s.shadowSoftness) && f(s.sThreshold) && f(s.sBlobRadius) && f(s.sMarchEpsilon) && f(s.sKappaFactor) &&
+                   f(s.pPrimitiveData) && f(s.pTestPos) && f(s.pRepeatNum) && f(s.pRepeatDist) && f(s.pShowPlane) &&
+                   f(s.iTime) && f(s.iMouse);
+        }
+
+        template <class C, class F>
+        bool visitCamera(C& c, F&& f)
+        {
+            return f(c.position) && f(c.target) && f(c.up) && f(c.fovY) && f(c.nearZ) && f(c.farZ);
+        }
+
+        // Index of p in list, appended if new; -1 for null
+        template <class T>
+        int32_t indexOf(std::vector<const T*>& list, const T* p)
+        {
+            if (!p) return -1;
+            auto it = std::find(list.begin(), list.end(), p);
+            if (it != list.end()) return int32_t(it - list.begin());
+            list.push_back(p);
+            return int32_t(list.size() - 1);
+        }
+
+        // Setup: renderer options, then the shared scene data, then the frames referring to it by index
+        Message setupMessage(const std::vector<DistributedFrame>& frames, const DistributedDesc& desc, uint32_t slowMs)
+        {
+            std::vector<const CsgProgram*> programs;
+            std::vector<const BlobGrid*> grids;
+            std::vector<const BrickMap*> maps;
+            Message frameData;
+            frameData.put(uint32_t(frames.size()));
+            for (const DistributedFrame& f : frames)
+            {
+                frameData.put(f.width);
+                frameData.put(f.height);
+                visitSettings(f.settings, [&](const auto& v) { frameData.put(v); return true; });
+                visitCamera(f.camera, [&](const auto& v) { frameData.put(v); return true; });
+                frameData.put(indexOf(programs, f.settings.csg.get()));
+                frameData.put(uint8_t(f.settings.csgBvh != nullptr));
+                frameData.put(indexOf(grids, f.settings.blobGrid.get()));
+                frameData.put(indexOf(maps, f.settings.brickMap.get()));
+            }
+
+            Message m;
+            m.type = MessageType::SETUP;
+            m.put(desc.options);
+            m.put(slowMs);
+            m.put(uint32_t(programs.size()));
+            for (const CsgProgram* p : programs)
+            {
+                m.putString(p->name);
+                m.putVector(p->code);
+                m.putVector(p->constants);
+                m.put(p->primitiveCount);
+            }
+            m.put(uint32_t(grids.size()));
+            for (const BlobGrid* g : grids)
+            {
+                m.putVector(g->vertices());
+                m.put(g->cellSize());
+            }
+            m.put(uint32_t(maps.size()));
+            for (const BrickMap* map : maps) m.putString(map->path());
+            m.putBytes(frameData.data.data(), frameData.data.size());
+            return m;
+        }
+
+        bool readSetup(Message& m, std::vector<DistributedFrame>& frames, Renderer::Options& options, uint32_t& slowMs,
+            std::string& error)
+        {
+            auto get = [&](auto& v) { return m.get(v); };
+            uint32_t count = 0;
+            bool ok = m.get(options) && m.get(slowMs) && m.get(count);
+            std::vector<std::shared_ptr<CsgProgram>> programs;
+            std::vector<std::shared_ptr<const CsgBvh>> bvhs;    // built for the first frame that wants one
+            for (uint32_t i = 0; ok && i < count; ++i)
+            {
+                auto p = std::make_shared<CsgProgram>();
+                ok = m.getString(p->name) && m.getVector(p->code) && m.getVector(p->constants) && m.get(p->primitiveCount);
+                programs.push_back(p);
+            }
+            bvhs.resize(programs.size());
+            std::vector<std::shared_ptr<const BlobGrid>> grids;
+            ok = ok && m.get(count);
+            for (uint32_t i = 0; ok && i < count; ++i)
+            {
+                std::vector<BlobVertex> vertices;
+                float cellSize = 0.f;
+                ok = m.getVector(vertices) && m.get(cellSize);
+                if (ok) grids.push_back(std::make_shared<BlobGrid>(std::move(vertices), cellSize));
+            }
+            std::vector<std::shared_ptr<const BrickMap>> maps;
+            ok = ok && m.get(count);
+            for (uint32_t i = 0; ok && i < count; ++i)
+            {
+                std::string path;
+                auto map = std::make_shared<BrickMap>();
+                ok = m.getString(path);
+                if (ok && !map->load(path, error)) return false;
+                maps.push_back(map);
+            }
+            ok = ok && m.get(count);
+            for (uint32_t i = 0; ok && i < count; ++i)
+            {
+                DistributedFrame f;
+                int32_t program = -1, grid = -1, map = -1;
+                uint8_t bvh = 0;
+                ok = m.get(f.width) && m.get(f.height) && visitSettings(f.settings, get) && visitCamera(f.camera, get) &&
+                     m.get(program) && m.get(bvh) && m.get(grid) && m.get(map) && program < int32_t(programs.size()) &&
+                     grid < int32_t(grids.size()) && map < int32_t(maps.size());
+                if (!ok) break;
+                if (program >= 0)
+                {
+                    f.settings.csg = programs[program];
+                    if (bvh && !bvhs[program]) bvhs[program] = std::make_shared<CsgBvh>(*programs[program]);
+                    if (bvh) f.settings.csgBvh = bvhs[program];
+                }
+                if (grid >= 0) f.settings.blobGrid = grids[grid];
+                if (map >= 0) f.settings.brickMap = maps[map];
+                if (map >= 0 && maps[map]->header().sceneHash != brickMapSceneHash(f.settings.scene, SceneParams::fromSettings(f.settings)))
+                {   // the file changed since the master checked it
+                    error = maps[map]->path() + ": baked from other scene parameters";
+                    return false;
+                }
+                frames.push_back(std::move(f));
+            }
+            if (!ok) error = "Invalid setup message";
+            return ok;
+        }
+
+        struct Tile
+        {
+            uint32_t frame, y0, rows;
+            uint32_t copies = 0;    // workers it is out on
+            bool done = false;
+        };
+
+        struct Worker
+        {
+            pid_t pid = -1;
+            int fd = -1;
+            std::deque<uint32_t> tiles;     // out on the worker, in order; the first is being rendered
+            Clock::time_point frontStart;   // when the first tile started
+        };
+
+        struct FrameState
+        {
+            Image image;
+            Renderer::FrameStats stats;
+            uint32_t remaining = 0;         // tiles
+            bool started = false;
+            Clock::time_point start;        // when the first tile was issued
+        };
+
+        // Starts path --worker <fd> on one end of a socket pair and returns the other end
+        bool spawnWorker(const std::string& path, Worker& worker, std::string& error)
+        {
+            int fds[2];
+            if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0)
+            {
+                error = std::string("socketpair failed: ") + strerror(errno);
+                return false;
+            }
+            fcntl(fds[0], F_SETFD, FD_CLOEXEC);     // the coordinator's ends stay out of the other workers
+            fflush(nullptr);
+            const pid_t pid = fork();
+            if (pid < 0)
+            {
+                error = std::string("fork failed: ") + strerror(errno);
+                close(fds[0]);
+                close(fds[1]);
+                return false;
+            }
+            if (pid == 0)
+            {
+                const std::string fd = std::to_string(fds[1]);
+                execl(path.c_str(), path.c_str(), "--worker", fd.c_str(), static_cast<char*>(nullptr));
+                _exit(127);
+            }
+            close(fds[1]);
+            worker.pid = pid;
+            worker.fd = fds[0];
+            return true;
+        }
+
+        void stopWorker(Worker& worker, bool kill)
+        {
+            if (worker.fd >= 0) close(worker.fd);
+            worker.fd = -1;
+            if (worker.pid > 0)
+            {
+                if (kill) ::kill(worker.pid, SIGTERM);
+                waitpid(worker.pid, nullptr, 0);
+            }
+            worker.pid = -1;
+        }
+    }
+
+    bool runWorker(int fd, std::string& error)
+    {
+        auto fail = [&](const std::string& message)
+        {
+            error = message;
+            Message m;
+            m.type = MessageType::FAILURE;
+            m.putString(message);
+            sendMessage(fd, m);
+            return false;
+        };
+
+        Message m;
+        if (!receiveMessage(fd, m) || m.type != MessageType::SETUP) return fail("Expected a setup message");
+        std::vector<DistributedFrame> frames;
+        Renderer::Options options;
+        uint32_t slowMs = 0;
+        if (!readSetup(m, frames, options, slowMs, error)) return fail(error);
+        const Renderer renderer(options);
+
+        Image rows;
+        Message result;
+        result.type = MessageType::RESULT;
+        for (;;)
+        {
+            if (!receiveMessage(fd, m)) return true;    // the coordinator is done
+            uint32_t tile = 0, frame = 0, y0 = 0, rowCount = 0;
+            if (m.type != MessageType::TILE || !m.get(tile) || !m.get(frame) || !m.get(y0) || !m.get(rowCount) ||
+                frame >= frames.size())
+                return fail("Invalid tile message");
+            if (slowMs) std::this_thread::sleep_for(std::chrono::milliseconds(slowMs));
+            const DistributedFrame& f = frames[frame];
+            Renderer::FrameStats stats;
+            renderer.renderRows(f.settings, f.camera, f.width, f.height, y0, rowCount, rows, nullptr, &stats);
+            result.data.clear();
+            result.put(tile);
+            result.put(stats);
+            result.putVector(rows.pixels);
+            if (!sendMessage(fd, result))
+            {
+                error = "Lost the coordinator";
+                return false;
+            }
+        }
+    }
+
+    bool renderDistributed(const std::vector<DistributedFrame>& frames, const DistributedDesc& desc, const FrameDone& done,
+        DistributedStats& stats, std::string& error)
+    {
+        stats = DistributedStats();
+        const auto start = Clock::now();
+
+        const uint32_t tileSize = std::max(desc.options.tileSize, 1u);
+        const uint32_t rows = (std::max(desc.bandRows, 1u) + tileSize - 1) / tileSize * tileSize;
+        std::vector<Tile> tiles;
+        std::vector<FrameState> states(frames.size());
+        for (uint32_t f = 0; f < uint32_t(frames.size()); ++f)
+            for (uint32_t y = 0; y < frames[f].height && frames[f].width > 0; y += rows)
+            {
+                tiles.push_back({ f, y, std::min(rows, frames[f].height - y) });
+                ++states[f].remaining;
+            }
+        std::deque<uint32_t> pending;
+        for (uint32_t t = 0; t < uint32_t(tiles.size()); ++t) pending.push_back(t);
+        stats.tiles = uint32_t(tiles.size());
+        for (uint32_t f = 0; f < uint32_t(frames.size()); ++f)
+            if (states[f].remaining == 0 && !done(f, Image(), Renderer::FrameStats()))
+            {
+                error = "Stopped after frame " + std::to_string(f);
+                return false;
+            }
+
+        std::string path = desc.workerPath;
+        if (path.empty())
+        {
+            char buf[4096];
+            const ssize_t n = readlink("/proc/self/exe", buf, sizeof(buf) - 1);
+            if (n <= 0)
+            {
+                error = "Can't find the executable of the workers";
+                return false;
+            }
+            path.assign(buf, size_t(n));
+        }
+
+        std::vector<Worker> workers(std::max(desc.workerCount, 1u));
+        stats.workerTiles.assign(workers.size(), 0);
+        auto shutdown = [&](bool kill)
+        {   // a worker still on a tile is on a duplicate
+            for (Worker& w : workers) stopWorker(w, kill || !w.tiles.empty());
+        };
+        for (uint32_t i = 0; i < uint32_t(workers.size()); ++i)
+        {
+            if (!spawnWorker(path, workers[i], error) ||
+                !sendMessage(workers[i].fd, setupMessage(frames, desc, i == 0 ? desc.slowWorkerMs : 0)))
+            {
+                if (error.empty()) error = "Failed to set up worker " + std::to_string(i);
+                shutdown(true);
+                return false;
+            }
+        }
+
+        // A worker that failed gives its tiles back to the queue
+        std::string workerError;
+        uint32_t alive = uint32_t(workers.size());
+        auto dropWorker = [&](Worker& w)
+        {
+            for (uint32_t t : w.tiles)
+                if (--tiles[t].copies == 0 && !tiles[t].done)
+                {
+                    pending.push_front(t);
+                    ++stats.reissued;
+                }
+            w.tiles.clear();
+            stopWorker(w, true);
+            ++stats.failedWorkers;
+            --alive;
+        };
+        auto issue = [&](Worker& w, uint32_t t)
+        {
+            Message m;
+            m.type = MessageType::TILE;
+            m.put(t);
+            m.put(tiles[t].frame);
+            m.put(tiles[t].y0);
+            m.put(tiles[t].rows);
+            FrameState& state = states[tiles[t].frame];
+            if (!state.started)
+            {
+                state.started = true;
+                state.start = Clock::now();
+            }
+            if (w.tiles.empty()) w.frontStart = Clock::now();
+            w.tiles.push_back(t);
+            ++tiles[t].copies;
+            if (!sendMessage(w.fd, m)) dropWorker(w);
+        };
+
+        // the oldest tile out on a worker that has been on its first tile for stragglerFactor mean tile times
+        double tileMs = 0.;
+        uint32_t tileCount = 0, tilesLeft = uint32_t(tiles.size());
+        auto straggler = [&](const Worker& idle) -> int64_t
+        {
+            if (tileCount == 0) return -1;
+            const double limit = desc.stragglerFactor * tileMs / tileCount;
+            int64_t best = -1;
+            double bestAge = limit;
+            for (const Worker& w : workers)
+            {
+                if (&w == &idle || w.tiles.empty()) continue;
+                const double age = elapsedMs(w.frontStart);
+                if (age <= bestAge) continue;
+                for (uint32_t t : w.tiles)
+                    if (!tiles[t].done && tiles[t].copies < 2)
+                    {
+                        best = t;
+                        bestAge = age;
+                        break;
+                    }
+            }
+            return best;
+        };
+
+        std::vector<pollfd> polls;
+        Message m;
+        while (tilesLeft > 0)
+        {
+            if (alive == 0)
+            {
+                error = "All workers failed" + (workerError.empty() ? std::string() : ": " + workerError);
+                shutdown(true);
+                return false;
+            }
+            bool waiting = false;   // idle workers with nothing to do but stragglers
+            for (Worker& w : workers)
+            {
+                while (w.fd >= 0 && w.tiles.size() < DistributedDesc::kTilesInFlight && !pending.empty())
+                {
+                    const uint32_t t = pending.front();
+                    pending.pop_front();
+                    if (!tiles[t].done) issue(w, t);
+                }
+                if (w.fd >= 0 && w.tiles.empty())
+                {
+                    const int64_t t = straggler(w);
+                    if (t >= 0)
+                    {
+                        ++stats.reissued;
+                        issue(w, uint32_t(t));
+                    }
+                    else
+                        waiting = true;
+                }
+            }
+
+            polls.clear();
+            for (const Worker& w : workers)
+                if (w.fd >= 0) polls.push_back({ w.fd, POLLIN, 0 });
+            if (poll(polls.data(), polls.size(), waiting ? 10 : -1) < 0 && errno != EINTR)
+            {
+                error = std::string("poll failed: ") + strerror(errno);
+                shutdown(true);
+                return false;
+            }
+            for (const pollfd& p : polls)
+            {
+                if (!p.revents) continue;
+                Worker& w = *std::find_if(workers.begin(), workers.end(), [&](const Worker& x) { return x.fd == p.fd; });
+                uint32_t t = 0;
+                Renderer::FrameStats tileStats;
+                if (!receiveMessage(w.fd, m) || m.type != MessageType::RESULT)
+                {
+                    std::string message;
+                    if (m.type == MessageType::FAILURE && m.getString(message)) workerError = message;
+                    dropWorker(w);
+                    continue;
+                }
+                std::vector<float4> pixels;
+                if (!m.get(t) || !m.get(tileStats) || !m.getVector(pixels) || w.tiles.empty() || w.tiles.front() != t ||
+                    pixels.size() != size_t(tiles[t].rows) * frames[tiles[t].frame].width)
+                {
+                    workerError = "Invalid result message";
+                    dropWorker(w);
+                    continue;
+                }
+                w.tiles.pop_front();
+                w.frontStart = Clock::now();
+                --tiles[t].copies;
+                tileMs += tileStats.trace.ms;
+                ++tileCount;
+                if (tiles[t].done)
+                {
+                    ++stats.duplicates;
+                    continue;
+                }
+                tiles[t].done = true;
+                --tilesLeft;
+                ++stats.workerTiles[size_t(&w - workers.data())];
+
+                const DistributedFrame& f = frames[tiles[t].frame];
+                FrameState& state = states[tiles[t].frame];
+                if (state.image.pixels.empty()) state.image.resize(f.width, f.height);
+                std::copy(pixels.begin(), pixels.end(), state.image.pixels.begin() + size_t(tiles[t].y0) * f.width);
+                state.stats.trace += tileStats.trace;
+                state.stats.prepassTiles += tileStats.prepassTiles;
+                if (--state.remaining == 0)
+                {   // the frame's wall time, as for a local render, rather than the sum of its tile times
+                    state.stats.trace.ms = elapsedMs(state.start);
+                    const bool ok = done(tiles[t].frame, state.image, state.stats);
+                    state.image = Image();
+                    if (!ok)
+                    {
+                        error = "Stopped after frame " + std::to_string(tiles[t].frame);
+                        shutdown(true);
+                        return false;
+                    }
+                }
+            }
+        }
+        shutdown(false);
+        stats.ms = elapsedMs(start);
+        return true;
+    }
+#endif
+}
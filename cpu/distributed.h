@@ -0,0 +1,66 @@
+#pragma once
+
+// Distributed rendering on one host: a coordinator starts worker processes (bdf_render --worker) connected by
+// Unix socket pairs, splits frames into bands of rows and hands them out, and reassembles the images.
+//
+// - Each worker gets a setup message once, with the settings and camera of every frame and the scene data they
+//   share: CSG programs and blob grids by value, brick maps by path (the workers map the same file). Tiles then
+//   only carry a frame index and a row range, and results their pixels and tracing statistics.
+// - A worker has up to kTilesInFlight tiles queued, so it never waits for the coordinator between tiles.
+// - Stragglers are re-issued: when no tile is left to hand out, a tile out for longer than stragglerFactor times
+//   the mean tile time is given to an idle worker as well, and the first result wins. The tiles of a worker that
+//   exits or fails go back to the queue.
+//
+// POSIX only (socketpair, fork, exec, poll).
+
+#include "renderer.h"
+
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace bdf
+{
+    struct DistributedFrame
+    {
+        RenderSettings settings;
+        CameraDesc camera;
+        uint32_t width = 0;
+        uint32_t height = 0;
+    };
+
+    struct DistributedDesc
+    {
+        static const uint32_t kTilesInFlight = 2;
+
+        uint32_t workerCount = 4;
+        uint32_t bandRows = 32;             // rows of a tile, rounded up to the renderer's tiles
+        Renderer::Options options;          // of the renderer of each worker
+        float stragglerFactor = 3.f;
+        std::string workerPath;             // executable run as <workerPath> --worker <fd>; empty: this one
+        uint32_t slowWorkerMs = 0;          // testing: worker 0 sleeps this long before each tile
+    };
+
+    struct DistributedStats
+    {
+        double ms = 0.;
+        uint32_t tiles = 0;
+        uint32_t reissued = 0;              // tiles handed out again, as stragglers or after a worker failed
+        uint32_t duplicates = 0;            // results of tiles already done, discarded
+        uint32_t failedWorkers = 0;
+        std::vector<uint32_t> workerTiles;  // results used, per worker
+    };
+
+    // Called on the coordinator as each frame is complete; returning false stops the run. stats.trace.ms is the wall
+    // time from the frame's first tile handed out to its last result.
+    using FrameDone = std::function<bool(uint32_t frame, const Image& image, const Renderer::FrameStats& stats)>;
+
+    // Renders the frames with desc.workerCount workers; on failure returns false with a message in error.
+    // Reprojection is not distributed, the frames are rendered without it.
+    bool renderDistributed(const std::vector<DistributedFrame>& frames, const DistributedDesc& desc, const FrameDone& done,
+        DistributedStats& stats, std::string& error);
+
+    // The worker side: serves a coordinator on the socket fd until it closes; on failure returns false with a
+    // message in error, which the coordinator also gets.
+    bool runWorker(int fd, std::string& error);
+}
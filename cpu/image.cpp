@@ -0,0 +1,325 @@
+#include "image.h"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+
+namespace bdf
+{
+    namespace
+    {
+        // PNG is written with stored (uncompressed) deflate blocks, which keeps the renderer free of dependencies.
+
+        uint32_t crc32(const uint8_t* data, size_t size, uint32_t crc = 0)
+        {
+            static const std::array<uint32_t, 256> table = []
+            {
+                std::array<uint32_t, 256> t{};
+                for (uint32_t n = 0; n < 256; ++n)
+                {
+                    uint32_t c = n;
+                    for (int k = 0; k < 8; ++k) c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+                    t[n] = c;
+                }
+                return t;
+            }();
+            crc = ~crc;
+            for (size_t i = 0; i < size; ++i) crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+            return ~crc;
+        }
+
+        // Adler-32 of zlib, a and b reduced every 5552 bytes, the most that can't overflow
+        void adler32(const uint8_t* data, size_t size, uint32_t adler[2])
+        {
+            while (size > 0)
+            {
+                const size_t n = std::min<size_t>(size, 5552);
+                for (size_t i = 0; i < n; ++i)
+                {
+                    adler[0] += data[i];
+                    adler[1] += adler[0];
+                }
+                adler[0] %= 65521;
+                adler[1] %= 65521;
+                data += n;
+                size -= n;
+            }
+        }
+
+        void putU32(std::vector<uint8_t>& out, uint32_t v)
+        {
+            out.push_back(uint8_t(v >> 24));
+            out.push_back(uint8_t(v >> 16));
+            out.push_back(uint8_t(v >> 8));
+            out.push_back(uint8_t(v));
+        }
+
+        void writeChunk(FILE* file, const char type[4], const std::vector<uint8_t>& data)
+        {
+            std::vector<uint8_t> buf;
+            putU32(buf, uint32_t(data.size()));
+            buf.insert(buf.end(), type, type + 4);
+            buf.insert(buf.end(), data.begin(), data.end());
+            putU32(buf, crc32(buf.data() + 4, buf.size() - 4));
+            fwrite(buf.data(), 1, buf.size(), file);
+        }
+
+        uint8_t toSrgb8(float v)
+        {
+            v = saturate(v);
+            v = v <= 0.0031308f ? 12.92f * v : 1.055f * std::pow(v, 1.f / 2.4f) - 0.055f;
+            return uint8_t(v * 255.f + .5f);
+        }
+
+        // toSrgb8 by a search of the smallest value of every code, found once by bisecting the floats of [0, 1]
+        uint8_t toSrgb8Fast(float v)
+        {
+            static const std::array<float, 255> thresholds = []
+            {
+                std::array<float, 255> t{};
+                for (int code = 1; code < 256; ++code)
+                {
+                    uint32_t lo = 0, hi = 0x3f800000;   // bits of 0 and 1
+                    while (lo < hi)
+                    {
+                        const uint32_t mid = lo + (hi - lo) / 2;
+                        float f;
+                        memcpy(&f, &mid, 4);
+                        if (toSrgb8(f) >= code) hi = mid;
+                        else lo = mid + 1;
+                    }
+                    memcpy(&t[code - 1], &lo, 4);
+                }
+                return t;
+            }();
+            return uint8_t(std::upper_bound(thresholds.begin(), thresholds.end(), v) - thresholds.begin());
+        }
+
+        // Round to nearest even, overflow to infinity
+        uint16_t toHalf(float f)
+        {
+            uint32_t x;
+            memcpy(&x, &f, 4);
+            const uint32_t sign = (x >> 16) & 0x8000;
+            x &= 0x7fffffff;
+            if (x >= 0x7f800000) return uint16_t(sign | 0x7c00 | (x > 0x7f800000 ? 0x200 : 0));
+            if (x >= 0x477ff000) return uint16_t(sign | 0x7c00);
+            uint32_t h, rest, half;
+            if (x < 0x38800000)
+            {   // subnormal
+                if (x < 0x33000000) return uint16_t(sign);
+                const uint32_t shift = 126 - (x >> 23), m = (x & 0x7fffff) | 0x800000;
+                h = m >> shift;
+                rest = m & ((1u << shift) - 1);
+                half = 1u << (shift - 1);
+            }
+            else
+            {
+                h = (x - 0x38000000) >> 13;
+                rest = x & 0x1fff;
+                half = 0x1000;
+            }
+            h += rest > half || (rest == half && (h & 1));
+            return uint16_t(sign | h);
+        }
+
+        template <class T>
+        void putLE(std::vector<uint8_t>& out, T v)
+        {
+            uint8_t bytes[sizeof(T)];
+            memcpy(bytes, &v, sizeof(T));   // the hosts of the renderer are little endian
+            out.insert(out.end(), bytes, bytes + sizeof(T));
+        }
+
+        void putAttribute(std::vector<uint8_t>& out, const char* name, const char* type, const std::vector<uint8_t>& value)
+        {
+            out.insert(out.end(), name, name + strlen(name) + 1);
+            out.insert(out.end(), type, type + strlen(type) + 1);
+            putLE(out, int32_t(value.size()));
+            out.insert(out.end(), value.begin(), value.end());
+        }
+
+        const uint32_t kExrHalf = 1, kExrFloat = 2;
+
+        // B, G, R, then Z and steps: EXR channels are sorted by name
+        uint32_t exrChannelCount(bool depthSteps) { return depthSteps ? 5 : 3; }
+        uint32_t exrChannelSize(uint32_t c) { return c < 3 ? 2 : 4; }
+    }
+
+    bool writePng(const std::string& path, const Image& image)
+    {
+        ImageStreamWriter writer;
+        std::string error;
+        return writer.open(path, image.width, image.height, false, error) && writer.writeRows(image, nullptr, error) &&
+               writer.close(error);
+    }
+
+    ImageStreamWriter::~ImageStreamWriter()
+    {
+        if (mFile) fclose(mFile);
+    }
+
+    bool ImageStreamWriter::isExr(const std::string& path)
+    {
+        return path.size() >= 4 && !strcmp(path.c_str() + path.size() - 4, ".exr");
+    }
+
+    bool ImageStreamWriter::fail(const std::string& message, std::string& error)
+    {
+        error = message;
+        if (mFile) fclose(mFile);
+        mFile = nullptr;
+        return false;
+    }
+
+    bool ImageStreamWriter::open(const std::string& path, uint32_t width, uint32_t height, bool depthSteps, std::string& error)
+    {
+        if (mFile) return fail("'" + mPath + "' is still open", error);
+        mPath = path;
+        mExr = isExr(path);
+        mDepthSteps = depthSteps;
+        mWidth = width;
+        mHeight = height;
+        mRow = 0;
+        mAdler[0] = 1;
+        mAdler[1] = 0;
+        if (width == 0 || height == 0 || width > 0x7fffffff || height > 0x7fffffff)
+            return fail("Can't write an image of " + std::to_string(width) + "x" + std::to_string(height) + " pixels", error);
+        if (depthSteps && !mExr) return fail("The depth and step channels need an .exr file", error);
+        mFile = fopen(path.c_str(), "wb");
+        if (!mFile) return fail("Failed to open '" + path + "'", error);
+
+        std::vector<uint8_t> header;
+        if (!mExr)
+        {
+            static const uint8_t kSignature[8] = { 137, 80, 78, 71, 13, 10, 26, 10 };
+            fwrite(kSignature, 1, 8, mFile);
+            putU32(header, width);
+            putU32(header, height);
+            header.insert(header.end(), { 8, 2, 0, 0, 0 }); // 8 bit, RGB, deflate, adaptive filter, no interlace
+            writeChunk(mFile, "IHDR", header);
+            return true;
+        }
+
+        // magic number, version 2 of single part scan line files
+        header = { 0x76, 0x2f, 0x31, 0x01, 2, 0, 0, 0 };
+        std::vector<uint8_t> channels, box;
+        static const char* const kNames[5] = { "B", "G", "R", "Z", "steps" };
+        for (uint32_t c = 0; c < exrChannelCount(depthSteps); ++c)
+        {
+            channels.insert(channels.end(), kNames[c], kNames[c] + strlen(kNames[c]) + 1);
+            putLE(channels, c < 3 ? kExrHalf : kExrFloat);
+            channels.insert(channels.end(), { 0, 0, 0, 0 });   // pLinear, reserved
+            putLE(channels, int32_t(1));                        // x and y sampling
+            putLE(channels, int32_t(1));
+        }
+        channels.push_back(0);
+        putAttribute(header, "channels", "chlist", channels);
+        putAttribute(header, "compression", "compression", { 0 });
+        for (int32_t v : { 0, 0, int32_t(width) - 1, int32_t(height) - 1 }) putLE(box, v);
+        putAttribute(header, "dataWindow", "box2i", box);
+        putAttribute(header, "displayWindow", "box2i", box);
+        putAttribute(header, "lineOrder", "lineOrder", { 0 });  // increasing y
+        std::vector<uint8_t> value;
+        putLE(value, 1.f);
+        putAttribute(header, "pixelAspectRatio", "float", value);
+        putAttribute(header, "screenWindowWidth", "float", value);
+        value.clear();
+        putLE(value, 0.f);
+        putLE(value, 0.f);
+        putAttribute(header, "screenWindowCenter", "v2f", value);
+        header.push_back(0);
+
+        // uncompressed scan lines have one line per chunk and a fixed size, so the offset table is known up front
+        uint64_t lineSize = 0;
+        for (uint32_t c = 0; c < exrChannelCount(depthSteps); ++c) lineSize += uint64_t(exrChannelSize(c)) * width;
+        const uint64_t first = header.size() + 8 * uint64_t(height);
+        for (uint32_t y = 0; y < height; ++y) putLE(header, first + y * (8 + lineSize));
+        fwrite(header.data(), 1, header.size(), mFile);
+        return true;
+    }
+
+    bool ImageStreamWriter::writeRows(const Image& rows, const float2* depthSteps, std::string& error)
+    {
+        if (!mFile) return fail("No image is open", error);
+        if (rows.width != mWidth || mRow + rows.height > mHeight) return fail("Rows outside of '" + mPath + "'", error);
+        if (mDepthSteps && !depthSteps) return fail("Missing the depth channels of '" + mPath + "'", error);
+
+        mBuffer.clear();
+        if (mExr)
+        {
+            mBuffer.reserve(size_t(rows.height) * (8 + (mDepthSteps ? 14 : 6) * size_t(mWidth)));
+            for (uint32_t y = 0; y < rows.height; ++y)
+            {
+                putLE(mBuffer, int32_t(mRow + y));
+                putLE(mBuffer, int32_t((mDepthSteps ? 14 : 6) * mWidth));
+                for (int c = 2; c >= 0; --c)
+                    for (uint32_t x = 0; x < mWidth; ++x) putLE(mBuffer, toHalf(rows.at(x, y)[c]));
+                if (mDepthSteps)
+                {
+                    const float2* row = depthSteps + size_t(y) * mWidth;
+                    for (uint32_t x = 0; x < mWidth; ++x) putLE(mBuffer, row[x].x);
+                    for (uint32_t x = 0; x < mWidth; ++x) putLE(mBuffer, row[x].y);
+                }
+            }
+            fwrite(mBuffer.data(), 1, mBuffer.size(), mFile);
+        }
+        else
+        {
+            // filtered scanlines: filter type 0 followed by the RGB bytes, in stored deflate blocks of an IDAT chunk
+            // each; the zlib stream runs over the chunks and ends in close
+            std::vector<uint8_t> raw;
+            raw.reserve(size_t(mWidth * 3 + 1) * rows.height);
+            for (uint32_t y = 0; y < rows.height; ++y)
+            {
+                raw.push_back(0);
+                for (uint32_t x = 0; x < mWidth; ++x)
+                {
+                    const float4& c = rows.at(x, y);
+                    raw.push_back(toSrgb8Fast(c.x));
+                    raw.push_back(toSrgb8Fast(c.y));
+                    raw.push_back(toSrgb8Fast(c.z));
+                }
+            }
+            adler32(raw.data(), raw.size(), mAdler);
+            if (mRow == 0) mBuffer = { 0x78, 0x01 };
+            for (size_t pos = 0; pos < raw.size(); pos += 65535)
+            {
+                const size_t len = std::min<size_t>(raw.size() - pos, 65535);
+                mBuffer.push_back(0);
+                mBuffer.push_back(uint8_t(len));
+                mBuffer.push_back(uint8_t(len >> 8));
+                mBuffer.push_back(uint8_t(~len));
+                mBuffer.push_back(uint8_t(~len >> 8));
+                mBuffer.insert(mBuffer.end(), raw.begin() + pos, raw.begin() + pos + len);
+            }
+            if (!mBuffer.empty()) writeChunk(mFile, "IDAT", mBuffer);
+        }
+        mRow += rows.height;
+        if (ferror(mFile)) return fail("Failed to write '" + mPath + "'", error);
+        return true;
+    }
+
+    bool ImageStreamWriter::close(std::string& error)
+    {
+        if (!mFile) return fail("No image is open", error);
+        if (mRow != mHeight)
+            return fail("'" + mPath + "' got " + std::to_string(mRow) + " of its " + std::to_string(mHeight) + " rows", error);
+        if (!mExr)
+        {   // an empty last block and the checksum
+            mBuffer = { 1, 0, 0, 0xff, 0xff };
+            putU32(mBuffer, (mAdler[1] << 16) | mAdler[0]);
+            writeChunk(mFile, "IDAT", mBuffer);
+            writeChunk(mFile, "IEND", {});
+        }
+        const bool ok = ferror(mFile) == 0;
+        FILE* file = mFile;
+        mFile = nullptr;
+        if (fclose(file) != 0 || !ok)
+        {
+            error = "Failed to write '" + mPath + "'";
+            return false;
+        }
+        return true;
+    }
+}
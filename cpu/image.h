@@ -0,0 +1,64 @@
+#pragma once
+
+#include "vector_math.h"
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace bdf
+{
+    struct Image
+    {
+        uint32_t width = 0;
+        uint32_t height = 0;
+        std::vector<float4> pixels; // row major, row 0 is the top of the image
+
+        void resize(uint32_t w, uint32_t h)
+        {
+            width = w;
+            height = h;
+            pixels.assign(size_t(w) * h, float4(0.f));
+        }
+        float4& at(uint32_t x, uint32_t y) { return pixels[size_t(y) * width + x]; }
+        const float4& at(uint32_t x, uint32_t y) const { return pixels[size_t(y) * width + x]; }
+    };
+
+    // Writes an 8 bit RGB PNG. The shader output is encoded to sRGB the same way Falcor's sRGB swap chain does,
+    // so the files can be compared with captures of the GPU sample. Returns false on I/O failure.
+    bool writePng(const std::string& path, const Image& image);
+
+    // Writes an image from the top a band of rows at a time, so that its size is not limited by memory. Writes an 8 bit
+    // RGB PNG like writePng, or, if the path ends in .exr, an uncompressed scanline OpenEXR file of the linear colors as
+    // half floats; with depthSteps, the EXR file also gets the depth channels of Renderer::renderRows as floats, Z for
+    // the hit distance and steps.
+    class ImageStreamWriter
+    {
+    public:
+        ImageStreamWriter() = default;
+        ImageStreamWriter(const ImageStreamWriter&) = delete;
+        ImageStreamWriter& operator=(const ImageStreamWriter&) = delete;
+        ~ImageStreamWriter();
+
+        static bool isExr(const std::string& path);
+
+        bool open(const std::string& path, uint32_t width, uint32_t height, bool depthSteps, std::string& error);
+        // The next rows.height rows; depthSteps has rows.width * rows.height entries if the file was opened with them
+        bool writeRows(const Image& rows, const float2* depthSteps, std::string& error);
+        // Finishes the file, which must have got all its rows
+        bool close(std::string& error);
+
+    private:
+        bool fail(const std::string& message, std::string& error);
+
+        FILE* mFile = nullptr;
+        std::string mPath;
+        bool mExr = false;
+        bool mDepthSteps = false;
+        uint32_t mWidth = 0;
+        uint32_t mHeight = 0;
+        uint32_t mRow = 0;              // rows written
+        uint32_t mAdler[2] = { 1, 0 };  // of the PNG scanlines
+        std::vector<uint8_t> mBuffer;   // the encoded rows
+    };
+}
@@ -0,0 +1,176 @@
+#pragma once
+
+// Number types of the templated primitives (bdf_primitives.h, sdf_primitives.h, Falloff and Vertex of
+// segment_tracing.h). A primitive is written once over its point type V, float3 or tvec3<F>, and computes in
+// F = scalar_t<V>:
+//   float          the scalar code; the overloads below make the generic code compile to plain float math
+//   f32x8, f32x16  ray packets (simd.h), one point per lane
+//   Interval       bounds of the function over a box of points (the product of the component intervals)
+//   Dual           the function and its gradient, forward mode
+// Branches are written as select(condition, a, b), or as branch(condition, a, b) with the sides as lambdas where
+// they are worth skipping. A comparison gives a bool for float and Dual, which branch turns into a plain if, so
+// the float instantiation is the scalar code; a lane mask for the lane types, where both sides are evaluated and
+// blended; and an IntervalMask for intervals, whose select returns the hull of both sides when the condition
+// holds for some points of the box and not for others.
+
+#include "simd.h"
+
+#include <cstring>
+#include <limits>
+#include <type_traits>
+#include <utility>
+
+namespace bdf
+{
+    // Scalar type of a point type: float for float3, F for tvec3<F>
+    template <class V> using scalar_t = std::decay_t<decltype(std::declval<V>().x)>;
+
+    // float
+
+    inline float select(bool m, float a, float b)  // a blend of the bits, as for the lanes: no branch to mispredict
+    {
+        uint32_t ua, ub, mask = 0u - uint32_t(m);
+        std::memcpy(&ua, &a, 4);
+        std::memcpy(&ub, &b, 4);
+        uint32_t r = (ua & mask) | (ub & ~mask);
+        std::memcpy(&a, &r, 4);
+        return a;
+    }
+#if defined(__AVX2__) || defined(__AVX512F__)
+    // minss/maxss: std::min and std::max are left to the compiler's if-conversion, which turns some into branches
+    inline float min(float a, float b) { return _mm_cvtss_f32(_mm_min_ss(_mm_set_ss(a), _mm_set_ss(b))); }
+    inline float max(float a, float b) { return _mm_cvtss_f32(_mm_max_ss(_mm_set_ss(a), _mm_set_ss(b))); }
+#else
+    inline float min(float a, float b) { return std::min(a, b); }
+    inline float max(float a, float b) { return std::max(a, b); }
+#endif
+    inline float abs(float a) { return std::abs(a); }
+    inline float sqrt(float a) { return std::sqrt(a); }
+    inline float round(float a) { return std::nearbyint(a); }  // half to even, as HLSL round()
+
+    // Interval: [lo, hi]. Operations round to nearest, not outwards, so a bound can be off by an ulp.
+
+    struct Interval
+    {
+        float lo, hi;
+
+        Interval() = default;
+        Interval(float s) : lo(s), hi(s) {}
+        Interval(float lo_, float hi_) : lo(lo_), hi(hi_) {}
+    };
+
+    // A condition over an interval: always if it holds for every value, maybe if it holds for some
+    struct IntervalMask
+    {
+        bool always, maybe;
+    };
+
+    inline Interval hull(const Interval& a, const Interval& b) { return { std::min(a.lo, b.lo), std::max(a.hi, b.hi) }; }
+
+    inline Interval operator+(const Interval& a, const Interval& b) { return { a.lo + b.lo, a.hi + b.hi }; }
+    inline Interval operator-(const Interval& a, const Interval& b) { return { a.lo - b.hi, a.hi - b.lo }; }
+    inline Interval operator-(const Interval& a) { return { -a.hi, -a.lo }; }
+    inline Interval operator*(const Interval& a, float s) { return s >= 0.f ? Interval(a.lo * s, a.hi * s) : Interval(a.hi * s, a.lo * s); }
+    inline Interval operator*(float s, const Interval& a) { return a * s; }
+    inline Interval operator*(const Interval& a, const Interval& b)
+    {
+        float p0 = a.lo * b.lo, p1 = a.lo * b.hi, p2 = a.hi * b.lo, p3 = a.hi * b.hi;
+        return { std::min(std::min(p0, p1), std::min(p2, p3)), std::max(std::max(p0, p1), std::max(p2, p3)) };
+    }
+    inline Interval operator/(const Interval& a, float s) { return a * (1.f / s); }
+    inline Interval operator/(const Interval& a, const Interval& b)
+    {
+        if (b.lo <= 0.f && b.hi >= 0.f)
+            return { -std::numeric_limits<float>::infinity(), std::numeric_limits<float>::infinity() };
+        return a * Interval(1.f / b.hi, 1.f / b.lo);
+    }
+
+    inline IntervalMask operator<(const Interval& a, const Interval& b) { return { a.hi < b.lo, a.lo < b.hi }; }
+    inline IntervalMask operator<=(const Interval& a, const Interval& b) { return { a.hi <= b.lo, a.lo <= b.hi }; }
+    inline IntervalMask operator>(const Interval& a, const Interval& b) { return b < a; }
+    inline IntervalMask operator>=(const Interval& a, const Interval& b) { return b <= a; }
+    inline IntervalMask operator&(IntervalMask a, IntervalMask b) { return { a.always && b.always, a.maybe && b.maybe }; }
+    inline IntervalMask operator|(IntervalMask a, IntervalMask b) { return { a.always || b.always, a.maybe || b.maybe }; }
+    inline IntervalMask operator!(IntervalMask a) { return { !a.maybe, !a.always }; }
+
+    inline Interval select(IntervalMask m, const Interval& a, const Interval& b) { return m.always ? a : !m.maybe ? b : hull(a, b); }
+    inline Interval min(const Interval& a, const Interval& b) { return { std::min(a.lo, b.lo), std::min(a.hi, b.hi) }; }
+    inline Interval max(const Interval& a, const Interval& b) { return { std::max(a.lo, b.lo), std::max(a.hi, b.hi) }; }
+    inline Interval abs(const Interval& a)
+    {
+        if (a.lo >= 0.f) return a;
+        if (a.hi <= 0.f) return -a;
+        return { 0.f, std::max(-a.lo, a.hi) };
+    }
+    inline Interval sqr(const Interval& a)  // tighter than a * a, which treats the factors as independent
+    {
+        Interval m = abs(a);
+        return { m.lo * m.lo, m.hi * m.hi };
+    }
+    inline Interval sqrt(const Interval& a) { return { std::sqrt(std::max(a.lo, 0.f)), std::sqrt(std::max(a.hi, 0.f)) }; }
+    inline Interval round(const Interval& a) { return { std::nearbyint(a.lo), std::nearbyint(a.hi) }; }
+
+    // The box spanned by two points, e.g. the ends of a segment
+    inline tvec3<Interval> intervalBox(float3 a, float3 b)
+    {
+        return { { std::min(a.x, b.x), std::max(a.x, b.x) }, { std::min(a.y, b.y), std::max(a.y, b.y) },
+                 { std::min(a.z, b.z), std::max(a.z, b.z) } };
+    }
+
+    // Dual: value v and gradient d with respect to the point
+
+    struct Dual
+    {
+        float v;
+        float3 d;
+
+        Dual() = default;
+        Dual(float s) : v(s), d(0.f) {}
+        Dual(float v_, float3 d_) : v(v_), d(d_) {}
+    };
+
+    inline Dual operator+(const Dual& a, const Dual& b) { return { a.v + b.v, a.d + b.d }; }
+    inline Dual operator-(const Dual& a, const Dual& b) { return { a.v - b.v, a.d - b.d }; }
+    inline Dual operator-(const Dual& a) { return { -a.v, -a.d }; }
+    inline Dual operator*(const Dual& a, float s) { return { a.v * s, a.d * s }; }
+    inline Dual operator*(float s, const Dual& a) { return a * s; }
+    inline Dual operator*(const Dual& a, const Dual& b) { return { a.v * b.v, a.d * b.v + a.v * b.d }; }
+    inline Dual operator/(const Dual& a, float s) { return { a.v / s, a.d / s }; }
+    inline Dual operator/(const Dual& a, const Dual& b) { return { a.v / b.v, (a.d * b.v - a.v * b.d) / (b.v * b.v) }; }
+
+    inline bool operator<(const Dual& a, const Dual& b) { return a.v < b.v; }
+    inline bool operator<=(const Dual& a, const Dual& b) { return a.v <= b.v; }
+    inline bool operator>(const Dual& a, const Dual& b) { return a.v > b.v; }
+    inline bool operator>=(const Dual& a, const Dual& b) { return a.v >= b.v; }
+
+    inline Dual select(bool m, const Dual& a, const Dual& b) { return m ? a : b; }
+    inline Dual min(const Dual& a, const Dual& b) { return b.v < a.v ? b : a; }
+    inline Dual max(const Dual& a, const Dual& b) { return b.v > a.v ? b : a; }
+    inline Dual abs(const Dual& a) { return a.v < 0.f ? -a : a; }
+    inline Dual sqr(const Dual& a) { return { a.v * a.v, a.d * (2.f * a.v) }; }
+    inline Dual sqrt(const Dual& a)    // gradient 0 where the derivative is infinite
+    {
+        float s = std::sqrt(a.v);
+        return { s, s > 0.f ? a.d * (.5f / s) : float3(0.f) };
+    }
+    inline Dual round(const Dual& a) { return { std::nearbyint(a.v), float3(0.f) }; }
+
+    // The point p as the variable of the gradient
+    inline tvec3<Dual> dualPoint(float3 p)
+    {
+        return { { p.x, float3(1, 0, 0) }, { p.y, float3(0, 1, 0) }, { p.z, float3(0, 0, 1) } };
+    }
+
+    // Generic helpers
+
+    template <class M, class A, class B>
+    auto branch(const M& m, A&& a, B&& b)
+    {
+        if constexpr (std::is_convertible_v<M, bool>)
+            return m ? a() : b();
+        else
+            return select(m, a(), b());
+    }
+
+    template <class V> inline scalar_t<V> lengthXZ(const V& p) { return sqrt(sqr(p.x) + sqr(p.z)); }
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+// Dynamic work distribution over a fixed number of threads: workers pull item indices from a shared
+// atomic counter, so expensive items (many steps per ray) do not stall the others.
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+namespace bdf
+{
+    inline uint32_t defaultThreadCount()
+    {
+        uint32_t n = std::thread::hardware_concurrency();
+        return n ? n : 1;
+    }
+
+    // Calls f(item, threadIndex) for every item in [0, count).
+    template <class F>
+    void parallelFor(uint32_t count, uint32_t threadCount, F&& f)
+    {
+        if (threadCount == 0) threadCount = defaultThreadCount();
+        threadCount = std::min(threadCount, count);
+        if (threadCount <= 1)
+        {
+            for (uint32_t i = 0; i < count; ++i) f(i, 0u);
+            return;
+        }
+
+        std::atomic<uint32_t> next{ 0 };
+        auto worker = [&](uint32_t thread)
+        {
+            for (uint32_t i = next++; i < count; i = next++) f(i, thread);
+        };
+        std::vector<std::thread> threads;
+        threads.reserve(threadCount - 1);
+        for (uint32_t t = 1; t < threadCount; ++t) threads.emplace_back(worker, t);
+        worker(0);
+        for (auto& t : threads) t.join();
+    }
+
+    // parallelFor with work stealing: every thread starts on its own contiguous run of the items and takes them in
+    // order, and a thread that ran out steals the back half of another thread's run. Neighbouring items, which
+    // callers arrange to be similar (sorted rays), stay on one thread, and a run of expensive items is split up.
+    template <class F>
+    void parallelForStealing(uint32_t count, uint32_t threadCount, F&& f)
+    {
+        if (threadCount == 0) threadCount = defaultThreadCount();
+        threadCount = std::min(threadCount, count);
+        if (threadCount <= 1)
+        {
+            for (uint32_t i = 0; i < count; ++i) f(i, 0u);
+            return;
+        }
+
+        // [begin, end) of a run, begin in the low word
+        struct alignas(64) Run
+        {
+            std::atomic<uint64_t> range;
+        };
+        auto pack = [](uint64_t begin, uint64_t end) { return begin | (end << 32); };
+        std::vector<Run> runs(threadCount);
+        for (uint32_t t = 0; t < threadCount; ++t)
+            runs[t].range = pack(uint64_t(count) * t / threadCount, uint64_t(count) * (t + 1) / threadCount);
+
+        auto worker = [&](uint32_t thread)
+        {
+            std::atomic<uint64_t>& own = runs[thread].range;
+            for (;;)
+            {
+                // take the front item of the own run
+                uint64_t r = own.load();
+                while (uint32_t(r) < uint32_t(r >> 32))
+                {
+                    if (own.compare_exchange_weak(r, r + 1))
+                    {
+                        f(uint32_t(r), thread);
+                        r = own.load();
+                    }
+                }
+                // steal the back half of the first non-empty run after the own one
+                bool stole = false;
+                for (uint32_t k = 1; k < threadCount && !stole; ++k)
+                {
+                    std::atomic<uint64_t>& victim = runs[(thread + k) % threadCount].range;
+                    uint64_t v = victim.load();
+                    while (uint32_t(v) < uint32_t(v >> 32))
+                    {
+                        const uint64_t begin = uint32_t(v), end = v >> 32, mid = begin + (end - begin) / 2;
+                        if (victim.compare_exchange_weak(v, pack(begin, mid)))
+                        {
+                            own = pack(mid, end);
+                            stole = true;
+                            break;
+                        }
+                    }
+                }
+                if (!stole) return;
+            }
+        };
+        std::vector<std::thread> threads;
+        threads.reserve(threadCount - 1);
+        for (uint32_t t = 1; t < threadCount; ++t) threads.emplace_back(worker, t);
+        worker(0);
+        for (auto& t : threads) t.join();
+    }
+}
@@ -0,0 +1,360 @@
+#include "renderer.h"
+
+#include "brick_map.h"
+#include "parallel.h"
+#include "tracers_simd.h"
+
+#include <chrono>
+#include <limits>
+
+namespace bdf
+{
+    namespace
+    {
+        struct FrameContext
+        {
+            const RenderSettings& settings;
+            CameraData camera;
+            float2 iResolution;
+            const float* coneTmin;      // per settings.coneTile tile, null without the pre-pass
+            uint32_t coneTilesX;
+            uint32_t coneTileY0;        // first tile row of coneTmin
+            DepthHistory* history;      // null without reprojection
+            uint32_t y0;                // frame row of the first image row
+            float2* depthSteps;         // per image pixel, null if not wanted
+        };
+
+        // Counters of one worker thread, padded to a cache line
+        struct alignas(64) ThreadStats
+        {
+            TraceStats trace;
+            uint32_t reprojected = 0;
+            uint32_t rejected = 0;
+        };
+
+        // Primary ray of a pixel, starting at its tile's cone pre-pass distance and at the reprojected depth of the
+        // previous frame if the bdf (negative inside) confirms the start is outside
+        template <class SceneT>
+        Ray primaryRay(const SceneT& scene, const FrameContext& ctx, uint32_t x, uint32_t y, ThreadStats& counters)
+        {
+            Ray ray = getCameraRay(ctx.camera, float2(float(x) + .5f, float(y) + .5f), ctx.iResolution, ctx.settings.primaryMaxDist);
+            if (ctx.coneTmin)
+                ray.Tmin = ctx.coneTmin[(y / ctx.settings.coneTile - ctx.coneTileY0) * ctx.coneTilesX + x / ctx.settings.coneTile];
+            float tStart;
+            if (ctx.history && ctx.history->reproject(ray, x, y, ctx.settings.reprojectionMargin, tStart) && tStart > ray.Tmin)
+            {
+                if (tStart < ray.Tmax && scene.bdf(ray.P + tStart * ray.V) > 0.f)
+                {
+                    ray.Tmin = tStart;
+                    ++counters.reprojected;
+                }
+                else
+                    ++counters.rejected;
+            }
+            return ray;
+        }
+
+        // coneTmin of BDF.ps.slang: start distance shared by the rays of a tile. Marches the axis of a cone containing
+        // them against the SDF, the free ball at t covers the cone up to (d + t) / (1 + tan), and stops where the
+        // cone may touch a surface or stops making progress. The rays are free up to the axial depth reached.
+        template <class SceneT>
+        float coneTmin(const SceneT& scene, const FrameContext& ctx, uint32_t tx, uint32_t ty, int& steps)
+        {
+            const RenderSettings& s = ctx.settings;
+            const float tanPix = 1.f / length(ctx.iResolution);
+            float2 lo = float2(float(tx * s.coneTile), float(ty * s.coneTile));
+            float2 hi = float2(std::min(lo.x + float(s.coneTile), ctx.iResolution.x), std::min(lo.y + float(s.coneTile), ctx.iResolution.y));
+            Ray axis = getCameraRay(ctx.camera, .5f * (lo + hi), ctx.iResolution, s.primaryMaxDist);
+            float cosA = 1.f;
+            cosA = std::min(cosA, dot(axis.V, getCameraRay(ctx.camera, lo, ctx.iResolution, s.primaryMaxDist).V));
+            cosA = std::min(cosA, dot(axis.V, getCameraRay(ctx.camera, float2(hi.x, lo.y), ctx.iResolution, s.primaryMaxDist).V));
+            cosA = std::min(cosA, dot(axis.V, getCameraRay(ctx.camera, float2(lo.x, hi.y), ctx.iResolution, s.primaryMaxDist).V));
+            cosA = std::min(cosA, dot(axis.V, getCameraRay(ctx.camera, hi, ctx.iResolution, s.primaryMaxDist).V));
+            const float k = std::sqrt(std::max(1.f - cosA * cosA, 0.f)) / cosA;
+
+            float t = 0.f;
+            steps = 0;
+            while (t < axis.Tmax && steps < s.primaryMaxIter)
+            {
+                float d = scene.sdf(axis.P + t * axis.V);
+                ++steps;
+                float dt = (d - k * t) / (1.f + k);
+                if (dt <= tanPix * t) break;
+                t += dt;
+            }
+            return std::min(t, axis.Tmax);
+        }
+
+        float3 itershadeOld(float val)
+        {
+            return mix(float3(0, 1, 0), mix(float3(1, 1, 0) * .95f, float3(1, 0, 0), saturate(2 * val - 1)), saturate(2 * val));
+        }
+        float3 itershadeHSV(float v)
+        {
+            return hsv2rgb(float3(v, 1, 1));
+        }
+        float3 itershade2(const RenderSettings& s, float v)
+        {
+            return mix(s.colorA, s.colorB, v);
+        }
+        float3 itershade3(const RenderSettings& s, float v)
+        {
+            float3 a = v < .5f ? s.colorA : s.colorB;
+            float3 b = v < .5f ? s.colorB : s.colorC;
+            v = v < .5f ? 2.f * v : 2.f * v - 1.f;
+            return mix(a, b, v);
+        }
+        float3 itershade4(const RenderSettings& s, float v)
+        {
+            const float ts[3 + 1] = { 0, 0.15f, 0.4f, 1.0f };
+            const float3 Cs[3 + 1] = { s.colorA, s.colorB, s.colorC, s.colorD };
+            int i = 0;
+            for (; i < 3; ++i)
+                if (ts[i + 1] >= v)
+                    break;
+            i = std::min(i, 2);
+            return mix(Cs[i], Cs[i + 1], (v - ts[i]) / (ts[i + 1] - ts[i]));
+        }
+
+        // V_COLORING_FUNC
+        float3 itershade(const RenderSettings& s, float v)
+        {
+            switch (s.coloringStepFunc)
+            {
+            case 0: return itershadeOld(v);
+            case 1: return itershadeHSV(v);
+            case 2: return itershade2(s, v);
+            case 3: return itershade3(s, v);
+            default: return itershade4(s, v);
+            }
+        }
+
+        // Second half of mainImageBDF: colors the pixel from the primary trace result.
+        template <class SceneT>
+        float4 shadeBDF(const SceneT& scene, const FrameContext& ctx, const Ray& ray, const TraceResult& ret, ThreadStats& counters)
+        {
+            const RenderSettings& s = ctx.settings;
+            float4 fragColor = float4(0);
+            float3 rgb = float3(0);
+            float tanPix = 1.f / length(ctx.iResolution);
+            if (s.coloring == Coloring::STEPSIZE)
+            {
+                rgb = itershade(s, float(ret.steps) / float(s.primaryMaxIter));
+            }
+            else if (ret.flags & 1)
+            { // background
+                rgb += mix(float3(111, 78, 55), float3(135, 206, 255), ray.V.y * .5f + .5f) / 255.f;
+            }
+            else if (ret.flags & 2)
+            { // shading
+                float3 p = ray.P + ray.V * ret.T;
+                float3 n = normal(s.normal, scene, p);
+                counters.trace.normalEvals += uint64_t(normalEvals(s.normal));
+                rgb += mix(float3(111, 78, 55), float3(135, 206, 255), n.y * .5f + .5f) / 255.f * 0.07f;
+                const int lightCount = std::min(std::max(s.lightCount, 1), kMaxLightCount);
+                Ray shadowRays[kMaxLightCount];
+                float visibility[kMaxLightCount];
+                TraceResult shadowResults[kMaxLightCount];
+                for (int i = 0; i < lightCount; ++i)
+                { // lights
+                    float minstep = tanPix * ret.T;
+                    shadowRays[i] = { p + (s.secondaryNOffset + tanPix * ret.T) * n, s.secondaryMinDist + minstep, lightDirection(i, lightCount), s.secondaryMaxDist };
+                }
+                SphereTraceDesc shadowDesc = { s.secondaryEpsilon, s.secondaryMaxIter };
+                int sh_steps = shadowLights(s.shadow, scene, shadowRays, lightCount, shadowDesc, s.shadowSoftness, visibility, shadowResults);
+                if (s.shadow != Shadows::NO_SHADOW)
+                    for (int i = 0; i < lightCount; ++i) counters.trace.shadow.add(shadowResults[i], s.secondaryMaxIter, 1);
+                if (s.coloring != Coloring::SHADOWSTEP)
+                {
+                    const float intensity = 3.f / float(lightCount);    // the light of the original three
+                    for (int i = 0; i < lightCount; ++i)
+                    {
+                        float3 l = shadowRays[i].V;
+                        rgb += intensity * visibility[i] * std::max(dot(n, l), 0.f) * max(float3(.5f, .5f, .6f) + float3(0.6f, .3f, .7f) * l, 0.f);
+                    }
+                }
+                rgb = Uncharted2ToneMapping(rgb);
+                if (s.coloring == Coloring::SHADOWSTEP)
+                    rgb = itershade(s, float(sh_steps) / float(lightCount * s.secondaryMaxIter));
+            }
+            else if (ret.flags & 4)
+            { //
+                rgb = float3(1, 0, 0);
+            }
+            fragColor.x = rgb.x;
+            fragColor.y = rgb.y;
+            fragColor.z = rgb.z;
+            return fragColor;
+        }
+
+        void writeDepthSteps(const FrameContext& ctx, uint32_t x, uint32_t y, const TraceResult& ret)
+        {
+            if (ctx.depthSteps)
+                ctx.depthSteps[size_t(y - ctx.y0) * uint32_t(ctx.iResolution.x) + x] =
+                    float2(ret.flags & 2 ? ret.T : std::numeric_limits<float>::infinity(), float(ret.steps));
+        }
+
+        template <class SceneT>
+        float4 mainImageBDF(const SceneT& scene, const FrameContext& ctx, uint32_t x, uint32_t y, ThreadStats& counters)
+        {
+            const RenderSettings& s = ctx.settings;
+            float tanPix = 1.f / length(ctx.iResolution);
+            Ray ray = primaryRay(scene, ctx, x, y, counters);
+
+            SphereTraceDesc stDesc = { tanPix, s.primaryMaxIter };
+            TraceResult ret = trace(s.trace, scene, ray, stDesc, s.sMarchEpsilon, s.bdfOmega, s.bdfHitScale);
+            counters.trace.primary.add(ret, s.primaryMaxIter, evalsPerStep(s.trace));
+            if (ctx.history) ctx.history->write(x, y, ret);
+            writeDepthSteps(ctx, x, y, ret);
+            return shadeBDF(scene, ctx, ray, ret, counters);
+        }
+
+        // mainImageBDF for a block of F::width pixels, with the primary bdf_trace done as one ray packet.
+        // Blocks are 4 pixels wide and clamped to the tile; lanes outside it duplicate an edge pixel.
+        template <class F, class SceneT>
+        void mainImageBDFPacket(const SceneT& scene, const FrameContext& ctx, uint32_t bx, uint32_t by,
+            uint32_t x1, uint32_t y1, Image& image, ThreadStats& counters)
+        {
+            constexpr int W = F::width;
+            const RenderSettings& s = ctx.settings;
+            float tanPix = 1.f / length(ctx.iResolution);
+
+            Ray rays[W];
+            for (int i = 0; i < W; ++i)
+            {
+                uint32_t x = std::min(bx + uint32_t(i % 4), x1 - 1), y = std::min(by + uint32_t(i / 4), y1 - 1);
+                rays[i] = primaryRay(scene, ctx, x, y, counters);
+            }
+
+            SphereTraceDesc stDesc = { tanPix, s.primaryMaxIter };
+            TraceResultPacket<F> ret = bdf_trace_packet(scene, packRays<F>(rays), stDesc);
+            for (int i = 0; i < W; ++i)
+            {
+                uint32_t x = bx + uint32_t(i % 4), y = by + uint32_t(i / 4);
+                if (x < x1 && y < y1)
+                {
+                    TraceResult lane = ret.lane(i);
+                    image.at(x, y - ctx.y0) = shadeBDF(scene, ctx, rays[i], lane, counters);
+                    counters.trace.primary.add(lane, s.primaryMaxIter, 1);
+                    if (ctx.history) ctx.history->write(x, y, lane);
+                    writeDepthSteps(ctx, x, y, lane);
+                }
+            }
+        }
+
+        template <class SceneT>
+        void renderTiles(const SceneT& scene, const FrameContext& ctx, const Renderer::Options& options, Image& image,
+            std::vector<ThreadStats>& counters)
+        {
+            const uint32_t tileSize = std::max(options.tileSize, 1u);
+            const uint32_t tilesX = (image.width + tileSize - 1) / tileSize;
+            const uint32_t tilesY = (image.height + tileSize - 1) / tileSize;
+            const bool packets = options.packetWidth > 1 && ctx.settings.trace == Tracers::BDF_TRACE &&
+                                 ctx.settings.coloring != Coloring::SEGMENT_TRACING;
+            parallelFor(tilesX * tilesY, options.threadCount, [&](uint32_t tile, uint32_t thread)
+            {   // in frame coordinates
+                const uint32_t x0 = (tile % tilesX) * tileSize, y0 = (tile / tilesX) * tileSize + ctx.y0;
+                const uint32_t x1 = std::min(x0 + tileSize, image.width), y1 = std::min(y0 + tileSize, image.height + ctx.y0);
+                if (packets)
+                {
+                    const uint32_t blockH = options.packetWidth >= 16 ? 4 : 2;
+                    for (uint32_t y = y0; y < y1; y += blockH)
+                        for (uint32_t x = x0; x < x1; x += 4)
+                        {
+                            if (blockH == 4)
+                                mainImageBDFPacket<f32x16>(scene, ctx, x, y, x1, y1, image, counters[thread]);
+                            else
+                                mainImageBDFPacket<f32x8>(scene, ctx, x, y, x1, y1, image, counters[thread]);
+                        }
+                    return;
+                }
+                for (uint32_t y = y0; y < y1; ++y)
+                    for (uint32_t x = x0; x < x1; ++x)
+                    {
+                        if (ctx.settings.coloring == Coloring::SEGMENT_TRACING)
+                            image.at(x, y - ctx.y0) = segmentTracingImage(scene.params.blobs, float2(float(x) + .5f, float(y) + .5f), ctx.iResolution,
+                                ctx.settings.iTime, ctx.settings.iMouse, ctx.settings.sMarchEpsilon, ctx.settings.primaryMaxIter);
+                        else
+                            image.at(x, y - ctx.y0) = mainImageBDF(scene, ctx, x, y, counters[thread]);
+                    }
+            });
+        }
+    }
+
+    void Renderer::render(const RenderSettings& settings, const CameraDesc& camera, uint32_t width, uint32_t height, Image& image,
+        FrameStats* stats, DepthHistory* history) const
+    {
+        image.resize(width, height);
+        renderImage(settings, camera, width, height, 0, image, nullptr, stats, history);
+    }
+
+    void Renderer::renderRows(const RenderSettings& settings, const CameraDesc& camera, uint32_t width, uint32_t height,
+        uint32_t y0, uint32_t rowCount, Image& rows, std::vector<float2>* depthSteps, FrameStats* stats) const
+    {
+        rowCount = y0 < height ? std::min(rowCount, height - y0) : 0;
+        rows.resize(width, rowCount);
+        if (depthSteps) depthSteps->assign(size_t(width) * rowCount, float2(std::numeric_limits<float>::infinity(), 0.f));
+        renderImage(settings, camera, width, height, y0, rows, depthSteps ? depthSteps->data() : nullptr, stats, nullptr);
+    }
+
+    void Renderer::renderImage(const RenderSettings& settings, const CameraDesc& camera, uint32_t width, uint32_t height,
+        uint32_t y0, Image& image, float2* depthSteps, FrameStats* stats, DepthHistory* history) const
+    {
+        if (stats) *stats = FrameStats();
+        if (image.width == 0 || image.height == 0) return;
+        auto start = std::chrono::steady_clock::now();
+
+        FrameContext ctx = { settings, CameraData::create(camera, float(width) / float(height)), float2(float(width), float(height)),
+                             nullptr, 0, 0, nullptr, y0, depthSteps };
+        if (history && settings.reprojection && settings.coloring != Coloring::SEGMENT_TRACING)
+        {
+            history->beginFrame(width, height);
+            ctx.history = history;
+        }
+        else if (history)
+            history->reset();
+        SceneParams params = SceneParams::fromSettings(settings);
+        // the pre-pass tiles of the rows rendered, in frame coordinates
+        const bool prepass = settings.coneTile > 0 && settings.coloring != Coloring::SEGMENT_TRACING;
+        const uint32_t coneTilesX = prepass ? (width + settings.coneTile - 1) / settings.coneTile : 0;
+        const uint32_t coneTileY0 = prepass ? y0 / settings.coneTile : 0;
+        const uint32_t coneTilesY = prepass ? (y0 + image.height + settings.coneTile - 1) / settings.coneTile - coneTileY0 : 0;
+        std::vector<float> tileTmin(size_t(coneTilesX) * coneTilesY);
+        std::vector<ThreadStats> counters(mOptions.threadCount ? mOptions.threadCount : defaultThreadCount());
+        auto renderScene = [&](const auto& scene)
+        {
+            if (prepass)
+            {
+                parallelFor(uint32_t(tileTmin.size()), mOptions.threadCount, [&](uint32_t tile, uint32_t thread)
+                {
+                    int steps;
+                    tileTmin[tile] = coneTmin(scene, ctx, tile % coneTilesX, coneTileY0 + tile / coneTilesX, steps);
+                    counters[thread].trace.prepassEvals += uint64_t(steps);
+                });
+                ctx.coneTmin = tileTmin.data();
+                ctx.coneTilesX = coneTilesX;
+                ctx.coneTileY0 = coneTileY0;
+            }
+            renderTiles(scene, ctx, mOptions, image, counters);
+        };
+        dispatchScene(settings.scene, params, [&](const auto& scene)
+        {
+            if (settings.brickMap)
+                renderScene(BrickMapScene<std::decay_t<decltype(scene)>>(scene, *settings.brickMap));
+            else
+                renderScene(scene);
+        });
+        if (ctx.history) ctx.history->endFrame(ctx.camera);
+        if (stats)
+        {
+            for (const ThreadStats& c : counters)
+            {
+                stats->trace += c.trace;
+                stats->reprojectedRays += c.reprojected;
+                stats->rejectedRays += c.rejected;
+            }
+            stats->prepassTiles = uint32_t(tileTmin.size());
+            stats->trace.ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        }
+    }
+}
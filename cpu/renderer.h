@@ -0,0 +1,55 @@
+#pragma once
+
+// Headless multithreaded CPU implementation of BDF.ps.slang's main(): the image is split into square tiles
+// which the worker threads pull from a shared queue. A frame can also be rendered a band of rows at a time, for
+// images too large to hold (stream_render.h).
+
+#include "camera.h"
+#include "image.h"
+#include "reprojection.h"
+#include "settings.h"
+#include "trace_stats.h"
+
+namespace bdf
+{
+    class Renderer
+    {
+    public:
+        struct Options
+        {
+            uint32_t threadCount = 0;   // 0: one per hardware thread
+            uint32_t tileSize = 16;
+            uint32_t packetWidth = 1;   // 8 or 16: trace primary bdf_trace rays as SIMD packets (see simd.h)
+        };
+
+        Renderer() = default;
+        explicit Renderer(const Options& options) : mOptions(options) {}
+
+        // Tracing statistics of a frame
+        struct FrameStats
+        {
+            TraceStats trace;
+            uint32_t prepassTiles = 0;  // cone pre-pass, one cone per settings.coneTile tile
+            uint32_t reprojectedRays = 0;   // started from the previous frame's depth
+            uint32_t rejectedRays = 0;      // reprojected start inside a surface, traced in full
+        };
+
+        // Renders a width x height frame into image. With settings.reprojection the primary rays start from the
+        // depth of the previous frame rendered with the same history, which is then updated.
+        void render(const RenderSettings& settings, const CameraDesc& camera, uint32_t width, uint32_t height, Image& image,
+            FrameStats* stats = nullptr, DepthHistory* history = nullptr) const;
+        // Renders rows [y0, y0 + rowCount) of a width x height frame into rows, the same pixels render gives them.
+        // depthSteps, if given, gets per pixel the distance of the primary hit (infinity without one) and the primary
+        // step count. Without reprojection.
+        void renderRows(const RenderSettings& settings, const CameraDesc& camera, uint32_t width, uint32_t height,
+            uint32_t y0, uint32_t rowCount, Image& rows, std::vector<float2>* depthSteps = nullptr, FrameStats* stats = nullptr) const;
+
+        const Options& getOptions() const { return mOptions; }
+
+    private:
+        void renderImage(const RenderSettings& settings, const CameraDesc& camera, uint32_t width, uint32_t height,
+            uint32_t y0, Image& image, float2* depthSteps, FrameStats* stats, DepthHistory* history) const;
+
+        Options mOptions;
+    };
+}
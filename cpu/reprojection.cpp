@@ -0,0 +1,87 @@
+#include "reprojection.h"
+
+#include <algorithm>
+
+namespace bdf
+{
+    void DepthHistory::beginFrame(uint32_t width, uint32_t height)
+    {
+        if (width != mWidth || height != mHeight)
+        {
+            mWidth = width;
+            mHeight = height;
+            mPrevT.assign(size_t(width) * height, -1.f);
+            mValid = false;
+        }
+        mNext.assign(size_t(width) * height, -1.f);
+    }
+
+    void DepthHistory::endFrame(const CameraData& camera)
+    {
+        mPrevT.swap(mNext);
+        mPrevCamera = camera;
+        mValid = true;
+    }
+
+    bool DepthHistory::previousPixel(float3 p, uint32_t& px, uint32_t& py) const
+    {
+        float4 c = mul(mPrevCamera.camViewProj, float4(p.x, p.y, p.z, 1.f));
+        if (c.w <= 0.f) return false;
+        float2 fragCoord = float2((c.x / c.w + 1.f) * .5f * float(mWidth), (1.f - c.y / c.w) * .5f * float(mHeight));
+        if (!(fragCoord.x >= 1.f && fragCoord.y >= 1.f && fragCoord.x < float(mWidth) - 1.f && fragCoord.y < float(mHeight) - 1.f))
+            return false;
+        px = uint32_t(fragCoord.x);
+        py = uint32_t(fragCoord.y);
+        return true;
+    }
+
+    bool DepthHistory::reproject(const Ray& ray, uint32_t x, uint32_t y, float margin, float& tStart) const
+    {
+        if (!mValid || x >= mWidth || y >= mHeight) return false;
+        const float2 iResolution = float2(float(mWidth), float(mHeight));
+
+        // First guess: the pixel's own previous distance. Its point is projected into the previous frame, whose hit
+        // there gives the next guess; two rounds settle it for camera motion of a few pixels.
+        float t = mPrevT[size_t(y) * mWidth + x];
+        for (int i = 0; i < 2 && t > 0.f; ++i)
+        {
+            uint32_t px, py;
+            if (!previousPixel(ray.P + t * ray.V, px, py)) return false;
+            float prevT = mPrevT[size_t(py) * mWidth + px];
+            if (prevT < 0.f) return false;
+
+            Ray prev = getCameraRay(mPrevCamera, float2(float(px) + .5f, float(py) + .5f), iResolution, prevT);
+            float3 e = prev.P + prevT * prev.V - ray.P;
+            t = dot(e, ray.V);
+            if (t > 0.f && dot(e, e) - t * t <= margin * margin * t * t)
+            {
+                // An edge of a nearer surface may have moved over the pixel: start before the nearest of the
+                // neighbouring hits, measured the same way.
+                float nearest = t;
+                for (uint32_t ny = py - 1; ny <= py + 1; ++ny)
+                    for (uint32_t nx = px - 1; nx <= px + 1; ++nx)
+                    {
+                        float nT = mPrevT[size_t(ny) * mWidth + nx];
+                        if (nT < 0.f) continue;
+                        Ray n = getCameraRay(mPrevCamera, float2(float(nx) + .5f, float(ny) + .5f), iResolution, nT);
+                        nearest = std::min(nearest, dot(n.P + nT * n.V - ray.P, ray.V));
+                    }
+                tStart = (1.f - margin) * nearest;
+
+                // Geometry that was off screen or hidden may have come in front: the skipped part of the ray has to
+                // have been seen empty. It is sampled at a few points, each visible in the previous frame and in
+                // front of the hit there.
+                for (float f : { .25f, .5f, .75f })
+                {
+                    float3 q = ray.P + f * tStart * ray.V;
+                    uint32_t qx, qy;
+                    if (!previousPixel(q, qx, qy)) return false;
+                    float qT = mPrevT[size_t(qy) * mWidth + qx];
+                    if (qT >= 0.f && qT < length(q - mPrevCamera.camEye)) return false;
+                }
+                return true;
+            }
+        }
+        return false;
+    }
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+// Temporal depth reprojection (DEPTH_REPROJECTION in BDF.ps.slang): the primary hit distances of the previous frame
+// give each ray of the next frame a start distance a margin before its expected hit. The guess is followed back to
+// the previous frame and has to land on a previous hit close to the new ray, otherwise (disocclusion, background,
+// off screen) the ray is traced from its usual start. The renderer also rejects starts inside a surface.
+
+#include "camera.h"
+
+#include <vector>
+
+namespace bdf
+{
+    class DepthHistory
+    {
+    public:
+        // Starts a width x height frame; the previous one stays readable if it had the same size.
+        void beginFrame(uint32_t width, uint32_t height);
+
+        // Records the primary trace result of a pixel of the current frame (a distance for hits only).
+        void write(uint32_t x, uint32_t y, const TraceResult& ret)
+        {
+            mNext[size_t(y) * mWidth + x] = (ret.flags & 2) ? ret.T : -1.f;
+        }
+
+        // Makes the current frame, rendered with camera, the previous one.
+        void endFrame(const CameraData& camera);
+
+        // Start distance (1 - margin) * t for the ray through pixel (x, y), where t is where the previous frame's hit
+        // surface crosses the ray; false if there is no such hit within margin * t of the ray.
+        bool reproject(const Ray& ray, uint32_t x, uint32_t y, float margin, float& tStart) const;
+
+        // Forgets the previous frame (scene or settings changed).
+        void reset() { mValid = false; }
+
+        bool isValid() const { return mValid; }
+
+    private:
+        // Pixel of the previous frame p projects to, false if off screen or on the border
+        bool previousPixel(float3 p, uint32_t& px, uint32_t& py) const;
+
+        uint32_t mWidth = 0;
+        uint32_t mHeight = 0;
+        std::vector<float> mPrevT;  // -1: no hit
+        std::vector<float> mNext;
+        CameraData mPrevCamera;
+        bool mValid = false;
+    };
+}
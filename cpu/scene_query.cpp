@@ -0,0 +1,258 @@
+#include "scene_query.h"
+
+#include "parallel.h"
+#include "tracers_simd.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace bdf
+{
+    namespace
+    {
+        using F = QueryLanes;
+        const size_t kLanes = F::width;
+
+        uint32_t chunkCount(size_t count, const QueryOptions& options)
+        {
+            const size_t chunk = std::max<size_t>(options.chunkSize, kLanes);
+            return uint32_t((count + chunk - 1) / chunk);
+        }
+
+        // Evaluates points [begin, end) a packet at a time; the last packet repeats its last point into the
+        // unused lanes and stores only the used ones.
+        template <class SceneT>
+        void queryPoints(const SceneT& scene, const PointQueries& q, const PointResults& r, size_t begin, size_t end)
+        {
+            const bool gradient = r.gradX || r.gradY || r.gradZ;
+            const bool sdf = r.sdf && !gradient;    // otherwise from sdg
+            for (size_t i = begin; i < end; i += kLanes)
+            {
+                const size_t n = std::min<size_t>(kLanes, end - i);
+                alignas(64) float x[kLanes], y[kLanes], z[kLanes], d[kLanes];
+                for (size_t j = 0; j < kLanes; ++j)
+                {
+                    const size_t k = i + std::min(j, n - 1);
+                    x[j] = q.x[k];
+                    y[j] = q.y[k];
+                    z[j] = q.z[k];
+                }
+                const tvec3<F> p = { F::load(x), F::load(y), F::load(z) };
+                if (sdf)
+                {
+                    sdfT(scene, p).store(d);
+                    std::copy(d, d + n, r.sdf + i);
+                }
+                if (r.bdf)
+                {
+                    bdfT(scene, p).store(d);
+                    std::copy(d, d + n, r.bdf + i);
+                }
+                if (gradient)
+                    for (size_t j = 0; j < n; ++j)
+                    {
+                        const float4 g = scene.sdg(float3(x[j], y[j], z[j]));
+                        if (r.gradX) r.gradX[i + j] = g.x;
+                        if (r.gradY) r.gradY[i + j] = g.y;
+                        if (r.gradZ) r.gradZ[i + j] = g.z;
+                        if (r.sdf) r.sdf[i + j] = g.w;
+                    }
+            }
+        }
+
+        template <class SceneT>
+        void queryBoxes(const SceneT& scene, const BoxQueries& q, const BoxResults& r, size_t begin, size_t end)
+        {
+            for (size_t i = begin; i < end; ++i)
+            {
+                const tvec3<Interval> box = intervalBox(float3(q.loX[i], q.loY[i], q.loZ[i]), float3(q.hiX[i], q.hiY[i], q.hiZ[i]));
+                if (r.sdfLo || r.sdfHi)
+                {
+                    const Interval s = sdfT(scene, box);
+                    if (r.sdfLo) r.sdfLo[i] = s.lo;
+                    if (r.sdfHi) r.sdfHi[i] = s.hi;
+                }
+                if (r.bdfLo || r.bdfHi)
+                {
+                    const Interval b = bdfT(scene, box);
+                    if (r.bdfLo) r.bdfLo[i] = b.lo;
+                    if (r.bdfHi) r.bdfHi[i] = b.hi;
+                }
+            }
+        }
+
+        // Octahedral map of a direction to [-1, 1]^2
+        float2 octahedral(float3 v)
+        {
+            v = v / (std::abs(v.x) + std::abs(v.y) + std::abs(v.z) + 1e-30f);
+            if (v.z >= 0.f) return float2(v.x, v.y);
+            return float2((1.f - std::abs(v.y)) * (v.x >= 0.f ? 1.f : -1.f), (1.f - std::abs(v.x)) * (v.y >= 0.f ? 1.f : -1.f));
+        }
+
+        // Bounds of the ray origins and mapped directions of a batch; a sort key scales them to [0, 64)
+        struct RayBounds
+        {
+            float lo[5], scale[5];
+
+            RayBounds(const Ray* rays, size_t count)
+            {
+                float hi[5];
+                for (int k = 0; k < 5; ++k) lo[k] = std::numeric_limits<float>::max(), hi[k] = -std::numeric_limits<float>::max();
+                for (size_t i = 0; i < count; ++i)
+                {
+                    const float2 d = octahedral(rays[i].V);
+                    const float c[5] = { d.x, d.y, rays[i].P.x, rays[i].P.y, rays[i].P.z };
+                    for (int k = 0; k < 5; ++k) lo[k] = std::min(lo[k], c[k]), hi[k] = std::max(hi[k], c[k]);
+                }
+                for (int k = 0; k < 5; ++k) scale[k] = hi[k] > lo[k] ? 64.f / (hi[k] - lo[k]) : 0.f;
+            }
+
+            // 5D Morton code of the mapped direction and the origin, 6 bits each. A coordinate that is the same for
+            // every ray adds nothing, so rays from one point (a scanner) are ordered by direction alone and rays in
+            // one direction (visibility) by origin alone.
+            uint32_t key(const Ray& ray) const
+            {
+                const float2 d = octahedral(ray.V);
+                const float c[5] = { d.x, d.y, ray.P.x, ray.P.y, ray.P.z };
+                static const auto spread = []
+                {   // bit i of q at bit 5 i
+                    std::array<uint32_t, 64> table = {};
+                    for (uint32_t q = 0; q < 64; ++q)
+                        for (int bit = 0; bit < 6; ++bit) table[q] |= ((q >> bit) & 1) << (5 * bit);
+                    return table;
+                }();
+                uint32_t key = 0;
+                for (int k = 0; k < 5; ++k)
+                    key |= spread[uint32_t(std::min(std::max((c[k] - lo[k]) * scale[k], 0.f), 63.f))] << k;
+                return key;
+            }
+        };
+
+        // Sorts key << 32 | index by the keys, 30 bits in 3 passes of a radix sort
+        void sortKeys(std::vector<uint64_t>& items)
+        {
+            std::vector<uint64_t> tmp(items.size());
+            for (int shift = 32; shift < 62; shift += 10)
+            {
+                uint32_t offsets[1024] = {};
+                for (uint64_t item : items) ++offsets[(item >> shift) & 1023];
+                uint32_t sum = 0;
+                for (uint32_t& o : offsets) sum += std::exchange(o, sum);
+                for (uint64_t item : items) tmp[offsets[(item >> shift) & 1023]++] = item;
+                items.swap(tmp);
+            }
+        }
+
+        template <class SceneT>
+        TraceResult traceRay(const SceneT& scene, const RenderSettings& s, const Ray& ray, const RayQueryDesc& desc)
+        {
+            if constexpr (!std::is_same_v<SceneT, Scene<Scenes::BLOBS>>)
+            {
+                if (desc.tracer == Tracers::SEGMENT_TRACE) return interval_segment_trace(scene, ray, desc.trace, s.sKappaFactor);
+            }
+            return trace(desc.tracer, scene, ray, desc.trace, s.sMarchEpsilon, s.bdfOmega, s.bdfHitScale);
+        }
+
+        // Rays [begin, end) into results[order[i]], QueryLanes at a time for a bdf_trace in packets
+        template <class SceneT>
+        void queryRays(const SceneT& scene, const RenderSettings& s, const Ray* rays, const uint32_t* order, TraceResult* results,
+            size_t begin, size_t end, const RayQueryDesc& desc)
+        {
+            auto index = [&](size_t i) { return order ? order[i] : uint32_t(i); };
+            if (!(desc.packets && desc.tracer == Tracers::BDF_TRACE))
+            {
+                for (size_t i = begin; i < end; ++i) results[index(i)] = traceRay(scene, s, rays[i], desc);
+                return;
+            }
+            for (size_t i = begin; i < end; i += kLanes)
+            {
+                const size_t n = std::min<size_t>(kLanes, end - i);
+                Ray packet[kLanes];
+                for (size_t j = 0; j < kLanes; ++j) packet[j] = rays[i + std::min(j, n - 1)];
+                const TraceResultPacket<F> ret = bdf_trace_packet(scene, packRays<F>(packet), desc.trace);
+                for (size_t j = 0; j < n; ++j) results[index(i + j)] = ret.lane(int(j));
+            }
+        }
+    }
+
+    SceneQuery::SceneQuery(const RenderSettings& settings)
+        : mSettings(settings), mParams(SceneParams::fromSettings(mSettings))
+    {
+    }
+
+    void SceneQuery::points(const PointQueries& queries, const PointResults& results, const QueryOptions& options) const
+    {
+        const size_t chunk = std::max<size_t>(options.chunkSize, kLanes);
+        dispatchScene(mSettings.scene, mParams, [&](const auto& scene)
+        {
+            parallelFor(chunkCount(queries.count, options), options.threadCount, [&](uint32_t c, uint32_t)
+            {
+                queryPoints(scene, queries, results, c * chunk, std::min(queries.count, (c + 1) * chunk));
+            });
+        });
+    }
+
+    void SceneQuery::boxes(const BoxQueries& queries, const BoxResults& results, const QueryOptions& options) const
+    {
+        const size_t chunk = std::max<size_t>(options.chunkSize, kLanes);
+        dispatchScene(mSettings.scene, mParams, [&](const auto& scene)
+        {
+            parallelFor(chunkCount(queries.count, options), options.threadCount, [&](uint32_t c, uint32_t)
+            {
+                queryBoxes(scene, queries, results, c * chunk, std::min(queries.count, (c + 1) * chunk));
+            });
+        });
+    }
+
+    bool SceneQuery::rays(const Ray* rays, size_t count, TraceResult* results, const RayQueryDesc& desc, std::string& error,
+        const QueryOptions& options) const
+    {
+        if (!isTracerAvailable(mSettings.scene, desc.tracer) && desc.tracer != Tracers::SEGMENT_TRACE)
+        {
+            error = std::string(kTraceLabels[uint32_t(desc.tracer)]) + " is only available for the Blobs scene";
+            return false;
+        }
+        if (count >= std::numeric_limits<uint32_t>::max())
+        {
+            error = "Too many rays in one batch";
+            return false;
+        }
+
+        // the sorted rays are copied, so that the tracing reads them in order
+        std::vector<uint32_t> order;
+        std::vector<Ray> sorted;
+        if (desc.sort && count > kRayBlock)
+        {
+            const RayBounds bounds(rays, count);
+            std::vector<uint64_t> keys(count);
+            parallelFor(uint32_t((count + kRayBlock - 1) / kRayBlock), options.threadCount, [&](uint32_t b, uint32_t)
+            {
+                for (size_t i = size_t(b) * kRayBlock; i < std::min<size_t>(count, (size_t(b) + 1) * kRayBlock); ++i)
+                    keys[i] = uint64_t(bounds.key(rays[i])) << 32 | i;
+            });
+            sortKeys(keys);
+            order.resize(count);
+            sorted.resize(count);
+            for (size_t i = 0; i < count; ++i)
+            {
+                order[i] = uint32_t(keys[i]);
+                sorted[i] = rays[order[i]];
+            }
+        }
+
+        dispatchScene(mSettings.scene, mParams, [&](const auto& scene)
+        {
+            parallelForStealing(uint32_t((count + kRayBlock - 1) / kRayBlock), options.threadCount, [&](uint32_t b, uint32_t)
+            {
+                queryRays(scene, mSettings, sorted.empty() ? rays : sorted.data(), order.empty() ? nullptr : order.data(), results, size_t(b) * kRayBlock,
+                    std::min<size_t>(count, (size_t(b) + 1) * kRayBlock), desc);
+            });
+        });
+        return true;
+    }
+}
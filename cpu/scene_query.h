@@ -0,0 +1,104 @@
+#pragma once
+
+// Batch queries of a scene from host code, for proximity and collision checks and ray casts outside the renderer.
+// Points come in as SoA arrays and the SDF, the BDF and the SDF gradient (the scene's sdg) go out into
+// caller-owned SoA arrays; boxes get Interval bounds of the SDF and BDF over them (scenes.h). A call splits
+// the queries into chunks run by parallelFor, evaluates sdfT/bdfT on QueryLanes points at a time and allocates
+// nothing per query. Gradients are evaluated per point, as sdg is float only.
+//
+// Rays of any origin and direction are traced with one of the tracers of tracers.h into a TraceResult each. They
+// are first sorted by a Morton code of direction and origin, so that neighbouring rays take similar paths; bdf_trace
+// then runs them as packets of QueryLanes rays. Blocks of the sorted rays are spread with parallelForStealing, since
+// step counts differ by orders of magnitude between rays.
+
+#include "common.h"
+#include "settings.h"
+#include "scenes.h"
+#include "simd.h"
+
+#include <cstddef>
+#include <string>
+
+namespace bdf
+{
+#if defined(__AVX512F__)
+    using QueryLanes = f32x16;
+#else
+    using QueryLanes = f32x8;
+#endif
+
+    struct PointQueries
+    {
+        const float* x = nullptr;
+        const float* y = nullptr;
+        const float* z = nullptr;
+        size_t count = 0;
+    };
+
+    // Outputs of PointQueries, count floats each; nullptr: not wanted
+    struct PointResults
+    {
+        float* sdf = nullptr;
+        float* bdf = nullptr;
+        float* gradX = nullptr;     // gradient of the SDF, not normalized
+        float* gradY = nullptr;
+        float* gradZ = nullptr;
+    };
+
+    struct BoxQueries
+    {
+        const float* loX = nullptr;
+        const float* loY = nullptr;
+        const float* loZ = nullptr;
+        const float* hiX = nullptr;
+        const float* hiY = nullptr;
+        const float* hiZ = nullptr;
+        size_t count = 0;
+    };
+
+    // Outputs of BoxQueries: bounds of the functions over each box; nullptr: not wanted
+    struct BoxResults
+    {
+        float* sdfLo = nullptr;
+        float* sdfHi = nullptr;
+        float* bdfLo = nullptr;
+        float* bdfHi = nullptr;
+    };
+
+    struct QueryOptions
+    {
+        uint32_t threadCount = 0;   // 0: one per hardware thread
+        uint32_t chunkSize = 4096;  // points or boxes per task; rays go in blocks of SceneQuery::kRayBlock
+    };
+
+    struct RayQueryDesc
+    {
+        // Any tracer of tracers.h; segment_trace is the blobs' segment tracing there and interval_segment_trace in the
+        // other scenes. their_sphere_trace is for the Blobs scene only.
+        Tracers tracer = Tracers::BDF_TRACE;
+        SphereTraceDesc trace = { 1e-4f, 512 };    // epsilon is relative to T, the cone of the renderer's rays
+        bool sort = true;           // order the rays by direction and origin first; packets need it, one ray at a time
+                                    // it mostly costs the sort
+        bool packets = true;        // bdf_trace as packets of QueryLanes rays; a scene evaluated lane by lane (a CSG
+                                    // BVH, a blob grid) is faster without
+    };
+
+    // The scene of settings; the query object keeps its CSG program, BVH and blob grid.
+    class SceneQuery
+    {
+    public:
+        static const uint32_t kRayBlock = 64;  // rays per work item of rays
+
+        explicit SceneQuery(const RenderSettings& settings);
+
+        void points(const PointQueries& queries, const PointResults& results, const QueryOptions& options = QueryOptions()) const;
+        void boxes(const BoxQueries& queries, const BoxResults& results, const QueryOptions& options = QueryOptions()) const;
+        // Traces rays[i] into results[i]; on failure returns false with a message in error.
+        bool rays(const Ray* rays, size_t count, TraceResult* results, const RayQueryDesc& desc, std::string& error,
+            const QueryOptions& options = QueryOptions()) const;
+
+    private:
+        RenderSettings mSettings;
+        SceneParams mParams;
+    };
+}
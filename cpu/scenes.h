@@ -0,0 +1,366 @@
+#pragma once
+
+// Host mirror of the scene functions of BDF.ps.slang (sdPrimitives/bdPrimitives/sdgPrimitives, the single primitive
+// scenes with repetition and ground plane, the blobs and the test scene) and of scene files loaded as CSG.
+// Scene<S> plays the role of the SCENE_SDF/SCENE_BDF defines: the scene is a template parameter, so the
+// tracers are compiled per scene the same way the shader is compiled per define set.
+
+#include "bdf_primitives.h"
+#include "csg_bvh.h"
+#include "sdf_primitives.h"
+#include "segment_tracing.h"
+#include "settings.h"
+
+namespace bdf
+{
+    struct SceneParams
+    {
+        BlobField blobs;
+        float3 primitiveData = float3(1);   // P_PRIMITIVE_DATA
+        float3 testPos = float3(0);         // P_TEST_POS
+        int3 repeatNum = { 3, 0, 3 };       // P_REPEAT_*_NUM
+        float3 repeatDist = float3(10);     // P_REPEAT_DIST
+        bool planeOn = true;                // P_PLANE_ON
+        const CsgProgram* csg = nullptr;    // Scenes::CSG
+        const CsgBvh* csgBvh = nullptr;
+
+        static SceneParams fromSettings(const RenderSettings& settings)
+        {
+            SceneParams params;
+            params.blobs.T = settings.sThreshold;
+            params.blobs.radius = settings.sBlobRadius;
+            params.blobs.kappa = settings.sKappaFactor;
+            params.blobs.grid = settings.blobGrid.get();
+            params.primitiveData = settings.pPrimitiveData;
+            params.testPos = settings.pTestPos;
+            params.repeatNum = settings.pRepeatNum;
+            params.repeatDist = settings.pRepeatDist;
+            params.planeOn = settings.pShowPlane;
+            params.csg = settings.csg.get();
+            params.csgBvh = settings.csgBvh.get();
+            return params;
+        }
+
+        // p: float3 or a tvec3 of a number type of number_types.h (as for the two plane adds)
+        template <class V>
+        V repetition(V p) const
+        {
+            if (repeatNum.x) p.x = REPLIM(p.x, repeatDist.x, float(repeatNum.x));
+            if (repeatNum.y) p.y = REPLIM(p.y, repeatDist.y, float(repeatNum.y));
+            if (repeatNum.z) p.z = REPLIM(p.z, repeatDist.z, float(repeatNum.z));
+            return p;
+        }
+        template <class V>
+        scalar_t<V> sdPlaneAdd(const scalar_t<V>& d, const V& p) const
+        {
+            return planeOn ? min(d, sdPlane(p + float3(0, primitiveData.y, 0), float3(0, 1, 0))) : d;
+        }
+        float4 sdgPlaneAdd(float4 d, float3 p) const
+        {
+            return planeOn ? sdgMin(d, sdgPlane(p + float3(0, primitiveData.y, 0), float3(0, 1, 0))) : d;
+        }
+        template <class V>
+        scalar_t<V> bdPlaneAdd(const scalar_t<V>& d, const V& p) const
+        {
+            return planeOn ? min(d, bdPlane(p + float3(0, primitiveData.y, 0), float3(0, 1, 0))) : d;
+        }
+    };
+
+    template <Scenes S>
+    struct Scene
+    {
+        const SceneParams& params;
+
+        float sdf(float3 p) const;     // sdfT and bdfT below at float3
+        float bdf(float3 p) const;
+        float4 sdg(float3 p) const;    // float4(gradient of sdf, sdf), for the normals
+    };
+
+    // The scene BDFs and SDFs, written once over the point type V of number_types.h: float3 (Scene<S>::bdf and
+    // sdf), a tvec3 of a lane type of simd.h (ray packets, point queries), of Interval (bounds over a box) or of
+    // Dual (the value and its gradient). A CSG scene runs CsgProgram::eval. Where the scalar code walks a
+    // structure per point (the BVH of a CSG scene, the grid of a blob field), lane types evaluate the float3 code
+    // lane by lane and the other types do without the structure.
+
+    template <class F, class Fn>
+    F evalLaneByLane(const tvec3<F>& p, Fn fn)
+    {
+        alignas(64) float x[F::width], y[F::width], z[F::width], d[F::width];
+        p.x.store(x);
+        p.y.store(y);
+        p.z.store(z);
+        for (int i = 0; i < F::width; ++i)
+            d[i] = fn(float3(x[i], y[i], z[i]));
+        return F::load(d);
+    }
+
+    template <class SceneT, class F>
+    F bdfLaneByLane(const SceneT& scene, const tvec3<F>& p)
+    {
+        return evalLaneByLane(p, [&](float3 q) { return scene.bdf(q); });
+    }
+
+    template <class SceneT, class F>
+    F sdfLaneByLane(const SceneT& scene, const tvec3<F>& p)
+    {
+        return evalLaneByLane(p, [&](float3 q) { return scene.sdf(q); });
+    }
+
+    template <class SceneT, class V>
+    scalar_t<V> bdfT(const SceneT& scene, const V& p)
+    {
+        return bdfLaneByLane(scene, p);
+    }
+    template <class SceneT, class V>
+    scalar_t<V> sdfT(const SceneT& scene, const V& p)
+    {
+        return sdfLaneByLane(scene, p);
+    }
+
+    // Blobs
+
+    template <class V>
+    scalar_t<V> bdfT(const Scene<Scenes::BLOBS>& scene, const V& p)
+    {
+        using F = scalar_t<V>;
+        const BlobField& blobs = scene.params.blobs;
+        if constexpr (isLaneType<F>)
+        {
+            if (blobs.grid) return bdfLaneByLane(scene, p);
+        }
+        const float T = blobs.T, radius = blobs.grid ? blobs.grid->maxRadius() : blobs.radius;
+        F d = 1e+10f;
+        float r = (1.f - T) * radius;
+        if (blobs.grid)
+        {
+            if constexpr (std::is_same_v<V, float3>)
+                d = blobs.grid->SphereBound(p, 1.f - T);
+            else
+                for (const BlobVertex& v : blobs.grid->vertices()) d = min(d, bdSphere(p - v.c, (1.f - T) * v.R));
+        }
+        else
+        {
+            d = min(d, bdSphere(p - float3(-radius / 2.f, 0, 0), r));
+            d = min(d, bdSphere(p - float3(radius / 2.f, 0, 0), r));
+            d = min(d, bdSphere(p - float3(radius / 3.f, radius, 0), r));
+        }
+        F s = blobs.Object(p) * (-1.f / blobs.KGlobal());
+        F sd = sqrt(sqr(d) + r) - r;
+        return select(sd < T * radius, s, d);
+    }
+
+    template <class V>
+    scalar_t<V> sdfT(const Scene<Scenes::BLOBS>& scene, const V& p)
+    {
+        if constexpr (isLaneType<scalar_t<V>>)
+        {
+            if (scene.params.blobs.grid) return sdfLaneByLane(scene, p);
+        }
+        return scene.params.blobs.Object(p) * (-1.f / scene.params.blobs.KGlobal());
+    }
+
+    // Primitives
+
+    template <class V>
+    scalar_t<V> bdfT(const Scene<Scenes::PRIMITIVES>&, const V& p)
+    {
+        scalar_t<V> d = 1e+10f;
+        d = min(d, bdBox(p, float3(1)));
+        d = min(d, bdSphere(p + float3(-3, 0, 0), 1.4f));
+        d = min(d, bdCone(p + float3(3, 0, 0), .3f));
+        d = min(d, bdCylinder(p + float3(0, 0, -4), 1.5f, 1.f));
+        d = min(d, bdTorus(p + float3(0, 0, +4), float2(1, .5f)));
+        d = min(d, bdPlane(p - float3(0, -2, 0), float3(0, 1, 0)));
+        return d;
+    }
+
+    template <class V>
+    scalar_t<V> sdfT(const Scene<Scenes::PRIMITIVES>&, const V& p)
+    {
+        scalar_t<V> d = 1e+10f;
+        d = min(d, sdBox(p, float3(1)));
+        d = min(d, sdSphere(p + float3(-3, 0, 0), 1.4f));
+        d = min(d, sdCone(p + float3(3, 0, 0), .3f));
+        d = min(d, sdCylinder(p + float3(0, 0, -4), 1.5f, 1.f));
+        d = min(d, sdTorus(p + float3(0, 0, +4), float2(1, .5f)));
+        d = min(d, sdPlane(p - float3(0, -2, 0), float3(0, 1, 0)));
+        return d;
+    }
+
+    // Single primitives with repetition and ground plane
+
+    template <class V>
+    scalar_t<V> bdfT(const Scene<Scenes::SPHERE>& scene, const V& p)
+    {
+        return scene.params.bdPlaneAdd(bdSphere(scene.params.repetition(p), scene.params.primitiveData.y), p);
+    }
+    template <class V>
+    scalar_t<V> sdfT(const Scene<Scenes::SPHERE>& scene, const V& p)
+    {
+        return scene.params.sdPlaneAdd(sdSphere(scene.params.repetition(p), scene.params.primitiveData.y), p);
+    }
+
+    template <class V>
+    scalar_t<V> bdfT(const Scene<Scenes::BOX>& scene, const V& p)
+    {
+        return scene.params.bdPlaneAdd(bdBox(scene.params.repetition(p), scene.params.primitiveData), p);
+    }
+    template <class V>
+    scalar_t<V> sdfT(const Scene<Scenes::BOX>& scene, const V& p)
+    {
+        return scene.params.sdPlaneAdd(sdBox(scene.params.repetition(p), scene.params.primitiveData), p);
+    }
+
+    template <class V>
+    scalar_t<V> bdfT(const Scene<Scenes::CYLINDER>& scene, const V& p)
+    {
+        return scene.params.bdPlaneAdd(bdCylinder(scene.params.repetition(p), scene.params.primitiveData.x, scene.params.primitiveData.y), p);
+    }
+    template <class V>
+    scalar_t<V> sdfT(const Scene<Scenes::CYLINDER>& scene, const V& p)
+    {
+        return scene.params.sdPlaneAdd(sdCylinder(scene.params.repetition(p), scene.params.primitiveData.x, scene.params.primitiveData.y), p);
+    }
+
+    template <class V>
+    scalar_t<V> bdfT(const Scene<Scenes::TORUS>& scene, const V& p)
+    {
+        return scene.params.bdPlaneAdd(bdTorus(scene.params.repetition(p), scene.params.primitiveData.xy()), p);
+    }
+    template <class V>
+    scalar_t<V> sdfT(const Scene<Scenes::TORUS>& scene, const V& p)
+    {
+        return scene.params.sdPlaneAdd(sdTorus(scene.params.repetition(p), scene.params.primitiveData.xy()), p);
+    }
+
+    // Test: the BDF is the SDF
+
+    template <class V>
+    scalar_t<V> sdfT(const Scene<Scenes::TEST>& scene, const V& p)
+    {
+        scalar_t<V> d = 1e+10f;
+        float r = bdBox(scene.params.testPos, scene.params.primitiveData);
+        d = min(sdBox(p, scene.params.primitiveData), d);
+        d = min(d, sdSphere(p - scene.params.testPos, r));
+        return scene.params.sdPlaneAdd(d, p);
+    }
+    template <class V>
+    scalar_t<V> bdfT(const Scene<Scenes::TEST>& scene, const V& p)
+    {
+        return sdfT(scene, p);
+    }
+
+    // CSG, generated as sdCSG/bdCSG/sdgCSG on the GPU. The BVH traversal differs per point, so lanes are
+    // evaluated one by one; Interval and Dual run the linear program, which computes the same min.
+
+    template <class V>
+    scalar_t<V> bdfT(const Scene<Scenes::CSG>& scene, const V& p)
+    {
+        if (scene.params.csgBvh)
+        {
+            if constexpr (std::is_same_v<V, float3>)
+                return scene.params.csgBvh->bdf(p);
+            else if constexpr (isLaneType<scalar_t<V>>)
+                return bdfLaneByLane(scene, p);
+        }
+        return scene.params.csg->template eval<true>(p);
+    }
+    template <class V>
+    scalar_t<V> sdfT(const Scene<Scenes::CSG>& scene, const V& p)
+    {
+        if (scene.params.csgBvh)
+        {
+            if constexpr (std::is_same_v<V, float3>)
+                return scene.params.csgBvh->sdf(p);
+            else if constexpr (isLaneType<scalar_t<V>>)
+                return sdfLaneByLane(scene, p);
+        }
+        return scene.params.csg->template eval<false>(p);
+    }
+
+    template <Scenes S>
+    inline float Scene<S>::sdf(float3 p) const
+    {
+        return sdfT(*this, p);
+    }
+    template <Scenes S>
+    inline float Scene<S>::bdf(float3 p) const
+    {
+        return bdfT(*this, p);
+    }
+
+    // Gradients, analytic and float only
+
+    template <>
+    inline float4 Scene<Scenes::BLOBS>::sdg(float3 p) const
+    {
+        return params.blobs.ObjectGradient(p) * (-1.f / params.blobs.KGlobal());
+    }
+
+    template <>
+    inline float4 Scene<Scenes::PRIMITIVES>::sdg(float3 p) const
+    {
+        float4 d = float4(0, 0, 0, 1e+10f);
+        d = sdgMin(d, sdgBox(p, float3(1)));
+        d = sdgMin(d, sdgSphere(p + float3(-3, 0, 0), 1.4f));
+        d = sdgMin(d, sdgCone(p + float3(3, 0, 0), .3f));
+        d = sdgMin(d, sdgCylinder(p + float3(0, 0, -4), 1.5f, 1.f));
+        d = sdgMin(d, sdgTorus(p + float3(0, 0, +4), float2(1, .5f)));
+        d = sdgMin(d, sdgPlane(p - float3(0, -2, 0), float3(0, 1, 0)));
+        return d;
+    }
+
+    template <>
+    inline float4 Scene<Scenes::SPHERE>::sdg(float3 p) const
+    {
+        return params.sdgPlaneAdd(sdgSphere(params.repetition(p), params.primitiveData.y), p);
+    }
+    template <>
+    inline float4 Scene<Scenes::BOX>::sdg(float3 p) const
+    {
+        return params.sdgPlaneAdd(sdgBox(params.repetition(p), params.primitiveData), p);
+    }
+    template <>
+    inline float4 Scene<Scenes::CYLINDER>::sdg(float3 p) const
+    {
+        return params.sdgPlaneAdd(sdgCylinder(params.repetition(p), params.primitiveData.x, params.primitiveData.y), p);
+    }
+    template <>
+    inline float4 Scene<Scenes::TORUS>::sdg(float3 p) const
+    {
+        return params.sdgPlaneAdd(sdgTorus(params.repetition(p), params.primitiveData.xy()), p);
+    }
+
+    template <>
+    inline float4 Scene<Scenes::TEST>::sdg(float3 p) const
+    {
+        float4 d = float4(0, 0, 0, 1e+10f);
+        float r = bdBox(params.testPos, params.primitiveData);
+        d = sdgMin(sdgBox(p, params.primitiveData), d);
+        d = sdgMin(d, sdgSphere(p - params.testPos, r));
+        return params.sdgPlaneAdd(d, p);
+    }
+
+    template <>
+    inline float4 Scene<Scenes::CSG>::sdg(float3 p) const
+    {
+        return params.csgBvh ? params.csgBvh->sdg(p) : params.csg->sdg(p);
+    }
+
+    // Calls f(Scene<S>{params}) with the scene selected at runtime; the per-frame counterpart of recompiling the shader.
+    template <class F>
+    decltype(auto) dispatchScene(Scenes scene, const SceneParams& params, F&& f)
+    {
+        switch (scene)
+        {
+        case Scenes::BLOBS: return f(Scene<Scenes::BLOBS>{ params });
+        case Scenes::PRIMITIVES: return f(Scene<Scenes::PRIMITIVES>{ params });
+        case Scenes::SPHERE: return f(Scene<Scenes::SPHERE>{ params });
+        case Scenes::BOX: return f(Scene<Scenes::BOX>{ params });
+        case Scenes::CYLINDER: return f(Scene<Scenes::CYLINDER>{ params });
+        case Scenes::TORUS: return f(Scene<Scenes::TORUS>{ params });
+        case Scenes::CSG: if (params.csg) return f(Scene<Scenes::CSG>{ params }); [[fallthrough]]; // no scene file loaded
+        case Scenes::TEST: default: return f(Scene<Scenes::TEST>{ params });
+        }
+    }
+}
@@ -0,0 +1,126 @@
+#pragma once
+
+// Host mirror of sdf_primitives.slang. The distance functions and REPLIM are templates over the point type
+// (see number_types.h); the sdg gradients are float only.
+
+#include "common.h"
+#include "number_types.h"
+
+namespace bdf
+{
+    // SDF primitives mostly copied from Inigo Quilez's SDF primitives https://iquilezles.org/articles/distfunctions/
+
+    template <class V>
+    scalar_t<V> sdSphere(const V& p, float r)
+    {
+        return length(p) - r;
+    }
+
+    template <class V>
+    scalar_t<V> sdBox(const V& p, float3 b)
+    {
+        using F = scalar_t<V>;
+        F dx = abs(p.x) - b.x, dy = abs(p.y) - b.y, dz = abs(p.z) - b.z;
+        return sqrt(sqr(max(dx, F(0.f))) + sqr(max(dy, F(0.f))) + sqr(max(dz, F(0.f)))) + min(max(max(dx, dy), dz), F(0.f));
+    }
+
+    template <class V>
+    scalar_t<V> sdCylinder(const V& p, float r) // Infinite
+    {
+        return lengthXZ(p) - r;
+    }
+    template <class V>
+    scalar_t<V> sdCylinder(const V& p, float r, float h) // Capped
+    {
+        using F = scalar_t<V>;
+        F dx = lengthXZ(p) - r, dy = abs(p.y) - h;
+        return min(max(dx, dy), F(0.f)) + sqrt(sqr(max(dx, F(0.f))) + sqr(max(dy, F(0.f))));
+    }
+
+    template <class V>
+    scalar_t<V> sdTorus(const V& p, float2 t) //t = vec2(R,r)
+    {
+        return sqrt(sqr(lengthXZ(p) - t.x) + sqr(p.y)) - t.y;
+    }
+
+    template <class V>
+    scalar_t<V> sdCone(const V& p, float t) // Infinite
+    {
+        return (lengthXZ(p) - abs(p.y) * t) / std::sqrt(1.f + t * t);
+    }
+
+    template <class V>
+    scalar_t<V> sdPlane(const V& p, float3 n)
+    {
+        return p.x * n.x + p.y * n.y + p.z * n.z;
+    }
+
+    // Gradients: float4(dd/dp, d) of the functions above (the sdg functions of
+    // https://iquilezles.org/articles/distgradfunctions3d/). On edges and axes one of the one-sided gradients.
+
+    inline float4 sdgSphere(float3 p, float r)
+    {
+        float l = length(p);
+        return float4(p / l, l - r);
+    }
+
+    inline float4 sdgBox(float3 p, float3 b)
+    {
+        float3 w = abs(p) - b;
+        float3 s = float3(p.x < 0.f ? -1.f : 1.f, p.y < 0.f ? -1.f : 1.f, p.z < 0.f ? -1.f : 1.f);
+        float g = max3(w.x, w.y, w.z);
+        float3 q = max(w, 0.f);
+        float l = length(q);
+        float3 n = g > 0.f ? q / l : (w.x > w.y && w.x > w.z ? float3(1, 0, 0) : (w.y > w.z ? float3(0, 1, 0) : float3(0, 0, 1)));
+        return float4(s * n, g > 0.f ? l : g);
+    }
+
+    inline float4 sdgCylinder(float3 p, float r) // Infinite
+    {
+        float l = length(p.xz());
+        return float4(float3(p.x, 0.f, p.z) / l, l - r);
+    }
+    inline float4 sdgCylinder(float3 p, float r, float h) // Capped
+    {
+        float l = length(p.xz());
+        float2 d = abs(float2(l, p.y)) - float2(r, h);
+        float g = std::max(d.x, d.y);
+        float2 q = max(d, 0.f);
+        float lq = length(q);
+        float2 n = g > 0.f ? q * (1.f / lq) : (d.x > d.y ? float2(1, 0) : float2(0, 1));
+        return float4(float3(p.x, 0.f, p.z) * (n.x / l) + float3(0.f, p.y < 0.f ? -n.y : n.y, 0.f), std::min(g, 0.f) + lq);
+    }
+
+    inline float4 sdgTorus(float3 p, float2 t) //t = vec2(R,r)
+    {
+        float l = length(p.xz());
+        float2 q = float2(l - t.x, p.y);
+        float lq = length(q);
+        return float4((float3(p.x, 0.f, p.z) * (q.x / l) + float3(0.f, q.y, 0.f)) / lq, lq - t.y);
+    }
+
+    inline float4 sdgCone(float3 p, float t) // Infinite
+    {
+        float l = length(p.xz()), k = 1.f / std::sqrt(1.f + t * t);
+        return float4((float3(p.x, 0.f, p.z) / l - float3(0.f, p.y < 0.f ? -t : t, 0.f)) * k, (l - std::abs(p.y) * t) * k);
+    }
+
+    inline float4 sdgPlane(float3 p, float3 n)
+    {
+        return float4(n, dot(p, n));
+    }
+
+    // min of two sdg results
+    inline float4 sdgMin(float4 a, float4 b)
+    {
+        return b.w < a.w ? b : a;
+    }
+
+    // Operations
+
+    template <class F>
+    F REPLIM(const F& p, float c, float l)
+    {   // HLSL round() rounds half to even, as does round() of number_types.h
+        return p - c * clamp(round(p / c), F(-l), F(l));
+    }
+}
@@ -0,0 +1,192 @@
+#include "segment_tracing.h"
+
+namespace bdf
+{
+    namespace
+    {
+        const float ra = 20.f; // Ray start interval
+        const float rb = 60.f; // Ray end interval
+
+        float3 RotateY(float3 p, float a)
+        {
+            float sa = std::sin(a);
+            float ca = std::cos(a);
+            return float3(ca * p.x + sa * p.z, p.y, -sa * p.x + ca * p.z);
+        }
+
+        float3 Background(float3 rd)
+        {
+            const float3 C1 = float3(0.8f, 0.8f, 0.9f);
+            const float3 C2 = float3(0.6f, 0.8f, 1.0f);
+            return mix(C1, C2, rd.y * 1.f + 0.25f);
+        }
+
+        float3 Shade(float3 /*p*/, float3 n)
+        {
+            const float3 l1 = normalize(float3(-2.f, -1.f, -1.f));
+            const float3 l2 = normalize(float3(2.f, 0.f, 1.f));
+            float d1 = std::pow(0.5f * (1.f + dot(n, l1)), 2.f);
+            float d2 = std::pow(0.5f * (1.f + dot(n, l2)), 2.f);
+            return float3(0.6f) + 0.2f * (d1 + d2) * Background(n);
+        }
+
+        float3 ShadeSteps(int n, int StepsMax)
+        {
+            const float3 a = float3(97, 130, 234) / 255.f;
+            const float3 b = float3(220, 94, 75) / 255.f;
+            const float3 c = float3(221, 220, 219) / 255.f;
+            float t = float(n) / float(StepsMax);
+            if (t < 0.5f)
+                return mix(a, c, 2.f * t);
+            else
+                return mix(c, b, 2.f * t - 1.f);
+        }
+    }
+
+    float VertexKSegment(float3 c, float R, float e, float3 a, float3 b)
+    {
+        float3 axis = normalize(b - a);
+        float l = dot((c - a), axis);
+        float kk = 0.f;
+        if (l < 0.f)
+        {
+            kk = FalloffK(length(c - a), length(c - b), R, e);
+        }
+        else if (length(b - a) < l)
+        {
+            kk = FalloffK(length(c - b), length(c - a), R, e);
+        }
+        else
+        {
+            float dd = length(c - a) - (l * l);
+            kk = FalloffK(dd, std::max(length(c - b), length(c - a)), R, e);
+        }
+        float grad = std::max(std::abs(dot(axis, normalize(c - a))), std::abs(dot(axis, normalize(c - b))));
+        return kk * grad;
+    }
+
+    float3 BlobField::ObjectNormal(float3 p) const
+    {
+        return normalize(ObjectGradient(p).xyz());
+    }
+
+    float BlobField::SphereTracing(float3 o, float3 u, bool& h, int& s, float ra, float rb, float Epsilon, int StepsMax) const
+    {
+        float kGlobal = KGlobal();
+        float t = ra;
+        h = false;
+        s = 0;
+        for (int i = 0; i < StepsMax; i++)
+        {
+            float3 p = o + t * u;
+            float v = Object(p);
+            s++;
+
+            // Hit object
+            if (v > 0.f)
+            {
+                h = true;
+                break;
+            }
+
+            // Move along ray
+            t += std::max(Epsilon, std::abs(v) / kGlobal);
+
+            // Escape marched far away
+            if (t > rb)
+                break;
+        }
+        return t;
+    }
+
+    float BlobField::SegmentTracing(float3 o, float3 u, bool& h, int& s, float ra, float rb, float Epsilon, int StepsMax) const
+    {
+        float t = ra;
+        h = false;
+        s = 0;
+        float candidate = 1.f;
+        for (int i = 0; i < StepsMax; i++)
+        {
+            s++;
+            float3 p = o + t * u;
+            float v = Object(p);
+
+            // Hit object
+            if (v > 0.f)
+            {
+                h = true;
+                break;
+            }
+
+            // Lipschitz constant on a segment
+            float lipschitzSeg = KSegment(p, o + (t + candidate) * u);
+
+            // Lipschitz marching distance
+            float step = std::abs(v) / lipschitzSeg;
+
+            // No further than the segment length
+            step = std::min(step, candidate);
+
+            // But at least, Epsilon
+            step = std::max(Epsilon, step);
+
+            // Move along ray
+            t += step;
+
+            // Escape marched far away
+            if (t > rb)
+                break;
+
+            candidate = kappa * step;
+        }
+        return t;
+    }
+
+    float4 segmentTracingImage(const BlobField& blobs, float2 fragCoord, float2 iResolution, float iTime, float4 iMouse,
+        float Epsilon, int StepsMax)
+    {
+        // Compute ray origin and direction
+        float2 pixel = (fragCoord / iResolution) * 2.f - float2(1.f);
+        float asp = iResolution.x / iResolution.y;
+        float3 rd = normalize(float3(asp * pixel.x, pixel.y - 1.5f, -4.f));
+        float3 ro = float3(0.f, 18.f, 40.f);
+        float2 mouse = (float2(iMouse.x, iMouse.y) / iResolution) * 2.f - float2(1.f);
+        if (mouse.y <= -0.9999f) // show cost at frame 0
+            mouse = float2(0.f);
+
+        float a = (iTime * 0.25f);
+        ro = RotateY(ro, a);
+        rd = RotateY(rd, a);
+
+        // Trace ray
+        bool hit;
+        int s;
+        float t;
+        float sep = mouse.x;
+
+        // Sphere tracing on the left, segment tracing on the right
+        if (pixel.x < sep)
+            t = blobs.SphereTracing(ro, rd, hit, s, ra, rb, Epsilon, StepsMax);
+        else
+            t = blobs.SegmentTracing(ro, rd, hit, s, ra, rb, Epsilon, StepsMax);
+
+        // Shade this with object
+        float3 rgb = Background(rd);
+        if (pixel.y > mouse.y)
+        {
+            if (hit)
+            {
+                float3 pos = ro + t * rd;
+                float3 n = blobs.ObjectNormal(pos);
+                rgb = Shade(pos, n);
+            }
+        }
+        else
+        {
+            rgb = ShadeSteps(s, StepsMax);
+        }
+        rgb *= smoothstep(1.f, 2.f, std::abs(pixel.x - sep) / (2.f / iResolution.x));
+        rgb *= smoothstep(1.f, 2.f, std::abs(pixel.y - mouse.y) / (2.f / iResolution.y));
+        return float4(rgb, 1.f);
+    }
+}
@@ -0,0 +1,144 @@
+#pragma once
+
+// Host mirror of SegmentTracing.slang (the blob scene of "Segment Tracing using Local Lipschitz Bounds").
+// The shader constants that come from defines (T, radius, kappa) are members here. With a BlobGrid the field is
+// made of the grid's vertices instead of the three hardcoded ones (BLOB_GRID in the shader).
+
+#include "blob_grid.h"
+#include "common.h"
+#include "number_types.h"
+
+#include <type_traits>
+
+namespace bdf
+{
+    // Cubic falloff
+    // x: distance
+    // R: radius
+    template <class F>
+    F Falloff(const F& x, float R)
+    {
+        F xx = clamp(x / R, F(0.f), F(1.f));
+        F y = (1.f - sqr(xx));
+        return y * y * y;
+    }
+
+    // Computes the global lipschitz bound of the falloff function
+    // e: energy
+    // R: radius
+    inline float FalloffK(float e, float R)
+    {
+        return 1.72f * std::abs(e) / R;
+    }
+
+    // Computes the local lipschitz bound of the falloff function
+    // a: value at first bound
+    // b: value at second bound
+    // R: radius
+    // e: energy
+    inline float FalloffK(float a, float b, float R, float e)
+    {
+        if (a > R)
+            return 0.f;
+        if (b < R / 5.f)
+        {
+            float t = (1.f - b / R);
+            return std::abs(e) * 6.f * (std::sqrt(b) / R) * (t * t);
+        }
+        else if (a > (R * R) / 5.f)
+        {
+            float t = (1.f - a / R);
+            return std::abs(e) * 6.f * (std::sqrt(a) / R) * (t * t);
+        }
+        else
+            return FalloffK(e, R);
+    }
+
+    // Point primitive field function
+    // p: world point
+    // c: center
+    // R: radius
+    // e: energy
+    template <class V>
+    scalar_t<V> Vertex(const V& p, float3 c, float R, float e)
+    {
+        return e * Falloff(length(p - c), R);
+    }
+
+    // Gradient and value of Vertex: float4(dVertex/dp, Vertex)
+    inline float4 VertexGradient(float3 p, float3 c, float R, float e)
+    {
+        float3 v = p - c;
+        float xx = clamp(length(v) / R, 0.f, 1.f);
+        float y = (1.f - xx * xx);
+        return float4(v * (-6.f * e * y * y / (R * R)), e * y * y * y);
+    }
+
+    // Evaluates the local lipschitz bound of a point primitive over a segment [a, b]
+    float VertexKSegment(float3 c, float R, float e, float3 a, float3 b);
+
+    struct BlobField
+    {
+        float T = 0.5f;       // Surface threshold (S_THRESHOLD)
+        float radius = 4.f;   // Primitive radius (S_BLOB_RADIUS)
+        float kappa = 2.f;    // Segment tracing factor for next candidate segment (S_KAPPA_FACTOR)
+        const BlobGrid* grid = nullptr;
+
+        // Tree root. In the other number types a grid is not walked: every vertex is summed.
+        template <class V>
+        scalar_t<V> Object(const V& p) const
+        {
+            using F = scalar_t<V>;
+            if constexpr (std::is_same_v<V, float3>)
+            {
+                if (grid) return grid->Field(p) - T;
+            }
+            else if (grid)
+            {
+                F I = 0.f;
+                for (const BlobVertex& v : grid->vertices()) I = I + Vertex(p, v.c, v.R, v.e);
+                return I - T;
+            }
+            F I = Vertex(p, float3(-radius / 2.f, 0, 0), radius, 1.f);
+            I = I + Vertex(p, float3(radius / 2.f, 0, 0), radius, 1.f);
+            I = I + Vertex(p, float3(radius / 3.f, radius, 0), radius, 1.f);
+            return I - T;
+        }
+
+        // Gradient and value of Object: float4(dObject/dp, Object)
+        float4 ObjectGradient(float3 p) const
+        {
+            float4 g = grid ? grid->FieldGradient(p) : VertexGradient(p, float3(-radius / 2.f, 0, 0), radius, 1.f)
+                + VertexGradient(p, float3(radius / 2.f, 0, 0), radius, 1.f)
+                + VertexGradient(p, float3(radius / 3.f, radius, 0), radius, 1.f);
+            g.w -= T;
+            return g;
+        }
+
+        // K root
+        float KSegment(float3 a, float3 b) const
+        {
+            if (grid) return grid->KSegment(a, b);
+            float K = VertexKSegment(float3(-radius / 2.f, 0, 0), radius, 1.f, a, b);
+            K += VertexKSegment(float3(radius / 2.f, 0, 0), radius, 1.f, a, b);
+            K += VertexKSegment(float3(radius / 3.f, radius, 0), radius, 1.f, a, b);
+            return K;
+        }
+
+        float KGlobal() const
+        {
+            if (grid) return grid->KGlobal();
+            return FalloffK(1.f, radius) * 3.f;
+        }
+
+        float3 ObjectNormal(float3 p) const;
+
+        // o : ray origin, u : ray direction, h : hit, s : Number of steps
+        float SphereTracing(float3 o, float3 u, bool& h, int& s, float ra, float rb, float Epsilon, int StepsMax) const;
+        float SegmentTracing(float3 o, float3 u, bool& h, int& s, float ra, float rb, float Epsilon, int StepsMax) const;
+    };
+
+    // Port of the original Shadertoy mainImage (V_COLORING 3): sphere tracing left of the mouse, segment tracing right.
+    float4 segmentTracingImage(const BlobField& blobs, float2 fragCoord, float2 iResolution, float iTime, float4 iMouse,
+        float Epsilon, int StepsMax);
+}
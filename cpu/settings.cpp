@@ -0,0 +1,85 @@
+#include "settings.h"
+
+namespace bdf
+{
+    const char* const kColoringLabels[4] = { "Default", "Stepsize", "Shadow stepsize", "Original Segment Tracing" };
+    const char* const kColorStepFunLabels[5] = { "Old", "HSV", "2", "3", "4" };
+    const char* const kSceneLabels[8] = { "Blobs", "Primitives", "Sphere", "Box", "Cylinder", "Torus", "Test", "CSG" };
+    const char* const kTraceLabels[7] = { "sdf_trace", "bdf_trace", "segment_trace", "their_sphere_trace", "bdf_trace_relaxed",
+        "bdf_trace_refined", "interval_segment_trace" };
+    const char* const kShadowLabels[5] = { "sdf_trace", "bdf_trace", "no_shadow", "bdf_packet", "bdf_soft" };
+    const char* const kNormalLabels[3] = { "normal_central", "normal_tetrahedral", "normal_analytic" };
+
+    void applySceneDefaults(Scenes scene, RenderSettings& settings, CameraDesc& camera)
+    {
+        settings.scene = scene;
+        camera.position = float3(2.f, 1.25f, 1.5f);
+        camera.target = float3(0.f);
+        switch (scene)
+        {
+        case Scenes::BLOBS:
+            settings.primaryMaxIter = 150;
+            settings.primaryMaxDist = 60.f;
+            camera.position = float3(0.f, 3.5f, 7.f);
+            camera.target = float3(0.f, 2.2f, 0.f);
+            break;
+        case Scenes::PRIMITIVES:
+        case Scenes::CSG:
+            camera.position = float3(6.f, 3.f, 4.f);
+            camera.target = float3(0.f, 0.f, 0.5f);
+            break;
+        case Scenes::SPHERE:
+            settings.pPrimitiveData.y = 0.7f;
+            break;
+        case Scenes::BOX:
+        case Scenes::TEST:
+            settings.pPrimitiveData = float3(0.4f, 0.5f, 0.6f);
+            break;
+        case Scenes::CYLINDER:
+            settings.pPrimitiveData.x = 0.6f;
+            settings.pPrimitiveData.y = 0.6f;
+            break;
+        case Scenes::TORUS:
+            settings.pPrimitiveData.x = 0.9f;
+            settings.pPrimitiveData.y = 0.3f;
+            break;
+        }
+        if (!isTracerAvailable(scene, settings.trace))
+            settings.trace = settings.trace == Tracers::THEIR_SPHERE_TRACE ? Tracers::SDF_TRACE : Tracers::BDF_TRACE;
+        if (scene == Scenes::BLOBS || settings.coloring == Coloring::STEPSIZE)
+            settings.shadow = Shadows::NO_SHADOW;
+        else if (settings.shadow != Shadows::NO_SHADOW)
+            settings.shadow = settings.trace == Tracers::SDF_TRACE ? Shadows::SDF_TRACE : Shadows::BDF_TRACE;
+    }
+
+    bool isTracerAvailable(Scenes scene, Tracers trace)
+    {
+        return scene == Scenes::BLOBS || (trace != Tracers::SEGMENT_TRACE && trace != Tracers::THEIR_SPHERE_TRACE);
+    }
+
+    std::string testDataString(const RenderSettings& settings)
+    {
+        bool stepColoring = settings.coloring == Coloring::STEPSIZE || settings.coloring == Coloring::SHADOWSTEP;
+        return std::string("sc") +
+            kColoringLabels[static_cast<uint32_t>(settings.coloring)] + '_' +
+            (stepColoring ? kColorStepFunLabels[settings.coloringStepFunc] : "") + '_' +
+            kSceneLabels[static_cast<uint32_t>(settings.scene)] + "__" +
+            kTraceLabels[static_cast<uint32_t>(settings.trace)] + "__" +
+            "shadow-" +
+            kShadowLabels[static_cast<uint32_t>(settings.shadow)] + "__" +
+            "step-" + std::to_string(settings.primaryMaxIter);
+    }
+
+    bool parseLabel(const char* const* labels, uint32_t count, const std::string& label, uint32_t& index)
+    {
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            if (label == labels[i])
+            {
+                index = i;
+                return true;
+            }
+        }
+        return false;
+    }
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+// Render configuration: the host counterpart of the defines ShaderToy_BDF::onGuiRender passes to BDF.ps.slang.
+// Enum values and labels match the radio button groups of the GUI.
+
+#include "vector_math.h"
+
+#include <memory>
+#include <string>
+
+namespace bdf
+{
+    struct CsgProgram;
+    class CsgBvh;
+    class BlobGrid;
+    class BrickMap;
+
+    enum class Coloring : uint32_t { DEFAULT = 0, STEPSIZE = 1, SHADOWSTEP = 2, SEGMENT_TRACING = 3 };
+    enum class Scenes : uint32_t { BLOBS = 0, PRIMITIVES = 1, SPHERE = 2, BOX = 3, CYLINDER = 4, TORUS = 5, TEST = 6, CSG = 7 };
+    enum class Tracers : uint32_t { SDF_TRACE = 0, BDF_TRACE = 1, SEGMENT_TRACE = 2, THEIR_SPHERE_TRACE = 3, BDF_TRACE_RELAXED = 4, BDF_TRACE_REFINED = 5, INTERVAL_SEGMENT_TRACE = 6 };
+    enum class Shadows : uint32_t { SDF_TRACE = 0, BDF_TRACE = 1, NO_SHADOW = 2, BDF_PACKET = 3, BDF_SOFT = 4 };
+    enum class Normals : uint32_t { CENTRAL = 0, TETRAHEDRAL = 1, ANALYTIC = 2 };
+
+    extern const char* const kColoringLabels[4];
+    extern const char* const kColorStepFunLabels[5];
+    extern const char* const kSceneLabels[8];
+    extern const char* const kTraceLabels[7];
+    extern const char* const kShadowLabels[5];
+    extern const char* const kNormalLabels[3];
+
+    const int kMaxLightCount = 64;
+
+    // New fields also go into visitSettings of distributed.cpp, which sends the settings to worker processes.
+    struct RenderSettings
+    {
+        // view
+        Coloring coloring = Coloring::DEFAULT;          // V_COLORING
+        uint32_t coloringStepFunc = 4;                  // V_COLORING_FUNC
+        float3 colorA = float3(93, 127, 232) / 255.f;   // V_COLOR_A..D
+        float3 colorB = float3(92, 236, 220) / 255.f;
+        float3 colorC = float3(241, 222, 100) / 255.f;
+        float3 colorD = float3(220, 94, 75) / 255.f;
+
+        // scene and trace
+        Scenes scene = Scenes::PRIMITIVES;
+        Tracers trace = Tracers::SDF_TRACE;
+        Shadows shadow = Shadows::SDF_TRACE;
+        Normals normal = Normals::ANALYTIC;             // NORMAL
+
+        int primaryMaxIter = 512;
+        float primaryMaxDist = 500.f;
+        uint32_t coneTile = 0;      // CONE_TILE: tile size of the cone pre-pass that advances the primary Tmin, 0 off
+        bool reprojection = false;  // DEPTH_REPROJECTION: start primary rays before last frame's hit (see reprojection.h)
+        float reprojectionMargin = .05f;
+        float bdfOmega = 1.6f;      // BDF_OMEGA: step factor of bdf_trace_relaxed/refined
+        float bdfHitScale = 4.f;    // BDF_HIT_SCALE: bdf_trace_refined marches to hitScale * epsilon, then refines
+        int secondaryMaxIter = 256;
+        float secondaryMaxDist = 100.f;
+        float secondaryMinDist = 0.01f;
+        float secondaryEpsilon = 0.001f;
+        float secondaryNOffset = 0.01f;
+        int lightCount = 3;             // LIGHT_COUNT: lights on a ring around the up axis, up to kMaxLightCount
+        float shadowSoftness = 8.f;     // SHADOW_SOFTNESS: penumbra factor of bdf_soft, visibility min(softness * d / T)
+
+        // blobs only
+        float sThreshold = .5f;
+        float sBlobRadius = 4.f;
+        float sMarchEpsilon = 0.1f;
+        float sKappaFactor = 2.f;
+        std::shared_ptr<const BlobGrid> blobGrid;   // replaces the three hardcoded blobs (see blob_grid.h)
+
+        // primitive parameters
+        float3 pPrimitiveData = float3(1);
+        float3 pTestPos = float3(0);
+        int3 pRepeatNum = { 1000, 0, 1000 };
+        float3 pRepeatDist = float3(4);
+        bool pShowPlane = true;
+
+        // loaded scene file of Scenes::CSG (see csg_scene.h)
+        std::shared_ptr<const CsgProgram> csg;
+        std::shared_ptr<const CsgBvh> csgBvh;       // optional, same distances as csg in fewer evaluations
+
+        // baked BDF of the scene (see brick_map.h), answers the bdf away from the surface
+        std::shared_ptr<const BrickMap> brickMap;
+
+        // Shadertoy inputs, only read by the original segment tracing image
+        float iTime = 0.f;
+        float4 iMouse = float4(0.f);
+    };
+
+    struct CameraDesc
+    {
+        float3 position = float3(2.f, 1.25f, 1.5f);
+        float3 target = float3(0.f);
+        float3 up = float3(0.f, 1.f, 0.f);
+        float fovY = 1.0383f;   // Falcor's default 21mm focal length on a 24mm frame
+        float nearZ = 0.1f;
+        float farZ = 1000.f;
+    };
+
+    // Applies what the GUI does when a scene is selected: camera pose, iteration limits and shadow/trace fixups.
+    void applySceneDefaults(Scenes scene, RenderSettings& settings, CameraDesc& camera);
+
+    // True if the tracer can render the scene: segment and their sphere tracing are blob only, as in the GUI;
+    // interval_segment_trace takes any scene but is not offered by the GUI.
+    bool isTracerAvailable(Scenes scene, Tracers trace);
+
+    // Configuration name, same scheme as ShaderToy_BDF::mTestDataString.
+    std::string testDataString(const RenderSettings& settings);
+
+    // Parses a GUI label (e.g. "Primitives", "bdf_trace") into the enum index; returns false if not found.
+    bool parseLabel(const char* const* labels, uint32_t count, const std::string& label, uint32_t& index);
+}
@@ -0,0 +1,198 @@
+#pragma once
+
+// SIMD lane types for ray packets: f32x8 (AVX2) and f32x16 (AVX-512), each with a matching mask type.
+// When the target ISA is not enabled at compile time, the same interface is provided by plain arrays,
+// so packet code compiles everywhere and the compiler vectorizes what it can.
+
+#include "vector_math.h"
+
+#include <cmath>
+#include <cstdint>
+
+#if defined(__AVX2__) || defined(__AVX512F__)
+#if defined(__GNUC__) && !defined(__clang__)
+// GCC 12 reports the _mm512_undefined_ps() inside its own intrinsics as uninitialized
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#include <immintrin.h>
+#pragma GCC diagnostic pop
+#else
+#include <immintrin.h>
+#endif
+#endif
+
+namespace bdf
+{
+    // Portable fallback
+
+    template <int W>
+    struct maskN
+    {
+        bool v[W];
+    };
+
+    template <int W>
+    struct floatN
+    {
+        static constexpr int width = W;
+        using mask = maskN<W>;
+        float v[W];
+
+        floatN() = default;
+        floatN(float s) { for (int i = 0; i < W; ++i) v[i] = s; }
+        static floatN load(const float* p) { floatN r; for (int i = 0; i < W; ++i) r.v[i] = p[i]; return r; }
+        void store(float* p) const { for (int i = 0; i < W; ++i) p[i] = v[i]; }
+        float operator[](int i) const { return v[i]; }
+    };
+
+#define BDF_FLOATN_BINOP(op)                                                                \
+    template <int W> inline floatN<W> operator op(const floatN<W>& a, const floatN<W>& b)  \
+    { floatN<W> r; for (int i = 0; i < W; ++i) r.v[i] = a.v[i] op b.v[i]; return r; }      \
+    template <int W> inline floatN<W> operator op(const floatN<W>& a, float b) { return a op floatN<W>(b); } \
+    template <int W> inline floatN<W> operator op(float a, const floatN<W>& b) { return floatN<W>(a) op b; }
+    BDF_FLOATN_BINOP(+) BDF_FLOATN_BINOP(-) BDF_FLOATN_BINOP(*) BDF_FLOATN_BINOP(/)
+#undef BDF_FLOATN_BINOP
+#define BDF_FLOATN_CMP(op)                                                                  \
+    template <int W> inline maskN<W> operator op(const floatN<W>& a, const floatN<W>& b)   \
+    { maskN<W> r; for (int i = 0; i < W; ++i) r.v[i] = a.v[i] op b.v[i]; return r; }       \
+    template <int W> inline maskN<W> operator op(const floatN<W>& a, float b) { return a op floatN<W>(b); }
+    BDF_FLOATN_CMP(<) BDF_FLOATN_CMP(<=) BDF_FLOATN_CMP(>) BDF_FLOATN_CMP(>=)
+#undef BDF_FLOATN_CMP
+
+    template <int W> inline floatN<W> operator-(const floatN<W>& a) { floatN<W> r; for (int i = 0; i < W; ++i) r.v[i] = -a.v[i]; return r; }
+    template <int W> inline floatN<W> min(const floatN<W>& a, const floatN<W>& b) { floatN<W> r; for (int i = 0; i < W; ++i) r.v[i] = a.v[i] < b.v[i] ? a.v[i] : b.v[i]; return r; }
+    template <int W> inline floatN<W> max(const floatN<W>& a, const floatN<W>& b) { floatN<W> r; for (int i = 0; i < W; ++i) r.v[i] = a.v[i] > b.v[i] ? a.v[i] : b.v[i]; return r; }
+    template <int W> inline floatN<W> abs(const floatN<W>& a) { floatN<W> r; for (int i = 0; i < W; ++i) r.v[i] = std::abs(a.v[i]); return r; }
+    template <int W> inline floatN<W> sqrt(const floatN<W>& a) { floatN<W> r; for (int i = 0; i < W; ++i) r.v[i] = std::sqrt(a.v[i]); return r; }
+    template <int W> inline floatN<W> round(const floatN<W>& a) { floatN<W> r; for (int i = 0; i < W; ++i) r.v[i] = std::nearbyint(a.v[i]); return r; }
+    template <int W> inline floatN<W> select(const maskN<W>& m, const floatN<W>& a, const floatN<W>& b) { floatN<W> r; for (int i = 0; i < W; ++i) r.v[i] = m.v[i] ? a.v[i] : b.v[i]; return r; }
+
+    template <int W> inline maskN<W> operator&(const maskN<W>& a, const maskN<W>& b) { maskN<W> r; for (int i = 0; i < W; ++i) r.v[i] = a.v[i] && b.v[i]; return r; }
+    template <int W> inline maskN<W> operator|(const maskN<W>& a, const maskN<W>& b) { maskN<W> r; for (int i = 0; i < W; ++i) r.v[i] = a.v[i] || b.v[i]; return r; }
+    template <int W> inline maskN<W> operator!(const maskN<W>& a) { maskN<W> r; for (int i = 0; i < W; ++i) r.v[i] = !a.v[i]; return r; }
+    template <int W> inline bool any(const maskN<W>& m) { for (int i = 0; i < W; ++i) if (m.v[i]) return true; return false; }
+    template <int W> inline uint32_t bits(const maskN<W>& m) { uint32_t r = 0; for (int i = 0; i < W; ++i) r |= uint32_t(m.v[i]) << i; return r; }
+
+#if defined(__AVX2__)
+    // AVX2: 8 lanes
+
+    struct m32x8
+    {
+        __m256 v;
+    };
+
+    struct f32x8
+    {
+        static constexpr int width = 8;
+        using mask = m32x8;
+        __m256 v;
+
+        f32x8() = default;
+        f32x8(__m256 x) : v(x) {}
+        f32x8(float s) : v(_mm256_set1_ps(s)) {}
+        static f32x8 load(const float* p) { return _mm256_loadu_ps(p); }
+        void store(float* p) const { _mm256_storeu_ps(p, v); }
+        float operator[](int i) const { alignas(32) float t[8]; _mm256_store_ps(t, v); return t[i]; }
+    };
+
+    inline f32x8 operator+(f32x8 a, f32x8 b) { return _mm256_add_ps(a.v, b.v); }
+    inline f32x8 operator-(f32x8 a, f32x8 b) { return _mm256_sub_ps(a.v, b.v); }
+    inline f32x8 operator*(f32x8 a, f32x8 b) { return _mm256_mul_ps(a.v, b.v); }
+    inline f32x8 operator/(f32x8 a, f32x8 b) { return _mm256_div_ps(a.v, b.v); }
+    inline f32x8 operator-(f32x8 a) { return _mm256_xor_ps(a.v, _mm256_set1_ps(-0.f)); }
+    inline m32x8 operator<(f32x8 a, f32x8 b) { return { _mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ) }; }
+    inline m32x8 operator<=(f32x8 a, f32x8 b) { return { _mm256_cmp_ps(a.v, b.v, _CMP_LE_OQ) }; }
+    inline m32x8 operator>(f32x8 a, f32x8 b) { return { _mm256_cmp_ps(a.v, b.v, _CMP_GT_OQ) }; }
+    inline m32x8 operator>=(f32x8 a, f32x8 b) { return { _mm256_cmp_ps(a.v, b.v, _CMP_GE_OQ) }; }
+    inline f32x8 min(f32x8 a, f32x8 b) { return _mm256_min_ps(a.v, b.v); }
+    inline f32x8 max(f32x8 a, f32x8 b) { return _mm256_max_ps(a.v, b.v); }
+    inline f32x8 abs(f32x8 a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.f), a.v); }
+    inline f32x8 sqrt(f32x8 a) { return _mm256_sqrt_ps(a.v); }
+    inline f32x8 round(f32x8 a) { return _mm256_round_ps(a.v, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC); }
+    inline f32x8 select(m32x8 m, f32x8 a, f32x8 b) { return _mm256_blendv_ps(b.v, a.v, m.v); }
+
+    inline m32x8 operator&(m32x8 a, m32x8 b) { return { _mm256_and_ps(a.v, b.v) }; }
+    inline m32x8 operator|(m32x8 a, m32x8 b) { return { _mm256_or_ps(a.v, b.v) }; }
+    inline m32x8 operator!(m32x8 a) { return { _mm256_xor_ps(a.v, _mm256_castsi256_ps(_mm256_set1_epi32(-1))) }; }
+    inline bool any(m32x8 m) { return _mm256_movemask_ps(m.v) != 0; }
+    inline uint32_t bits(m32x8 m) { return uint32_t(_mm256_movemask_ps(m.v)); }
+#else
+    using f32x8 = floatN<8>;
+    using m32x8 = maskN<8>;
+#endif
+
+#if defined(__AVX512F__)
+    // AVX-512: 16 lanes, native mask registers
+
+    struct m32x16
+    {
+        __mmask16 v;
+    };
+
+    struct f32x16
+    {
+        static constexpr int width = 16;
+        using mask = m32x16;
+        __m512 v;
+
+        f32x16() = default;
+        f32x16(__m512 x) : v(x) {}
+        f32x16(float s) : v(_mm512_set1_ps(s)) {}
+        static f32x16 load(const float* p) { return _mm512_loadu_ps(p); }
+        void store(float* p) const { _mm512_storeu_ps(p, v); }
+        float operator[](int i) const { alignas(64) float t[16]; _mm512_store_ps(t, v); return t[i]; }
+    };
+
+    inline f32x16 operator+(f32x16 a, f32x16 b) { return _mm512_add_ps(a.v, b.v); }
+    inline f32x16 operator-(f32x16 a, f32x16 b) { return _mm512_sub_ps(a.v, b.v); }
+    inline f32x16 operator*(f32x16 a, f32x16 b) { return _mm512_mul_ps(a.v, b.v); }
+    inline f32x16 operator/(f32x16 a, f32x16 b) { return _mm512_div_ps(a.v, b.v); }
+    inline f32x16 operator-(f32x16 a) { return _mm512_sub_ps(_mm512_setzero_ps(), a.v); }
+    inline m32x16 operator<(f32x16 a, f32x16 b) { return { _mm512_cmp_ps_mask(a.v, b.v, _CMP_LT_OQ) }; }
+    inline m32x16 operator<=(f32x16 a, f32x16 b) { return { _mm512_cmp_ps_mask(a.v, b.v, _CMP_LE_OQ) }; }
+    inline m32x16 operator>(f32x16 a, f32x16 b) { return { _mm512_cmp_ps_mask(a.v, b.v, _CMP_GT_OQ) }; }
+    inline m32x16 operator>=(f32x16 a, f32x16 b) { return { _mm512_cmp_ps_mask(a.v, b.v, _CMP_GE_OQ) }; }
+    inline f32x16 min(f32x16 a, f32x16 b) { return _mm512_min_ps(a.v, b.v); }
+    inline f32x16 max(f32x16 a, f32x16 b) { return _mm512_max_ps(a.v, b.v); }
+    inline f32x16 abs(f32x16 a) { return _mm512_abs_ps(a.v); }
+    inline f32x16 sqrt(f32x16 a) { return _mm512_sqrt_ps(a.v); }
+    inline f32x16 round(f32x16 a) { return _mm512_roundscale_ps(a.v, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC); }
+    inline f32x16 select(m32x16 m, f32x16 a, f32x16 b) { return _mm512_mask_blend_ps(m.v, b.v, a.v); }
+
+    inline m32x16 operator&(m32x16 a, m32x16 b) { return { __mmask16(a.v & b.v) }; }
+    inline m32x16 operator|(m32x16 a, m32x16 b) { return { __mmask16(a.v | b.v) }; }
+    inline m32x16 operator!(m32x16 a) { return { __mmask16(~a.v) }; }
+    inline bool any(m32x16 m) { return m.v != 0; }
+    inline uint32_t bits(m32x16 m) { return m.v; }
+#else
+    using f32x16 = floatN<16>;
+    using m32x16 = maskN<16>;
+#endif
+
+    // Lane-type generic helpers
+
+    // true for the lane types above, which have a width (number_types.h adds scalar number types)
+    template <class F, class = void> constexpr bool isLaneType = false;
+    template <class F> constexpr bool isLaneType<F, decltype(void(F::width))> = true;
+
+    template <class F> inline F clamp(const F& x, const F& lo, const F& hi) { return min(max(x, lo), hi); }
+    template <class F> inline F sqr(const F& x) { return x * x; }
+
+    // 3 component vector of lanes (SoA)
+    template <class F>
+    struct tvec3
+    {
+        F x, y, z;
+    };
+
+    template <class F> inline tvec3<F> operator+(const tvec3<F>& a, const tvec3<F>& b) { return { a.x + b.x, a.y + b.y, a.z + b.z }; }
+    template <class F> inline tvec3<F> operator-(const tvec3<F>& a, const tvec3<F>& b) { return { a.x - b.x, a.y - b.y, a.z - b.z }; }
+    template <class F> inline tvec3<F> operator+(const tvec3<F>& a, const float3& b) { return { a.x + F(b.x), a.y + F(b.y), a.z + F(b.z) }; }
+    template <class F> inline tvec3<F> operator-(const tvec3<F>& a, const float3& b) { return { a.x - F(b.x), a.y - F(b.y), a.z - F(b.z) }; }
+    template <class F> inline tvec3<F> operator*(const F& s, const tvec3<F>& a) { return { s * a.x, s * a.y, s * a.z }; }
+    template <class F> inline tvec3<F> abs(const tvec3<F>& a) { return { abs(a.x), abs(a.y), abs(a.z) }; }
+    template <class F> inline F dot(const tvec3<F>& a, const tvec3<F>& b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+    template <class F> inline F dot2(const tvec3<F>& a) { return sqr(a.x) + sqr(a.y) + sqr(a.z); }
+    template <class F> inline F length(const tvec3<F>& a) { return sqrt(dot2(a)); }
+}
@@ -0,0 +1,114 @@
+#include "stream_render.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace bdf
+{
+    namespace
+    {
+        using Clock = std::chrono::steady_clock;
+
+        double elapsedMs(Clock::time_point start)
+        {
+            return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+        }
+
+        struct Band
+        {
+            Image image;
+            std::vector<float2> depthSteps;
+        };
+    }
+
+    bool renderStreamed(const Renderer& renderer, const RenderSettings& settings, const CameraDesc& camera, uint32_t width,
+        uint32_t height, const std::string& path, const StreamRenderDesc& desc, StreamRenderStats& stats, std::string& error)
+    {
+        stats = StreamRenderStats();
+        const auto start = Clock::now();
+        ImageStreamWriter writer;
+        if (!writer.open(path, width, height, desc.depthSteps, error)) return false;
+
+        // whole tiles, so that the bands are split into the tiles of a full frame
+        const uint32_t tileSize = std::max(renderer.getOptions().tileSize, 1u);
+        const uint32_t rows = (std::max(desc.bandRows, 1u) + tileSize - 1) / tileSize * tileSize;
+        const uint32_t bandCount = (height + rows - 1) / rows;
+
+        // a band is traced into a free slot, queued, encoded and freed again; slots are allocated by the first bands
+        std::vector<Band> slots(std::max(desc.bandsInFlight, 1u) + 1);
+        std::deque<uint32_t> freeSlots, traced;
+        for (uint32_t i = 0; i < uint32_t(slots.size()); ++i) freeSlots.push_back(i);
+        std::mutex mutex;
+        std::condition_variable cv;
+        bool failed = false;
+        std::string writeError;
+
+        std::thread encoder([&]
+        {
+            for (uint32_t b = 0; b < bandCount; ++b)
+            {
+                uint32_t slot;
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    cv.wait(lock, [&] { return !traced.empty(); });
+                    slot = traced.front();
+                    traced.pop_front();
+                }
+                const auto encodeStart = Clock::now();
+                const Band& band = slots[slot];
+                const bool ok = writer.writeRows(band.image, desc.depthSteps ? band.depthSteps.data() : nullptr, writeError);
+                stats.encodeMs += elapsedMs(encodeStart);
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    freeSlots.push_back(slot);
+                    failed = !ok;
+                }
+                cv.notify_all();
+                if (!ok) return;
+            }
+        });
+
+        for (uint32_t b = 0; b < bandCount; ++b)
+        {
+            uint32_t slot;
+            {
+                const auto waitStart = Clock::now();
+                std::unique_lock<std::mutex> lock(mutex);
+                cv.wait(lock, [&] { return !freeSlots.empty() || failed; });
+                stats.stallMs += elapsedMs(waitStart);
+                if (failed) break;  // the encoder stopped
+                slot = freeSlots.front();
+                freeSlots.pop_front();
+            }
+            Band& band = slots[slot];
+            Renderer::FrameStats bandStats;
+            renderer.renderRows(settings, camera, width, height, b * rows, rows, band.image,
+                desc.depthSteps ? &band.depthSteps : nullptr, &bandStats);
+            stats.frame.trace += bandStats.trace;
+            stats.frame.prepassTiles += bandStats.prepassTiles;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                traced.push_back(slot);
+            }
+            cv.notify_all();
+        }
+        encoder.join();
+        if (failed)
+        {
+            error = writeError;
+            return false;
+        }
+        if (!writer.close(error)) return false;
+
+        stats.bands = bandCount;
+        for (const Band& band : slots)
+            stats.bandBytes += band.image.pixels.capacity() * sizeof(float4) + band.depthSteps.capacity() * sizeof(float2);
+        stats.ms = elapsedMs(start);
+        return true;
+    }
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+// Renders a frame of any size into a file a band of rows at a time, for print and dataset captures of 16k-32k
+// pixels that would not fit in memory as one Image. The renderer traces a band on its threads while an encoder
+// thread converts and writes the bands before it (ImageStreamWriter), so memory is bounded by the bands in flight,
+// a few rows each, and encoding overlaps tracing. The pixels are those of Renderer::render.
+
+#include "renderer.h"
+
+#include <string>
+
+namespace bdf
+{
+    struct StreamRenderDesc
+    {
+        uint32_t bandRows = 64;         // rows traced at a time, rounded up to the renderer's tiles
+        uint32_t bandsInFlight = 2;     // traced bands waiting for the encoder before tracing waits
+        bool depthSteps = false;        // also write the depth and step channels (.exr only)
+    };
+
+    struct StreamRenderStats
+    {
+        Renderer::FrameStats frame;     // of all the bands; trace.ms is the time spent tracing
+        double ms = 0.;                 // until the file was closed
+        double encodeMs = 0.;           // spent by the encoder thread
+        double stallMs = 0.;            // tracing waited for the encoder
+        uint32_t bands = 0;
+        size_t bandBytes = 0;           // memory of the bands, allocated once
+    };
+
+    // Renders a width x height frame into path (ImageStreamWriter); on failure returns false with a message in error.
+    bool renderStreamed(const Renderer& renderer, const RenderSettings& settings, const CameraDesc& camera, uint32_t width,
+        uint32_t height, const std::string& path, const StreamRenderDesc& desc, StreamRenderStats& stats, std::string& error);
+}
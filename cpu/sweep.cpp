@@ -0,0 +1,131 @@
+#include "sweep.h"
+
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+
+namespace bdf
+{
+    std::vector<SweepPoint> SweepSpec::expand(Scenes scene, Tracers trace, uint32_t width, uint32_t height) const
+    {
+        const std::vector<Scenes> sc = scenes.empty() ? std::vector<Scenes>{ scene } : scenes;
+        const std::vector<Tracers> tr = tracers.empty() ? std::vector<Tracers>{ trace } : tracers;
+        const std::vector<int> sh = shadows.empty() ? std::vector<int>{ -1 } : shadows;
+        const std::vector<int> it = maxIters.empty() ? std::vector<int>{ 0 } : maxIters;
+        const std::vector<std::pair<uint32_t, uint32_t>> sz = sizes.empty() ? std::vector<std::pair<uint32_t, uint32_t>>{ { width, height } } : sizes;
+        const uint32_t cameraCount = cameras.empty() ? 1u : uint32_t(cameras.size());
+
+        std::vector<SweepPoint> points;
+        for (Scenes s : sc)
+            for (Tracers t : tr)
+            {
+                if (!isTracerAvailable(s, t)) continue;
+                for (size_t k = 0; k < (s == Scenes::BLOBS ? 1 : sh.size()); ++k)
+                    for (int maxIter : it)
+                        for (const auto& size : sz)
+                            for (uint32_t c = 0; c < cameraCount; ++c)
+                                points.push_back({ s, t, s == Scenes::BLOBS ? -1 : sh[k], maxIter, size.first, size.second, c });
+            }
+        return points;
+    }
+
+    bool parseSweepSpec(const std::string& text, SweepSpec& spec, std::string& error)
+    {
+        SweepSpec parsed;
+        std::istringstream lines(text);
+        uint32_t lineNumber = 0;
+        for (std::string line; std::getline(lines, line);)
+        {
+            ++lineNumber;
+            line = line.substr(0, line.find('#'));
+            std::istringstream tokens(line);
+            std::string key, value;
+            if (!(tokens >> key)) continue;
+            auto fail = [&](const std::string& message)
+            {
+                error = "line " + std::to_string(lineNumber) + ": " + message;
+                return false;
+            };
+
+            std::vector<std::string> values;
+            while (tokens >> value) values.push_back(value);
+            if (values.empty()) return fail("'" + key + "' without values");
+
+            if (key == "camera")
+            {
+                SweepCamera camera;
+                if (values.size() == 1 && values[0] == "default")
+                    camera.sceneDefault = true;
+                else if (values.size() == 2 &&
+                         sscanf(values[0].c_str(), "%f,%f,%f", &camera.eye.x, &camera.eye.y, &camera.eye.z) == 3 &&
+                         sscanf(values[1].c_str(), "%f,%f,%f", &camera.target.x, &camera.target.y, &camera.target.z) == 3)
+                    camera.sceneDefault = false;
+                else
+                    return fail("expected 'camera default' or 'camera <x,y,z> <x,y,z>'");
+                parsed.cameras.push_back(camera);
+                continue;
+            }
+            for (const std::string& v : values)
+            {
+                uint32_t index;
+                int n;
+                uint32_t w, h;
+                if (key == "scene")
+                {
+                    if (!parseLabel(kSceneLabels, uint32_t(std::size(kSceneLabels)), v, index)) return fail("unknown scene '" + v + "'");
+                    parsed.scenes.push_back(static_cast<Scenes>(index));
+                }
+                else if (key == "trace")
+                {
+                    if (!parseLabel(kTraceLabels, uint32_t(std::size(kTraceLabels)), v, index)) return fail("unknown tracer '" + v + "'");
+                    parsed.tracers.push_back(static_cast<Tracers>(index));
+                }
+                else if (key == "shadow")
+                {
+                    if (v == "match") parsed.shadows.push_back(-1);
+                    else if (parseLabel(kShadowLabels, uint32_t(std::size(kShadowLabels)), v, index)) parsed.shadows.push_back(int(index));
+                    else return fail("unknown shadow '" + v + "'");
+                }
+                else if (key == "maxiter")
+                {
+                    if (sscanf(v.c_str(), "%d", &n) != 1 || n < 0) return fail("invalid maxiter '" + v + "'");
+                    parsed.maxIters.push_back(n);
+                }
+                else if (key == "size")
+                {
+                    if (sscanf(v.c_str(), "%ux%u", &w, &h) != 2 || w == 0 || h == 0) return fail("invalid size '" + v + "'");
+                    parsed.sizes.push_back({ w, h });
+                }
+                else
+                    return fail("unknown key '" + key + "'");
+            }
+        }
+        spec = std::move(parsed);
+        return true;
+    }
+
+    bool loadSweepSpec(const std::string& path, SweepSpec& spec, std::string& error)
+    {
+        std::ifstream file(path, std::ios::binary);
+        if (!file)
+        {
+            error = "cannot open '" + path + "'";
+            return false;
+        }
+        std::ostringstream text;
+        text << file.rdbuf();
+        if (!parseSweepSpec(text.str(), spec, error))
+        {
+            error = path + ": " + error;
+            return false;
+        }
+        return true;
+    }
+
+    std::string sweepJobName(const RenderSettings& settings, const SweepPoint& point)
+    {
+        return testDataString(settings) + "__" + std::to_string(point.width) + "x" + std::to_string(point.height) +
+            "__cam" + std::to_string(point.camera);
+    }
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+// Parameter sweeps for bdf_render --sweep: every combination of the listed scenes, tracers, shadows, iteration
+// limits, image sizes and camera poses, rendered as independent jobs.
+//
+// Format: one list per line, the key followed by its values; '#' starts a comment. Keys left out keep the value
+// of the command line (scene, tracer, size) or of the scene defaults (shadow, maxiter, camera).
+//   scene <label> ...          Blobs, Primitives, Sphere, Box, Cylinder, Torus, Test, CSG
+//   trace <label> ...          tracers of the GUI; combinations the GUI does not offer are skipped
+//   shadow <label> ...         shadow modes, or match: the mode the GUI picks for the tracer
+//   maxiter <n> ...            PRIMARY_MAXITER, 0: the scene default
+//   size <w>x<h> ...
+//   camera default | camera <x,y,z> <x,y,z>    one pose per line: the scene's pose, or eye and target
+
+#include "settings.h"
+
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace bdf
+{
+    struct SweepCamera
+    {
+        bool sceneDefault = true;
+        float3 eye = float3(0.f), target = float3(0.f);
+    };
+
+    // One combination; shadow -1 and maxIter 0 keep the scene defaults
+    struct SweepPoint
+    {
+        Scenes scene;
+        Tracers trace;
+        int shadow;
+        int maxIter;
+        uint32_t width, height;
+        uint32_t camera;    // index into SweepSpec::cameras
+    };
+
+    struct SweepSpec
+    {
+        std::vector<Scenes> scenes;
+        std::vector<Tracers> tracers;
+        std::vector<int> shadows;
+        std::vector<int> maxIters;
+        std::vector<std::pair<uint32_t, uint32_t>> sizes;     // width, height
+        std::vector<SweepCamera> cameras;
+
+        // All the combinations, lists left empty replaced by the given values. The Blobs scene has no shadows,
+        // so its shadow list collapses to one entry.
+        std::vector<SweepPoint> expand(Scenes scene, Tracers trace, uint32_t width, uint32_t height) const;
+    };
+
+    // Parses sweep text; on failure returns false with a "line N: ..." message in error.
+    bool parseSweepSpec(const std::string& text, SweepSpec& spec, std::string& error);
+    bool loadSweepSpec(const std::string& path, SweepSpec& spec, std::string& error);
+
+    // File name of a job: testDataString of its settings, the image size and the camera index. Points that resolve to
+    // the same settings (a match shadow and the tracer's own shadow listed explicitly) get the same name and are
+    // rendered once.
+    std::string sweepJobName(const RenderSettings& settings, const SweepPoint& point);
+}
@@ -0,0 +1,134 @@
+#include "trace_stats.h"
+
+namespace bdf
+{
+    RayStats& RayStats::operator+=(const RayStats& o)
+    {
+        rays += o.rays;
+        steps += o.steps;
+        evals += o.evals;
+        escaped += o.escaped;
+        hit += o.hit;
+        exhausted += o.exhausted;
+        for (uint32_t b = 0; b < kStepBins; ++b) histogram[b] += o.histogram[b];
+        return *this;
+    }
+
+    double RayStats::stepQuantile(double q, int maxIter) const
+    {
+        if (rays == 0) return 0.;
+        uint64_t count = 0;
+        for (uint32_t b = 0; b < kStepBins; ++b)
+        {
+            count += histogram[b];
+            if (double(count) >= q * double(rays)) return double(b + 1) * double(maxIter) / double(kStepBins);
+        }
+        return double(maxIter);
+    }
+
+    TraceStats& TraceStats::operator+=(const TraceStats& o)
+    {
+        primary += o.primary;
+        shadow += o.shadow;
+        normalEvals += o.normalEvals;
+        prepassEvals += o.prepassEvals;
+        ms += o.ms;
+        return *this;
+    }
+
+    TraceStats TraceStats::fromCounters(const uint32_t* words, double ms)
+    {
+        auto counter = [words](uint32_t i) { return uint64_t(words[2 * i]) | uint64_t(words[2 * i + 1]) << 32; };
+        auto decode = [&](uint32_t base)
+        {
+            RayStats r;
+            r.rays = counter(base + 0);
+            r.steps = counter(base + 1);
+            r.evals = counter(base + 2);
+            r.escaped = counter(base + 3);
+            r.hit = counter(base + 4);
+            r.exhausted = counter(base + 5);
+            for (uint32_t b = 0; b < kStepBins; ++b) r.histogram[b] = counter(base + 6 + b);
+            return r;
+        };
+        TraceStats stats;
+        stats.primary = decode(0);
+        stats.shadow = decode(kRayCounters);
+        stats.normalEvals = counter(2 * kRayCounters);
+        stats.prepassEvals = counter(2 * kRayCounters + 1);
+        stats.ms = ms;
+        return stats;
+    }
+
+    int evalsPerStep(Tracers trace)
+    {
+        return trace == Tracers::SEGMENT_TRACE ? 2 : 1;
+    }
+
+    int normalEvals(Normals normal)
+    {
+        switch (normal)
+        {
+        case Normals::CENTRAL: return 6;
+        case Normals::TETRAHEDRAL: return 4;
+        case Normals::ANALYTIC: default: return 1;
+        }
+    }
+
+    namespace
+    {
+        void writeRayHeader(FILE* file, const char* kind)
+        {
+            fprintf(file, ",%s_rays,%s_steps,%s_evals,%s_escaped,%s_hit,%s_exhausted,%s_p50,%s_p90,%s_p99", kind, kind, kind, kind,
+                kind, kind, kind, kind, kind);
+            for (uint32_t b = 0; b < kStepBins; ++b) fprintf(file, ",%s_bin%u", kind, b);
+        }
+
+        void writeRay(FILE* file, const RayStats& r, int maxIter)
+        {
+            fprintf(file, ",%llu,%llu,%llu,%llu,%llu,%llu,%.1f,%.1f,%.1f", (unsigned long long)r.rays, (unsigned long long)r.steps,
+                (unsigned long long)r.evals, (unsigned long long)r.escaped, (unsigned long long)r.hit, (unsigned long long)r.exhausted,
+                r.stepQuantile(.5, maxIter), r.stepQuantile(.9, maxIter), r.stepQuantile(.99, maxIter));
+            for (uint32_t b = 0; b < kStepBins; ++b) fprintf(file, ",%llu", (unsigned long long)r.histogram[b]);
+        }
+
+        std::string formatRay(const char* kind, const RayStats& r, int maxIter)
+        {
+            char line[256];
+            const double n = double(std::max<uint64_t>(r.rays, 1));
+            snprintf(line, sizeof(line), "  %-7s %10llu rays %7.2f steps/ray (p50 %.0f, p90 %.0f, p99 %.0f of %d), "
+                "escaped %5.1f%% hit %5.1f%% exhausted %5.2f%%\n", kind, (unsigned long long)r.rays, double(r.steps) / n,
+                r.stepQuantile(.5, maxIter), r.stepQuantile(.9, maxIter), r.stepQuantile(.99, maxIter), maxIter,
+                100. * double(r.escaped) / n, 100. * double(r.hit) / n, 100. * double(r.exhausted) / n);
+            return line;
+        }
+    }
+
+    void writeStatsCsvHeader(FILE* file)
+    {
+        fprintf(file, "config,frame,ms,rays_per_s,evals,normal_evals,prepass_evals");
+        writeRayHeader(file, "primary");
+        writeRayHeader(file, "shadow");
+        fprintf(file, "\n");
+    }
+
+    void writeStatsCsvRow(FILE* file, const std::string& config, uint64_t frame, int primaryMaxIter, int secondaryMaxIter,
+        const TraceStats& stats)
+    {
+        fprintf(file, "%s,%llu,%.3f,%.0f,%llu,%llu,%llu", config.c_str(), (unsigned long long)frame, stats.ms, stats.raysPerSecond(),
+            (unsigned long long)stats.evals(), (unsigned long long)stats.normalEvals, (unsigned long long)stats.prepassEvals);
+        writeRay(file, stats.primary, primaryMaxIter);
+        writeRay(file, stats.shadow, secondaryMaxIter);
+        fprintf(file, "\n");
+    }
+
+    std::string formatStats(const TraceStats& stats, int primaryMaxIter, int secondaryMaxIter)
+    {
+        std::string text = formatRay("primary", stats.primary, primaryMaxIter);
+        if (stats.shadow.rays > 0) text += formatRay("shadow", stats.shadow, secondaryMaxIter);
+        char line[256];
+        snprintf(line, sizeof(line), "  %.2f M field evaluations (%.2f M normal, %.2f M pre-pass)\n", double(stats.evals()) * 1e-6,
+            double(stats.normalEvals) * 1e-6, double(stats.prepassEvals) * 1e-6);
+        return text + line;
+    }
+}
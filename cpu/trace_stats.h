@@ -0,0 +1,90 @@
+#pragma once
+
+// Per-frame tracing statistics: the numbers behind the step count colorings (V_COLORING 1 and 2). The CPU renderer
+// collects them in per-thread counters, the GUI in the counter buffer of BDF.ps.slang (TRACE_STATS, see
+// TraceStats.slang), whose layout fromCounters decodes. Both write the same CSV.
+
+#include "common.h"
+#include "settings.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+namespace bdf
+{
+    // Step count histogram bins: bin b holds the rays with b * maxIter / kStepBins <= steps < (b + 1) * maxIter / kStepBins,
+    // the last one also the rays that hit the iteration cap
+    const uint32_t kStepBins = 32;
+
+    inline uint32_t stepBin(int steps, int maxIter)
+    {
+        uint32_t bin = uint32_t(std::max(steps, 0)) * kStepBins / uint32_t(std::max(maxIter, 1));
+        return bin < kStepBins ? bin : kStepBins - 1;
+    }
+
+    // Rays of one kind, primary or shadow
+    struct RayStats
+    {
+        uint64_t rays = 0;
+        uint64_t steps = 0;
+        uint64_t evals = 0;         // field evaluations: steps times the evaluations per step of the tracer
+        uint64_t escaped = 0;       // rays ending with flags bit 0 (T > Tmax)
+        uint64_t hit = 0;           // bit 1 (close to a surface)
+        uint64_t exhausted = 0;     // bit 2 (iteration cap)
+        uint64_t histogram[kStepBins] = {};
+
+        void add(const TraceResult& ret, int maxIter, int evalsPerStep)
+        {
+            ++rays;
+            steps += uint64_t(ret.steps);
+            evals += uint64_t(ret.steps) * uint64_t(evalsPerStep);
+            escaped += uint64_t(ret.flags & 1);
+            hit += uint64_t((ret.flags >> 1) & 1);
+            exhausted += uint64_t((ret.flags >> 2) & 1);
+            ++histogram[stepBin(ret.steps, maxIter)];
+        }
+
+        RayStats& operator+=(const RayStats& o);
+
+        // Smallest step count below which at least fraction q of the rays end, at the resolution of the bins; 0 without rays
+        double stepQuantile(double q, int maxIter) const;
+    };
+
+    struct TraceStats
+    {
+        RayStats primary;
+        RayStats shadow;
+        uint64_t normalEvals = 0;   // of the normals of the primary hits
+        uint64_t prepassEvals = 0;  // cone pre-pass (CONE_TILE)
+        double ms = 0.;             // frame time
+
+        uint64_t evals() const { return primary.evals + shadow.evals + normalEvals + prepassEvals; }
+        double raysPerSecond() const { return ms > 0. ? double(primary.rays + shadow.rays) * 1e3 / ms : 0.; }
+
+        TraceStats& operator+=(const TraceStats& o);
+
+        // Counter buffer of TraceStats.slang: for the primary, then the shadow rays kRayCounters counters (rays,
+        // steps, evals, escaped, hit, exhausted, histogram), then the normal and pre-pass evaluations. Each counter is
+        // two 32 bit words, low then high.
+        static const uint32_t kRayCounters = 6 + kStepBins;
+        static const uint32_t kCounters = 2 * kRayCounters + 2;
+        static const uint32_t kCounterWords = 2 * kCounters;
+        static TraceStats fromCounters(const uint32_t* words, double ms);
+    };
+
+    // Evaluations of the field per step of a tracer: segment tracing evaluates the field and its Lipschitz bound
+    int evalsPerStep(Tracers trace);
+    // Evaluations of a normal estimator
+    int normalEvals(Normals normal);
+
+    // CSV with one row per frame; config is the configuration name (testDataString)
+    void writeStatsCsvHeader(FILE* file);
+    void writeStatsCsvRow(FILE* file, const std::string& config, uint64_t frame, int primaryMaxIter, int secondaryMaxIter,
+        const TraceStats& stats);
+
+    // One line per ray kind: mean and quantile steps, termination fractions, then the evaluations. The rays/s are left
+    // to the caller's frame line and the CSV.
+    std::string formatStats(const TraceStats& stats, int primaryMaxIter, int secondaryMaxIter);
+}
@@ -0,0 +1,339 @@
+#pragma once
+
+// Host mirror of the tracers of BDF.ps.slang. SceneT provides sdf(p), bdf(p), sdg(p) and params.blobs (see scenes.h);
+// interval_segment_trace, which has no shader counterpart, also bdfT over an Interval box.
+
+#include "common.h"
+#include "number_types.h"
+#include "settings.h"
+
+namespace bdf
+{
+    // NORMAL
+
+    // Central differences, 6 evaluations
+    template <class SceneT>
+    float3 normal_central(const SceneT& scene, float3 p)
+    {
+        const float eps0 = 0.01f;
+        return normalize(float3(scene.sdf(p + float3(eps0, 0, 0)), scene.sdf(p + float3(0, eps0, 0)), scene.sdf(p + float3(0, 0, eps0))) -
+                         float3(scene.sdf(p - float3(eps0, 0, 0)), scene.sdf(p - float3(0, eps0, 0)), scene.sdf(p - float3(0, 0, eps0))));
+    }
+
+    // Differences along the vertices of a tetrahedron, 4 evaluations (https://iquilezles.org/articles/normalsSDF/)
+    template <class SceneT>
+    float3 normal_tetrahedral(const SceneT& scene, float3 p)
+    {
+        // The taps come from a table: written out as float3(eps0, -eps0, -eps0) etc., GCC assembles each tap with
+        // two scalar stores and one 8-byte load when sdf is not inlined, which stalls store forwarding and made
+        // the 4 evaluations slower than the 6 of normal_central.
+        static const float3 k[4] = { float3(1, -1, -1), float3(-1, -1, 1), float3(-1, 1, -1), float3(1, 1, 1) };
+        const float eps0 = 0.01f;
+        float d[4];
+        for (int i = 0; i < 4; ++i) d[i] = scene.sdf(p + eps0 * k[i]);
+        return normalize(float3(d[0] - d[1] - d[2] + d[3], -d[0] - d[1] + d[2] + d[3], -d[0] + d[1] - d[2] + d[3]));
+    }
+
+    // Gradient of the scene's sdg, one evaluation
+    template <class SceneT>
+    float3 normal_analytic(const SceneT& scene, float3 p)
+    {
+        return normalize(scene.sdg(p).xyz());
+    }
+
+    template <class SceneT>
+    float3 normal(Normals id, const SceneT& scene, float3 p)
+    {
+        switch (id)
+        {
+        case Normals::CENTRAL: return normal_central(scene, p);
+        case Normals::TETRAHEDRAL: return normal_tetrahedral(scene, p);
+        case Normals::ANALYTIC: default: return normal_analytic(scene, p);
+        }
+    }
+
+    template <class SceneT>
+    TraceResult sdf_trace(const SceneT& scene, const Ray& ray, const SphereTraceDesc& params)
+    {
+        TraceResult ret = { ray.Tmin, 0, 0 };
+        float d;
+        do
+        {
+            d = scene.sdf(ray.P + ret.T * ray.V);
+            ret.T += d;
+            ++ret.steps;
+        } while (ret.T < ray.Tmax &&                      // Stay within bound box
+                 std::abs(d) > params.epsilon * ret.T &&  // Stop if cone is close to surface
+                 ret.steps < params.maxiters              // Stop if too many iterations
+        );
+        ret.flags = int(ret.T >= ray.Tmax)
+                  | (int(std::abs(d) <= params.epsilon * ret.T) << 1)
+                  | (int(ret.steps >= params.maxiters) << 2);
+        return ret;
+    }
+
+    template <class SceneT>
+    TraceResult bdf_trace(const SceneT& scene, const Ray& ray, const SphereTraceDesc& params)
+    {
+        TraceResult ret = { ray.Tmin, 0, 0 };
+        float d;
+        do
+        {
+            d = scene.bdf(ray.P + ret.T * ray.V);
+            ret.T += d;
+            ++ret.steps;
+        } while (ret.T < ray.Tmax &&                      // Stay within bound box
+                 std::abs(d) > params.epsilon * ret.T &&  // Stop if cone is close to surface
+                 ret.steps < params.maxiters              // Stop if too many iterations
+        );
+        ret.flags = int(ret.T >= ray.Tmax)
+                  | (int(std::abs(d) <= params.epsilon * ret.T) << 1)
+                  | (int(ret.steps >= params.maxiters) << 2);
+        return ret;
+    }
+
+    // bdf_trace with over-relaxed steps omega * d. A BDF is negative inside, so a step that crossed the surface shows
+    // up as d < 0; a step longer than the sum of the bounds at its ends may have jumped over a thin part. Either way
+    // the step is redone as a plain one and the rest of the ray is traced with plain steps. An over-relaxed step past
+    // Tmax is never evaluated, so it is redone the same way; only a plain step past Tmax escapes.
+    template <class SceneT>
+    TraceResult bdf_trace_relaxed(const SceneT& scene, const Ray& ray, const SphereTraceDesc& params, float omega)
+    {
+        TraceResult ret = { ray.Tmin, 0, 0 };
+        float d, prevD = 0.f, step = 0.f;
+        bool hit = false;
+        for (;;)
+        {
+            d = scene.bdf(ray.P + ret.T * ray.V);
+            ++ret.steps;
+            if (step > prevD && (d < 0.f || step > prevD + d) && ret.steps < params.maxiters)
+            {   // backtrack
+                ret.T -= step - prevD;
+                step = prevD;
+                omega = 1.f;
+                continue;
+            }
+            if (std::abs(d) <= params.epsilon * (ret.T + d) || ret.steps >= params.maxiters)
+            {
+                hit = std::abs(d) <= params.epsilon * (ret.T + d);
+                ret.T += d;
+                break;
+            }
+            step = d > 0.f ? omega * d : d;
+            prevD = d;
+            ret.T += step;
+            if (ret.T >= ray.Tmax)
+            {
+                if (step <= prevD) break;
+                ret.T -= step - prevD;  // over-relaxed past Tmax
+                step = prevD;
+                omega = 1.f;
+            }
+        }
+        ret.flags = int(ret.T >= ray.Tmax)
+                  | (int(hit) << 1)
+                  | (int(ret.steps >= params.maxiters) << 2);
+        return ret;
+    }
+
+    // Plain steps and regula falsi on the sign change of the BDF after bdf_trace_refined found a surface.
+    const int kRefineSteps = 8;
+
+    // bdf_trace_relaxed with a hit epsilon hitScale times looser, followed by a refinement of the hit to epsilon:
+    // plain steps until the BDF changes sign, then regula falsi on the bracket. A ray that only grazed the surface
+    // moves away from it during the refinement and is traced on.
+    template <class SceneT>
+    TraceResult bdf_trace_refined(const SceneT& scene, const Ray& ray, const SphereTraceDesc& params, float omega, float hitScale)
+    {
+        const float looseEpsilon = hitScale * params.epsilon;
+        TraceResult ret = { ray.Tmin, 0, 0 };
+        Ray rest = ray;
+        for (;;)
+        {
+            const SphereTraceDesc loose = { looseEpsilon, params.maxiters - ret.steps };
+            TraceResult march = bdf_trace_relaxed(scene, rest, loose, omega);
+            ret.T = march.T;
+            ret.steps += march.steps;
+            ret.flags = march.flags;
+            if (!(march.flags & 2) || (march.flags & 1)) return ret;   // missed
+
+            // refine
+            float t = ret.T, d = scene.bdf(ray.P + t * ray.V);
+            float tOut = 0.f, dOut = 0.f, tIn = 0.f, dIn = 0.f;
+            bool hasOut = false, hasIn = false;
+            ++ret.steps;
+            for (int i = 0; i < kRefineSteps && std::abs(d) > params.epsilon * t; ++i)
+            {
+                if (d > 0.f) tOut = t, dOut = d, hasOut = true;
+                else tIn = t, dIn = d, hasIn = true;
+                t = hasOut && hasIn ? tOut + dOut * (tIn - tOut) / (dOut - dIn) : t + d;
+                d = scene.bdf(ray.P + t * ray.V);
+                ++ret.steps;
+            }
+            ret.T = t;
+            bool hit = (hasOut && hasIn) || std::abs(d) <= params.epsilon * t;
+            if (hit || ret.steps >= params.maxiters || t >= ray.Tmax)
+            {
+                ret.flags = int(t >= ray.Tmax)
+                          | (int(hit && t < ray.Tmax) << 1)
+                          | (int(ret.steps >= params.maxiters) << 2);
+                return ret;
+            }
+
+            rest.Tmin = t;  // grazed
+        }
+    }
+
+    template <class SceneT>
+    TraceResult segment_trace(const SceneT& scene, const Ray& ray, const SphereTraceDesc& params, float marchEpsilon)
+    {   //wrap
+        TraceResult ret;
+        bool h;
+        ret.T = scene.params.blobs.SegmentTracing(ray.P, ray.V, h, ret.steps, ray.Tmin, ray.Tmax, marchEpsilon, params.maxiters);
+        ret.flags = int(ret.T >= ray.Tmax)
+                  | (int(h) << 1)
+                  | (int(ret.steps >= params.maxiters) << 2);
+        return ret;
+    }
+
+    // Segment tracing of any scene with the segment bounds computed by interval arithmetic, instead of the Lipschitz
+    // bounds derived by hand for the blobs (KSegment, segment_tracing.h). bdfT of the box around a candidate segment
+    // bounds the BDF on every point of the segment: if the bound is positive, the segment cannot reach the surface
+    // and is skipped whole, otherwise it is halved. The BDF only has to have the sign of the SDF. Once a segment is
+    // as short as the cone width, the tracer steps as bdf_trace does. CPU only: the shader has no intervals.
+    template <class SceneT>
+    TraceResult interval_segment_trace(const SceneT& scene, const Ray& ray, const SphereTraceDesc& params, float kappa)
+    {
+        TraceResult ret = { ray.Tmin, 0, 0 };
+        float candidate = 1.f;
+        bool hit = false;
+        while (ret.T < ray.Tmax && ret.steps < params.maxiters)
+        {
+            Interval d = bdfT(scene, intervalBox(ray.P + ret.T * ray.V, ray.P + (ret.T + candidate) * ray.V));
+            ++ret.steps;
+            if (d.lo > 0.f)
+            {   // no surface on the segment
+                ret.T += candidate;
+                candidate *= kappa;
+            }
+            else if (candidate <= params.epsilon * ret.T)
+            {   // as small as the cone: either the surface or a bound too loose to decide (a box across a REPLIM
+                // cell boundary covers both cells), so take a bdf_trace step
+                float dT = scene.bdf(ray.P + ret.T * ray.V);
+                ++ret.steps;
+                if (std::abs(dT) <= params.epsilon * ret.T)
+                {
+                    hit = true;
+                    break;
+                }
+                ret.T += dT;
+            }
+            else
+                candidate = std::max(.5f * candidate, params.epsilon * ret.T);
+        }
+        ret.flags = int(ret.T >= ray.Tmax)
+                  | (int(hit) << 1)
+                  | (int(ret.steps >= params.maxiters) << 2);
+        return ret;
+    }
+
+    template <class SceneT>
+    TraceResult their_sphere_trace(const SceneT& scene, const Ray& ray, const SphereTraceDesc& params, float marchEpsilon)
+    { //wrap
+        TraceResult ret;
+        bool h;
+        ret.T = scene.params.blobs.SphereTracing(ray.P, ray.V, h, ret.steps, ray.Tmin, ray.Tmax, marchEpsilon, params.maxiters);
+        ret.flags = int(ret.T >= ray.Tmax)
+                  | (int(h) << 1)
+                  | (int(ret.steps >= params.maxiters) << 2);
+        return ret;
+    }
+
+    template <class SceneT>
+    TraceResult bdf_shadow(const SceneT& scene, const Ray& ray, const SphereTraceDesc& params)
+    {
+        TraceResult ret = { ray.Tmin, 0, 0 };
+        float d;
+        do
+        {
+            d = scene.bdf(ray.P + ret.T * ray.V);
+            ret.T += 0.99f * d;
+            ++ret.steps;
+        } while (ret.T < ray.Tmax &&                 // Stay within bound box
+                 d > params.epsilon * ret.T &&       // Stop if cone is close to surface
+                 ret.steps < params.maxiters         // Stop if too many iterations
+        );
+        ret.flags = int(ret.T >= ray.Tmax)
+                  | (int(std::abs(d) <= params.epsilon * ret.T) << 1)
+                  | (int(ret.steps >= params.maxiters) << 2);
+        return ret;
+    }
+
+    inline TraceResult no_shadow(const Ray& ray)
+    {
+        TraceResult res = { ray.Tmax, 1, 0 };
+        return res;
+    }
+
+    // bdf_shadow that also tracks the smallest d / T along the ray, the angle by which the ray clears the geometry,
+    // and turns it into the light's visibility min(softness * d / T, 1): a penumbra from a single trace.
+    // Visibility is 0 if the ray does not reach Tmax.
+    template <class SceneT>
+    TraceResult bdf_soft_shadow(const SceneT& scene, const Ray& ray, const SphereTraceDesc& params, float softness, float& visibility)
+    {
+        TraceResult ret = { ray.Tmin, 0, 0 };
+        float d, ratio = 1.f;
+        do
+        {
+            d = scene.bdf(ray.P + ret.T * ray.V);
+            ratio = std::min(ratio, d / ret.T);
+            ret.T += 0.99f * d;
+            ++ret.steps;
+        } while (ret.T < ray.Tmax &&                 // Stay within bound box
+                 d > params.epsilon * ret.T &&       // Stop if cone is close to surface
+                 ret.steps < params.maxiters         // Stop if too many iterations
+        );
+        ret.flags = int(ret.T >= ray.Tmax)
+                  | (int(std::abs(d) <= params.epsilon * ret.T) << 1)
+                  | (int(ret.steps >= params.maxiters) << 2);
+        visibility = (ret.flags & 1) ? saturate(softness * ratio) : 0.f;
+        return ret;
+    }
+
+    // Direction to light i of the count lights of mainImageBDF, evenly spaced on a ring 45 degrees above the horizon
+    inline float3 lightDirection(int i, int count)
+    {
+        float t = float(i) * 2.f * pi / float(count);
+        return std::sqrt(.5f) * float3(std::cos(t), 1, std::sin(t));
+    }
+
+    // TRACE
+    template <class SceneT>
+    TraceResult trace(Tracers id, const SceneT& scene, const Ray& ray, const SphereTraceDesc& params, float marchEpsilon,
+        float omega, float hitScale)
+    {
+        switch (id)
+        {
+        case Tracers::SDF_TRACE: return sdf_trace(scene, ray, params);
+        case Tracers::BDF_TRACE: return bdf_trace(scene, ray, params);
+        case Tracers::BDF_TRACE_RELAXED: return bdf_trace_relaxed(scene, ray, params, omega);
+        case Tracers::BDF_TRACE_REFINED: return bdf_trace_refined(scene, ray, params, omega, hitScale);
+        case Tracers::SEGMENT_TRACE: return segment_trace(scene, ray, params, marchEpsilon);
+        case Tracers::INTERVAL_SEGMENT_TRACE: return interval_segment_trace(scene, ray, params, scene.params.blobs.kappa);
+        case Tracers::THEIR_SPHERE_TRACE: default: return their_sphere_trace(scene, ray, params, marchEpsilon);
+        }
+    }
+
+    // SHADOW, one ray at a time: bdf_packet and bdf_soft are bdf_shadow here, shadowLights (tracers_simd.h) traces
+    // all the lights of a hit with them
+    template <class SceneT>
+    TraceResult shadow(Shadows id, const SceneT& scene, const Ray& ray, const SphereTraceDesc& params)
+    {
+        switch (id)
+        {
+        case Shadows::SDF_TRACE: return sdf_trace(scene, ray, params);
+        case Shadows::BDF_TRACE: case Shadows::BDF_PACKET: case Shadows::BDF_SOFT: return bdf_shadow(scene, ray, params);
+        case Shadows::NO_SHADOW: default: return no_shadow(ray);
+        }
+    }
+}
@@ -0,0 +1,283 @@
+#pragma once
+
+// Ray packet versions of bdf_trace and bdf_shadow: every lane marches its own ray, lanes retire individually once
+// their loop condition fails and keep their final T, distance and step count while the others continue.
+
+#include "scenes.h"
+#include "tracers.h"
+
+namespace bdf
+{
+    template <class F>
+    struct RayPacket
+    {
+        tvec3<F> P;
+        F Tmin;
+        tvec3<F> V;
+        F Tmax;
+    };
+
+    template <class F>
+    struct TraceResultPacket
+    {
+        F T;
+        F steps;
+        typename F::mask escaped;   // flags bit 0
+        typename F::mask hit;       // flags bit 1
+        typename F::mask exhausted; // flags bit 2
+
+        TraceResult lane(int i) const
+        {
+            TraceResult r;
+            r.T = T[i];
+            r.steps = int(steps[i]);
+            r.flags = int((bits(escaped) >> i) & 1) | int(((bits(hit) >> i) & 1) << 1) | int(((bits(exhausted) >> i) & 1) << 2);
+            return r;
+        }
+    };
+
+    // The packet of F::width rays
+    template <class F>
+    RayPacket<F> packRays(const Ray* rays)
+    {
+        alignas(64) float px[F::width], py[F::width], pz[F::width], vx[F::width], vy[F::width], vz[F::width], tmin[F::width], tmax[F::width];
+        for (int i = 0; i < F::width; ++i)
+        {
+            px[i] = rays[i].P.x; py[i] = rays[i].P.y; pz[i] = rays[i].P.z;
+            vx[i] = rays[i].V.x; vy[i] = rays[i].V.y; vz[i] = rays[i].V.z;
+            tmin[i] = rays[i].Tmin; tmax[i] = rays[i].Tmax;
+        }
+        return { { F::load(px), F::load(py), F::load(pz) }, F::load(tmin), { F::load(vx), F::load(vy), F::load(vz) }, F::load(tmax) };
+    }
+
+    template <class SceneT, class F>
+    TraceResultPacket<F> bdf_trace_packet(const SceneT& scene, const RayPacket<F>& ray, const SphereTraceDesc& params)
+    {
+        using M = typename F::mask;
+        const F maxiters = float(params.maxiters);
+        F T = ray.Tmin, d = 0.f, steps = 0.f;
+        M active = T <= T; // all lanes
+        do
+        {
+            F dNew = bdfT(scene, ray.P + T * ray.V);
+            d = select(active, dNew, d);
+            T = select(active, T + dNew, T);
+            steps = select(active, steps + 1.f, steps);
+            active = active
+                   & (T < ray.Tmax)                 // Stay within bound box
+                   & (abs(d) > params.epsilon * T)  // Stop if cone is close to surface
+                   & (steps < maxiters);            // Stop if too many iterations
+        } while (any(active));
+
+        TraceResultPacket<F> ret;
+        ret.T = T;
+        ret.steps = steps;
+        ret.escaped = T >= ray.Tmax;
+        ret.hit = abs(d) <= params.epsilon * T;
+        ret.exhausted = steps >= maxiters;
+        return ret;
+    }
+
+    template <class SceneT, class F>
+    TraceResultPacket<F> bdf_shadow_packet(const SceneT& scene, const RayPacket<F>& ray, const SphereTraceDesc& params)
+    {
+        using M = typename F::mask;
+        const F maxiters = float(params.maxiters);
+        F T = ray.Tmin, d = 0.f, steps = 0.f;
+        M active = T <= T; // all lanes
+        do
+        {
+            F dNew = bdfT(scene, ray.P + T * ray.V);
+            d = select(active, dNew, d);
+            T = select(active, T + .99f * dNew, T);
+            steps = select(active, steps + 1.f, steps);
+            active = active
+                   & (T < ray.Tmax)                 // Stay within bound box
+                   & (d > params.epsilon * T)       // Stop if cone is close to surface
+                   & (steps < maxiters);            // Stop if too many iterations
+        } while (any(active));
+
+        TraceResultPacket<F> ret;
+        ret.T = T;
+        ret.steps = steps;
+        ret.escaped = T >= ray.Tmax;
+        ret.hit = abs(d) <= params.epsilon * T;
+        ret.exhausted = steps >= maxiters;
+        return ret;
+    }
+
+    // Shared step of bdf_packet: marches the axes of up to F::width cones against the SDF like coneTmin (renderer.cpp).
+    // The ball at axial depth t covers a cone of half-angle tangent k up to (d + t) / (1 + k), so one evaluation
+    // advances the n rays of the cone. A lane stops where that no longer beats tracing the rays apart, where n times
+    // the cone step falls below the distance at the axis, a step of a single ray.
+    template <class SceneT, class F>
+    TraceResultPacket<F> sdf_cone_packet(const SceneT& scene, const RayPacket<F>& axis, const F& k, const F& n, const SphereTraceDesc& params)
+    {
+        using M = typename F::mask;
+        const F maxiters = float(params.maxiters);
+        F T = axis.Tmin, steps = 0.f;
+        M active = T < axis.Tmax;
+        while (any(active))
+        {
+            F d = sdfT(scene, axis.P + T * axis.V);
+            F dt = (d - k * T) / (1.f + k);
+            steps = select(active, steps + 1.f, steps);
+            active = active & (n * dt > d) & (dt > params.epsilon * T);
+            T = select(active, T + dt, T);
+            active = active & (T < axis.Tmax) & (steps < maxiters);
+        }
+
+        TraceResultPacket<F> ret;
+        ret.T = T;
+        ret.steps = steps;
+        ret.escaped = T >= axis.Tmax;
+        ret.hit = T < T;    // no lane
+        ret.exhausted = steps >= maxiters;
+        return ret;
+    }
+
+    // SHADOW for all the lights of a hit: the visibility in [0, 1] of each of the count rays and the steps taken, and
+    // with results the trace result of each ray.
+    // bdf_packet shares the evaluations of rays that leave one point: a range of lights marches the axis of a cone
+    // containing their directions with sdf_cone_packet, the cones of 8 ranges at once, then the range is halved and
+    // each half marches its own, narrower cone from there, down to single lights. These are traced from where their
+    // cone stopped in packets of 8 lanes: the scenes with a vector bdfT do the 8 evaluations at once, the CSG BVH and
+    // blob grid scenes still lane by lane. A cone that escapes leaves all its lights visible. As the SDF grows by at
+    // most t from the start, a cone of half-angle tangent k steps at most about (1 - k) / (1 + k) t: it is only
+    // marched if n times that clearly exceeds t. The lights of mainImageBDF are ordered around a ring, so a range is
+    // an arc. bdf_soft traces one soft shadow ray per light and the other modes trace the rays one by one.
+    template <class SceneT>
+    int shadowLights(Shadows id, const SceneT& scene, const Ray* rays, int count, const SphereTraceDesc& params, float softness,
+        float* visibility, TraceResult* results = nullptr)
+    {
+        int steps = 0;
+        if (id == Shadows::BDF_SOFT)
+        {
+            for (int i = 0; i < count; ++i)
+            {
+                TraceResult sh = bdf_soft_shadow(scene, rays[i], params, softness, visibility[i]);
+                if (results) results[i] = sh;
+                steps += sh.steps;
+            }
+            return steps;
+        }
+        if (id != Shadows::BDF_PACKET)
+        {
+            for (int i = 0; i < count; ++i)
+            {
+                TraceResult sh = shadow(id, scene, rays[i], params);
+                visibility[i] = float((sh.flags & 1) != 0);
+                if (results) results[i] = sh;
+                steps += sh.steps;
+            }
+            return steps;
+        }
+
+        // bdf_packet
+        constexpr int W = f32x8::width;
+        bool shared = true;     // the cones need a common origin
+        for (int i = 1; i < count; ++i)
+            shared = shared && rays[i].P.x == rays[0].P.x && rays[i].P.y == rays[0].P.y && rays[i].P.z == rays[0].P.z
+                            && rays[i].Tmin == rays[0].Tmin && rays[i].Tmax == rays[0].Tmax;
+        struct LightCone
+        {
+            int lo, hi;         // lights
+            float tFree;        // the rays are free up to tFree
+        };
+        LightCone queue[2 * kMaxLightCount];    // the ranges of a binary split of the lights, in the order of their level
+        int head = 0, tail = 0;
+        queue[tail++] = { 0, count, rays[0].Tmin };
+
+        Ray packet[W];          // the lights whose cones stopped, traced 8 at a time
+        int pending[W], pendingCount = 0;
+        auto tracePending = [&]()
+        {
+            for (int l = pendingCount; l < W; ++l) packet[l] = packet[pendingCount - 1];    // padding lanes repeat the last ray
+            TraceResultPacket<f32x8> ret = bdf_shadow_packet(scene, packRays<f32x8>(packet), params);
+            for (int l = 0; l < pendingCount; ++l)
+            {
+                TraceResult sh = ret.lane(l);
+                visibility[pending[l]] = float((sh.flags & 1) != 0);
+                if (results) results[pending[l]] = sh;
+                steps += sh.steps;
+            }
+            pendingCount = 0;
+        };
+        auto split = [&](const LightCone& c)
+        {
+            int mid = (c.lo + c.hi) / 2;
+            queue[tail++] = { c.lo, mid, c.tFree };
+            queue[tail++] = { mid, c.hi, c.tFree };
+        };
+
+        while (head < tail)
+        {
+            LightCone cones[W];
+            alignas(32) float coneK[W], coneN[W];
+            Ray axes[W];
+            int coneCount = 0;
+            while (head < tail && coneCount < W)
+            {
+                const LightCone c = queue[head++];
+                const int n = c.hi - c.lo;
+                if (!shared || n == 1)
+                {
+                    for (int i = c.lo; i < c.hi; ++i)
+                    {
+                        pending[pendingCount] = i;
+                        packet[pendingCount] = rays[i];
+                        packet[pendingCount].Tmin = std::max(rays[i].Tmin, c.tFree);
+                        if (++pendingCount == W) tracePending();
+                    }
+                    continue;
+                }
+                float3 axis = float3(0.f);
+                for (int i = c.lo; i < c.hi; ++i) axis += rays[i].V;
+                axis = normalize(axis);
+                float cosA = 1.f;
+                for (int i = c.lo; i < c.hi; ++i) cosA = std::min(cosA, dot(axis, rays[i].V));
+                const float k = std::sqrt(std::max(1.f - cosA * cosA, 0.f)) / std::max(cosA, 1e-6f);
+                if (float(n) * (1.f - k) <= 2.f * (1.f + k))
+                {
+                    split(c);
+                    continue;
+                }
+                // a ray's axial depth is at most its T: the cone starts at tFree * cosA, and its rays are free up to
+                // the axial depth it reaches
+                cones[coneCount] = c;
+                coneK[coneCount] = k;
+                coneN[coneCount] = float(n);
+                axes[coneCount] = { rays[c.lo].P, c.tFree * cosA, axis, rays[c.lo].Tmax };
+                ++coneCount;
+            }
+            if (coneCount == 0) continue;
+
+            for (int l = coneCount; l < W; ++l)
+            {   // padding lanes repeat the last cone
+                coneK[l] = coneK[coneCount - 1];
+                coneN[l] = coneN[coneCount - 1];
+                axes[l] = axes[coneCount - 1];
+            }
+            TraceResultPacket<f32x8> ret = sdf_cone_packet(scene, packRays<f32x8>(axes), f32x8::load(coneK), f32x8::load(coneN), params);
+            for (int l = 0; l < coneCount; ++l)
+            {
+                TraceResult cone = ret.lane(l);
+                LightCone c = cones[l];
+                c.tFree = std::max(c.tFree, cone.T);
+                steps += cone.steps;
+                if (cone.flags & 1)
+                {
+                    for (int i = c.lo; i < c.hi; ++i)
+                    {
+                        visibility[i] = 1.f;
+                        if (results) results[i] = { cone.T, 0, 1 };
+                    }
+                }
+                else
+                    split(c);
+            }
+        }
+        if (pendingCount > 0) tracePending();
+        return steps;
+    }
+}
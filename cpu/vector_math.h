@@ -0,0 +1,150 @@
+#pragma once
+
+// Minimal HLSL-like vector types for the host port of the shaders.
+// Only what the ported shader code needs; names follow the Falcor host types.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+namespace bdf
+{
+    struct float2
+    {
+        float x = 0, y = 0;
+
+        float2() = default;
+        constexpr explicit float2(float s) : x(s), y(s) {}
+        constexpr float2(float x_, float y_) : x(x_), y(y_) {}
+    };
+
+    struct float3
+    {
+        float x = 0, y = 0, z = 0;
+
+        float3() = default;
+        constexpr explicit float3(float s) : x(s), y(s), z(s) {}
+        constexpr float3(float x_, float y_, float z_) : x(x_), y(y_), z(z_) {}
+
+        float& operator[](int i) { return (&x)[i]; }
+        float operator[](int i) const { return (&x)[i]; }
+        float2 xy() const { return { x, y }; }
+        float2 xz() const { return { x, z }; }
+        float3 yzx() const { return { y, z, x }; }
+        float3 zxy() const { return { z, x, y }; }
+    };
+
+    struct float4
+    {
+        float x = 0, y = 0, z = 0, w = 0;
+
+        float4() = default;
+        constexpr explicit float4(float s) : x(s), y(s), z(s), w(s) {}
+        constexpr float4(float x_, float y_, float z_, float w_) : x(x_), y(y_), z(z_), w(w_) {}
+        constexpr float4(const float3& v, float w_) : x(v.x), y(v.y), z(v.z), w(w_) {}
+
+        float& operator[](int i) { return (&x)[i]; }
+        float operator[](int i) const { return (&x)[i]; }
+        float3 xyz() const { return { x, y, z }; }
+    };
+
+    struct int3
+    {
+        int x = 0, y = 0, z = 0;
+    };
+
+    // float2
+
+    inline float2 operator+(float2 a, float2 b) { return { a.x + b.x, a.y + b.y }; }
+    inline float2 operator-(float2 a, float2 b) { return { a.x - b.x, a.y - b.y }; }
+    inline float2 operator*(float2 a, float2 b) { return { a.x * b.x, a.y * b.y }; }
+    inline float2 operator/(float2 a, float2 b) { return { a.x / b.x, a.y / b.y }; }
+    inline float2 operator*(float2 a, float s) { return { a.x * s, a.y * s }; }
+    inline float2 operator*(float s, float2 a) { return { a.x * s, a.y * s }; }
+    inline float2 operator-(float2 a) { return { -a.x, -a.y }; }
+
+    inline float dot(float2 a, float2 b) { return a.x * b.x + a.y * b.y; }
+    inline float length(float2 a) { return std::sqrt(dot(a, a)); }
+    inline float2 abs(float2 a) { return { std::abs(a.x), std::abs(a.y) }; }
+    inline float2 max(float2 a, float s) { return { std::max(a.x, s), std::max(a.y, s) }; }
+
+    // float3
+
+    inline float3 operator+(float3 a, float3 b) { return { a.x + b.x, a.y + b.y, a.z + b.z }; }
+    inline float3 operator-(float3 a, float3 b) { return { a.x - b.x, a.y - b.y, a.z - b.z }; }
+    inline float3 operator*(float3 a, float3 b) { return { a.x * b.x, a.y * b.y, a.z * b.z }; }
+    inline float3 operator/(float3 a, float3 b) { return { a.x / b.x, a.y / b.y, a.z / b.z }; }
+    inline float3 operator+(float3 a, float s) { return { a.x + s, a.y + s, a.z + s }; }
+    inline float3 operator-(float3 a, float s) { return { a.x - s, a.y - s, a.z - s }; }
+    inline float3 operator*(float3 a, float s) { return { a.x * s, a.y * s, a.z * s }; }
+    inline float3 operator*(float s, float3 a) { return { a.x * s, a.y * s, a.z * s }; }
+    inline float3 operator/(float3 a, float s) { return { a.x / s, a.y / s, a.z / s }; }
+    inline float3 operator-(float3 a) { return { -a.x, -a.y, -a.z }; }
+    inline float3& operator+=(float3& a, float3 b) { return a = a + b; }
+    inline float3& operator*=(float3& a, float s) { return a = a * s; }
+
+    inline float dot(float3 a, float3 b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+    inline float length(float3 a) { return std::sqrt(dot(a, a)); }
+    inline float3 normalize(float3 a) { return a / length(a); }
+    inline float3 cross(float3 a, float3 b) { return { a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x }; }
+    inline float3 abs(float3 a) { return { std::abs(a.x), std::abs(a.y), std::abs(a.z) }; }
+    inline float3 max(float3 a, float3 b) { return { std::max(a.x, b.x), std::max(a.y, b.y), std::max(a.z, b.z) }; }
+    inline float3 min(float3 a, float3 b) { return { std::min(a.x, b.x), std::min(a.y, b.y), std::min(a.z, b.z) }; }
+    inline float3 max(float3 a, float s) { return max(a, float3(s)); }
+    inline float3 min(float3 a, float s) { return min(a, float3(s)); }
+    inline float3 clamp(float3 a, float lo, float hi) { return min(max(a, lo), hi); }
+    inline float3 pow(float3 a, float3 e) { return { std::pow(a.x, e.x), std::pow(a.y, e.y), std::pow(a.z, e.z) }; }
+    inline float3 fract(float3 a) { return a - float3(std::floor(a.x), std::floor(a.y), std::floor(a.z)); }
+
+    // float4
+
+    inline float4 operator+(float4 a, float4 b) { return { a.x + b.x, a.y + b.y, a.z + b.z, a.w + b.w }; }
+    inline float4 operator*(float4 a, float s) { return { a.x * s, a.y * s, a.z * s, a.w * s }; }
+    inline float dot(float4 a, float4 b) { return a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w; }
+
+    // scalar
+
+    inline float clamp(float x, float lo, float hi) { return std::min(std::max(x, lo), hi); }
+    inline float saturate(float x) { return clamp(x, 0.f, 1.f); }
+    inline float mix(float a, float b, float t) { return a + (b - a) * t; }
+    inline float3 mix(float3 a, float3 b, float t) { return a + (b - a) * t; }
+    inline float3 mix(float3 a, float3 b, float3 t) { return a + (b - a) * t; }
+    inline float smoothstep(float e0, float e1, float x)
+    {
+        float t = saturate((x - e0) / (e1 - e0));
+        return t * t * (3.f - 2.f * t);
+    }
+
+    // Row-major 4x4 matrix, column vectors: v' = M * v.
+    struct float4x4
+    {
+        float m[4][4] = {};
+
+        static float4x4 identity()
+        {
+            float4x4 r;
+            for (int i = 0; i < 4; ++i) r.m[i][i] = 1.f;
+            return r;
+        }
+    };
+
+    inline float4 mul(const float4x4& M, float4 v)
+    {
+        float4 r;
+        for (int i = 0; i < 4; ++i)
+            r[i] = M.m[i][0] * v.x + M.m[i][1] * v.y + M.m[i][2] * v.z + M.m[i][3] * v.w;
+        return r;
+    }
+
+    inline float4x4 mul(const float4x4& A, const float4x4& B)
+    {
+        float4x4 r;
+        for (int i = 0; i < 4; ++i)
+            for (int j = 0; j < 4; ++j)
+                for (int k = 0; k < 4; ++k)
+                    r.m[i][j] += A.m[i][k] * B.m[k][j];
+        return r;
+    }
+
+    float4x4 inverse(const float4x4& M);
+}